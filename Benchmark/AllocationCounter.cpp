@@ -0,0 +1,102 @@
+#include "AllocationCounter.h"
+
+#include <algorithm> // max
+#include <atomic>
+#include <cstdlib> // malloc, free
+#include <new>
+
+// The replacements live on their own so the compiler can't inline a free() next to a builtin operator new
+namespace
+{
+	// Heap allocations of the whole program, the frame loop should settle to none
+	std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+uint64_t GetAllocationCount()
+{
+	return g_allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	void* memory = std::malloc(size > 0 ? size : 1);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	operator delete(memory);
+}
+
+// alignas types (the job system's per-thread data, the renderer's tile buffers...) come through these
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	size_t align = static_cast<size_t>(alignment);
+	size = (std::max<size_t>(size, 1) + align - 1) / align * align;
+#ifdef _WIN32
+	void* memory = _aligned_malloc(size, align);
+#else
+	void* memory = std::aligned_alloc(align, size);
+#endif
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(memory, alignment);
+}
+
+// The array and sized forms go through the ones above, every new is counted and freed the way it was made
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	operator delete(memory);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+	operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(memory, alignment);
+}
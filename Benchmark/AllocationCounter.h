@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+// The benchmark replaces the global operator new/delete (every form, array, sized and aligned) to count heap allocations
+
+// Allocations made since the program started, on any thread
+uint64_t GetAllocationCount();
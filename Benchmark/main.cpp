@@ -0,0 +1,1438 @@
+#include <algorithm> // min/max
+#include <cmath> // sqrt
+#include <cstdio> // fprintf
+#include <cstdlib> // atoi
+#include <cstring> // strcmp, memcmp
+#include <fstream>
+#include <iterator> // std::size
+#include <random>
+#include <string>
+#include <thread> // hardware_concurrency
+#include <vector>
+#include "AllocationCounter.h"
+#include "BatchTransform.h"
+#include "CpuFeatures.h"
+#include "FrameStats.h"
+#include "GraphicsEngine.h"
+#include "OcclusionCuller.h"
+#include "SoftwareRenderer.h"
+#include "StateObjectCache.h"
+
+// Benchmark [--objects N] [--seed N] [--frames N] [--threads N] [--width N] [--height N] [--warmup N] [--no-instancing]
+//           [--depth-test] [--walls N] [--occlusion] [--render-thread] [--path camera.txt] [--json results.json] [--csv frames.csv] [--trace trace.json]
+// Benchmark [options above] --thread-sweep
+// Benchmark [options above] --cull-benchmark
+// Benchmark [options above] --instance-sweep
+// Benchmark --validate <scratch directory>
+//
+// Headless, deterministic run of GraphicsEngine on its Software backend: a generated scene of
+// --objects instances of the engine's triangle in clusters (some of them spinning), the camera
+// flying a scripted path through it, --frames frames of BeginFrame/EndFrame in a row (frustum
+// culling, draw sorting and the CPU renderer). No window and no GPU, so it runs the same on a
+// build machine as on a desktop.
+//
+// Everything that moves steps by 1/60 s a frame whatever the frame took, so two runs with the
+// same options render the same images: the image hash (FNV-1a of every frame's render target)
+// and the visible counts only change when the code does, the times are what to compare.
+//
+// The camera path goes through GraphicsEngine::ProcessCameraInput, the code WASD and the mouse
+// run. --path replaces the built-in one with lines of
+//   frames keys mouseDeltaX mouseDeltaY
+// keys being some of WASD or - for none, the mouse turns the view when a delta isn't 0,
+// # starts a comment. The path starts over when the frames outlast it.
+//
+// --warmup N runs N frames before the measured ones (the path and the scene go on from there), the
+// measured frames start with every cache and arena warm: what a long session looks like, and the
+// frames that must not allocate at all.
+// --thread-sweep runs the frames on 1, 2, 4 ... 32 threads and prints the frame times of every
+// thread count (--csv writes them), the images must not change with the thread count.
+// --cull-benchmark only culls: 100k boxes against the camera's frustum along the path, with the
+// Scalar, SSE2 and AVX2 kernels, on one thread and on the job system (--csv writes the table).
+// --no-instancing submits every visible object as a draw of its own instead of one instanced draw,
+// --instance-sweep compares both on 100 to 100k objects (--csv writes the table).
+// --depth-test renders with a depth buffer (cleared every frame, LESS), the images change with it.
+// --walls N stands N big triangles in the scene, the occluders: --occlusion renders them into an
+// OcclusionCuller at the size of the render target and drops the objects they hide (with --depth-test
+// the images are the same as without it, only what the depth test would reject is dropped).
+// --render-thread renders on the engine's render thread with 2 frames in flight, frame N+1 is
+// simulated while frame N is rendered: the frame times are those of the simulation thread, the
+// images are hashed on the render thread as each frame ends and are the same as without it.
+// --json writes the options, the summary (FrameStats) and every frame, --csv one row per frame.
+//
+// --validate runs the validation of the engine's systems, checks the warm frame loop doesn't touch
+// the heap and that the render thread pays off, the test entry point: prints a line per check,
+// returns 1 when one fails.
+// Without Visual Studio, the sources of Benchmark.vcxproj but D3D11StateCache, D3DShaderCompiler
+// and Window (Windows only, the Software backend doesn't need them):
+// g++ -std=c++17 -O2 -pthread -I../DirectXLearning main.cpp AllocationCounter.cpp ../DirectXLearning/{BatchTransform,CameraController,ConstantBlock,CpuFeatures,DrawQueue,FrameStats,FrustumCulling,GraphicsEngine,JobSystem,LinearArena,Log,MappedFile,OcclusionCuller,Profiler,RasterKernels,RenderThread,RingAllocator,ShaderCache,ShaderPermutationList,ShaderPermutations,SimdMath,SoftwareRenderer,StateFilteringContext,StateObjectCache,TransformHierarchy}.cpp -o Benchmark
+
+namespace
+{
+	const float kDeltaTime = 1.0f / 60.0f;
+
+	// Objects per cluster, every kAnimatedClusterStride-th cluster spins around its root
+	const uint32_t kClusterSize = 16;
+	const uint32_t kAnimatedClusterStride = 4;
+	// Room per object on the ground, the scene grows with the square root of the count
+	const float kObjectSpacing = 2.0f;
+	const float kClusterRadius = 3.0f;
+
+	// Walls: the triangle scaled up, standing on the ground in grey
+	const float kWallWidth = 12.0f;
+	const float kWallHeight = 8.0f;
+	const SimdMath::Float4 kWallTint(0.5f, 0.5f, 0.5f, 1.0f);
+
+	// Tints of the instances
+	const uint32_t kTintCount = 4;
+	const SimdMath::Float4 kTints[kTintCount] =
+	{
+		SimdMath::Float4(1.0f, 1.0f, 1.0f, 1.0f),
+		SimdMath::Float4(1.0f, 0.6f, 0.6f, 1.0f),
+		SimdMath::Float4(0.6f, 1.0f, 0.6f, 1.0f),
+		SimdMath::Float4(0.6f, 0.6f, 1.0f, 1.0f),
+	};
+
+	// Every code path of the SIMD kernels, the ones the CPU can't run are skipped
+	const SimdIsa kSimdIsas[] = { SimdIsa::Scalar, SimdIsa::SSE2, SimdIsa::AVX2 };
+
+	// Phases of a frame, in FrameStats and in the per-frame results
+	enum BenchmarkPhase
+	{
+		kCameraPhase, // ProcessCameraInput
+		kScenePhase, // the clusters spin, SetTriangleInstances
+		kBeginFramePhase, // scene transforms, view, frustum
+		kEndFramePhase, // culling, draw queue, software rendering
+		kPhaseCount
+	};
+	const char* const kPhaseNames[kPhaseCount] = { "Camera", "Scene", "BeginFrame", "EndFrame" };
+	const char* const kPhaseColumns[kPhaseCount] = { "cameraMs", "sceneMs", "beginFrameMs", "endFrameMs" };
+
+	struct BenchmarkOptions
+	{
+		uint32_t objects = 10000;
+		uint32_t seed = 1;
+		uint32_t frames = 600;
+		unsigned threads = 0;
+		int width = 1280;
+		int height = 720;
+		std::string pathFile;
+		std::string jsonPath;
+		std::string csvPath;
+		std::string tracePath;
+		uint32_t warmupFrames = 0;
+		bool threadSweep = false;
+		bool cullBenchmark = false;
+		bool instanceSweep = false;
+		bool instancing = true;
+		bool depthTest = false;
+		uint32_t walls = 0;
+		bool occlusion = false;
+		bool renderThread = false;
+	};
+
+	// The camera input held for some frames
+	struct PathSegment
+	{
+		uint32_t frames;
+		CameraInput input;
+	};
+
+	// Fly in, turn right, strafe, look left and down, back off, look up again
+	// input: forward, back, left, right, look, mouseDeltaX, mouseDeltaY
+	const PathSegment kDefaultPath[] =
+	{
+		{ 180, { true, false, false, false, false, 0, 0 } },
+		{ 60, { false, false, false, false, true, 3, 0 } },
+		{ 120, { true, false, false, true, false, 0, 0 } },
+		{ 90, { false, false, false, false, true, -4, 1 } },
+		{ 120, { false, true, true, false, false, 0, 0 } },
+		{ 90, { true, false, false, false, true, 0, -1 } },
+	};
+
+	// What a frame did, for the per-frame results
+	struct FrameRecord
+	{
+		double phaseSeconds[kPhaseCount];
+		double frameSeconds;
+		uint32_t updatedNodes;
+		uint32_t visibleObjects;
+		uint32_t uploadedBytes;
+		uint64_t allocations;
+		uint64_t imageHash;
+	};
+
+	// A whole run, what the outputs are made of
+	struct BenchmarkRun
+	{
+		std::vector<FrameRecord> records;
+		FrameStats stats;
+		uint64_t runHash = 0;
+		unsigned threads = 0;
+		double seconds = 0.0; // the measured frames, from the start of the first one to the end of the last one rendered
+	};
+
+	// Clusters of triangle instances under spinning or still roots
+	struct BenchmarkScene
+	{
+		struct SpinningRoot
+		{
+			uint32_t node;
+			float x, z;
+			float speed; // radians per second
+		};
+
+		TransformHierarchy hierarchy;
+		std::vector<SpinningRoot> spinningRoots;
+		std::vector<uint32_t> objectNodes; // the instances, in node order
+		std::vector<uint32_t> spinningObjects; // the instances under a spinning root
+		std::vector<uint32_t> walls; // the instances that are walls, after the objects
+		std::vector<GraphicsEngine::InstanceData> instances;
+		float size = 0.0f; // side of the square the clusters are in, centered on the origin
+
+		void Generate(uint32_t objects, uint32_t wallCount, uint32_t seed)
+		{
+			std::mt19937 random(seed);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			size = std::sqrt(static_cast<float>(objects)) * kObjectSpacing;
+
+			uint32_t clusters = (objects + kClusterSize - 1) / kClusterSize;
+			for (uint32_t cluster = 0; cluster < clusters; cluster++)
+			{
+				float x = (unit(random) - 0.5f) * size;
+				float z = (unit(random) - 0.5f) * size;
+				uint32_t root = hierarchy.AddNode(TransformHierarchy::kNoParent, SimdMath::MatrixTranslation(x, 0.0f, z));
+				bool spinning = cluster % kAnimatedClusterStride == 0;
+				if (spinning)
+				{
+					spinningRoots.push_back({ root, x, z, unit(random) * 2.0f - 1.0f });
+				}
+
+				uint32_t count = std::min(kClusterSize, objects - cluster * kClusterSize);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					float scale = 0.5f + unit(random);
+					SimdMath::Matrix local = SimdMath::MatrixMultiply(
+						SimdMath::MatrixMultiply(SimdMath::MatrixScaling(scale, scale, scale), SimdMath::MatrixRotationRollPitchYaw(0.0f, unit(random) * SimdMath::kPi * 2.0f, 0.0f)),
+						SimdMath::MatrixTranslation((unit(random) * 2.0f - 1.0f) * kClusterRadius, unit(random) * 3.0f, (unit(random) * 2.0f - 1.0f) * kClusterRadius));
+					if (spinning)
+					{
+						spinningObjects.push_back(static_cast<uint32_t>(objectNodes.size()));
+					}
+					objectNodes.push_back(hierarchy.AddNode(root, local));
+					GraphicsEngine::InstanceData instance = {};
+					instance.color = kTints[random() % kTintCount];
+					instances.push_back(instance);
+				}
+			}
+
+			// Still roots, anywhere in the square and turned any way
+			for (uint32_t wall = 0; wall < wallCount; wall++)
+			{
+				SimdMath::Matrix local = SimdMath::MatrixMultiply(
+					SimdMath::MatrixMultiply(SimdMath::MatrixScaling(kWallWidth, kWallHeight, 1.0f), SimdMath::MatrixRotationRollPitchYaw(0.0f, unit(random) * SimdMath::kPi * 2.0f, 0.0f)),
+					SimdMath::MatrixTranslation((unit(random) - 0.5f) * size, 0.9f * kWallHeight, (unit(random) - 0.5f) * size));
+				walls.push_back(static_cast<uint32_t>(objectNodes.size()));
+				objectNodes.push_back(hierarchy.AddNode(TransformHierarchy::kNoParent, local));
+				GraphicsEngine::InstanceData instance = {};
+				instance.color = kWallTint;
+				instances.push_back(instance);
+			}
+
+			hierarchy.Update();
+			for (uint32_t object = 0; object < objectNodes.size(); object++)
+			{
+				StoreWorld(object);
+			}
+		}
+
+		// Returns how many world matrices were recomputed
+		uint32_t Update(float time)
+		{
+			for (const SpinningRoot& root : spinningRoots)
+			{
+				hierarchy.SetLocal(root.node, SimdMath::MatrixMultiply(
+					SimdMath::MatrixRotationRollPitchYaw(0.0f, root.speed * time, 0.0f),
+					SimdMath::MatrixTranslation(root.x, 0.0f, root.z)));
+			}
+			uint32_t updated = hierarchy.Update();
+			for (uint32_t object : spinningObjects)
+			{
+				StoreWorld(object);
+			}
+			return updated;
+		}
+
+		// Instances take the world matrix transposed, like the constant buffer
+		void StoreWorld(uint32_t object)
+		{
+			SimdMath::StoreFloat4x4(&instances[object].world, SimdMath::MatrixTranspose(hierarchy.GetWorld(objectNodes[object])));
+		}
+	};
+
+	// "frames keys mouseDeltaX mouseDeltaY" lines, false with a message on the first bad one
+	bool ReadCameraPath(const std::string& path, std::vector<PathSegment>& segments)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			std::fprintf(stderr, "can't open %s\n", path.c_str());
+			return false;
+		}
+		std::string line;
+		for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+		{
+			line = line.substr(0, line.find('#'));
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+			{
+				continue;
+			}
+			unsigned frames = 0;
+			char keys[16] = {};
+			PathSegment segment = {};
+			if (std::sscanf(line.c_str(), "%u %15s %d %d", &frames, keys, &segment.input.mouseDeltaX, &segment.input.mouseDeltaY) != 4)
+			{
+				std::fprintf(stderr, "%s(%d): expected frames keys mouseDeltaX mouseDeltaY\n", path.c_str(), lineNumber);
+				return false;
+			}
+			for (const char* key = keys; *key; key++)
+			{
+				switch (*key)
+				{
+				case 'W': case 'w': segment.input.forward = true; break;
+				case 'S': case 's': segment.input.back = true; break;
+				case 'A': case 'a': segment.input.left = true; break;
+				case 'D': case 'd': segment.input.right = true; break;
+				case '-': break;
+				default:
+					std::fprintf(stderr, "%s(%d): unknown key %c\n", path.c_str(), lineNumber, *key);
+					return false;
+				}
+			}
+			segment.frames = frames;
+			segment.input.look = segment.input.mouseDeltaX != 0 || segment.input.mouseDeltaY != 0;
+			if (frames > 0)
+			{
+				segments.push_back(segment);
+			}
+		}
+		if (segments.empty())
+		{
+			std::fprintf(stderr, "%s: no frames in the path\n", path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// FNV-1a
+	uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Start outside a scene of sceneSize, looking across it, fast enough for the path to cross it
+	CameraController GetStartCamera(float sceneSize)
+	{
+		CameraController camera;
+		camera.SetPosition(SimdMath::VectorSet(0.0f, 2.0f, -0.5f * sceneSize - 5.0f, 1.0f), SimdMath::VectorSet(0.0f, 2.0f, 0.0f, 1.0f));
+		camera.SetMoveSpeed(std::max(3.0f, sceneSize / 8.0f));
+		return camera;
+	}
+
+	// Steps through a camera path one frame at a time, starting over at its end
+	class PathPlayer
+	{
+	public:
+		explicit PathPlayer(const std::vector<PathSegment>& path) : m_path(path) {}
+
+		const CameraInput& Next()
+		{
+			const PathSegment& segment = m_path[m_segment];
+			if (++m_segmentFrame == segment.frames)
+			{
+				m_segment = (m_segment + 1) % m_path.size();
+				m_segmentFrame = 0;
+			}
+			return segment.input;
+		}
+
+	private:
+		const std::vector<PathSegment>& m_path;
+		size_t m_segment = 0;
+		uint32_t m_segmentFrame = 0;
+	};
+
+	// Run the frames of options through a new engine, false when it can't start
+	bool RunBenchmark(const BenchmarkOptions& options, const std::vector<PathSegment>& path, BenchmarkRun& run)
+	{
+		OcclusionCuller culler;
+		GraphicsEngine engine;
+		if (!engine.InitializeHeadless(options.width, options.height, options.threads))
+		{
+			std::fprintf(stderr, "can't create a %dx%d render target\n", options.width, options.height);
+			return false;
+		}
+		run.threads = engine.GetJobSystem()->GetThreadCount();
+		engine.SetInstancing(options.instancing);
+		engine.SetDepthTest(options.depthTest);
+
+		BenchmarkScene scene;
+		scene.Generate(options.objects, options.walls, options.seed);
+		uint32_t objectCount = static_cast<uint32_t>(scene.instances.size());
+		engine.SetTriangleOccluders(scene.walls.data(), static_cast<uint32_t>(scene.walls.size()));
+		if (options.occlusion)
+		{
+			// Pixel for pixel with the render target, so it only hides what the renderer would
+			culler.Initialize(options.width, options.height);
+			engine.SetOcclusionCuller(&culler);
+		}
+
+		run.stats = FrameStats(std::max(1u, options.frames));
+		for (const char* name : kPhaseNames)
+		{
+			run.stats.AddPhase(name);
+		}
+		run.records.clear();
+		run.records.reserve(options.frames);
+
+		// The warm-up frames are the start of the path, the measured ones carry on from there
+		const SoftwareRenderer& renderer = *engine.GetSoftwareRenderer();
+		uint32_t frameCount = options.warmupFrames + options.frames;
+
+		// With the render thread what the render side owns (the image, the uploads) is read on it, as
+		// each frame ends, the simulation only gets it back with the Flush at the end
+		std::vector<uint64_t> renderedHashes;
+		std::vector<uint32_t> renderedUploads;
+		uint32_t renderedFrames = 0;
+		if (options.renderThread)
+		{
+			renderedHashes.resize(frameCount);
+			renderedUploads.resize(frameCount);
+			engine.SetFrameRenderedCallback([&]()
+			{
+				renderedHashes[renderedFrames] = HashBytes(renderer.GetRenderTarget(), static_cast<size_t>(renderer.GetWidth()) * renderer.GetHeight() * sizeof(uint32_t));
+				renderedUploads[renderedFrames] = engine.GetConstantUploadStats().bytesUploaded;
+				renderedFrames++;
+			});
+			engine.SetRenderThread(2);
+		}
+
+		bool tracing = !options.tracePath.empty();
+		ProfileCapture capture;
+		FrameTimer timer;
+		engine.SetCamera(GetStartCamera(scene.size));
+		PathPlayer player(path);
+		double measuredStart = timer.GetTime();
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			bool measured = frame >= options.warmupFrames;
+			if (frame == options.warmupFrames)
+			{
+				measuredStart = timer.GetTime();
+			}
+			if (tracing && frame == options.warmupFrames)
+			{
+				SetProfilerThreadName("Main");
+				SetProfilerEnabled(true);
+			}
+
+			FrameRecord record = {};
+			uint64_t allocationsBefore = GetAllocationCount();
+			double phaseStart = timer.GetTime();
+			double frameStart = phaseStart;
+			auto endPhase = [&](BenchmarkPhase phase)
+			{
+				double now = timer.GetTime();
+				record.phaseSeconds[phase] = now - phaseStart;
+				phaseStart = now;
+			};
+
+			engine.ProcessCameraInput(player.Next(), kDeltaTime);
+			endPhase(kCameraPhase);
+
+			{
+				PROFILE_SCOPE("Benchmark::Scene");
+				record.updatedNodes = scene.Update(frame * kDeltaTime);
+				engine.SetTriangleInstances(scene.instances.data(), objectCount);
+			}
+			endPhase(kScenePhase);
+
+			engine.BeginFrame(options.width, options.height);
+			endPhase(kBeginFramePhase);
+
+			engine.EndFrame();
+			endPhase(kEndFramePhase);
+
+			record.frameSeconds = timer.GetTime() - frameStart;
+			record.allocations = GetAllocationCount() - allocationsBefore;
+			if (!measured)
+			{
+				continue;
+			}
+			record.visibleObjects = engine.GetVisibleInstanceCount();
+			if (!options.renderThread)
+			{
+				record.uploadedBytes = engine.GetConstantUploadStats().bytesUploaded;
+			}
+			for (uint32_t phase = 0; phase < kPhaseCount; phase++)
+			{
+				run.stats.SetPhaseTime(phase, record.phaseSeconds[phase]);
+			}
+			run.stats.EndFrame(record.frameSeconds);
+
+			// Out of the timed part
+			if (!options.renderThread)
+			{
+				record.imageHash = HashBytes(renderer.GetRenderTarget(), static_cast<size_t>(renderer.GetWidth()) * renderer.GetHeight() * sizeof(uint32_t));
+			}
+			run.records.push_back(record);
+			if (tracing)
+			{
+				capture.Collect();
+			}
+		}
+
+		// The last frames are still on the render thread
+		engine.Flush();
+		run.seconds = timer.GetTime() - measuredStart;
+		if (options.renderThread)
+		{
+			engine.SetRenderThread(0);
+			for (uint32_t frame = 0; frame < options.frames; frame++)
+			{
+				run.records[frame].imageHash = renderedHashes[options.warmupFrames + frame];
+				run.records[frame].uploadedBytes = renderedUploads[options.warmupFrames + frame];
+			}
+		}
+		run.runHash = HashBytes(nullptr, 0);
+		for (const FrameRecord& record : run.records)
+		{
+			run.runHash = HashBytes(&record.imageHash, sizeof(record.imageHash), run.runHash);
+		}
+
+		if (tracing)
+		{
+			SetProfilerEnabled(false);
+			capture.Collect();
+			if (!capture.WriteChromeTrace(options.tracePath))
+			{
+				std::fprintf(stderr, "can't write %s\n", options.tracePath.c_str());
+			}
+		}
+		return true;
+	}
+
+	std::string FormatFrame(uint32_t frame, const FrameRecord& record, bool json)
+	{
+		char text[128];
+		std::string line;
+		snprintf(text, sizeof(text), json ? "{\"frame\":%u,\"frameMs\":%.4f" : "%u,%.4f", frame, record.frameSeconds * 1000.0);
+		line += text;
+		for (uint32_t phase = 0; phase < kPhaseCount; phase++)
+		{
+			if (json)
+			{
+				snprintf(text, sizeof(text), ",\"%s\":%.4f", kPhaseColumns[phase], record.phaseSeconds[phase] * 1000.0);
+			}
+			else
+			{
+				snprintf(text, sizeof(text), ",%.4f", record.phaseSeconds[phase] * 1000.0);
+			}
+			line += text;
+		}
+		snprintf(text, sizeof(text), json ? ",\"updatedNodes\":%u,\"visibleObjects\":%u,\"uploadedBytes\":%u,\"allocations\":%llu,\"imageHash\":\"%016llx\"}" : ",%u,%u,%u,%llu,%016llx\n",
+			record.updatedNodes, record.visibleObjects, record.uploadedBytes, static_cast<unsigned long long>(record.allocations),
+			static_cast<unsigned long long>(record.imageHash));
+		line += text;
+		return line;
+	}
+
+	bool WriteCsv(const std::string& path, const std::vector<FrameRecord>& records)
+	{
+		std::string csv = "frame,frameMs";
+		for (const char* column : kPhaseColumns)
+		{
+			csv += ",";
+			csv += column;
+		}
+		csv += ",updatedNodes,visibleObjects,uploadedBytes,allocations,imageHash\n";
+		for (uint32_t frame = 0; frame < records.size(); frame++)
+		{
+			csv += FormatFrame(frame, records[frame], false);
+		}
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		return static_cast<bool>(file.write(csv.data(), csv.size()));
+	}
+
+	double GetMeanVisibleObjects(const std::vector<FrameRecord>& records)
+	{
+		uint64_t visible = 0;
+		for (const FrameRecord& record : records)
+		{
+			visible += record.visibleObjects;
+		}
+		return records.empty() ? 0.0 : static_cast<double>(visible) / records.size();
+	}
+
+	bool WriteJson(const std::string& path, const BenchmarkOptions& options, const BenchmarkRun& run)
+	{
+		char text[512];
+		snprintf(text, sizeof(text), "{\"config\":{\"objects\":%u,\"seed\":%u,\"frames\":%u,\"threads\":%u,\"width\":%d,\"height\":%d,\"simd\":\"%s\",\"path\":\"%s\",\"warmupFrames\":%u,\"instancing\":%s,\"depthTest\":%s,\"walls\":%u,\"occlusion\":%s,\"renderThread\":%s},\n"
+			"\"summary\":{\"runHash\":\"%016llx\",\"meanVisibleObjects\":%.1f,\"lastFrameAllocations\":%llu},\n\"stats\":",
+			options.objects, options.seed, options.frames, run.threads, options.width, options.height, GetSimdIsaName(GetBestSimdIsa()),
+			options.pathFile.empty() ? "default" : "file", options.warmupFrames, options.instancing ? "true" : "false", options.depthTest ? "true" : "false", options.walls, options.occlusion ? "true" : "false", options.renderThread ? "true" : "false", static_cast<unsigned long long>(run.runHash), GetMeanVisibleObjects(run.records),
+			static_cast<unsigned long long>(run.records.empty() ? 0 : run.records.back().allocations));
+		std::string json = text;
+		std::string statsJson = run.stats.ToJson();
+		json.append(statsJson, 0, statsJson.size() - 1); // without its newline
+		json += ",\n\"frames\":[";
+		for (uint32_t frame = 0; frame < run.records.size(); frame++)
+		{
+			json += frame > 0 ? ",\n" : "\n";
+			json += FormatFrame(frame, run.records[frame], true);
+		}
+		json += "]}\n";
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		return static_cast<bool>(file.write(json.data(), json.size()));
+	}
+
+	// Seeds every randomized validation runs with
+	const uint32_t kValidationSeeds = 4;
+
+	// A warm engine renders a frame without touching the heap: once the first frames have grown the
+	// engine's storage, no frame of most of the path may allocate (aligned news included), on one
+	// thread and on several
+	bool ValidateSteadyStateAllocations(JobSystem&, const std::string&)
+	{
+		const std::vector<PathSegment> path(std::begin(kDefaultPath), std::end(kDefaultPath));
+		for (unsigned threads : { 1u, 4u })
+		{
+			BenchmarkOptions options;
+			options.objects = 2000;
+			options.warmupFrames = 30;
+			options.frames = 600;
+			options.threads = threads;
+			options.width = 320;
+			options.height = 200;
+			BenchmarkRun run;
+			if (!RunBenchmark(options, path, run))
+			{
+				return false;
+			}
+			for (uint32_t frame = 0; frame < run.records.size(); frame++)
+			{
+				if (run.records[frame].allocations != 0)
+				{
+					std::fprintf(stderr, "%u threads, frame %u: %llu allocations\n", threads, frame,
+						static_cast<unsigned long long>(run.records[frame].allocations));
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// BeginFrame keeps the view, the projection and the frustum from the last frame while the camera
+	// doesn't move and the aspect ratio doesn't change: after random moves, idle frames, new cameras
+	// and new sizes they must be what rebuilding them every frame gives, to the bit
+	bool ValidateViewCache(JobSystem&, const std::string&)
+	{
+		auto sameBits = [](const auto& a, const auto& b) { return std::memcmp(&a, &b, sizeof(a)) == 0; };
+		const int kSizes[][2] = { { 64, 40 }, { 128, 80 }, { 40, 64 }, { 50, 50 } };
+
+		GraphicsEngine engine;
+		if (!engine.InitializeHeadless(kSizes[0][0], kSizes[0][1], 1))
+		{
+			return false;
+		}
+		for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+		{
+			std::mt19937 random(seed);
+			std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+			CameraController camera = GetStartCamera(100.0f);
+			engine.SetCamera(camera);
+			int width = kSizes[0][0];
+			int height = kSizes[0][1];
+			for (uint32_t frame = 0; frame < 300; frame++)
+			{
+				uint32_t event = random() % 16;
+				if (event == 0)
+				{
+					SimdMath::Vector eye = SimdMath::VectorSet(position(random), position(random), position(random), 1.0f);
+					SimdMath::Vector target = SimdMath::VectorAdd(eye, SimdMath::VectorSet(1.0f + position(random), position(random), 1.0f, 0.0f));
+					camera.SetPosition(eye, target);
+					engine.SetCamera(camera);
+				}
+				else if (event == 1)
+				{
+					// The second size has the aspect of the first, the projection stays
+					const int* size = kSizes[random() % std::size(kSizes)];
+					width = size[0];
+					height = size[1];
+				}
+				else
+				{
+					// A third of the frames the camera doesn't move
+					CameraInput input = {};
+					if (random() % 3 != 0)
+					{
+						input.forward = random() % 2 != 0;
+						input.back = random() % 4 == 0;
+						input.left = random() % 3 == 0;
+						input.right = random() % 3 == 0;
+						input.look = random() % 2 != 0;
+						input.mouseDeltaX = static_cast<int>(random() % 21) - 10;
+						input.mouseDeltaY = static_cast<int>(random() % 21) - 10;
+					}
+					camera.Update(input, kDeltaTime);
+					engine.ProcessCameraInput(input, kDeltaTime);
+				}
+
+				engine.BeginFrame(width, height);
+				engine.EndFrame();
+
+				SimdMath::Matrix view = SimdMath::MatrixTranspose(camera.GetView());
+				SimdMath::Matrix projection = SimdMath::MatrixTranspose(SimdMath::MatrixPerspectiveFovLH(SimdMath::kPiDiv4,
+					static_cast<float>(width) / static_cast<float>(height), GraphicsEngine::kNearPlane, GraphicsEngine::kFarPlane));
+				SimdMath::Float4x4 viewProjection;
+				SimdMath::StoreFloat4x4(&viewProjection, SimdMath::MatrixMultiply(projection, view));
+				if (!sameBits(engine.GetView(), view) || !sameBits(engine.GetProjection(), projection)
+					|| !sameBits(engine.GetFrustum(), ExtractFrustumPlanes(&viewProjection.m[0][0])))
+				{
+					std::fprintf(stderr, "seed %u, frame %u\n", seed, frame);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Walls in the scene and the depth test on: culling what they hide must not change a pixel, and
+	// must cull something
+	bool ValidateOcclusionCulling(JobSystem&, const std::string&)
+	{
+		const std::vector<PathSegment> path(std::begin(kDefaultPath), std::end(kDefaultPath));
+		BenchmarkOptions options;
+		options.objects = 2000;
+		options.walls = 40;
+		options.frames = 240;
+		options.threads = 1;
+		options.width = 320;
+		options.height = 200;
+		options.depthTest = true;
+		BenchmarkRun reference;
+		BenchmarkRun culled;
+		options.occlusion = true;
+		if (!RunBenchmark(options, path, culled))
+		{
+			return false;
+		}
+		options.occlusion = false;
+		if (!RunBenchmark(options, path, reference))
+		{
+			return false;
+		}
+
+		uint64_t referenceVisible = 0;
+		uint64_t culledVisible = 0;
+		for (uint32_t frame = 0; frame < options.frames; frame++)
+		{
+			if (culled.records[frame].imageHash != reference.records[frame].imageHash)
+			{
+				std::fprintf(stderr, "frame %u: the image changed\n", frame);
+				return false;
+			}
+			referenceVisible += reference.records[frame].visibleObjects;
+			culledVisible += culled.records[frame].visibleObjects;
+		}
+		std::printf("occlusion culling: %.1f of %.1f visible objects a frame left\n", static_cast<double>(culledVisible) / options.frames,
+			static_cast<double>(referenceVisible) / options.frames);
+		return culledVisible < referenceVisible;
+	}
+
+	// The render thread on the benchmark scene: the images must be those of the run without it, on a
+	// pool of 1 thread (the render thread rasterizes itself) and of 2. With 2 frames in flight, the
+	// simulation of a frame overlaps the rendering of the last one: on the pool of 1 thread each side
+	// has a core and the frames run faster, by less than 2x, the simulation is the smaller half here.
+	// Only a machine with 2 free cores can show it, on fewer the speedup is reported, not checked.
+	bool ValidateRenderThreadSpeedup(JobSystem&, const std::string&)
+	{
+		const double kMinSpeedup = 1.1;
+		const std::vector<PathSegment> path(std::begin(kDefaultPath), std::end(kDefaultPath));
+		double speedup = 0.0;
+		for (unsigned threads : { 1u, 2u })
+		{
+			BenchmarkOptions options;
+			options.objects = 2000;
+			options.warmupFrames = 30;
+			options.frames = 300;
+			options.threads = threads;
+			options.width = 320;
+			options.height = 200;
+			BenchmarkRun serial;
+			BenchmarkRun threaded;
+			if (!RunBenchmark(options, path, serial))
+			{
+				return false;
+			}
+			options.renderThread = true;
+			if (!RunBenchmark(options, path, threaded))
+			{
+				return false;
+			}
+			for (uint32_t frame = 0; frame < options.frames; frame++)
+			{
+				if (threaded.records[frame].imageHash != serial.records[frame].imageHash
+					|| threaded.records[frame].uploadedBytes != serial.records[frame].uploadedBytes)
+				{
+					std::fprintf(stderr, "%u threads, frame %u: not the frame of the run without the render thread\n", threads, frame);
+					return false;
+				}
+			}
+			if (threads == 1)
+			{
+				speedup = threaded.seconds > 0.0 ? serial.seconds / threaded.seconds : 0.0;
+			}
+		}
+
+		bool checked = std::thread::hardware_concurrency() >= 2;
+		std::printf("render thread speedup with 2 frames in flight: %.2fx%s\n", speedup, checked ? "" : " (not checked, fewer than 2 cores)");
+		return !checked || speedup >= kMinSpeedup;
+	}
+
+	// One check of --validate, directory is scratch space for the ones that write files
+	struct ValidationCheck
+	{
+		const char* name;
+		bool (*run)(JobSystem& pool, const std::string& directory);
+	};
+
+	const ValidationCheck kValidationChecks[] =
+	{
+		{ "job system", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateJobSystem(seed, 4))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "simd math", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateSimdMath(seed, 1000))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "batch transform", [](JobSystem&, const std::string&)
+			{
+				for (SimdIsa isa : kSimdIsas)
+				{
+					for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+					{
+						if (!ValidateBatchTransform(isa, seed, 100))
+						{
+							std::fprintf(stderr, "%s kernel, seed %u\n", GetSimdIsaName(isa), seed);
+							return false;
+						}
+					}
+				}
+				return true;
+			} },
+		{ "block coverage", [](JobSystem&, const std::string&)
+			{
+				for (SimdIsa isa : kSimdIsas)
+				{
+					for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+					{
+						if (!ValidateBlockCoverage(isa, seed, 1024))
+						{
+							std::fprintf(stderr, "%s kernel, seed %u\n", GetSimdIsaName(isa), seed);
+							return false;
+						}
+					}
+				}
+				return true;
+			} },
+		{ "depth test", [](JobSystem& pool, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateDepthTest(pool, seed, 16))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "occlusion culler", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateOcclusionCuller(seed, 500))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "frustum culling", [](JobSystem&, const std::string&)
+			{
+				for (SimdIsa isa : kSimdIsas)
+				{
+					for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+					{
+						if (!ValidateFrustumCulling(isa, seed, 100))
+						{
+							return false;
+						}
+					}
+				}
+				return true;
+			} },
+		{ "draw queue", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateDrawQueue(seed, 50))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "constant block", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateConstantBlock(seed, 200))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "transform hierarchy", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateTransformHierarchy(seed, 50))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "linear arena", [](JobSystem& pool, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateLinearArena(&pool, seed, 64) || !ValidateLinearArena(nullptr, seed, 64))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "ring allocator", [](JobSystem& pool, const std::string&)
+			{
+				for (uint32_t framesInFlight = 1; framesInFlight <= 3; framesInFlight++)
+				{
+					for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+					{
+						if (!ValidateRingAllocator(&pool, framesInFlight, seed, 64) || !ValidateRingAllocator(nullptr, framesInFlight, seed, 64))
+						{
+							return false;
+						}
+					}
+				}
+				return true;
+			} },
+		{ "state filtering", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateStateFiltering(seed, 10000))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "state object cache", [](JobSystem& pool, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateStateObjectCache(&pool, seed, 20000) || !ValidateStateObjectCache(nullptr, seed, 20000))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "profiler", [](JobSystem& pool, const std::string& directory)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateProfiler(&pool, directory, seed, 16) || !ValidateProfiler(nullptr, directory, seed, 16))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "frame stats", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateFrameStats(seed, 2000))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "view cache", ValidateViewCache },
+		{ "steady state allocations", ValidateSteadyStateAllocations },
+		{ "occlusion culling", ValidateOcclusionCulling },
+		{ "render thread", [](JobSystem&, const std::string&)
+			{
+				for (uint32_t seed = 0; seed < kValidationSeeds; seed++)
+				{
+					if (!ValidateRenderThread(seed, 200))
+					{
+						return false;
+					}
+				}
+				return true;
+			} },
+		{ "render thread speedup", ValidateRenderThreadSpeedup },
+	};
+
+	int Validate(const std::string& directory)
+	{
+		JobSystem pool;
+		bool passed = true;
+		for (const ValidationCheck& check : kValidationChecks)
+		{
+			bool ok = check.run(pool, directory);
+			std::printf("%s: %s\n", check.name, ok ? "ok" : "FAILED");
+			std::fflush(stdout);
+			passed = passed && ok;
+		}
+		return passed ? 0 : 1;
+	}
+
+	// --cull-benchmark: the frustum culling kernels alone, on kCullBenchmarkBoxes boxes spread like
+	// the scene's objects and the frustum of the engine's camera along the path. Every instruction
+	// set culls the same boxes on one thread and on the job system, and must find the same ones.
+	const uint32_t kCullBenchmarkBoxes = 100000;
+
+	int RunCullBenchmark(const BenchmarkOptions& options, const std::vector<PathSegment>& path)
+	{
+		GraphicsEngine engine;
+		if (!engine.InitializeHeadless(options.width, options.height, options.threads))
+		{
+			std::fprintf(stderr, "can't create a %dx%d render target\n", options.width, options.height);
+			return 1;
+		}
+		JobSystem* pool = engine.GetJobSystem();
+
+		// Center x/y/z then extents x/y/z, one array each
+		const uint32_t count = kCullBenchmarkBoxes;
+		float size = std::sqrt(static_cast<float>(count)) * kObjectSpacing;
+		std::vector<float> bounds(static_cast<size_t>(count) * 6);
+		std::mt19937 random(options.seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			bounds[i] = (unit(random) - 0.5f) * size;
+			bounds[count + i] = unit(random) * 3.0f;
+			bounds[count * 2 + i] = (unit(random) - 0.5f) * size;
+			for (uint32_t axis = 3; axis < 6; axis++)
+			{
+				bounds[count * axis + i] = 0.25f + unit(random) * 1.25f;
+			}
+		}
+		const float* data = bounds.data();
+		BoxArrays boxes = { data, data + count, data + count * 2, data + count * 3, data + count * 4, data + count * 5 };
+		std::vector<uint32_t> visible(count);
+
+		const uint32_t kIsaCount = static_cast<uint32_t>(std::size(kSimdIsas));
+		double singleSeconds[kIsaCount] = {};
+		double pooledSeconds[kIsaCount] = {};
+		uint64_t visibleTotal = 0;
+		engine.SetCamera(GetStartCamera(size));
+		PathPlayer player(path);
+		FrameTimer timer;
+		for (uint32_t frame = 0; frame < options.frames; frame++)
+		{
+			engine.ProcessCameraInput(player.Next(), kDeltaTime);
+			engine.BeginFrame(options.width, options.height);
+			const FrustumPlanes& frustum = engine.GetFrustum();
+
+			uint32_t reference = 0;
+			for (uint32_t isa = 0; isa < kIsaCount; isa++)
+			{
+				if (ClampSimdIsa(kSimdIsas[isa]) != kSimdIsas[isa])
+				{
+					continue;
+				}
+				double start = timer.GetTime();
+				uint32_t single = CullBoxes(frustum, boxes, count, visible.data(), nullptr, kSimdIsas[isa]);
+				double middle = timer.GetTime();
+				uint32_t pooled = CullBoxes(frustum, boxes, count, visible.data(), pool, kSimdIsas[isa]);
+				singleSeconds[isa] += middle - start;
+				pooledSeconds[isa] += timer.GetTime() - middle;
+
+				if (isa == 0)
+				{
+					reference = single;
+					visibleTotal += single;
+				}
+				if (single != reference || pooled != reference)
+				{
+					std::fprintf(stderr, "frame %u: %s finds %u and %u visible boxes, Scalar %u\n", frame, GetSimdIsaName(kSimdIsas[isa]), single, pooled, reference);
+					return 1;
+				}
+			}
+		}
+
+		uint32_t frames = std::max(1u, options.frames);
+		std::printf("%u boxes, %u frustums, %u threads, %.1f visible on average\n", count, options.frames, pool->GetThreadCount(),
+			static_cast<double>(visibleTotal) / frames);
+		std::printf("isa     1 thread ms  ns/box  speedup  %2u threads ms  speedup\n", pool->GetThreadCount());
+		std::string csv = "isa,singleThreadMs,nsPerBox,speedup,threads,jobSystemMs,jobSystemSpeedup\n";
+		for (uint32_t isa = 0; isa < kIsaCount; isa++)
+		{
+			const char* name = GetSimdIsaName(kSimdIsas[isa]);
+			if (ClampSimdIsa(kSimdIsas[isa]) != kSimdIsas[isa])
+			{
+				std::printf("%-7s not supported here\n", name);
+				continue;
+			}
+			double singleMs = singleSeconds[isa] * 1000.0 / frames;
+			double pooledMs = pooledSeconds[isa] * 1000.0 / frames;
+			double nsPerBox = singleSeconds[isa] * 1e9 / (static_cast<double>(frames) * count);
+			double speedup = singleSeconds[isa] > 0.0 ? singleSeconds[0] / singleSeconds[isa] : 0.0;
+			double pooledSpeedup = pooledSeconds[isa] > 0.0 ? singleSeconds[0] / pooledSeconds[isa] : 0.0;
+			std::printf("%-7s %11.3f %7.2f %7.2fx %14.3f %7.2fx\n", name, singleMs, nsPerBox, speedup, pooledMs, pooledSpeedup);
+			char row[160];
+			snprintf(row, sizeof(row), "%s,%.4f,%.3f,%.3f,%u,%.4f,%.3f\n", name, singleMs, nsPerBox, speedup, pool->GetThreadCount(), pooledMs, pooledSpeedup);
+			csv += row;
+		}
+
+		if (!options.csvPath.empty())
+		{
+			std::ofstream file(options.csvPath, std::ios::binary | std::ios::trunc);
+			if (!file.write(csv.data(), csv.size()))
+			{
+				std::fprintf(stderr, "can't write %s\n", options.csvPath.c_str());
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	double GetMeanUploadedBytes(const std::vector<FrameRecord>& records)
+	{
+		uint64_t bytes = 0;
+		for (const FrameRecord& record : records)
+		{
+			bytes += record.uploadedBytes;
+		}
+		return records.empty() ? 0.0 : static_cast<double>(bytes) / records.size();
+	}
+
+	// --instance-sweep: 100 to 100k objects, submitted as one instanced draw and as one draw per
+	// object, the frame times and constant uploads side by side. Both must see the same objects.
+	int RunInstanceSweep(const BenchmarkOptions& options, const std::vector<PathSegment>& path)
+	{
+		const uint32_t kObjectCounts[] = { 100, 1000, 10000, 100000 };
+		std::printf("%u frames at %dx%d (%s)\n", options.frames, options.width, options.height, GetSimdIsaName(GetBestSimdIsa()));
+		std::printf("objects  visible  instanced ms  upload KB  per-draw ms  upload KB  speedup\n");
+		std::string csv = "objects,meanVisibleObjects,instancedMs,instancedUploadBytes,perDrawMs,perDrawUploadBytes,speedup\n";
+		for (uint32_t objects : kObjectCounts)
+		{
+			BenchmarkRun runs[2];
+			for (int instanced = 0; instanced < 2; instanced++)
+			{
+				BenchmarkOptions sweepOptions = options;
+				sweepOptions.objects = objects;
+				sweepOptions.instancing = instanced == 1;
+				sweepOptions.tracePath.clear();
+				if (!RunBenchmark(sweepOptions, path, runs[instanced]))
+				{
+					return 1;
+				}
+			}
+			const BenchmarkRun& perDraw = runs[0];
+			const BenchmarkRun& instanced = runs[1];
+			double visible = GetMeanVisibleObjects(instanced.records);
+			if (GetMeanVisibleObjects(perDraw.records) != visible)
+			{
+				std::fprintf(stderr, "%u objects: the two submissions saw different objects\n", objects);
+				return 1;
+			}
+
+			double instancedMs = instanced.stats.GetFrameSummary(false).mean;
+			double perDrawMs = perDraw.stats.GetFrameSummary(false).mean;
+			double instancedUpload = GetMeanUploadedBytes(instanced.records);
+			double perDrawUpload = GetMeanUploadedBytes(perDraw.records);
+			double speedup = instancedMs > 0.0 ? perDrawMs / instancedMs : 0.0;
+			std::printf("%7u %8.1f %13.3f %10.1f %12.3f %10.1f %7.2fx\n", objects, visible, instancedMs, instancedUpload / 1024.0,
+				perDrawMs, perDrawUpload / 1024.0, speedup);
+			std::fflush(stdout);
+			char row[160];
+			snprintf(row, sizeof(row), "%u,%.1f,%.4f,%.0f,%.4f,%.0f,%.3f\n", objects, visible, instancedMs, instancedUpload, perDrawMs, perDrawUpload, speedup);
+			csv += row;
+		}
+
+		if (!options.csvPath.empty())
+		{
+			std::ofstream file(options.csvPath, std::ios::binary | std::ios::trunc);
+			if (!file.write(csv.data(), csv.size()))
+			{
+				std::fprintf(stderr, "can't write %s\n", options.csvPath.c_str());
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	// --thread-sweep: the same run on 1 to 32 threads, the frame times side by side
+	// Every thread count must render the same images, the sweep fails otherwise.
+	int RunThreadSweep(const BenchmarkOptions& options, const std::vector<PathSegment>& path)
+	{
+		const unsigned kThreadCounts[] = { 1, 2, 4, 8, 16, 32 };
+		std::printf("%u objects, %u frames at %dx%d (%s), %u hardware threads\n", options.objects, options.frames, options.width, options.height,
+			GetSimdIsaName(GetBestSimdIsa()), std::thread::hardware_concurrency());
+		std::printf("threads  mean ms   p50 ms   p95 ms   p99 ms  speedup\n");
+		std::string csv = "threads,meanMs,p50Ms,p95Ms,p99Ms,maxMs,speedup\n";
+		double baseline = 0.0;
+		uint64_t firstHash = 0;
+		bool sameImages = true;
+		for (unsigned threads : kThreadCounts)
+		{
+			BenchmarkOptions sweepOptions = options;
+			sweepOptions.threads = threads;
+			sweepOptions.tracePath.clear();
+			BenchmarkRun run;
+			if (!RunBenchmark(sweepOptions, path, run))
+			{
+				return 1;
+			}
+
+			FrameTimeSummary summary = run.stats.GetFrameSummary(false);
+			if (threads == kThreadCounts[0])
+			{
+				baseline = summary.mean;
+				firstHash = run.runHash;
+			}
+			sameImages = sameImages && run.runHash == firstHash;
+			double speedup = summary.mean > 0.0 ? baseline / summary.mean : 0.0;
+			std::printf("%7u %8.3f %8.3f %8.3f %8.3f %7.2fx\n", threads, summary.mean, summary.p50, summary.p95, summary.p99, speedup);
+			std::fflush(stdout);
+			char row[128];
+			snprintf(row, sizeof(row), "%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f\n", threads, summary.mean, summary.p50, summary.p95, summary.p99, summary.max, speedup);
+			csv += row;
+		}
+
+		if (!sameImages)
+		{
+			std::fprintf(stderr, "the thread counts rendered different images\n");
+			return 1;
+		}
+		if (!options.csvPath.empty())
+		{
+			std::ofstream file(options.csvPath, std::ios::binary | std::ios::trunc);
+			if (!file.write(csv.data(), csv.size()))
+			{
+				std::fprintf(stderr, "can't write %s\n", options.csvPath.c_str());
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	int Run(const BenchmarkOptions& options)
+	{
+		std::vector<PathSegment> path(std::begin(kDefaultPath), std::end(kDefaultPath));
+		if (!options.pathFile.empty())
+		{
+			path.clear();
+			if (!ReadCameraPath(options.pathFile, path))
+			{
+				return 1;
+			}
+		}
+
+		if (options.threadSweep)
+		{
+			return RunThreadSweep(options, path);
+		}
+		if (options.cullBenchmark)
+		{
+			return RunCullBenchmark(options, path);
+		}
+		if (options.instanceSweep)
+		{
+			return RunInstanceSweep(options, path);
+		}
+
+		BenchmarkRun run;
+		if (!RunBenchmark(options, path, run))
+		{
+			return 1;
+		}
+
+		FrameTimeSummary summary = run.stats.GetFrameSummary(false);
+		std::printf("%u objects, %u frames at %dx%d, %u threads (%s)\n", options.objects, options.frames, options.width, options.height,
+			run.threads, GetSimdIsaName(GetBestSimdIsa()));
+		std::printf("frame ms: mean %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f, %llu hitches\n", summary.mean, summary.p50, summary.p95, summary.p99,
+			summary.max, static_cast<unsigned long long>(run.stats.GetHitchCount(false)));
+		for (uint32_t phase = 0; phase < kPhaseCount; phase++)
+		{
+			FrameTimeSummary phaseSummary = run.stats.GetPhaseSummary(phase, false);
+			std::printf("  %-10s mean %.3f p95 %.3f\n", kPhaseNames[phase], phaseSummary.mean, phaseSummary.p95);
+		}
+		std::printf("visible objects: mean %.1f, run hash %016llx\n", GetMeanVisibleObjects(run.records), static_cast<unsigned long long>(run.runHash));
+
+		bool written = true;
+		if (!options.jsonPath.empty() && !WriteJson(options.jsonPath, options, run))
+		{
+			std::fprintf(stderr, "can't write %s\n", options.jsonPath.c_str());
+			written = false;
+		}
+		if (!options.csvPath.empty() && !WriteCsv(options.csvPath, run.records))
+		{
+			std::fprintf(stderr, "can't write %s\n", options.csvPath.c_str());
+			written = false;
+		}
+		return written ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	std::string validateDirectory;
+	bool valid = true;
+	for (int i = 1; i < argc && valid; i++)
+	{
+		if (std::strcmp(argv[i], "--thread-sweep") == 0)
+		{
+			options.threadSweep = true;
+		}
+		else if (std::strcmp(argv[i], "--cull-benchmark") == 0)
+		{
+			options.cullBenchmark = true;
+		}
+		else if (std::strcmp(argv[i], "--instance-sweep") == 0)
+		{
+			options.instanceSweep = true;
+		}
+		else if (std::strcmp(argv[i], "--no-instancing") == 0)
+		{
+			options.instancing = false;
+		}
+		else if (std::strcmp(argv[i], "--depth-test") == 0)
+		{
+			options.depthTest = true;
+		}
+		else if (std::strcmp(argv[i], "--occlusion") == 0)
+		{
+			options.occlusion = true;
+		}
+		else if (std::strcmp(argv[i], "--render-thread") == 0)
+		{
+			options.renderThread = true;
+		}
+		else if (i + 1 >= argc)
+		{
+			valid = false;
+		}
+		else if (std::strcmp(argv[i], "--objects") == 0)
+		{
+			options.objects = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0)
+		{
+			options.seed = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0)
+		{
+			options.frames = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--warmup") == 0)
+		{
+			options.warmupFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--walls") == 0)
+		{
+			options.walls = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--threads") == 0)
+		{
+			options.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--width") == 0)
+		{
+			options.width = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--height") == 0)
+		{
+			options.height = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--path") == 0)
+		{
+			options.pathFile = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--json") == 0)
+		{
+			options.jsonPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--csv") == 0)
+		{
+			options.csvPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--trace") == 0)
+		{
+			options.tracePath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--validate") == 0)
+		{
+			validateDirectory = argv[++i];
+		}
+		else
+		{
+			valid = false;
+		}
+	}
+	if (valid && !validateDirectory.empty())
+	{
+		return Validate(validateDirectory);
+	}
+	if (!valid || options.objects == 0 || options.width <= 0 || options.height <= 0)
+	{
+		std::fprintf(stderr, "usage: Benchmark [--objects N] [--seed N] [--frames N] [--threads N] [--width N] [--height N] [--warmup N] [--no-instancing]\n"
+			"                 [--depth-test] [--walls N] [--occlusion] [--render-thread] [--path camera.txt] [--json results.json] [--csv frames.csv] [--trace trace.json]\n"
+			"       Benchmark [options above] --thread-sweep\n"
+			"       Benchmark [options above] --cull-benchmark\n"
+			"       Benchmark [options above] --instance-sweep\n"
+			"       Benchmark --validate <scratch directory>\n");
+		return 1;
+	}
+	return Run(options);
+}
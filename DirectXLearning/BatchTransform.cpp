@@ -0,0 +1,325 @@
+#include "BatchTransform.h"
+#include <cmath> // fabs, sqrt
+#include <random> // validation
+#include <vector>
+#include "JobSystem.h"
+
+#if CPU_FEATURES_X86
+#include <immintrin.h> // SSE2/AVX2 intrinsics
+#endif
+
+namespace
+{
+	// Reference kernel, one object at a time
+	// Also finishes the objects left over by the SIMD kernels
+	void BatchTransformScalar(const TransformArrays& transforms, uint32_t first, uint32_t count, const float* viewProjection, float* matrices)
+	{
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			float x = transforms.rotationX[i];
+			float y = transforms.rotationY[i];
+			float z = transforms.rotationZ[i];
+			float w = transforms.rotationW[i];
+			float sx = transforms.scaleX[i];
+			float sy = transforms.scaleY[i];
+			float sz = transforms.scaleZ[i];
+
+			// Rows 0-2 of the transposed world matrix, row 3 is always (0, 0, 0, 1)
+			float world[12] = {
+				sx * (1.0f - 2.0f * (y * y + z * z)), sy * 2.0f * (x * y - z * w), sz * 2.0f * (x * z + y * w), transforms.positionX[i],
+				sx * 2.0f * (x * y + z * w), sy * (1.0f - 2.0f * (x * x + z * z)), sz * 2.0f * (y * z - x * w), transforms.positionY[i],
+				sx * 2.0f * (x * z - y * w), sy * 2.0f * (y * z + x * w), sz * (1.0f - 2.0f * (x * x + y * y)), transforms.positionZ[i],
+			};
+
+			float* out = matrices + static_cast<size_t>(i) * 16;
+			for (int row = 0; row < 4; row++)
+			{
+				for (int column = 0; column < 4; column++)
+				{
+					if (viewProjection)
+					{
+						const float* vp = viewProjection + row * 4;
+						out[row * 4 + column] = vp[0] * world[column] + vp[1] * world[4 + column] + vp[2] * world[8 + column] + (column == 3 ? vp[3] : 0.0f);
+					}
+					else
+					{
+						out[row * 4 + column] = row < 3 ? world[row * 4 + column] : (column == 3 ? 1.0f : 0.0f);
+					}
+				}
+			}
+		}
+	}
+
+#if CPU_FEATURES_X86
+	// 4 objects per instruction, each register holds one matrix element of 4 objects
+	void BatchTransformSSE2(const TransformArrays& transforms, uint32_t first, uint32_t count, const float* viewProjection, float* matrices)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		uint32_t i = first;
+		for (; i + 4 <= first + count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(transforms.rotationX + i);
+			__m128 y = _mm_loadu_ps(transforms.rotationY + i);
+			__m128 z = _mm_loadu_ps(transforms.rotationZ + i);
+			__m128 w = _mm_loadu_ps(transforms.rotationW + i);
+			__m128 sx = _mm_loadu_ps(transforms.scaleX + i);
+			__m128 sy = _mm_loadu_ps(transforms.scaleY + i);
+			__m128 sz = _mm_loadu_ps(transforms.scaleZ + i);
+
+			__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+			__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+			__m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+			__m128 world[12] = {
+				_mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)))),
+				_mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(xy, zw))),
+				_mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(xz, yw))),
+				_mm_loadu_ps(transforms.positionX + i),
+				_mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xy, zw))),
+				_mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)))),
+				_mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(yz, xw))),
+				_mm_loadu_ps(transforms.positionY + i),
+				_mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xz, yw))),
+				_mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(yz, xw))),
+				_mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)))),
+				_mm_loadu_ps(transforms.positionZ + i),
+			};
+
+			__m128 out[16];
+			for (int row = 0; row < 4; row++)
+			{
+				for (int column = 0; column < 4; column++)
+				{
+					if (viewProjection)
+					{
+						const float* vp = viewProjection + row * 4;
+						__m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(vp[0]), world[column]), _mm_mul_ps(_mm_set1_ps(vp[1]), world[4 + column]));
+						value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(vp[2]), world[8 + column]));
+						out[row * 4 + column] = column == 3 ? _mm_add_ps(value, _mm_set1_ps(vp[3])) : value;
+					}
+					else
+					{
+						out[row * 4 + column] = row < 3 ? world[row * 4 + column] : (column == 3 ? one : zero);
+					}
+				}
+			}
+
+			// Element-major to object-major, 4x4 at a time
+			float* destination = matrices + static_cast<size_t>(i) * 16;
+			for (int group = 0; group < 4; group++)
+			{
+				__m128 r0 = out[group * 4 + 0], r1 = out[group * 4 + 1], r2 = out[group * 4 + 2], r3 = out[group * 4 + 3];
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(destination + 0 * 16 + group * 4, r0);
+				_mm_storeu_ps(destination + 1 * 16 + group * 4, r1);
+				_mm_storeu_ps(destination + 2 * 16 + group * 4, r2);
+				_mm_storeu_ps(destination + 3 * 16 + group * 4, r3);
+			}
+		}
+		BatchTransformScalar(transforms, i, first + count - i, viewProjection, matrices);
+	}
+
+	// Store 8 registers holding the same 8 elements of 8 objects as 8 rows of 8 elements
+	TARGET_AVX2 void StoreTransposed8x8(const __m256* elements, float* destination, size_t stride)
+	{
+		__m256 t0 = _mm256_unpacklo_ps(elements[0], elements[1]);
+		__m256 t1 = _mm256_unpackhi_ps(elements[0], elements[1]);
+		__m256 t2 = _mm256_unpacklo_ps(elements[2], elements[3]);
+		__m256 t3 = _mm256_unpackhi_ps(elements[2], elements[3]);
+		__m256 t4 = _mm256_unpacklo_ps(elements[4], elements[5]);
+		__m256 t5 = _mm256_unpackhi_ps(elements[4], elements[5]);
+		__m256 t6 = _mm256_unpacklo_ps(elements[6], elements[7]);
+		__m256 t7 = _mm256_unpackhi_ps(elements[6], elements[7]);
+
+		__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+		_mm256_storeu_ps(destination + 0 * stride, _mm256_permute2f128_ps(s0, s4, 0x20));
+		_mm256_storeu_ps(destination + 1 * stride, _mm256_permute2f128_ps(s1, s5, 0x20));
+		_mm256_storeu_ps(destination + 2 * stride, _mm256_permute2f128_ps(s2, s6, 0x20));
+		_mm256_storeu_ps(destination + 3 * stride, _mm256_permute2f128_ps(s3, s7, 0x20));
+		_mm256_storeu_ps(destination + 4 * stride, _mm256_permute2f128_ps(s0, s4, 0x31));
+		_mm256_storeu_ps(destination + 5 * stride, _mm256_permute2f128_ps(s1, s5, 0x31));
+		_mm256_storeu_ps(destination + 6 * stride, _mm256_permute2f128_ps(s2, s6, 0x31));
+		_mm256_storeu_ps(destination + 7 * stride, _mm256_permute2f128_ps(s3, s7, 0x31));
+	}
+
+	// 8 objects per instruction, same layout as the SSE2 kernel with FMA for the products
+	TARGET_AVX2 void BatchTransformAVX2(const TransformArrays& transforms, uint32_t first, uint32_t count, const float* viewProjection, float* matrices)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 zero = _mm256_setzero_ps();
+
+		uint32_t i = first;
+		for (; i + 8 <= first + count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(transforms.rotationX + i);
+			__m256 y = _mm256_loadu_ps(transforms.rotationY + i);
+			__m256 z = _mm256_loadu_ps(transforms.rotationZ + i);
+			__m256 w = _mm256_loadu_ps(transforms.rotationW + i);
+			__m256 sx = _mm256_loadu_ps(transforms.scaleX + i);
+			__m256 sy = _mm256_loadu_ps(transforms.scaleY + i);
+			__m256 sz = _mm256_loadu_ps(transforms.scaleZ + i);
+
+			// Doubled once here instead of once per element
+			__m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+			__m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+			__m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+			__m256 xw = _mm256_mul_ps(x2, w), yw = _mm256_mul_ps(y2, w), zw = _mm256_mul_ps(z2, w);
+
+			__m256 world[12] = {
+				_mm256_mul_ps(sx, _mm256_sub_ps(one, _mm256_add_ps(yy, zz))),
+				_mm256_mul_ps(sy, _mm256_sub_ps(xy, zw)),
+				_mm256_mul_ps(sz, _mm256_add_ps(xz, yw)),
+				_mm256_loadu_ps(transforms.positionX + i),
+				_mm256_mul_ps(sx, _mm256_add_ps(xy, zw)),
+				_mm256_mul_ps(sy, _mm256_sub_ps(one, _mm256_add_ps(xx, zz))),
+				_mm256_mul_ps(sz, _mm256_sub_ps(yz, xw)),
+				_mm256_loadu_ps(transforms.positionY + i),
+				_mm256_mul_ps(sx, _mm256_sub_ps(xz, yw)),
+				_mm256_mul_ps(sy, _mm256_add_ps(yz, xw)),
+				_mm256_mul_ps(sz, _mm256_sub_ps(one, _mm256_add_ps(xx, yy))),
+				_mm256_loadu_ps(transforms.positionZ + i),
+			};
+
+			__m256 out[16];
+			for (int row = 0; row < 4; row++)
+			{
+				for (int column = 0; column < 4; column++)
+				{
+					if (viewProjection)
+					{
+						const float* vp = viewProjection + row * 4;
+						__m256 value = column == 3 ? _mm256_set1_ps(vp[3]) : zero;
+						value = _mm256_fmadd_ps(_mm256_set1_ps(vp[2]), world[8 + column], value);
+						value = _mm256_fmadd_ps(_mm256_set1_ps(vp[1]), world[4 + column], value);
+						out[row * 4 + column] = _mm256_fmadd_ps(_mm256_set1_ps(vp[0]), world[column], value);
+					}
+					else
+					{
+						out[row * 4 + column] = row < 3 ? world[row * 4 + column] : (column == 3 ? one : zero);
+					}
+				}
+			}
+
+			// Elements 0-7 then 8-15 of the 8 matrices
+			float* destination = matrices + static_cast<size_t>(i) * 16;
+			StoreTransposed8x8(out, destination, 16);
+			StoreTransposed8x8(out + 8, destination + 8, 16);
+		}
+		BatchTransformScalar(transforms, i, first + count - i, viewProjection, matrices);
+	}
+#endif
+
+	void RunBatchTransform(const TransformArrays& transforms, uint32_t count, const float* viewProjection, float* matrices, JobSystem* pool, SimdIsa isa)
+	{
+		BatchTransformFunction kernel = GetBatchTransformFunction(isa);
+		if (!pool || pool->GetThreadCount() == 1 || count < kBatchTransformParallelThreshold)
+		{
+			kernel(transforms, 0, count, viewProjection, matrices);
+			return;
+		}
+
+		// Chunks write disjoint ranges of matrices, nothing to synchronize
+		uint32_t chunkCount = (count + kBatchTransformChunkSize - 1) / kBatchTransformChunkSize;
+		pool->ParallelFor(chunkCount, [&](uint32_t chunk, uint32_t)
+		{
+			uint32_t first = chunk * kBatchTransformChunkSize;
+			uint32_t chunkSize = count - first < kBatchTransformChunkSize ? count - first : kBatchTransformChunkSize;
+			kernel(transforms, first, chunkSize, viewProjection, matrices);
+		});
+	}
+}
+
+BatchTransformFunction GetBatchTransformFunction(SimdIsa isa)
+{
+	switch (ClampSimdIsa(isa))
+	{
+#if CPU_FEATURES_X86
+	case SimdIsa::AVX2:
+		return BatchTransformAVX2;
+	case SimdIsa::SSE2:
+		return BatchTransformSSE2;
+#endif
+	default:
+		return BatchTransformScalar;
+	}
+}
+
+void ComputeWorldMatrices(const TransformArrays& transforms, uint32_t count, float* matrices, JobSystem* pool, SimdIsa isa)
+{
+	RunBatchTransform(transforms, count, nullptr, matrices, pool, isa);
+}
+
+void ComputeWorldViewProjectionMatrices(const TransformArrays& transforms, uint32_t count, const float viewProjection[16], float* matrices, JobSystem* pool, SimdIsa isa)
+{
+	RunBatchTransform(transforms, count, viewProjection, matrices, pool, isa);
+}
+
+bool ValidateBatchTransform(SimdIsa isa, uint32_t seed, int iterations)
+{
+	BatchTransformFunction reference = GetBatchTransformFunction(SimdIsa::Scalar);
+	BatchTransformFunction tested = GetBatchTransformFunction(isa);
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> positionRange(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> unitRange(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scaleRange(0.1f, 10.0f);
+	std::uniform_int_distribution<uint32_t> countRange(1, 67); // odd sizes to hit the leftover path
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		uint32_t count = countRange(random);
+		std::vector<float> components(10 * count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			float quaternion[4] = { unitRange(random), unitRange(random), unitRange(random), unitRange(random) };
+			float length = std::sqrt(quaternion[0] * quaternion[0] + quaternion[1] * quaternion[1] + quaternion[2] * quaternion[2] + quaternion[3] * quaternion[3]);
+			for (int c = 0; c < 3; c++)
+			{
+				components[c * count + i] = positionRange(random);
+				components[(7 + c) * count + i] = scaleRange(random);
+			}
+			for (int c = 0; c < 4; c++)
+			{
+				components[(3 + c) * count + i] = length > 0.0f ? quaternion[c] / length : (c == 3 ? 1.0f : 0.0f);
+			}
+		}
+		const float* data = components.data();
+		TransformArrays transforms = { data, data + count, data + 2 * count, data + 3 * count, data + 4 * count, data + 5 * count, data + 6 * count, data + 7 * count, data + 8 * count, data + 9 * count };
+
+		float viewProjection[16];
+		for (float& value : viewProjection)
+		{
+			value = unitRange(random);
+		}
+
+		// World only, then with the view-projection
+		for (int pass = 0; pass < 2; pass++)
+		{
+			const float* vp = pass == 0 ? nullptr : viewProjection;
+			std::vector<float> expected(16 * count);
+			std::vector<float> result(16 * count);
+			reference(transforms, 0, count, vp, expected.data());
+			tested(transforms, 0, count, vp, result.data());
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				// FMA and the operation order change the rounding, nothing else
+				if (std::fabs(result[i] - expected[i]) > 1e-4f * (1.0f + std::fabs(expected[i])))
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
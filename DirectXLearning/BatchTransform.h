@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include "CpuFeatures.h"
+
+class JobSystem;
+
+// World and world-view-projection matrices for many objects at once
+//
+// Objects are stored as structure of arrays (one array per component), so the
+// kernels load 4 (SSE2) or 8 (AVX2) objects per instruction and build all their
+// matrices side by side, then transpose the lanes into one 16 float matrix per object.
+// Big batches are split into chunks and spread over a JobSystem.
+//
+// World = scale * rotation * translation (row vectors, like SimdMath/DirectXMath).
+// Output matrices are transposed, ready to be copied into a constant buffer.
+
+// Below this many objects a batch runs on the calling thread only
+const uint32_t kBatchTransformParallelThreshold = 4096;
+
+// Objects per task when a batch is split over a JobSystem (a multiple of the SIMD width)
+const uint32_t kBatchTransformChunkSize = 1024;
+
+// One array per component, all of them count long
+struct TransformArrays
+{
+	const float* positionX;
+	const float* positionY;
+	const float* positionZ;
+	// Unit quaternions
+	const float* rotationX;
+	const float* rotationY;
+	const float* rotationZ;
+	const float* rotationW;
+	const float* scaleX;
+	const float* scaleY;
+	const float* scaleZ;
+};
+
+// Build the transposed matrices of objects [first, first + count) into matrices + first * 16
+// viewProjection is transposed too (like the constant buffer), null writes the world matrices
+typedef void (*BatchTransformFunction)(const TransformArrays& transforms, uint32_t first, uint32_t count, const float* viewProjection, float* matrices);
+
+// Kernel for an instruction set (clamped to what the CPU supports)
+BatchTransformFunction GetBatchTransformFunction(SimdIsa isa);
+
+// Transposed world matrices of count objects, 16 floats each
+// pool can be null, it is only used for batches of kBatchTransformParallelThreshold objects and more
+void ComputeWorldMatrices(const TransformArrays& transforms, uint32_t count, float* matrices, JobSystem* pool, SimdIsa isa = GetBestSimdIsa());
+
+// Transposed world * viewProjection matrices of count objects, viewProjection is transposed as well
+void ComputeWorldViewProjectionMatrices(const TransformArrays& transforms, uint32_t count, const float viewProjection[16], float* matrices, JobSystem* pool, SimdIsa isa = GetBestSimdIsa());
+
+// Run random transforms through the kernel of an instruction set and compare with the
+// scalar reference, returns false when an element is off by more than rounding
+bool ValidateBatchTransform(SimdIsa isa, uint32_t seed, int iterations);
@@ -0,0 +1,49 @@
+#include "CameraController.h"
+
+bool CameraController::Update(const CameraInput& input, float deltaTime)
+{
+	bool moved = input.forward || input.back || input.left || input.right;
+	SimdMath::Vector forward = SimdMath::Vector3Normalize(
+		SimdMath::VectorSubtract(m_target, m_position)
+	);
+
+	SimdMath::Vector right = SimdMath::Vector3Normalize(
+		SimdMath::Vector3Cross(forward, m_up)
+	);
+
+	if (input.forward) {
+		m_position = SimdMath::VectorAdd(m_position, SimdMath::VectorScale(forward, m_moveSpeed * deltaTime));
+		m_target = SimdMath::VectorAdd(m_target, SimdMath::VectorScale(forward, m_moveSpeed * deltaTime));
+	}
+	if (input.back) {
+		m_position = SimdMath::VectorSubtract(m_position, SimdMath::VectorScale(forward, m_moveSpeed * deltaTime));
+		m_target = SimdMath::VectorSubtract(m_target, SimdMath::VectorScale(forward, m_moveSpeed * deltaTime));
+	}
+	if (input.left) {
+		m_position = SimdMath::VectorSubtract(m_position, SimdMath::VectorScale(right, m_moveSpeed * deltaTime));
+		m_target = SimdMath::VectorSubtract(m_target, SimdMath::VectorScale(right, m_moveSpeed * deltaTime));
+	}
+	if (input.right) {
+		m_position = SimdMath::VectorAdd(m_position, SimdMath::VectorScale(right, m_moveSpeed * deltaTime));
+		m_target = SimdMath::VectorAdd(m_target, SimdMath::VectorScale(right, m_moveSpeed * deltaTime));
+	}
+
+	// Mouse look, turns the direction to the target around the position
+	// Holding the button without moving the mouse keeps the view as it is
+	if (input.look && (input.mouseDeltaX != 0 || input.mouseDeltaY != 0)) {
+		float yawChange = input.mouseDeltaX * m_mouseSensitivity;
+		float pitchChange = input.mouseDeltaY * m_mouseSensitivity;
+		SimdMath::Matrix rotationMatrix = SimdMath::MatrixRotationRollPitchYaw(pitchChange, yawChange, 0);
+		SimdMath::Vector directionVector = SimdMath::VectorSubtract(m_target, m_position);
+		directionVector = SimdMath::Vector3Transform(directionVector, rotationMatrix);
+		m_target = SimdMath::VectorAdd(m_position, directionVector);
+		moved = true;
+	}
+	return moved;
+}
+
+void CameraController::SetPosition(SimdMath::Vector position, SimdMath::Vector target)
+{
+	m_position = position;
+	m_target = target;
+}
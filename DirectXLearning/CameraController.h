@@ -0,0 +1,42 @@
+#pragma once
+#include "SimdMath.h"
+
+// What moves the camera in a frame, the keys and mouse of the window or a scripted path
+struct CameraInput
+{
+	bool forward; // W
+	bool back; // S
+	bool left; // A
+	bool right; // D
+	bool look; // right mouse button held, the mouse deltas turn the view
+	int mouseDeltaX;
+	int mouseDeltaY;
+};
+
+// Fly camera: WASD moves the position and the target together, the mouse turns the target
+// around the position. GraphicsEngine drives it from the window, the benchmark from a script,
+// so both move the same way for the same input.
+class CameraController
+{
+public:
+	// Returns true when the camera moved (the view has to be rebuilt)
+	bool Update(const CameraInput& input, float deltaTime);
+
+	void SetPosition(SimdMath::Vector position, SimdMath::Vector target);
+	SimdMath::Vector GetPosition() const { return m_position; }
+	SimdMath::Vector GetTarget() const { return m_target; }
+	SimdMath::Vector GetUp() const { return m_up; }
+
+	// Left-handed look-at view of the camera, not transposed
+	SimdMath::Matrix GetView() const { return SimdMath::MatrixLookAtLH(m_position, m_target, m_up); }
+
+	float GetMoveSpeed() const { return m_moveSpeed; }
+	void SetMoveSpeed(float moveSpeed) { m_moveSpeed = moveSpeed; }
+
+private:
+	SimdMath::Vector m_position = SimdMath::VectorSet(0.0f, 0.0f, -5.0f, 1.0f);
+	SimdMath::Vector m_target = SimdMath::VectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	SimdMath::Vector m_up = SimdMath::VectorSet(0.0f, 1.0f, 0.0f, 1.0f);
+	float m_moveSpeed = 3.0f;
+	float m_mouseSensitivity = 0.005f;
+};
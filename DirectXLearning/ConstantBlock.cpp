@@ -0,0 +1,189 @@
+#include "ConstantBlock.h"
+#include <algorithm> // min/max
+#include <cstring> // memcpy, memcmp
+#include <random>
+
+void ConstantBlock::Initialize(uint32_t size)
+{
+	m_data.assign((size + kConstantSize - 1) / kConstantSize * kConstantSize, 0);
+	m_dirtyBegin = 0;
+	m_dirtyEnd = GetSize();
+}
+
+void ConstantBlock::Write(uint32_t offset, const void* data, uint32_t size)
+{
+	if (offset > GetSize() || size > GetSize() - offset)
+	{
+		return;
+	}
+
+	// Trim the bytes that didn't change from both ends
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint8_t* target = m_data.data() + offset;
+	uint32_t first = 0;
+	while (first < size && bytes[first] == target[first])
+	{
+		first++;
+	}
+	if (first == size)
+	{
+		return;
+	}
+	uint32_t last = size;
+	while (bytes[last - 1] == target[last - 1])
+	{
+		last--;
+	}
+	memcpy(target + first, bytes + first, last - first);
+
+	// Grow the dirty range to the constants the changed bytes are in
+	uint32_t begin = (offset + first) / kConstantSize * kConstantSize;
+	uint32_t end = (offset + last + kConstantSize - 1) / kConstantSize * kConstantSize;
+	if (IsDirty())
+	{
+		begin = std::min(begin, m_dirtyBegin);
+		end = std::max(end, m_dirtyEnd);
+	}
+	m_dirtyBegin = begin;
+	m_dirtyEnd = end;
+}
+
+bool ValidateConstantBlock(uint32_t seed, int iterations)
+{
+	// Known writes into a 3 constant block (40 bytes rounded up to 48)
+	ConstantBlock block;
+	block.Initialize(40);
+	if (block.GetSize() != 48 || block.GetDirtyBegin() != 0 || block.GetDirtyEnd() != 48)
+	{
+		return false;
+	}
+	block.ClearDirty();
+
+	struct KnownWrite
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint32_t changed; // bytes changed inside the write, counted from its start
+		uint32_t dirtyBegin; // dirty range after the write, 0/0 for clean
+		uint32_t dirtyEnd;
+	};
+	const KnownWrite kKnownWrites[] =
+	{
+		{ 0, 16, 0, 0, 0 }, // same bytes, stays clean
+		{ 20, 4, 4, 16, 32 }, // one float inside the second constant
+		{ 31, 2, 2, 16, 48 }, // straddles the second and third, grows the range
+		{ 0, 48, 0, 16, 48 }, // the whole block unchanged, nothing grows
+		{ 12, 8, 1, 0, 48 }, // only the first byte differs, the first constant joins
+	};
+	for (const KnownWrite& write : kKnownWrites)
+	{
+		uint8_t bytes[48];
+		memcpy(bytes, block.GetData() + write.offset, write.size);
+		for (uint32_t i = 0; i < write.changed; i++)
+		{
+			bytes[i]++;
+		}
+		block.Write(write.offset, bytes, write.size);
+		if (block.GetDirtyBegin() != write.dirtyBegin || block.GetDirtyEnd() != write.dirtyEnd
+			|| memcmp(block.GetData() + write.offset, bytes, write.size) != 0)
+		{
+			return false;
+		}
+	}
+
+	// Writes past the end are dropped whole
+	block.ClearDirty();
+	uint8_t outside[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	block.Write(44, outside, 8);
+	block.Write(49, outside, 1);
+	if (block.IsDirty())
+	{
+		return false;
+	}
+
+	// Random writes, some of them with bytes the block already holds, checked against a plain
+	// copy: the upload must cover exactly the constants with a changed byte
+	std::mt19937 random(seed);
+	ConstantUploadStats stats = {};
+	uint64_t expectedUploaded = 0;
+	uint32_t expectedUploads = 0;
+	uint32_t expectedTotal = 0;
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		uint32_t size = 1 + random() % 512;
+		block.Initialize(size);
+		uint32_t roundedSize = (size + kConstantSize - 1) / kConstantSize * kConstantSize;
+		std::vector<uint8_t> copy(roundedSize, 0);
+		if (block.GetSize() != roundedSize)
+		{
+			return false;
+		}
+		block.ClearDirty();
+
+		for (int frame = 0; frame < 16; frame++)
+		{
+			uint32_t changedBegin = roundedSize;
+			uint32_t changedEnd = 0;
+			uint32_t writes = random() % 4;
+			for (uint32_t i = 0; i < writes; i++)
+			{
+				uint32_t offset = random() % roundedSize;
+				uint32_t length = 1 + random() % (roundedSize - offset);
+				std::vector<uint8_t> bytes(copy.begin() + offset, copy.begin() + offset + length);
+				for (uint8_t& byte : bytes)
+				{
+					if (random() % 8 == 0)
+					{
+						byte = static_cast<uint8_t>(random());
+					}
+				}
+				for (uint32_t b = 0; b < length; b++)
+				{
+					if (bytes[b] != copy[offset + b])
+					{
+						changedBegin = std::min(changedBegin, offset + b);
+						changedEnd = std::max(changedEnd, offset + b + 1);
+					}
+				}
+				memcpy(copy.data() + offset, bytes.data(), length);
+				block.Write(offset, bytes.data(), length);
+			}
+
+			// The upload: what UploadConstants sends, the whole block when it could only update it all
+			stats.bytesTotal += block.GetSize();
+			expectedTotal += roundedSize;
+			if (changedBegin < changedEnd)
+			{
+				uint32_t begin = changedBegin / kConstantSize * kConstantSize;
+				uint32_t end = (changedEnd + kConstantSize - 1) / kConstantSize * kConstantSize;
+				if (!block.IsDirty() || block.GetDirtyBegin() != begin || block.GetDirtyEnd() != end)
+				{
+					return false;
+				}
+				expectedUploaded += end - begin;
+				expectedUploads++;
+			}
+			else if (block.IsDirty())
+			{
+				return false;
+			}
+			if (memcmp(block.GetData(), copy.data(), roundedSize) != 0)
+			{
+				return false;
+			}
+
+			if (block.IsDirty())
+			{
+				if (block.GetDirtyBegin() % kConstantSize != 0 || block.GetDirtyEnd() % kConstantSize != 0 || block.GetDirtyEnd() > block.GetSize())
+				{
+					return false;
+				}
+				stats.uploads++;
+				stats.bytesUploaded += block.GetDirtyEnd() - block.GetDirtyBegin();
+				block.ClearDirty();
+			}
+		}
+	}
+	return stats.uploads == expectedUploads && stats.bytesUploaded == expectedUploaded
+		&& stats.bytesTotal == expectedTotal && stats.bytesUploaded <= stats.bytesTotal;
+}
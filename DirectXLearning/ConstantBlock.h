@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <vector>
+
+// CPU copy of a constant buffer that knows which bytes changed since the last upload
+//
+// Constant data is split in blocks by how often it changes (per frame, per pass, per
+// object) and every block is uploaded on its own. Writes are compared with the copy,
+// only the bytes that really changed grow the dirty range, and the upload only sends
+// that range, rounded out to 16 bytes (one constant, the granularity of partial
+// constant buffer updates). A block nobody changed isn't uploaded at all.
+
+// Bytes of one shader constant (float4)
+const uint32_t kConstantSize = 16;
+
+// Upload counters of a frame, to check what the dirty ranges save
+struct ConstantUploadStats
+{
+	uint32_t uploads; // blocks that were dirty and got uploaded
+	uint32_t bytesUploaded; // what they sent
+	uint32_t bytesTotal; // what uploading every block whole would have sent
+};
+
+class ConstantBlock
+{
+public:
+	// size is rounded up to whole constants, the contents start zeroed and dirty
+	void Initialize(uint32_t size);
+
+	// Copy size bytes at offset, the block only becomes dirty where they differ from what it holds
+	void Write(uint32_t offset, const void* data, uint32_t size);
+	template <typename T>
+	void Write(uint32_t offset, const T& value) { Write(offset, &value, sizeof(T)); }
+
+	bool IsDirty() const { return m_dirtyBegin < m_dirtyEnd; }
+	// Dirty bytes, whole constants
+	uint32_t GetDirtyBegin() const { return m_dirtyBegin; }
+	uint32_t GetDirtyEnd() const { return m_dirtyEnd; }
+
+	// Call once the dirty range is uploaded
+	void ClearDirty() { m_dirtyBegin = m_dirtyEnd = 0; }
+
+	const uint8_t* GetData() const { return m_data.data(); }
+	uint32_t GetSize() const { return static_cast<uint32_t>(m_data.size()); }
+
+private:
+	std::vector<uint8_t> m_data;
+	uint32_t m_dirtyBegin = 0;
+	uint32_t m_dirtyEnd = 0;
+};
+
+// Writes known ranges and random ones into blocks of random sizes, checks the dirty range of every
+// upload is exactly the 16 byte constants that changed, and the bytes sent against the whole blocks
+bool ValidateConstantBlock(uint32_t seed, int iterations);
@@ -0,0 +1,74 @@
+#include "CpuFeatures.h"
+
+#if CPU_FEATURES_X86 && defined(_MSC_VER)
+#include <intrin.h> // __cpuid, _xgetbv
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	SimdIsa DetectSimdIsa()
+	{
+#if CPU_FEATURES_X86 && defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+
+		// The OS also has to save the YMM registers on context switches
+		bool ymmEnabled = osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+
+		bool avx2 = false;
+		if (maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		if (avx2 && fma && ymmEnabled)
+		{
+			return SimdIsa::AVX2;
+		}
+		return sse2 ? SimdIsa::SSE2 : SimdIsa::Scalar;
+#elif CPU_FEATURES_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		{
+			return SimdIsa::AVX2;
+		}
+		return __builtin_cpu_supports("sse2") ? SimdIsa::SSE2 : SimdIsa::Scalar;
+#else
+		return SimdIsa::Scalar;
+#endif
+	}
+}
+
+SimdIsa GetBestSimdIsa()
+{
+	static const SimdIsa best = DetectSimdIsa();
+	return best;
+}
+
+SimdIsa ClampSimdIsa(SimdIsa requested)
+{
+	SimdIsa best = GetBestSimdIsa();
+	return static_cast<int>(requested) > static_cast<int>(best) ? best : requested;
+}
+
+const char* GetSimdIsaName(SimdIsa isa)
+{
+	switch (isa)
+	{
+	case SimdIsa::SSE2:
+		return "SSE2";
+	case SimdIsa::AVX2:
+		return "AVX2";
+	default:
+		return "Scalar";
+	}
+}
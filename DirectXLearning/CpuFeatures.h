@@ -0,0 +1,32 @@
+#pragma once
+
+// Instruction sets the CPU code paths can be compiled for, from narrowest to widest
+enum class SimdIsa
+{
+	Scalar, // plain C++, also the reference the SIMD versions are checked against
+	SSE2, // 4 lanes, always there on x64
+	AVX2 // 8 lanes
+};
+
+// Widest instruction set both the compiler and the CPU we run on support
+// Detected once, the result is cached
+SimdIsa GetBestSimdIsa();
+
+// Clamp a requested instruction set to what this machine can run
+SimdIsa ClampSimdIsa(SimdIsa requested);
+
+// Human readable name, for logs and benchmark results
+const char* GetSimdIsaName(SimdIsa isa);
+
+// Compiler specific spelling for "compile this function for AVX2"
+// MSVC lets any function use AVX2 intrinsics, GCC and Clang need the target attribute
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_FEATURES_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#else
+#define CPU_FEATURES_X86 0
+#endif
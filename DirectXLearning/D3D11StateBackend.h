@@ -0,0 +1,51 @@
+#pragma once
+#include <d3d11.h> // Main DirectX 11 header
+#include "StateFilteringContext.h"
+
+// StateBackend of the GPU, every call is the D3D11 call for one slot
+class D3D11StateBackend : public StateBackend
+{
+public:
+	// The context the calls go to, it isn't owned
+	void SetContext(ID3D11DeviceContext* context) { m_context = context; }
+
+	void SetRenderTarget(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil) override
+	{
+		m_context->OMSetRenderTargets(renderTarget ? 1 : 0, &renderTarget, depthStencil);
+	}
+
+	void SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset) override
+	{
+		UINT strides = stride;
+		UINT offsets = offset;
+		m_context->IASetVertexBuffers(slot, 1, &buffer, &strides, &offsets);
+	}
+
+	void SetInputLayout(ID3D11InputLayout* layout) override
+	{
+		m_context->IASetInputLayout(layout);
+	}
+
+	void SetPrimitiveTopology(uint32_t topology) override
+	{
+		m_context->IASetPrimitiveTopology(static_cast<D3D11_PRIMITIVE_TOPOLOGY>(topology));
+	}
+
+	void SetVertexShader(ID3D11VertexShader* shader) override
+	{
+		m_context->VSSetShader(shader, nullptr, 0);
+	}
+
+	void SetPixelShader(ID3D11PixelShader* shader) override
+	{
+		m_context->PSSetShader(shader, nullptr, 0);
+	}
+
+	void SetVertexConstantBuffer(uint32_t slot, ID3D11Buffer* buffer) override
+	{
+		m_context->VSSetConstantBuffers(slot, 1, &buffer);
+	}
+
+private:
+	ID3D11DeviceContext* m_context = nullptr;
+};
@@ -0,0 +1,177 @@
+#include "D3D11StateCache.h"
+#include <fstream> // the saved list
+#include <iterator> // istreambuf_iterator
+
+namespace
+{
+	// Start of the file Save writes, the last byte is the version
+	const uint32_t kStateListMagic = 0x01435350; // "PSC" 1
+
+	// The descriptors with padding are copied field by field into zeroed ones, so equal
+	// descriptors have equal bytes whatever the caller left in the padding
+	D3D11_BLEND_DESC ZeroPadding(const D3D11_BLEND_DESC& desc)
+	{
+		D3D11_BLEND_DESC result;
+		memset(&result, 0, sizeof(result));
+		result.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+		result.IndependentBlendEnable = desc.IndependentBlendEnable;
+		for (int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+		{
+			const D3D11_RENDER_TARGET_BLEND_DESC& source = desc.RenderTarget[i];
+			D3D11_RENDER_TARGET_BLEND_DESC& target = result.RenderTarget[i];
+			target.BlendEnable = source.BlendEnable;
+			target.SrcBlend = source.SrcBlend;
+			target.DestBlend = source.DestBlend;
+			target.BlendOp = source.BlendOp;
+			target.SrcBlendAlpha = source.SrcBlendAlpha;
+			target.DestBlendAlpha = source.DestBlendAlpha;
+			target.BlendOpAlpha = source.BlendOpAlpha;
+			target.RenderTargetWriteMask = source.RenderTargetWriteMask;
+		}
+		return result;
+	}
+
+	D3D11_DEPTH_STENCIL_DESC ZeroPadding(const D3D11_DEPTH_STENCIL_DESC& desc)
+	{
+		D3D11_DEPTH_STENCIL_DESC result;
+		memset(&result, 0, sizeof(result));
+		result.DepthEnable = desc.DepthEnable;
+		result.DepthWriteMask = desc.DepthWriteMask;
+		result.DepthFunc = desc.DepthFunc;
+		result.StencilEnable = desc.StencilEnable;
+		result.StencilReadMask = desc.StencilReadMask;
+		result.StencilWriteMask = desc.StencilWriteMask;
+		result.FrontFace = desc.FrontFace;
+		result.BackFace = desc.BackFace;
+		return result;
+	}
+
+	void LogLateCreation(bool loaded, const wchar_t* kind)
+	{
+		if (loaded)
+		{
+			OutputDebugString(L"State object created after loading the list: ");
+			OutputDebugString(kind);
+			OutputDebugString(L"\n");
+		}
+	}
+}
+
+void D3D11StateCache::Initialize(ID3D11Device* device)
+{
+	m_device = device;
+	m_loaded = false;
+	m_loadedCount = 0;
+
+	m_blendStates.Initialize(kCapacity, [this](const D3D11_BLEND_DESC& desc, Microsoft::WRL::ComPtr<ID3D11BlendState>& state)
+	{
+		LogLateCreation(m_loaded, L"blend");
+		return SUCCEEDED(m_device->CreateBlendState(&desc, state.GetAddressOf()));
+	});
+	m_rasterizerStates.Initialize(kCapacity, [this](const D3D11_RASTERIZER_DESC& desc, Microsoft::WRL::ComPtr<ID3D11RasterizerState>& state)
+	{
+		LogLateCreation(m_loaded, L"rasterizer");
+		return SUCCEEDED(m_device->CreateRasterizerState(&desc, state.GetAddressOf()));
+	});
+	m_depthStencilStates.Initialize(kCapacity, [this](const D3D11_DEPTH_STENCIL_DESC& desc, Microsoft::WRL::ComPtr<ID3D11DepthStencilState>& state)
+	{
+		LogLateCreation(m_loaded, L"depth-stencil");
+		return SUCCEEDED(m_device->CreateDepthStencilState(&desc, state.GetAddressOf()));
+	});
+	m_samplerStates.Initialize(kCapacity, [this](const D3D11_SAMPLER_DESC& desc, Microsoft::WRL::ComPtr<ID3D11SamplerState>& state)
+	{
+		LogLateCreation(m_loaded, L"sampler");
+		return SUCCEEDED(m_device->CreateSamplerState(&desc, state.GetAddressOf()));
+	});
+}
+
+ID3D11BlendState* D3D11StateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+	const Microsoft::WRL::ComPtr<ID3D11BlendState>* state = m_blendStates.GetOrCreate(ZeroPadding(desc));
+	return state ? state->Get() : nullptr;
+}
+
+ID3D11RasterizerState* D3D11StateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	const Microsoft::WRL::ComPtr<ID3D11RasterizerState>* state = m_rasterizerStates.GetOrCreate(desc);
+	return state ? state->Get() : nullptr;
+}
+
+ID3D11DepthStencilState* D3D11StateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	const Microsoft::WRL::ComPtr<ID3D11DepthStencilState>* state = m_depthStencilStates.GetOrCreate(ZeroPadding(desc));
+	return state ? state->Get() : nullptr;
+}
+
+ID3D11SamplerState* D3D11StateCache::GetSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	const Microsoft::WRL::ComPtr<ID3D11SamplerState>* state = m_samplerStates.GetOrCreate(desc);
+	return state ? state->Get() : nullptr;
+}
+
+bool D3D11StateCache::Load(const wchar_t* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	uint32_t magic = 0;
+	if (data.size() < sizeof(magic))
+	{
+		return false;
+	}
+	memcpy(&magic, data.data(), sizeof(magic));
+	if (magic != kStateListMagic)
+	{
+		return false;
+	}
+
+	// One list per kind, in the order Save writes them
+	size_t offset = sizeof(magic);
+	size_t read = m_blendStates.Warm(data.data() + offset, data.size() - offset);
+	offset += read;
+	if (read != 0)
+	{
+		read = m_rasterizerStates.Warm(data.data() + offset, data.size() - offset);
+		offset += read;
+	}
+	if (read != 0)
+	{
+		read = m_depthStencilStates.Warm(data.data() + offset, data.size() - offset);
+		offset += read;
+	}
+	if (read != 0)
+	{
+		read = m_samplerStates.Warm(data.data() + offset, data.size() - offset);
+	}
+
+	m_loaded = true;
+	m_loadedCount = GetSize();
+	return read != 0;
+}
+
+bool D3D11StateCache::Save(const wchar_t* path) const
+{
+	std::vector<uint8_t> data(sizeof(kStateListMagic));
+	memcpy(data.data(), &kStateListMagic, sizeof(kStateListMagic));
+	m_blendStates.Serialize(data);
+	m_rasterizerStates.Serialize(data);
+	m_depthStencilStates.Serialize(data);
+	m_samplerStates.Serialize(data);
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return file.good();
+}
+
+uint32_t D3D11StateCache::GetSize() const
+{
+	return m_blendStates.GetSize() + m_rasterizerStates.GetSize() + m_depthStencilStates.GetSize() + m_samplerStates.GetSize();
+}
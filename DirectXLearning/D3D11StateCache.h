@@ -0,0 +1,40 @@
+#pragma once
+#include <d3d11.h> // Main DirectX 11 header
+#include <wrl.h> // ComPtr smart pointers
+#include "StateObjectCache.h"
+
+// Every blend, rasterizer, depth-stencil and sampler state of the engine (see StateObjectCache.h)
+// The same descriptor gives the same object, whoever asks. Load creates the states a previous
+// run saved, so the frames only ever find theirs.
+class D3D11StateCache
+{
+public:
+	// States of each kind the cache can hold
+	static constexpr uint32_t kCapacity = 256;
+
+	void Initialize(ID3D11Device* device);
+
+	// Null when the device refuses the descriptor or the cache is full
+	ID3D11BlendState* GetBlendState(const D3D11_BLEND_DESC& desc);
+	ID3D11RasterizerState* GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+	ID3D11DepthStencilState* GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	ID3D11SamplerState* GetSamplerState(const D3D11_SAMPLER_DESC& desc);
+
+	// Create every state listed in a file written by Save, false when there is none or it's from another version
+	bool Load(const wchar_t* path);
+	bool Save(const wchar_t* path) const;
+
+	// States created since Load, the list is worth saving again when there are some
+	uint32_t GetCreatedSinceLoad() const { return GetSize() - m_loadedCount; }
+
+private:
+	uint32_t GetSize() const;
+
+	Microsoft::WRL::ComPtr<ID3D11Device> m_device;
+	StateObjectCache<D3D11_BLEND_DESC, Microsoft::WRL::ComPtr<ID3D11BlendState>> m_blendStates;
+	StateObjectCache<D3D11_RASTERIZER_DESC, Microsoft::WRL::ComPtr<ID3D11RasterizerState>> m_rasterizerStates;
+	StateObjectCache<D3D11_DEPTH_STENCIL_DESC, Microsoft::WRL::ComPtr<ID3D11DepthStencilState>> m_depthStencilStates;
+	StateObjectCache<D3D11_SAMPLER_DESC, Microsoft::WRL::ComPtr<ID3D11SamplerState>> m_samplerStates;
+	bool m_loaded = false; // creating a state after that means the list was missing it
+	uint32_t m_loadedCount = 0;
+};
@@ -0,0 +1,40 @@
+#include "D3DShaderCompiler.h"
+#include <windows.h> // Windows header
+#include <d3dcompiler.h> // D3DCompileFromFile
+#include <wrl.h> // ComPtr smart pointers
+
+#pragma comment(lib, "d3dcompiler.lib")
+
+bool D3DShaderCompiler::Compile(const ShaderCompileDesc& desc, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+	// Null terminated list, the strings stay in desc
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const ShaderDefine& define : desc.defines)
+	{
+		macros.push_back({ define.name.c_str(), define.value.c_str() });
+	}
+	macros.push_back({ nullptr, nullptr });
+
+	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> errorBlob;
+	std::wstring widePath(desc.path.begin(), desc.path.end());
+	HRESULT hr = D3DCompileFromFile(widePath.c_str(),
+		macros.data(), // defines of the permutation
+		D3D_COMPILE_STANDARD_FILE_INCLUDE, // the includes the cache key follows
+		desc.entryPoint.c_str(), // entry point function name
+		desc.target.c_str(), // shader model
+		desc.flags, // shader compile options
+		0, // effect compile options
+		shaderBlob.GetAddressOf(), // compiled shader
+		errorBlob.GetAddressOf() // error messages
+	);
+
+	if (FAILED(hr)) {
+		errors = errorBlob ? std::string(static_cast<const char*>(errorBlob->GetBufferPointer()), errorBlob->GetBufferSize())
+			: desc.path + ": can't compile the shader";
+		return false;
+	}
+	const uint8_t* data = static_cast<const uint8_t*>(shaderBlob->GetBufferPointer());
+	bytecode.assign(data, data + shaderBlob->GetBufferSize());
+	return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "ShaderPermutationList.h" // kD3DCompilerTag
+#include "ShaderPermutations.h"
+
+// ShaderCompiler over D3DCompileFromFile, the defines become the D3D_SHADER_MACROs and the
+// includes go through the standard include handler (relative to the including file, like
+// ComputeShaderKey follows them). D3DCompile is thread safe, so is this.
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	uint32_t GetTag() const override { return kD3DCompilerTag; }
+	bool Compile(const ShaderCompileDesc& desc, std::vector<uint8_t>& bytecode, std::string& errors) override;
+};
@@ -0,0 +1,251 @@
+#include "DrawQueue.h"
+#include <algorithm> // stable_sort
+#include <cstring> // memcpy
+#include <random>
+
+namespace
+{
+	// Writes down every call in the order Submit made it
+	class RecordingSubmitter : public DrawSubmitter
+	{
+	public:
+		enum CallType { kPass, kShader, kMaterial, kDraw };
+		struct Call
+		{
+			CallType type;
+			uint32_t value; // the bound field, or the draw's object
+		};
+
+		std::vector<Call> calls;
+
+		void BindPass(uint32_t pass) override { calls.push_back({ kPass, pass }); }
+		void BindShader(uint32_t shader) override { calls.push_back({ kShader, shader }); }
+		void BindMaterial(uint32_t material) override { calls.push_back({ kMaterial, material }); }
+		void SubmitDraw(const DrawCommand& command) override { calls.push_back({ kDraw, command.object }); }
+	};
+}
+
+uint32_t GetDrawKeyDepth(float depth, bool backToFront)
+{
+	if (!(depth > 0.0f))
+	{
+		depth = 0.0f; // negative, -0 and NaN all go first
+	}
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return backToFront ? ~bits : bits;
+}
+
+void DrawQueue::Clear()
+{
+	m_commands.clear();
+	m_entries.clear();
+	m_sorted = true;
+}
+
+void DrawQueue::Add(uint64_t key, const DrawCommand& command)
+{
+	m_entries.push_back({ key, static_cast<uint32_t>(m_commands.size()) });
+	m_commands.push_back(command);
+	m_sorted = false;
+}
+
+void DrawQueue::Sort()
+{
+	if (m_sorted)
+	{
+		return;
+	}
+	m_sorted = true;
+
+	uint32_t count = GetDrawCount();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// Histograms of the 8 bytes in one read of the keys
+	uint32_t histograms[8][256] = {};
+	for (const Entry& entry : m_entries)
+	{
+		for (int digit = 0; digit < 8; digit++)
+		{
+			histograms[digit][(entry.key >> (digit * 8)) & 0xFF]++;
+		}
+	}
+
+	m_scratch.resize(count);
+	Entry* source = m_entries.data();
+	Entry* destination = m_scratch.data();
+
+	for (int digit = 0; digit < 8; digit++)
+	{
+		uint32_t* histogram = histograms[digit];
+
+		// Every key has the same byte here, this pass wouldn't move anything
+		if (histogram[(source[0].key >> (digit * 8)) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Counts to first positions
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t bucketSize = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketSize;
+		}
+
+		// Stable scatter, equal bytes keep the order of the previous pass
+		for (uint32_t i = 0; i < count; i++)
+		{
+			destination[histogram[(source[i].key >> (digit * 8)) & 0xFF]++] = source[i];
+		}
+
+		Entry* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	// Odd number of passes, the result is in the scratch buffer
+	if (source != m_entries.data())
+	{
+		m_entries.swap(m_scratch);
+	}
+}
+
+void DrawQueue::Submit(DrawSubmitter& submitter)
+{
+	Sort();
+	m_stats = {};
+
+	bool first = true;
+	uint64_t previousKey = 0;
+	for (const Entry& entry : m_entries)
+	{
+		uint32_t pass = GetDrawKeyPass(entry.key);
+		uint32_t shader = GetDrawKeyShader(entry.key);
+		uint32_t material = GetDrawKeyMaterial(entry.key);
+
+		if (first || pass != GetDrawKeyPass(previousKey))
+		{
+			submitter.BindPass(pass);
+			m_stats.passChanges++;
+		}
+		if (first || shader != GetDrawKeyShader(previousKey))
+		{
+			submitter.BindShader(shader);
+			m_stats.shaderChanges++;
+		}
+		if (first || material != GetDrawKeyMaterial(previousKey))
+		{
+			submitter.BindMaterial(material);
+			m_stats.materialChanges++;
+		}
+
+		submitter.SubmitDraw(m_commands[entry.command]);
+		m_stats.draws++;
+
+		first = false;
+		previousKey = entry.key;
+	}
+}
+
+bool ValidateDrawQueue(uint32_t seed, int iterations)
+{
+	std::mt19937 random(seed);
+
+	// The same queue all along, Clear must leave nothing of the last round behind
+	DrawQueue queue;
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		// Some bytes are the same in every key (their pass is skipped), the others take a few
+		// values so whole keys repeat and the order between them is the insertion order
+		uint64_t base = (static_cast<uint64_t>(random()) << 32) | random();
+		uint32_t varying = random() & 0xFF;
+		uint32_t values = 1 + random() % 8;
+		uint32_t count = random() % 2000;
+
+		queue.Clear();
+		std::vector<uint64_t> keys(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t key = base;
+			for (int digit = 0; digit < 8; digit++)
+			{
+				if (varying & (1u << digit))
+				{
+					key &= ~(0xFFull << (digit * 8));
+					key |= static_cast<uint64_t>(((random() % values) * 37) & 0xFF) << (digit * 8);
+				}
+			}
+			keys[i] = key;
+
+			DrawCommand command = {};
+			command.object = i;
+			queue.Add(key, command);
+		}
+
+		std::vector<uint32_t> expected(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			expected[i] = i;
+		}
+		std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+		// Half the time Submit sorts by itself
+		if (random() % 2 == 0)
+		{
+			queue.Sort();
+		}
+		RecordingSubmitter submitter;
+		queue.Submit(submitter);
+
+		// The binds a draw needs: all of them on the first, then each field that changed
+		std::vector<RecordingSubmitter::Call> expectedCalls;
+		DrawQueueStats expectedStats = {};
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t key = keys[expected[i]];
+			uint64_t previous = i > 0 ? keys[expected[i - 1]] : 0;
+			if (i == 0 || GetDrawKeyPass(key) != GetDrawKeyPass(previous))
+			{
+				expectedCalls.push_back({ RecordingSubmitter::kPass, GetDrawKeyPass(key) });
+				expectedStats.passChanges++;
+			}
+			if (i == 0 || GetDrawKeyShader(key) != GetDrawKeyShader(previous))
+			{
+				expectedCalls.push_back({ RecordingSubmitter::kShader, GetDrawKeyShader(key) });
+				expectedStats.shaderChanges++;
+			}
+			if (i == 0 || GetDrawKeyMaterial(key) != GetDrawKeyMaterial(previous))
+			{
+				expectedCalls.push_back({ RecordingSubmitter::kMaterial, GetDrawKeyMaterial(key) });
+				expectedStats.materialChanges++;
+			}
+			expectedCalls.push_back({ RecordingSubmitter::kDraw, expected[i] });
+			expectedStats.draws++;
+		}
+
+		if (submitter.calls.size() != expectedCalls.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < expectedCalls.size(); i++)
+		{
+			if (submitter.calls[i].type != expectedCalls[i].type || submitter.calls[i].value != expectedCalls[i].value)
+			{
+				return false;
+			}
+		}
+
+		const DrawQueueStats& stats = queue.GetStats();
+		if (stats.draws != expectedStats.draws || stats.passChanges != expectedStats.passChanges
+			|| stats.shaderChanges != expectedStats.shaderChanges || stats.materialChanges != expectedStats.materialChanges)
+		{
+			return false;
+		}
+	}
+	return true;
+}
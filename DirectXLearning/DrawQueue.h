@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <vector>
+
+// Draw submission sorted by pipeline state
+//
+// Every draw of the frame is added with a 64 bit key, most significant bits first:
+//   pass (4 bits) | shader (12 bits) | material (16 bits) | depth (32 bits)
+// Sorting the keys groups the draws by pass, then by shader, then by material, and
+// orders them by depth inside a group. Submit walks the sorted draws and only binds
+// the parts of the state that differ from the previous draw, so a frame with
+// thousands of draws pays for one bind per distinct shader/material, not per draw.
+//
+// The sort is an LSD radix sort on the keys, 8 bits per pass, and the passes where
+// every key has the same byte (unused fields, a single shader...) are skipped.
+
+const int kDrawKeyPassBits = 4;
+const int kDrawKeyShaderBits = 12;
+const int kDrawKeyMaterialBits = 16;
+const int kDrawKeyDepthBits = 32;
+
+const int kDrawKeyDepthShift = 0;
+const int kDrawKeyMaterialShift = kDrawKeyDepthShift + kDrawKeyDepthBits;
+const int kDrawKeyShaderShift = kDrawKeyMaterialShift + kDrawKeyMaterialBits;
+const int kDrawKeyPassShift = kDrawKeyShaderShift + kDrawKeyShaderBits;
+
+// Fields are truncated to their number of bits
+inline uint64_t MakeDrawKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t depth)
+{
+	return (static_cast<uint64_t>(pass & ((1u << kDrawKeyPassBits) - 1)) << kDrawKeyPassShift)
+		| (static_cast<uint64_t>(shader & ((1u << kDrawKeyShaderBits) - 1)) << kDrawKeyShaderShift)
+		| (static_cast<uint64_t>(material & ((1u << kDrawKeyMaterialBits) - 1)) << kDrawKeyMaterialShift)
+		| (static_cast<uint64_t>(depth) << kDrawKeyDepthShift);
+}
+
+inline uint32_t GetDrawKeyPass(uint64_t key) { return static_cast<uint32_t>(key >> kDrawKeyPassShift) & ((1u << kDrawKeyPassBits) - 1); }
+inline uint32_t GetDrawKeyShader(uint64_t key) { return static_cast<uint32_t>(key >> kDrawKeyShaderShift) & ((1u << kDrawKeyShaderBits) - 1); }
+inline uint32_t GetDrawKeyMaterial(uint64_t key) { return static_cast<uint32_t>(key >> kDrawKeyMaterialShift) & ((1u << kDrawKeyMaterialBits) - 1); }
+
+// Depth field of a key from a depth >= 0 (view depth, or anything that grows with the distance)
+// Positive floats sort like their bit patterns, so nothing is lost to quantization
+// Opaque passes want front to back (less overdraw), transparent ones back to front
+uint32_t GetDrawKeyDepth(float depth, bool backToFront);
+
+// What a draw does once its state is bound
+struct DrawCommand
+{
+	uint32_t vertexCount; // per instance for instanced draws
+	uint32_t startVertex;
+	uint32_t instanceCount; // 0 for a non-instanced draw
+	uint32_t startInstance;
+	uint32_t object; // up to the caller (constants to use, instance data...)
+};
+
+// Receives the sorted draws, implemented by the renderer
+class DrawSubmitter
+{
+public:
+	virtual ~DrawSubmitter() = default;
+
+	virtual void BindPass(uint32_t pass) = 0;
+	virtual void BindShader(uint32_t shader) = 0;
+	virtual void BindMaterial(uint32_t material) = 0;
+	virtual void SubmitDraw(const DrawCommand& command) = 0;
+};
+
+// Counters of the last Submit
+struct DrawQueueStats
+{
+	uint32_t draws;
+	uint32_t passChanges;
+	uint32_t shaderChanges;
+	uint32_t materialChanges;
+};
+
+class DrawQueue
+{
+public:
+	// Forget the draws of the last frame (keeps the memory)
+	void Clear();
+
+	void Add(uint64_t key, const DrawCommand& command);
+
+	// Order the draws by key, draws with the same key keep the order they were added in
+	void Sort();
+
+	// Send the draws in key order, the first draw binds everything, the next ones only what changed
+	// Sorts first if the queue isn't sorted yet
+	void Submit(DrawSubmitter& submitter);
+
+	uint32_t GetDrawCount() const { return static_cast<uint32_t>(m_entries.size()); }
+	const DrawQueueStats& GetStats() const { return m_stats; }
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t command; // index in m_commands
+	};
+
+	std::vector<DrawCommand> m_commands;
+	std::vector<Entry> m_entries;
+	std::vector<Entry> m_scratch; // other half of the radix sort ping-pong
+	bool m_sorted = true;
+	DrawQueueStats m_stats = {};
+};
+
+// Sorts random keys (repeated keys, bytes every key shares) and checks the order against
+// std::stable_sort, then the binds Submit makes and its stats against the changes in that order
+bool ValidateDrawQueue(uint32_t seed, int iterations);
@@ -0,0 +1,424 @@
+#include "FrameStats.h"
+#include <algorithm> // sort
+#include <cmath> // ceil
+#include <cstdio> // snprintf
+#include <fstream>
+#include <random>
+
+namespace
+{
+	uint64_t ToMicroseconds(double seconds)
+	{
+		return seconds > 0.0 ? static_cast<uint64_t>(seconds * 1000000.0 + 0.5) : 0;
+	}
+
+	// Index of the highest set bit, value isn't 0
+	uint32_t GetHighestBit(uint64_t value)
+	{
+		uint32_t bit = 0;
+		for (uint32_t shift = 32; shift > 0; shift /= 2)
+		{
+			if (value >> shift)
+			{
+				value >>= shift;
+				bit += shift;
+			}
+		}
+		return bit;
+	}
+
+	// Rank of a percentile in count sorted values, 1 based
+	uint64_t GetRank(double percentile, uint64_t count)
+	{
+		double rank = std::ceil(percentile / 100.0 * static_cast<double>(count));
+		return rank < 1.0 ? 1 : (rank > static_cast<double>(count) ? count : static_cast<uint64_t>(rank));
+	}
+}
+
+uint32_t LatencyHistogram::GetBucket(uint64_t value)
+{
+	const uint64_t kMaxValue = (1ull << kMaxValueBits) - 1;
+	value = value < kMaxValue ? value : kMaxValue;
+	if (value < 2 * kSubBucketCount)
+	{
+		return static_cast<uint32_t>(value);
+	}
+	// The top kSubBucketBits + 1 bits pick the bucket, the ones below are dropped
+	uint32_t shift = GetHighestBit(value) - kSubBucketBits;
+	return shift * kSubBucketCount + static_cast<uint32_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::GetBucketLow(uint32_t bucket)
+{
+	if (bucket < 2 * kSubBucketCount)
+	{
+		return bucket;
+	}
+	uint32_t shift = bucket / kSubBucketCount - 1;
+	return static_cast<uint64_t>(bucket % kSubBucketCount + kSubBucketCount) << shift;
+}
+
+uint64_t LatencyHistogram::GetBucketHigh(uint32_t bucket)
+{
+	if (bucket < 2 * kSubBucketCount)
+	{
+		return bucket;
+	}
+	return GetBucketLow(bucket) + (1ull << (bucket / kSubBucketCount - 1)) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value)
+{
+	m_counts[GetBucket(value)]++;
+	m_count++;
+	m_sum += value;
+}
+
+void LatencyHistogram::Remove(uint64_t value)
+{
+	m_counts[GetBucket(value)]--;
+	m_count--;
+	m_sum -= value;
+}
+
+void LatencyHistogram::Add(const LatencyHistogram& other)
+{
+	for (uint32_t i = 0; i < kBucketCount; i++)
+	{
+		m_counts[i] += other.m_counts[i];
+	}
+	m_count += other.m_count;
+	m_sum += other.m_sum;
+}
+
+void LatencyHistogram::Clear()
+{
+	std::fill(m_counts.begin(), m_counts.end(), 0);
+	m_count = 0;
+	m_sum = 0;
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(double percentile) const
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+	uint64_t rank = GetRank(percentile, m_count);
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < kBucketCount; i++)
+	{
+		seen += m_counts[i];
+		if (seen >= rank)
+		{
+			uint64_t low = GetBucketLow(i);
+			return low + (GetBucketHigh(i) - low) / 2;
+		}
+	}
+	return GetBucketHigh(kBucketCount - 1);
+}
+
+FrameStats::FrameStats(uint32_t windowFrames, double hitchSeconds)
+	: m_hitchSeconds(hitchSeconds)
+	, m_hitchMicroseconds(ToMicroseconds(hitchSeconds))
+	, m_samples(windowFrames > 0 ? windowFrames : 1)
+{
+}
+
+uint32_t FrameStats::AddPhase(const char* name)
+{
+	if (m_phases.size() >= kMaxPhases)
+	{
+		return kNoPhase;
+	}
+	m_phases.push_back({ name, LatencyHistogram(), LatencyHistogram() });
+
+	// The frames already in the window count as 0, Remove takes them out like the others
+	uint32_t phase = static_cast<uint32_t>(m_phases.size() - 1);
+	uint64_t windowFrames = m_frames < m_samples.size() ? m_frames : m_samples.size();
+	for (uint64_t i = 0; i < windowFrames; i++)
+	{
+		m_phases[phase].window.Record(0);
+	}
+	for (Sample& sample : m_samples)
+	{
+		sample.phases[phase] = 0;
+	}
+	return phase;
+}
+
+void FrameStats::SetPhaseTime(uint32_t phase, double seconds)
+{
+	if (phase < m_phases.size())
+	{
+		m_currentPhases[phase] = ToMicroseconds(seconds);
+	}
+}
+
+void FrameStats::EndFrame(double frameSeconds)
+{
+	// The oldest frame leaves the window once it is full
+	Sample& sample = m_samples[m_frames % m_samples.size()];
+	if (m_frames >= m_samples.size())
+	{
+		m_windowFrames.Remove(sample.frame);
+		m_windowHitches -= sample.frame > m_hitchMicroseconds ? 1 : 0;
+		for (uint32_t i = 0; i < m_phases.size(); i++)
+		{
+			m_phases[i].window.Remove(sample.phases[i]);
+		}
+	}
+
+	sample.frame = ToMicroseconds(frameSeconds);
+	m_windowFrames.Record(sample.frame);
+	m_totalFrames.Record(sample.frame);
+	if (sample.frame > m_hitchMicroseconds)
+	{
+		m_windowHitches++;
+		m_hitches++;
+	}
+	for (uint32_t i = 0; i < m_phases.size(); i++)
+	{
+		sample.phases[i] = m_currentPhases[i];
+		m_phases[i].window.Record(sample.phases[i]);
+		m_phases[i].total.Record(sample.phases[i]);
+		m_currentPhases[i] = 0;
+	}
+	m_frames++;
+}
+
+namespace
+{
+	FrameTimeSummary Summarize(const LatencyHistogram& histogram)
+	{
+		FrameTimeSummary summary;
+		summary.frames = histogram.GetCount();
+		summary.mean = histogram.GetMean() / 1000.0;
+		summary.min = histogram.GetMin() / 1000.0;
+		summary.max = histogram.GetMax() / 1000.0;
+		summary.p50 = histogram.GetValueAtPercentile(50.0) / 1000.0;
+		summary.p95 = histogram.GetValueAtPercentile(95.0) / 1000.0;
+		summary.p99 = histogram.GetValueAtPercentile(99.0) / 1000.0;
+		summary.p999 = histogram.GetValueAtPercentile(99.9) / 1000.0;
+		return summary;
+	}
+
+	void AppendSummary(std::string& json, const FrameTimeSummary& summary)
+	{
+		char text[256];
+		snprintf(text, sizeof(text), "{\"frames\":%llu,\"mean\":%.3f,\"min\":%.3f,\"max\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"p99.9\":%.3f}",
+			static_cast<unsigned long long>(summary.frames), summary.mean, summary.min, summary.max, summary.p50, summary.p95, summary.p99, summary.p999);
+		json += text;
+	}
+}
+
+FrameTimeSummary FrameStats::GetFrameSummary(bool window) const
+{
+	return Summarize(window ? m_windowFrames : m_totalFrames);
+}
+
+FrameTimeSummary FrameStats::GetPhaseSummary(uint32_t phase, bool window) const
+{
+	return Summarize(window ? m_phases[phase].window : m_phases[phase].total);
+}
+
+std::string FrameStats::ToJson() const
+{
+	char text[128];
+	snprintf(text, sizeof(text), "{\"frames\":%llu,\"windowFrames\":%u,\"hitchMs\":%.3f",
+		static_cast<unsigned long long>(m_frames), GetWindowSize(), m_hitchSeconds * 1000.0);
+	std::string json = text;
+
+	// Same layout for the window and the totals
+	for (int window = 1; window >= 0; window--)
+	{
+		snprintf(text, sizeof(text), ",\n\"%s\":{\"hitches\":%llu,\"frameTimeMs\":", window ? "window" : "total",
+			static_cast<unsigned long long>(GetHitchCount(window != 0)));
+		json += text;
+		AppendSummary(json, GetFrameSummary(window != 0));
+		json += ",\"phasesMs\":{";
+		for (uint32_t phase = 0; phase < m_phases.size(); phase++)
+		{
+			json += phase > 0 ? ",\n\"" : "\n\"";
+			for (const char* c = m_phases[phase].name; *c; c++)
+			{
+				json += *c == '"' || *c == '\\' ? "\\" : "";
+				json += *c;
+			}
+			json += "\":";
+			AppendSummary(json, GetPhaseSummary(phase, window != 0));
+		}
+		json += "}}";
+	}
+	json += "}\n";
+	return json;
+}
+
+bool FrameStats::WriteJson(const std::string& path) const
+{
+	std::string json = ToJson();
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	return static_cast<bool>(file.write(json.data(), json.size()));
+}
+
+namespace
+{
+	// Nearest rank percentile of the values, sorted
+	uint64_t GetExactPercentile(const std::vector<uint64_t>& sorted, double percentile)
+	{
+		return sorted.empty() ? 0 : sorted[GetRank(percentile, sorted.size()) - 1];
+	}
+
+	// Within the width of the bucket of the exact value
+	bool IsClose(uint64_t value, uint64_t exact)
+	{
+		uint32_t bucket = LatencyHistogram::GetBucket(exact);
+		uint64_t width = LatencyHistogram::GetBucketHigh(bucket) - LatencyHistogram::GetBucketLow(bucket);
+		return value + width >= exact && value <= exact + width;
+	}
+
+	bool MatchesValues(const LatencyHistogram& histogram, std::vector<uint64_t> values)
+	{
+		std::sort(values.begin(), values.end());
+		uint64_t sum = 0;
+		for (uint64_t value : values)
+		{
+			sum += value;
+		}
+		if (histogram.GetCount() != values.size() || (!values.empty() && histogram.GetMean() != static_cast<double>(sum) / values.size()))
+		{
+			return false;
+		}
+		const double kPercentiles[] = { 0.0, 1.0, 25.0, 50.0, 90.0, 95.0, 99.0, 99.9, 100.0 };
+		for (double percentile : kPercentiles)
+		{
+			if (!IsClose(histogram.GetValueAtPercentile(percentile), GetExactPercentile(values, percentile)))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool MatchesSummary(const FrameTimeSummary& a, const FrameTimeSummary& b)
+	{
+		return a.frames == b.frames && a.mean == b.mean && a.min == b.min && a.max == b.max
+			&& a.p50 == b.p50 && a.p95 == b.p95 && a.p99 == b.p99 && a.p999 == b.p999;
+	}
+}
+
+bool ValidateFrameStats(uint32_t seed, int frames)
+{
+	std::mt19937 random(seed);
+
+	// Buckets: contiguous, each value in its own, no wider than 1/64 of its values
+	for (uint32_t bucket = 0; bucket < LatencyHistogram::kBucketCount; bucket++)
+	{
+		uint64_t low = LatencyHistogram::GetBucketLow(bucket);
+		uint64_t high = LatencyHistogram::GetBucketHigh(bucket);
+		if (LatencyHistogram::GetBucket(low) != bucket || LatencyHistogram::GetBucket(high) != bucket
+			|| (bucket > 0 && LatencyHistogram::GetBucketHigh(bucket - 1) + 1 != low)
+			|| (high - low) * LatencyHistogram::kSubBucketCount > low)
+		{
+			return false;
+		}
+	}
+
+	// Percentiles of frame time like distributions: steady with hitches, exponential, very wide
+	for (int distribution = 0; distribution < 3; distribution++)
+	{
+		std::vector<uint64_t> values(1 + random() % 20000);
+		for (uint64_t& value : values)
+		{
+			if (distribution == 0)
+			{
+				value = random() % 100 == 0 ? 30000 + random() % 200000 : 16000 + random() % 1500;
+			}
+			else if (distribution == 1)
+			{
+				value = static_cast<uint64_t>(std::exponential_distribution<double>(1.0 / 8000.0)(random));
+			}
+			else
+			{
+				value = random() >> (random() % 32);
+			}
+		}
+		LatencyHistogram histogram;
+		for (uint64_t value : values)
+		{
+			histogram.Record(value);
+		}
+		if (!MatchesValues(histogram, values))
+		{
+			return false;
+		}
+
+		// Taking half back out leaves the histogram of the other half
+		std::vector<uint64_t> kept;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			if (i % 2 == 0)
+			{
+				histogram.Remove(values[i]);
+			}
+			else
+			{
+				kept.push_back(values[i]);
+			}
+		}
+		if (!MatchesValues(histogram, kept))
+		{
+			return false;
+		}
+	}
+
+	// Frames through the rolling window, a phase added late, compared with the last frames from scratch
+	const uint32_t kWindow = 97;
+	const double kHitchSeconds = 0.025;
+	FrameStats stats(kWindow, kHitchSeconds);
+	uint32_t input = stats.AddPhase("Input");
+	uint32_t simulation = stats.AddPhase("Simulation");
+	uint32_t late = FrameStats::kNoPhase;
+	std::vector<double> frameTimes;
+	std::vector<double> lateTimes;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if (frame == frames / 3)
+		{
+			late = stats.AddPhase("Late");
+		}
+		double frameSeconds = random() % 50 == 0 ? 0.03 + (random() % 1000) / 10000.0 : 0.016 + (random() % 1000) / 1000000.0;
+		double lateSeconds = late != FrameStats::kNoPhase ? frameSeconds * 0.25 : 0.0;
+		stats.SetPhaseTime(input, frameSeconds * 0.1);
+		stats.SetPhaseTime(simulation, frameSeconds * 0.5);
+		stats.SetPhaseTime(late, lateSeconds);
+		stats.EndFrame(frameSeconds);
+		frameTimes.push_back(frameSeconds);
+		lateTimes.push_back(lateSeconds);
+	}
+
+	FrameStats window(kWindow, kHitchSeconds);
+	uint32_t windowLate = window.AddPhase("Late");
+	uint64_t hitches = 0;
+	size_t first = frameTimes.size() > kWindow ? frameTimes.size() - kWindow : 0;
+	for (size_t frame = 0; frame < frameTimes.size(); frame++)
+	{
+		hitches += ToMicroseconds(frameTimes[frame]) > ToMicroseconds(kHitchSeconds) ? 1 : 0;
+		if (frame >= first)
+		{
+			window.SetPhaseTime(windowLate, lateTimes[frame]);
+			window.EndFrame(frameTimes[frame]);
+		}
+	}
+	if (stats.GetFrameCount() != static_cast<uint64_t>(frames) || stats.GetHitchCount(false) != hitches
+		|| stats.GetHitchCount(true) != window.GetHitchCount(false)
+		|| !MatchesSummary(stats.GetFrameSummary(true), window.GetFrameSummary(false))
+		|| (late != FrameStats::kNoPhase && !MatchesSummary(stats.GetPhaseSummary(late, true), window.GetPhaseSummary(windowLate, false))))
+	{
+		return false;
+	}
+
+	std::string json = stats.ToJson();
+	return json.find("\"window\":") != std::string::npos && json.find("\"total\":") != std::string::npos
+		&& json.find("\"Late\":") != std::string::npos && json.find("\"p99.9\":") != std::string::npos;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <chrono> // frame timer
+#include <cstdint> // fixed size integers
+#include <string>
+#include <vector>
+
+// Seconds between frames, on the steady clock (QueryPerformanceCounter on Windows)
+class FrameTimer
+{
+public:
+	FrameTimer() : m_start(std::chrono::steady_clock::now()), m_last(m_start) {}
+
+	// Seconds since the last Tick, 0 the first time
+	double Tick()
+	{
+		auto now = std::chrono::steady_clock::now();
+		double seconds = m_ticks > 0 ? std::chrono::duration<double>(now - m_last).count() : 0.0;
+		m_last = now;
+		m_ticks++;
+		return seconds;
+	}
+
+	// Seconds since the timer was made, to time the phases of a frame
+	double GetTime() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count(); }
+	uint64_t GetTicks() const { return m_ticks; }
+
+private:
+	std::chrono::steady_clock::time_point m_start;
+	std::chrono::steady_clock::time_point m_last;
+	uint64_t m_ticks = 0;
+};
+
+// Log bucketed histogram of integer values (microseconds), HDR histogram style
+//
+// Values below 128 have their own bucket, above that every power of two is split in 64
+// buckets, so a bucket is never wider than 1/64 of its values (percentiles within ~0.8%,
+// the middle of the bucket is reported). Recording is a few shifts and an increment, and
+// Remove takes a value back out, for rolling windows. Values from 2^40 on are clamped.
+class LatencyHistogram
+{
+public:
+	static const uint32_t kSubBucketBits = 6;
+	static const uint32_t kSubBucketCount = 1 << kSubBucketBits;
+	static const uint32_t kMaxValueBits = 40;
+	static const uint32_t kBucketCount = (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+	LatencyHistogram() : m_counts(kBucketCount, 0) {}
+
+	void Record(uint64_t value);
+	// value must have been recorded
+	void Remove(uint64_t value);
+	void Add(const LatencyHistogram& other);
+	void Clear();
+
+	uint64_t GetCount() const { return m_count; }
+	double GetMean() const { return m_count > 0 ? static_cast<double>(m_sum) / m_count : 0.0; }
+	// Nearest rank: the value that percentile of the values are at or below, 0 when empty
+	uint64_t GetValueAtPercentile(double percentile) const;
+	uint64_t GetMin() const { return GetValueAtPercentile(0.0); }
+	uint64_t GetMax() const { return GetValueAtPercentile(100.0); }
+
+	// Bucket of a value and the values a bucket holds, [GetBucketLow, GetBucketHigh]
+	static uint32_t GetBucket(uint64_t value);
+	static uint64_t GetBucketLow(uint32_t bucket);
+	static uint64_t GetBucketHigh(uint32_t bucket);
+
+private:
+	std::vector<uint32_t> m_counts;
+	uint64_t m_count = 0;
+	uint64_t m_sum = 0;
+};
+
+// Frame time, or one phase of it, over the window or since the start, in milliseconds
+struct FrameTimeSummary
+{
+	uint64_t frames;
+	double mean;
+	double min;
+	double max;
+	double p50;
+	double p95;
+	double p99;
+	double p999;
+};
+
+// Frame time statistics, cheap enough to leave on
+//
+// Every EndFrame records the frame time and the time of each phase (input, simulation...)
+// into a histogram of the last windowFrames frames and one since the start. The window
+// keeps the samples of its frames in a ring to take the oldest back out of its histograms,
+// so recording never depends on the window size. A hitch is a frame longer than hitchSeconds.
+class FrameStats
+{
+public:
+	static const uint32_t kMaxPhases = 8;
+	static const uint32_t kNoPhase = UINT32_MAX;
+
+	explicit FrameStats(uint32_t windowFrames = 600, double hitchSeconds = 2.0 / 60.0);
+
+	// Index of a new phase for SetPhaseTime, kNoPhase when there are kMaxPhases already
+	// name must outlive the stats (string literal). Added after the first frames, the frames
+	// before count as 0 in the window and aren't in the totals.
+	uint32_t AddPhase(const char* name);
+	// Time of a phase in the current frame, phases that aren't set count as 0
+	void SetPhaseTime(uint32_t phase, double seconds);
+	// Records the frame and its phases, then starts the next one
+	void EndFrame(double frameSeconds);
+
+	uint32_t GetWindowSize() const { return static_cast<uint32_t>(m_samples.size()); }
+	double GetHitchSeconds() const { return m_hitchSeconds; }
+	uint64_t GetFrameCount() const { return m_frames; }
+	uint64_t GetHitchCount(bool window) const { return window ? m_windowHitches : m_hitches; }
+	uint32_t GetPhaseCount() const { return static_cast<uint32_t>(m_phases.size()); }
+	const char* GetPhaseName(uint32_t phase) const { return m_phases[phase].name; }
+
+	FrameTimeSummary GetFrameSummary(bool window) const;
+	FrameTimeSummary GetPhaseSummary(uint32_t phase, bool window) const;
+
+	// Window and totals, frames, hitches and the phases, times in milliseconds
+	std::string ToJson() const;
+	bool WriteJson(const std::string& path) const;
+
+private:
+	struct Phase
+	{
+		const char* name;
+		LatencyHistogram window;
+		LatencyHistogram total;
+	};
+
+	// Microseconds of a frame and of its phases, while it is in the window
+	struct Sample
+	{
+		uint64_t frame;
+		uint64_t phases[kMaxPhases];
+	};
+
+	double m_hitchSeconds;
+	uint64_t m_hitchMicroseconds;
+	uint64_t m_frames = 0;
+	uint64_t m_hitches = 0;
+	uint64_t m_windowHitches = 0;
+	LatencyHistogram m_windowFrames;
+	LatencyHistogram m_totalFrames;
+	std::vector<Phase> m_phases;
+	std::vector<Sample> m_samples; // ring, m_frames % size is the oldest once it is full
+	uint64_t m_currentPhases[kMaxPhases] = {};
+};
+
+// Checks the histogram percentiles against sorted values, Remove against a histogram of what
+// is left, and the window of FrameStats against the last frames recomputed from scratch
+bool ValidateFrameStats(uint32_t seed, int frames);
@@ -0,0 +1,381 @@
+#include "FrustumCulling.h"
+#include <algorithm> // equal
+#include <cmath> // fabs
+#include <cstring> // memmove
+#include <random> // validation
+#include <vector>
+#include "JobSystem.h"
+#include "LinearArena.h"
+#include "SimdMath.h" // PlaneNormalize
+
+#if CPU_FEATURES_X86
+#include <immintrin.h> // SSE2/AVX2 intrinsics
+#endif
+
+namespace
+{
+	// Reference kernels, one object at a time
+	// The index is always written and the count only moves when the object is visible, no branch per object
+	uint32_t BoxCullScalar(const FrustumPlanes& frustum, const BoxArrays& boxes, uint32_t first, uint32_t count, uint32_t* visible)
+	{
+		uint32_t visibleCount = 0;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			bool inside = true;
+			for (const float* plane : frustum.planes)
+			{
+				// Distance of the center, and how far the box reaches towards the plane
+				float distance = plane[0] * boxes.centerX[i] + plane[1] * boxes.centerY[i] + plane[2] * boxes.centerZ[i] + plane[3];
+				float reach = std::fabs(plane[0]) * boxes.extentX[i] + std::fabs(plane[1]) * boxes.extentY[i] + std::fabs(plane[2]) * boxes.extentZ[i];
+				inside = inside && distance + reach >= 0.0f;
+			}
+			visible[visibleCount] = i;
+			visibleCount += inside ? 1 : 0;
+		}
+		return visibleCount;
+	}
+
+	uint32_t SphereCullScalar(const FrustumPlanes& frustum, const SphereArrays& spheres, uint32_t first, uint32_t count, uint32_t* visible)
+	{
+		uint32_t visibleCount = 0;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			bool inside = true;
+			for (const float* plane : frustum.planes)
+			{
+				float distance = plane[0] * spheres.centerX[i] + plane[1] * spheres.centerY[i] + plane[2] * spheres.centerZ[i] + plane[3];
+				inside = inside && distance + spheres.radius[i] >= 0.0f;
+			}
+			visible[visibleCount] = i;
+			visibleCount += inside ? 1 : 0;
+		}
+		return visibleCount;
+	}
+
+#if CPU_FEATURES_X86
+	// Append the lanes of a 4 bit mask
+	inline uint32_t AppendVisible4(uint32_t index, int mask, uint32_t* visible)
+	{
+		uint32_t visibleCount = 0;
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			visible[visibleCount] = index + lane;
+			visibleCount += (mask >> lane) & 1;
+		}
+		return visibleCount;
+	}
+
+	// 4 objects per instruction
+	uint32_t BoxCullSSE2(const FrustumPlanes& frustum, const BoxArrays& boxes, uint32_t first, uint32_t count, uint32_t* visible)
+	{
+		const __m128 signBit = _mm_set1_ps(-0.0f);
+		uint32_t visibleCount = 0;
+		uint32_t i = first;
+		for (; i + 4 <= first + count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(boxes.centerX + i);
+			__m128 cy = _mm_loadu_ps(boxes.centerY + i);
+			__m128 cz = _mm_loadu_ps(boxes.centerZ + i);
+			__m128 ex = _mm_loadu_ps(boxes.extentX + i);
+			__m128 ey = _mm_loadu_ps(boxes.extentY + i);
+			__m128 ez = _mm_loadu_ps(boxes.extentZ + i);
+
+			// A lane gets its sign bit set as soon as one plane has the box completely outside
+			__m128 outside = _mm_setzero_ps();
+			for (const float* plane : frustum.planes)
+			{
+				__m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_mul_ps(c, cz)), _mm_set1_ps(plane[3]));
+				__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signBit, a), ex), _mm_mul_ps(_mm_andnot_ps(signBit, b), ey)), _mm_mul_ps(_mm_andnot_ps(signBit, c), ez));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+			}
+			visibleCount += AppendVisible4(i, ~_mm_movemask_ps(outside) & 0xF, visible + visibleCount);
+		}
+		return visibleCount + BoxCullScalar(frustum, boxes, i, first + count - i, visible + visibleCount);
+	}
+
+	uint32_t SphereCullSSE2(const FrustumPlanes& frustum, const SphereArrays& spheres, uint32_t first, uint32_t count, uint32_t* visible)
+	{
+		uint32_t visibleCount = 0;
+		uint32_t i = first;
+		for (; i + 4 <= first + count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(spheres.centerX + i);
+			__m128 cy = _mm_loadu_ps(spheres.centerY + i);
+			__m128 cz = _mm_loadu_ps(spheres.centerZ + i);
+			__m128 radius = _mm_loadu_ps(spheres.radius + i);
+
+			__m128 outside = _mm_setzero_ps();
+			for (const float* plane : frustum.planes)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), cx), _mm_mul_ps(_mm_set1_ps(plane[1]), cy)), _mm_mul_ps(_mm_set1_ps(plane[2]), cz)), _mm_set1_ps(plane[3]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			}
+			visibleCount += AppendVisible4(i, ~_mm_movemask_ps(outside) & 0xF, visible + visibleCount);
+		}
+		return visibleCount + SphereCullScalar(frustum, spheres, i, first + count - i, visible + visibleCount);
+	}
+
+	// For every 8 bit visibility mask, the lanes to keep packed to the front and how many there are
+	struct CompactTable
+	{
+		uint64_t lanes[256]; // byte k is the lane of the k-th visible object
+		uint8_t counts[256];
+
+		constexpr CompactTable() : lanes(), counts()
+		{
+			for (int mask = 0; mask < 256; mask++)
+			{
+				int count = 0;
+				for (int lane = 0; lane < 8; lane++)
+				{
+					if (mask & (1 << lane))
+					{
+						lanes[mask] |= static_cast<uint64_t>(lane) << (count * 8);
+						count++;
+					}
+				}
+				counts[mask] = static_cast<uint8_t>(count);
+			}
+		}
+	};
+	constexpr CompactTable kCompactTable;
+
+	// Append the lanes of an 8 bit mask with one table lookup and one store
+	// Writes 8 indices, so visible needs room for 8 even when fewer are visible
+	TARGET_AVX2 inline uint32_t AppendVisible8(uint32_t index, int mask, uint32_t* visible)
+	{
+		__m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&kCompactTable.lanes[mask])));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(visible), _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(index)), lanes));
+		return kCompactTable.counts[mask];
+	}
+
+	// 8 objects per instruction
+	// The packed indices of a group never reach past the group itself, so the 8 wide stores stay inside visible
+	TARGET_AVX2 uint32_t BoxCullAVX2(const FrustumPlanes& frustum, const BoxArrays& boxes, uint32_t first, uint32_t count, uint32_t* visible)
+	{
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		uint32_t visibleCount = 0;
+		uint32_t i = first;
+		for (; i + 8 <= first + count; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(boxes.centerX + i);
+			__m256 cy = _mm256_loadu_ps(boxes.centerY + i);
+			__m256 cz = _mm256_loadu_ps(boxes.centerZ + i);
+			__m256 ex = _mm256_loadu_ps(boxes.extentX + i);
+			__m256 ey = _mm256_loadu_ps(boxes.extentY + i);
+			__m256 ez = _mm256_loadu_ps(boxes.extentZ + i);
+
+			// Same operation order as the scalar kernel (no FMA) so the results are identical
+			__m256 outside = _mm256_setzero_ps();
+			for (const float* plane : frustum.planes)
+			{
+				__m256 a = _mm256_set1_ps(plane[0]), b = _mm256_set1_ps(plane[1]), c = _mm256_set1_ps(plane[2]);
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)), _mm256_mul_ps(c, cz)), _mm256_set1_ps(plane[3]));
+				__m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signBit, a), ex), _mm256_mul_ps(_mm256_andnot_ps(signBit, b), ey)), _mm256_mul_ps(_mm256_andnot_ps(signBit, c), ez));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+			visibleCount += AppendVisible8(i, ~_mm256_movemask_ps(outside) & 0xFF, visible + visibleCount);
+		}
+		return visibleCount + BoxCullScalar(frustum, boxes, i, first + count - i, visible + visibleCount);
+	}
+
+	TARGET_AVX2 uint32_t SphereCullAVX2(const FrustumPlanes& frustum, const SphereArrays& spheres, uint32_t first, uint32_t count, uint32_t* visible)
+	{
+		uint32_t visibleCount = 0;
+		uint32_t i = first;
+		for (; i + 8 <= first + count; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(spheres.centerX + i);
+			__m256 cy = _mm256_loadu_ps(spheres.centerY + i);
+			__m256 cz = _mm256_loadu_ps(spheres.centerZ + i);
+			__m256 radius = _mm256_loadu_ps(spheres.radius + i);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (const float* plane : frustum.planes)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), cx), _mm256_mul_ps(_mm256_set1_ps(plane[1]), cy)), _mm256_mul_ps(_mm256_set1_ps(plane[2]), cz)), _mm256_set1_ps(plane[3]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+			visibleCount += AppendVisible8(i, ~_mm256_movemask_ps(outside) & 0xFF, visible + visibleCount);
+		}
+		return visibleCount + SphereCullScalar(frustum, spheres, i, first + count - i, visible + visibleCount);
+	}
+#endif
+
+	// Every chunk packs its visible indices at the start of its own range of the output,
+	// then the ranges are moved down one after the other (never overlapping forward)
+	template <typename Arrays, typename Kernel>
+	uint32_t RunCulling(const FrustumPlanes& frustum, const Arrays& arrays, uint32_t count, uint32_t* visibleIndices, JobSystem* pool, Kernel kernel)
+	{
+		if (!pool || pool->GetThreadCount() == 1 || count < kFrustumCullParallelThreshold)
+		{
+			return kernel(frustum, arrays, 0, count, visibleIndices);
+		}
+
+		uint32_t chunkCount = (count + kFrustumCullChunkSize - 1) / kFrustumCullChunkSize;
+		// Counts of the chunks on the scratch arena, culling every frame doesn't touch the heap
+		ArenaScope scratch(GetScratchArena());
+		uint32_t* chunkVisible = scratch.GetArena().Allocate<uint32_t>(chunkCount);
+		pool->ParallelFor(chunkCount, [&](uint32_t chunk, uint32_t)
+		{
+			uint32_t first = chunk * kFrustumCullChunkSize;
+			uint32_t chunkSize = count - first < kFrustumCullChunkSize ? count - first : kFrustumCullChunkSize;
+			chunkVisible[chunk] = kernel(frustum, arrays, first, chunkSize, visibleIndices + first);
+		});
+
+		uint32_t visibleCount = chunkVisible[0];
+		for (uint32_t chunk = 1; chunk < chunkCount; chunk++)
+		{
+			memmove(visibleIndices + visibleCount, visibleIndices + chunk * kFrustumCullChunkSize, chunkVisible[chunk] * sizeof(uint32_t));
+			visibleCount += chunkVisible[chunk];
+		}
+		return visibleCount;
+	}
+}
+
+FrustumPlanes ExtractFrustumPlanes(const float viewProjection[16])
+{
+	// Rows of the transposed matrix are the columns of view * projection, so clip = (dot(p, row0), ..., dot(p, row3))
+	const float* row[4] = { viewProjection, viewProjection + 4, viewProjection + 8, viewProjection + 12 };
+
+	FrustumPlanes frustum;
+	for (int c = 0; c < 4; c++)
+	{
+		frustum.planes[0][c] = row[3][c] + row[0][c]; // left: -w <= x
+		frustum.planes[1][c] = row[3][c] - row[0][c]; // right: x <= w
+		frustum.planes[2][c] = row[3][c] + row[1][c]; // bottom: -w <= y
+		frustum.planes[3][c] = row[3][c] - row[1][c]; // top: y <= w
+		frustum.planes[4][c] = row[2][c]; // near: 0 <= z
+		frustum.planes[5][c] = row[3][c] - row[2][c]; // far: z <= w
+	}
+
+	// Unit normals, so the plane equation gives a real distance to compare radiuses with
+	for (float* plane : frustum.planes)
+	{
+		SimdMath::Float4* stored = reinterpret_cast<SimdMath::Float4*>(plane);
+		SimdMath::StoreFloat4(stored, SimdMath::PlaneNormalize(SimdMath::LoadFloat4(stored)));
+	}
+	return frustum;
+}
+
+void TransformBounds(const float boundsMin[3], const float boundsMax[3], const float world[16], float center[3], float extents[3])
+{
+	float localCenter[3];
+	float localExtents[3];
+	for (int c = 0; c < 3; c++)
+	{
+		localCenter[c] = 0.5f * (boundsMin[c] + boundsMax[c]);
+		localExtents[c] = 0.5f * (boundsMax[c] - boundsMin[c]);
+	}
+
+	// The box around the rotated box reaches |m| * extents along each axis
+	for (int r = 0; r < 3; r++)
+	{
+		const float* m = world + r * 4;
+		center[r] = m[0] * localCenter[0] + m[1] * localCenter[1] + m[2] * localCenter[2] + m[3];
+		extents[r] = std::fabs(m[0]) * localExtents[0] + std::fabs(m[1]) * localExtents[1] + std::fabs(m[2]) * localExtents[2];
+	}
+}
+
+bool IsBoxInFrustum(const FrustumPlanes& frustum, const float center[3], const float extents[3])
+{
+	BoxArrays box = { &center[0], &center[1], &center[2], &extents[0], &extents[1], &extents[2] };
+	uint32_t index;
+	return BoxCullScalar(frustum, box, 0, 1, &index) == 1;
+}
+
+BoxCullFunction GetBoxCullFunction(SimdIsa isa)
+{
+	switch (ClampSimdIsa(isa))
+	{
+#if CPU_FEATURES_X86
+	case SimdIsa::AVX2:
+		return BoxCullAVX2;
+	case SimdIsa::SSE2:
+		return BoxCullSSE2;
+#endif
+	default:
+		return BoxCullScalar;
+	}
+}
+
+SphereCullFunction GetSphereCullFunction(SimdIsa isa)
+{
+	switch (ClampSimdIsa(isa))
+	{
+#if CPU_FEATURES_X86
+	case SimdIsa::AVX2:
+		return SphereCullAVX2;
+	case SimdIsa::SSE2:
+		return SphereCullSSE2;
+#endif
+	default:
+		return SphereCullScalar;
+	}
+}
+
+uint32_t CullBoxes(const FrustumPlanes& frustum, const BoxArrays& boxes, uint32_t count, uint32_t* visibleIndices, JobSystem* pool, SimdIsa isa)
+{
+	return RunCulling(frustum, boxes, count, visibleIndices, pool, GetBoxCullFunction(isa));
+}
+
+uint32_t CullSpheres(const FrustumPlanes& frustum, const SphereArrays& spheres, uint32_t count, uint32_t* visibleIndices, JobSystem* pool, SimdIsa isa)
+{
+	return RunCulling(frustum, spheres, count, visibleIndices, pool, GetSphereCullFunction(isa));
+}
+
+bool ValidateFrustumCulling(SimdIsa isa, uint32_t seed, int iterations)
+{
+	BoxCullFunction boxReference = GetBoxCullFunction(SimdIsa::Scalar);
+	BoxCullFunction boxTested = GetBoxCullFunction(isa);
+	SphereCullFunction sphereReference = GetSphereCullFunction(SimdIsa::Scalar);
+	SphereCullFunction sphereTested = GetSphereCullFunction(isa);
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unitRange(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> positionRange(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> sizeRange(0.0f, 5.0f);
+	std::uniform_int_distribution<uint32_t> countRange(1, 131); // odd sizes to hit the leftover path
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		FrustumPlanes frustum;
+		for (float* plane : frustum.planes)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				plane[c] = c == 3 ? positionRange(random) : unitRange(random);
+			}
+		}
+
+		uint32_t count = countRange(random);
+		std::vector<float> components(7 * count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				components[c * count + i] = positionRange(random);
+				components[(3 + c) * count + i] = sizeRange(random);
+			}
+			components[6 * count + i] = sizeRange(random);
+		}
+		const float* data = components.data();
+		BoxArrays boxes = { data, data + count, data + 2 * count, data + 3 * count, data + 4 * count, data + 5 * count };
+		SphereArrays spheres = { data, data + count, data + 2 * count, data + 6 * count };
+
+		std::vector<uint32_t> expected(count);
+		std::vector<uint32_t> result(count);
+		uint32_t expectedCount = boxReference(frustum, boxes, 0, count, expected.data());
+		if (boxTested(frustum, boxes, 0, count, result.data()) != expectedCount || !std::equal(expected.begin(), expected.begin() + expectedCount, result.begin()))
+		{
+			return false;
+		}
+		expectedCount = sphereReference(frustum, spheres, 0, count, expected.data());
+		if (sphereTested(frustum, spheres, 0, count, result.data()) != expectedCount || !std::equal(expected.begin(), expected.begin() + expectedCount, result.begin()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
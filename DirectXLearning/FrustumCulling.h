@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include "CpuFeatures.h"
+
+class JobSystem;
+
+// View frustum culling of bounding boxes and spheres
+//
+// The six planes come from the view * projection matrix (transposed, like the
+// constant buffer and the occlusion culler), normalized so spheres can be tested
+// with their radius. Bounds are stored as structure of arrays and the kernels test
+// 4 (SSE2) or 8 (AVX2) objects against one plane per instruction, then append the
+// indices of the visible ones to a compact list. Big batches are split into chunks
+// spread over a JobSystem and the chunk lists are packed together at the end.
+//
+// The tests are conservative: an object is only culled when it is completely
+// outside one of the planes.
+
+// Below this many objects a batch runs on the calling thread only
+const uint32_t kFrustumCullParallelThreshold = 8192;
+
+// Objects per task when a batch is split over a JobSystem (a multiple of the SIMD width)
+const uint32_t kFrustumCullChunkSize = 4096;
+
+// Planes of the frustum, (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside
+// Order: left, right, bottom, top, near, far
+struct FrustumPlanes
+{
+	float planes[6][4];
+};
+
+// Axis aligned boxes as center and half size, one array per component
+struct BoxArrays
+{
+	const float* centerX;
+	const float* centerY;
+	const float* centerZ;
+	const float* extentX;
+	const float* extentY;
+	const float* extentZ;
+};
+
+// Spheres, one array per component
+struct SphereArrays
+{
+	const float* centerX;
+	const float* centerY;
+	const float* centerZ;
+	const float* radius;
+};
+
+// Planes of viewProjection (transposed, D3D clip space: 0 <= z <= w)
+// With a world * view * projection matrix the planes are in object space instead of world space
+FrustumPlanes ExtractFrustumPlanes(const float viewProjection[16]);
+
+// World space box of an object space box placed by world (transposed), as center and half size
+void TransformBounds(const float boundsMin[3], const float boundsMax[3], const float world[16], float center[3], float extents[3]);
+
+// Single box test, for the odd object that doesn't come in a batch
+bool IsBoxInFrustum(const FrustumPlanes& frustum, const float center[3], const float extents[3]);
+
+// Test objects [first, first + count) and write the indices of the visible ones to visible,
+// in increasing order, returns how many were written (visible needs room for count indices)
+typedef uint32_t (*BoxCullFunction)(const FrustumPlanes& frustum, const BoxArrays& boxes, uint32_t first, uint32_t count, uint32_t* visible);
+typedef uint32_t (*SphereCullFunction)(const FrustumPlanes& frustum, const SphereArrays& spheres, uint32_t first, uint32_t count, uint32_t* visible);
+
+// Kernels for an instruction set (clamped to what the CPU supports)
+BoxCullFunction GetBoxCullFunction(SimdIsa isa);
+SphereCullFunction GetSphereCullFunction(SimdIsa isa);
+
+// Indices of the visible objects in increasing order, visibleIndices needs room for count indices
+// pool can be null, it is only used for batches of kFrustumCullParallelThreshold objects and more
+uint32_t CullBoxes(const FrustumPlanes& frustum, const BoxArrays& boxes, uint32_t count, uint32_t* visibleIndices, JobSystem* pool, SimdIsa isa = GetBestSimdIsa());
+uint32_t CullSpheres(const FrustumPlanes& frustum, const SphereArrays& spheres, uint32_t count, uint32_t* visibleIndices, JobSystem* pool, SimdIsa isa = GetBestSimdIsa());
+
+// Run random frusta and bounds through the kernels of an instruction set and compare
+// with the scalar reference, returns false on the first mismatch
+bool ValidateFrustumCulling(SimdIsa isa, uint32_t seed, int iterations);
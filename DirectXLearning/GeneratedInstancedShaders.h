@@ -0,0 +1,152 @@
+// Generated by ShaderTranspiler from InstancedVertexShader.hlsl and PixelShader.hlsl, don't edit
+// ShaderTranspiler --vs InstancedVertexShader.hlsl --ps PixelShader.hlsl --out GeneratedInstancedShaders.h --prefix Instanced
+#pragma once
+#include <algorithm> // min/max
+#include <cmath> // sqrt
+#include <cstddef> // offsetof
+#include "SoftwareShaders.h"
+
+// cbuffer FrameConstants : register(b0)
+// HLSL packing: vectors don't cross 16 byte boundaries, matrices start on one
+struct GeneratedInstancedFrameConstants
+{
+	float Time; // float, offset 0
+	float DeltaTime; // float, offset 4
+	float padding0[2];
+};
+static_assert(sizeof(GeneratedInstancedFrameConstants) == 16, "cbuffer packing");
+const int kGeneratedInstancedFrameConstantsSlot = 0;
+static_assert(kGeneratedInstancedFrameConstantsSlot < kMaxConstantBuffers, "the CPU renderer has fewer constant buffer slots");
+
+// cbuffer PassConstants : register(b1)
+// HLSL packing: vectors don't cross 16 byte boundaries, matrices start on one
+struct GeneratedInstancedPassConstants
+{
+	float View[16]; // matrix, offset 0
+	float Projection[16]; // matrix, offset 64
+};
+static_assert(sizeof(GeneratedInstancedPassConstants) == 128, "cbuffer packing");
+const int kGeneratedInstancedPassConstantsSlot = 1;
+static_assert(kGeneratedInstancedPassConstantsSlot < kMaxConstantBuffers, "the CPU renderer has fewer constant buffer slots");
+
+// Input/output layouts
+const SoftwareShaderElement kGeneratedInstancedVertexInputs[] =
+{
+	{ "POSITION", 0, 3, offsetof(SoftwareVertex, position) },
+	{ "COLOR", 0, 4, offsetof(SoftwareVertex, color) },
+	{ "INSTANCEWORLD", 0, 4, offsetof(SoftwareInstance, world) },
+	{ "INSTANCEWORLD", 1, 4, offsetof(SoftwareInstance, world) + 16 },
+	{ "INSTANCEWORLD", 2, 4, offsetof(SoftwareInstance, world) + 32 },
+	{ "INSTANCEWORLD", 3, 4, offsetof(SoftwareInstance, world) + 48 },
+	{ "INSTANCECOLOR", 0, 4, offsetof(SoftwareInstance, color) },
+	{ nullptr, 0, 0, 0 },
+};
+const SoftwareShaderElement kGeneratedInstancedVertexOutputs[] =
+{
+	{ "SV_POSITION", 0, 4, -1 },
+	{ "COLOR", 0, 4, 0 },
+	{ nullptr, 0, 0, 0 },
+};
+const SoftwareShaderElement kGeneratedInstancedPixelInputs[] =
+{
+	{ "SV_POSITION", 0, 4, -1 },
+	{ "COLOR", 0, 4, 0 },
+	{ nullptr, 0, 0, 0 },
+};
+const SoftwareShaderElement kGeneratedInstancedPixelOutputs[] =
+{
+	{ "SV_TARGET", 0, 4, 0 },
+	{ nullptr, 0, 0, 0 },
+};
+
+// InstancedVertexShader.hlsl
+struct InstancedVertexShaderKernel
+{
+	static const int kVaryingCount = 4;
+
+	void operator()(const void* const* constants, const VertexShaderInput& input, VertexShaderOutput& output) const
+	{
+		const GeneratedInstancedPassConstants& b1 = *static_cast<const GeneratedInstancedPassConstants*>(constants[1]);
+		for (int lane = 0; lane < kVertexShaderLanes; lane++)
+		{
+			// InstancedVertexShader.hlsl(35)
+			float l_output_position[4] = {};
+			float l_output_color[4] = {};
+
+			// InstancedVertexShader.hlsl(38)
+			float l_pos[4] = {};
+			l_pos[0] = input.position[0][lane];
+			l_pos[1] = input.position[1][lane];
+			l_pos[2] = input.position[2][lane];
+			l_pos[3] = 1.0f;
+
+			// InstancedVertexShader.hlsl(41)
+			const float t0 = l_pos[0] * input.instanceWorld[0][lane] + l_pos[1] * input.instanceWorld[1][lane] + l_pos[2] * input.instanceWorld[2][lane] + l_pos[3] * input.instanceWorld[3][lane];
+			const float t1 = l_pos[0] * input.instanceWorld[4][lane] + l_pos[1] * input.instanceWorld[5][lane] + l_pos[2] * input.instanceWorld[6][lane] + l_pos[3] * input.instanceWorld[7][lane];
+			const float t2 = l_pos[0] * input.instanceWorld[8][lane] + l_pos[1] * input.instanceWorld[9][lane] + l_pos[2] * input.instanceWorld[10][lane] + l_pos[3] * input.instanceWorld[11][lane];
+			const float t3 = l_pos[0] * input.instanceWorld[12][lane] + l_pos[1] * input.instanceWorld[13][lane] + l_pos[2] * input.instanceWorld[14][lane] + l_pos[3] * input.instanceWorld[15][lane];
+			l_pos[0] = t0;
+			l_pos[1] = t1;
+			l_pos[2] = t2;
+			l_pos[3] = t3;
+
+			// InstancedVertexShader.hlsl(42)
+			const float t4 = l_pos[0] * b1.View[0] + l_pos[1] * b1.View[1] + l_pos[2] * b1.View[2] + l_pos[3] * b1.View[3];
+			const float t5 = l_pos[0] * b1.View[4] + l_pos[1] * b1.View[5] + l_pos[2] * b1.View[6] + l_pos[3] * b1.View[7];
+			const float t6 = l_pos[0] * b1.View[8] + l_pos[1] * b1.View[9] + l_pos[2] * b1.View[10] + l_pos[3] * b1.View[11];
+			const float t7 = l_pos[0] * b1.View[12] + l_pos[1] * b1.View[13] + l_pos[2] * b1.View[14] + l_pos[3] * b1.View[15];
+			l_pos[0] = t4;
+			l_pos[1] = t5;
+			l_pos[2] = t6;
+			l_pos[3] = t7;
+
+			// InstancedVertexShader.hlsl(43)
+			const float t8 = l_pos[0] * b1.Projection[0] + l_pos[1] * b1.Projection[1] + l_pos[2] * b1.Projection[2] + l_pos[3] * b1.Projection[3];
+			const float t9 = l_pos[0] * b1.Projection[4] + l_pos[1] * b1.Projection[5] + l_pos[2] * b1.Projection[6] + l_pos[3] * b1.Projection[7];
+			const float t10 = l_pos[0] * b1.Projection[8] + l_pos[1] * b1.Projection[9] + l_pos[2] * b1.Projection[10] + l_pos[3] * b1.Projection[11];
+			const float t11 = l_pos[0] * b1.Projection[12] + l_pos[1] * b1.Projection[13] + l_pos[2] * b1.Projection[14] + l_pos[3] * b1.Projection[15];
+			l_pos[0] = t8;
+			l_pos[1] = t9;
+			l_pos[2] = t10;
+			l_pos[3] = t11;
+
+			// InstancedVertexShader.hlsl(45)
+			l_output_position[0] = l_pos[0];
+			l_output_position[1] = l_pos[1];
+			l_output_position[2] = l_pos[2];
+			l_output_position[3] = l_pos[3];
+
+			// InstancedVertexShader.hlsl(46)
+			l_output_color[0] = (input.color[0][lane] * input.instanceColor[0][lane]);
+			l_output_color[1] = (input.color[1][lane] * input.instanceColor[1][lane]);
+			l_output_color[2] = (input.color[2][lane] * input.instanceColor[2][lane]);
+			l_output_color[3] = (input.color[3][lane] * input.instanceColor[3][lane]);
+
+			// InstancedVertexShader.hlsl(47)
+			output.position[0][lane] = l_output_position[0];
+			output.position[1][lane] = l_output_position[1];
+			output.position[2][lane] = l_output_position[2];
+			output.position[3][lane] = l_output_position[3];
+			output.varyings[0][lane] = l_output_color[0];
+			output.varyings[1][lane] = l_output_color[1];
+			output.varyings[2][lane] = l_output_color[2];
+			output.varyings[3][lane] = l_output_color[3];
+		}
+	}
+};
+
+// PixelShader.hlsl
+struct InstancedPixelShaderKernel
+{
+	void operator()(const void* const*, const PixelShaderInput& input, PixelShaderOutput& output) const
+	{
+		for (int lane = 0; lane < kPixelShaderLanes; lane++)
+		{
+			// PixelShader.hlsl(11)
+			output.color[0][lane] = input.varyings[0][lane];
+			output.color[1][lane] = input.varyings[1][lane];
+			output.color[2][lane] = input.varyings[2][lane];
+			output.color[3][lane] = input.varyings[3][lane];
+		}
+	}
+};
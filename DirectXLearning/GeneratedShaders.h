@@ -0,0 +1,158 @@
+// Generated by ShaderTranspiler from VertexShader.hlsl and PixelShader.hlsl, don't edit
+// ShaderTranspiler --vs VertexShader.hlsl --ps PixelShader.hlsl --out GeneratedShaders.h
+#pragma once
+#include <algorithm> // min/max
+#include <cmath> // sqrt
+#include <cstddef> // offsetof
+#include "SoftwareShaders.h"
+
+// cbuffer FrameConstants : register(b0)
+// HLSL packing: vectors don't cross 16 byte boundaries, matrices start on one
+struct GeneratedFrameConstants
+{
+	float Time; // float, offset 0
+	float DeltaTime; // float, offset 4
+	float padding0[2];
+};
+static_assert(sizeof(GeneratedFrameConstants) == 16, "cbuffer packing");
+const int kGeneratedFrameConstantsSlot = 0;
+static_assert(kGeneratedFrameConstantsSlot < kMaxConstantBuffers, "the CPU renderer has fewer constant buffer slots");
+
+// cbuffer PassConstants : register(b1)
+// HLSL packing: vectors don't cross 16 byte boundaries, matrices start on one
+struct GeneratedPassConstants
+{
+	float View[16]; // matrix, offset 0
+	float Projection[16]; // matrix, offset 64
+};
+static_assert(sizeof(GeneratedPassConstants) == 128, "cbuffer packing");
+const int kGeneratedPassConstantsSlot = 1;
+static_assert(kGeneratedPassConstantsSlot < kMaxConstantBuffers, "the CPU renderer has fewer constant buffer slots");
+
+// cbuffer ObjectConstants : register(b2)
+// HLSL packing: vectors don't cross 16 byte boundaries, matrices start on one
+struct GeneratedObjectConstants
+{
+	float World[16]; // matrix, offset 0
+};
+static_assert(sizeof(GeneratedObjectConstants) == 64, "cbuffer packing");
+const int kGeneratedObjectConstantsSlot = 2;
+static_assert(kGeneratedObjectConstantsSlot < kMaxConstantBuffers, "the CPU renderer has fewer constant buffer slots");
+
+// Input/output layouts
+const SoftwareShaderElement kGeneratedVertexInputs[] =
+{
+	{ "POSITION", 0, 3, offsetof(SoftwareVertex, position) },
+	{ "COLOR", 0, 4, offsetof(SoftwareVertex, color) },
+	{ nullptr, 0, 0, 0 },
+};
+const SoftwareShaderElement kGeneratedVertexOutputs[] =
+{
+	{ "SV_POSITION", 0, 4, -1 },
+	{ "COLOR", 0, 4, 0 },
+	{ nullptr, 0, 0, 0 },
+};
+const SoftwareShaderElement kGeneratedPixelInputs[] =
+{
+	{ "SV_POSITION", 0, 4, -1 },
+	{ "COLOR", 0, 4, 0 },
+	{ nullptr, 0, 0, 0 },
+};
+const SoftwareShaderElement kGeneratedPixelOutputs[] =
+{
+	{ "SV_TARGET", 0, 4, 0 },
+	{ nullptr, 0, 0, 0 },
+};
+
+// VertexShader.hlsl
+struct VertexShaderKernel
+{
+	static const int kVaryingCount = 4;
+
+	void operator()(const void* const* constants, const VertexShaderInput& input, VertexShaderOutput& output) const
+	{
+		const GeneratedPassConstants& b1 = *static_cast<const GeneratedPassConstants*>(constants[1]);
+		const GeneratedObjectConstants& b2 = *static_cast<const GeneratedObjectConstants*>(constants[2]);
+		for (int lane = 0; lane < kVertexShaderLanes; lane++)
+		{
+			// VertexShader.hlsl(34)
+			float l_output_position[4] = {};
+			float l_output_color[4] = {};
+
+			// VertexShader.hlsl(37)
+			float l_pos[4] = {};
+			l_pos[0] = input.position[0][lane];
+			l_pos[1] = input.position[1][lane];
+			l_pos[2] = input.position[2][lane];
+			l_pos[3] = 1.0f;
+
+			// VertexShader.hlsl(40)
+			const float t0 = l_pos[0] * b2.World[0] + l_pos[1] * b2.World[1] + l_pos[2] * b2.World[2] + l_pos[3] * b2.World[3];
+			const float t1 = l_pos[0] * b2.World[4] + l_pos[1] * b2.World[5] + l_pos[2] * b2.World[6] + l_pos[3] * b2.World[7];
+			const float t2 = l_pos[0] * b2.World[8] + l_pos[1] * b2.World[9] + l_pos[2] * b2.World[10] + l_pos[3] * b2.World[11];
+			const float t3 = l_pos[0] * b2.World[12] + l_pos[1] * b2.World[13] + l_pos[2] * b2.World[14] + l_pos[3] * b2.World[15];
+			l_pos[0] = t0;
+			l_pos[1] = t1;
+			l_pos[2] = t2;
+			l_pos[3] = t3;
+
+			// VertexShader.hlsl(41)
+			const float t4 = l_pos[0] * b1.View[0] + l_pos[1] * b1.View[1] + l_pos[2] * b1.View[2] + l_pos[3] * b1.View[3];
+			const float t5 = l_pos[0] * b1.View[4] + l_pos[1] * b1.View[5] + l_pos[2] * b1.View[6] + l_pos[3] * b1.View[7];
+			const float t6 = l_pos[0] * b1.View[8] + l_pos[1] * b1.View[9] + l_pos[2] * b1.View[10] + l_pos[3] * b1.View[11];
+			const float t7 = l_pos[0] * b1.View[12] + l_pos[1] * b1.View[13] + l_pos[2] * b1.View[14] + l_pos[3] * b1.View[15];
+			l_pos[0] = t4;
+			l_pos[1] = t5;
+			l_pos[2] = t6;
+			l_pos[3] = t7;
+
+			// VertexShader.hlsl(42)
+			const float t8 = l_pos[0] * b1.Projection[0] + l_pos[1] * b1.Projection[1] + l_pos[2] * b1.Projection[2] + l_pos[3] * b1.Projection[3];
+			const float t9 = l_pos[0] * b1.Projection[4] + l_pos[1] * b1.Projection[5] + l_pos[2] * b1.Projection[6] + l_pos[3] * b1.Projection[7];
+			const float t10 = l_pos[0] * b1.Projection[8] + l_pos[1] * b1.Projection[9] + l_pos[2] * b1.Projection[10] + l_pos[3] * b1.Projection[11];
+			const float t11 = l_pos[0] * b1.Projection[12] + l_pos[1] * b1.Projection[13] + l_pos[2] * b1.Projection[14] + l_pos[3] * b1.Projection[15];
+			l_pos[0] = t8;
+			l_pos[1] = t9;
+			l_pos[2] = t10;
+			l_pos[3] = t11;
+
+			// VertexShader.hlsl(44)
+			l_output_position[0] = l_pos[0];
+			l_output_position[1] = l_pos[1];
+			l_output_position[2] = l_pos[2];
+			l_output_position[3] = l_pos[3];
+
+			// VertexShader.hlsl(45)
+			l_output_color[0] = input.color[0][lane];
+			l_output_color[1] = input.color[1][lane];
+			l_output_color[2] = input.color[2][lane];
+			l_output_color[3] = input.color[3][lane];
+
+			// VertexShader.hlsl(46)
+			output.position[0][lane] = l_output_position[0];
+			output.position[1][lane] = l_output_position[1];
+			output.position[2][lane] = l_output_position[2];
+			output.position[3][lane] = l_output_position[3];
+			output.varyings[0][lane] = l_output_color[0];
+			output.varyings[1][lane] = l_output_color[1];
+			output.varyings[2][lane] = l_output_color[2];
+			output.varyings[3][lane] = l_output_color[3];
+		}
+	}
+};
+
+// PixelShader.hlsl
+struct PixelShaderKernel
+{
+	void operator()(const void* const*, const PixelShaderInput& input, PixelShaderOutput& output) const
+	{
+		for (int lane = 0; lane < kPixelShaderLanes; lane++)
+		{
+			// PixelShader.hlsl(11)
+			output.color[0][lane] = input.varyings[0][lane];
+			output.color[1][lane] = input.varyings[1][lane];
+			output.color[2][lane] = input.varyings[2][lane];
+			output.color[3][lane] = input.varyings[3][lane];
+		}
+	}
+};
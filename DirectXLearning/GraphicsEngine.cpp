@@ -1,31 +1,58 @@
 #include "GraphicsEngine.h"
+#include "GeneratedShaders.h" // kernels of the software backend
+#include "GeneratedInstancedShaders.h"
+#include "Log.h"
+#include <algorithm> // std::min
+#include <cstring> // memcpy
+#include <iterator> // std::size
+#ifdef _WIN32
 #include "Window.h"
+#include "D3DShaderCompiler.h"
+#endif
 
 // Constructor
 GraphicsEngine::GraphicsEngine()
 {
+#ifdef _WIN32
 	// Initialize the pointers to nullptr
 	// This is important because the ComPtr class will call Release() on the pointer when it goes out of scope
 	m_device = nullptr;
 	m_context = nullptr;
+	m_context1 = nullptr;
 	m_swapChain = nullptr;
 	m_renderTarget = nullptr;
 	m_vertexShader = nullptr;
 	m_pixelShader = nullptr;
 	m_inputLayout = nullptr;
+	m_instancedVertexShader = nullptr;
+	m_instancedInputLayout = nullptr;
 	m_vertexBuffer = nullptr;
-	m_constantBuffer = nullptr;
+#endif
 }
 
 // Destructor
 GraphicsEngine::~GraphicsEngine()
 {
+	// The frames still queued are submitted before anything goes away
+	m_renderThread.Stop();
+
+#ifdef _WIN32
+	// The next run creates these states up front
+	if (m_device && m_stateCache.GetCreatedSinceLoad() > 0)
+	{
+		m_stateCache.Save(kStateListFile);
+	}
+#endif
 	// ComPtr will automatically release the resources when it goes out of scope
 }
 
 // Initialize the Directx for our window
+#ifdef _WIN32
 bool GraphicsEngine::Initialize(HWND hwnd, int windowWidth, int windowHeight)
 {
+	// One worker per core, the window thread is thread 0
+	m_jobs = std::make_unique<JobSystem>();
+
 	UINT createDeviceFlags = 0;
 	#ifdef _DEBUG
 		createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
@@ -48,7 +75,7 @@ bool GraphicsEngine::Initialize(HWND hwnd, int windowWidth, int windowHeight)
 	swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;  // Remove any extra flags that might cause issues
 
 	// Log that we're starting device creation
-	OutputDebugString(L"Creating Device and SwapChain...\n");
+	LogMessage("Creating Device and SwapChain...\n");
 
 	// Create the device, device context and swap chain
 	//UINT createDeviceFlags = D3D11_CREATE_DEVICE_DEBUG; // enable debugging
@@ -76,18 +103,19 @@ bool GraphicsEngine::Initialize(HWND hwnd, int windowWidth, int windowHeight)
 		return false;
 	}
 
-	OutputDebugString(L"Device and SwapChain created successfully\n");
+	LogMessage("Device and SwapChain created successfully\n");
 
-	// Create a simple blend state
-D3D11_BLEND_DESC blendDesc = {};
-blendDesc.RenderTarget[0].BlendEnable = FALSE;
-blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	// Every state object comes from the cache, the ones the last run used are created right away
+	m_stateCache.Initialize(m_device.Get());
+	m_stateCache.Load(kStateListFile);
 
-Microsoft::WRL::ComPtr<ID3D11BlendState> blendState;
-m_device->CreateBlendState(&blendDesc, blendState.GetAddressOf());
+	// Create a simple blend state
+	D3D11_BLEND_DESC blendDesc = {};
+	blendDesc.RenderTarget[0].BlendEnable = FALSE;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 
-float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-m_context->OMSetBlendState(blendState.Get(), blendFactor, 0xFFFFFFFF);
+	float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	m_context->OMSetBlendState(m_stateCache.GetBlendState(blendDesc), blendFactor, 0xFFFFFFFF);
 
 	// Add this to your Initialize function after creating device
 	D3D11_RASTERIZER_DESC rastDesc = {};
@@ -96,22 +124,21 @@ m_context->OMSetBlendState(blendState.Get(), blendFactor, 0xFFFFFFFF);
 	rastDesc.FrontCounterClockwise = FALSE;  // This is the default
 	rastDesc.DepthClipEnable = TRUE;
 
-	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rastState;
-	HRESULT hr = m_device->CreateRasterizerState(&rastDesc, rastState.GetAddressOf());
-	if (SUCCEEDED(hr)) {
-		m_context->RSSetState(rastState.Get());
-		OutputDebugString(L"Rasterizer state set\n");
+	ID3D11RasterizerState* rastState = m_stateCache.GetRasterizerState(rastDesc);
+	if (rastState) {
+		m_context->RSSetState(rastState);
+		LogMessage("Rasterizer state set\n");
 	}
 
 
 	// Create the render target
 	if (!CreateRenderTarget())
 	{
-		OutputDebugString(L"Failed to create render target\n");
+		LogMessage("Failed to create render target\n");
 		return false;
 	}
 
-	OutputDebugString(L"Render target created successfully\n");
+	LogMessage("Render target created successfully\n");
 
 	// set up the viewport
 	D3D11_VIEWPORT viewport = {}; // create a viewport
@@ -122,37 +149,77 @@ m_context->OMSetBlendState(blendState.Get(), blendFactor, 0xFFFFFFFF);
 
 	if (m_context) {
 		m_context->RSSetViewports(1, &viewport); // set the viewport
-		OutputDebugString(L"Viewport set successfully\n");
+		LogMessage("Viewport set successfully\n");
 	}
 	else {
-		OutputDebugString(L"Failed to set viewport\n");
+		LogMessage("Failed to set viewport\n");
 		return false;
 	}
 
 	// Create the shaders
 	if (!CreateShaders())
 	{
-		OutputDebugString(L"Failed to create shaders\n");
+		LogMessage("Failed to create shaders\n");
 		return false;
 	}
 
 	// Create the triangle
 	if (!CreateTriangle())
 	{
-		OutputDebugString(L"Failed to create triangle\n");
+		LogMessage("Failed to create triangle\n");
 		return false;
 	}
 
-	// Create the constant buffer
-	if (!CreateConstantBuffer())
+	// Create the constant buffers
+	if (!CreateConstantBuffers())
 	{
-		OutputDebugString(L"Failed to create constant buffer\n");
+		LogMessage("Failed to create constant buffers\n");
+		return false;
+	}
+
+	// Create the rings for the per-frame data
+	if (!CreateFrameRings())
+	{
+		LogMessage("Failed to create frame rings\n");
 		return false;
 	}
 
 	return true;
 }
+#endif
+
+bool GraphicsEngine::InitializeHeadless(int width, int height, unsigned threadCount)
+{
+	LogMessage("Creating software renderer...\n");
+
+	m_backend = RenderBackend::Software;
+	m_jobs = std::make_unique<JobSystem>(threadCount);
+	m_softwareRenderer = std::make_unique<SoftwareRenderer>();
+	if (!m_softwareRenderer->Initialize(width, height, *m_jobs))
+	{
+		LogMessage("Failed to create software renderer\n");
+		return false;
+	}
 
+	// Only the vertex data is needed, there are no GPU shaders or buffers to create
+	if (!CreateTriangle())
+	{
+		LogMessage("Failed to create triangle\n");
+		return false;
+	}
+
+	// The constants are copied by the renderer and the instances live in CPU memory until Flush
+	if (!CreateConstantBuffers())
+	{
+		LogMessage("Failed to create constant buffers\n");
+		return false;
+	}
+	m_softwareInstanceRing.Initialize(kInstanceRingSize);
+
+	return true;
+}
+
+#ifdef _WIN32
 bool GraphicsEngine::CreateRenderTarget()
 {
 	// Get the back buffer from the swap chain
@@ -161,7 +228,7 @@ bool GraphicsEngine::CreateRenderTarget()
 	// Check if we got the back buffer
 	if (FAILED(result))
 	{
-		OutputDebugString(L"Failed to get back buffer\n");
+		LogMessage("Failed to get back buffer\n");
 		return false;
 	}
 
@@ -174,113 +241,683 @@ bool GraphicsEngine::CreateRenderTarget()
 
 	if (FAILED(result))
 	{
-		OutputDebugString(L"Failed to create render target view\n");
+		LogMessage("Failed to create render target view\n");
 		return false;
 	}
 
 	// set the render target
-	m_context->OMSetRenderTargets(1, m_renderTarget.GetAddressOf(), nullptr);
+	m_stateBackend.SetContext(m_context.Get());
+	m_state.SetRenderTarget(m_renderTarget.Get(), nullptr);
 
 	return true;
 }
 
 void GraphicsEngine::BeginFrame(const Window& window)
 {
-	if (!m_renderTarget)
+	BeginFrame(window.GetWidth(), window.GetHeight());
+}
+#endif
+
+void GraphicsEngine::BeginFrame(int viewWidth, int viewHeight)
+{
+	PROFILE_SCOPE("GraphicsEngine::BeginFrame");
+
+	// The packet of this frame, with a render thread this waits while it is framesInFlight frames behind
+	m_packet = m_renderThread.IsRunning() ? &m_renderThread.BeginFrame() : &m_inlinePacket;
+
+	// Frame constants, the clock
+	float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_startTime).count();
+	FrameConstants& frameConstants = m_packet->frameConstants;
+	frameConstants = {};
+	frameConstants.time = time;
+	frameConstants.deltaTime = time - m_lastFrameTime;
+	m_lastFrameTime = time;
+
+	// World matrices, only the nodes that moved since the last frame are recomputed
+	m_scene.Update();
+
+	// View matrix from camera position, kept from the last frame while the camera doesn't move
+	bool cameraChanged = false;
+	if (m_viewDirty)
+	{
+		m_view = SimdMath::MatrixTranspose(m_camera.GetView());
+		m_viewDirty = false;
+		cameraChanged = true;
+	}
+
+	// Projection matrix, same thing with the window size
+	float aspect = static_cast<float>(viewWidth) / static_cast<float>(viewHeight);
+	if (aspect != m_projectionAspect)
 	{
-		OutputDebugString(L"Render target is null in BeginFrame\n");
+		m_projection = SimdMath::MatrixTranspose(SimdMath::MatrixPerspectiveFovLH(
+			SimdMath::kPiDiv4, // 45 degrees
+			aspect,
+			kNearPlane,
+			kFarPlane
+		));
+		m_projectionAspect = aspect;
+		cameraChanged = true;
+	}
+
+	// Frustum planes for culling, from the transposed view * projection (projection^T * view^T)
+	if (cameraChanged)
+	{
+		SimdMath::Float4x4 viewProjection;
+		SimdMath::StoreFloat4x4(&viewProjection, SimdMath::MatrixMultiply(m_projection, m_view));
+		m_frustum = ExtractFrustumPlanes(&viewProjection.m[0][0]);
+	}
+
+	// Pass constants, the shader gets transposed matrices
+	m_packet->passConstants.view = m_view;
+	m_packet->passConstants.projection = m_projection;
+
+	// Occluders are rendered with this frame's camera
+	SimdMath::StoreFloat4x4(&m_world, SimdMath::MatrixTranspose(m_scene.GetWorld(m_triangleNode)));
+	if (m_occlusionCuller)
+	{
+		SimdMath::Float4x4 view;
+		SimdMath::Float4x4 projection;
+		SimdMath::StoreFloat4x4(&view, m_view);
+		SimdMath::StoreFloat4x4(&projection, m_projection);
+		m_occlusionCuller->BeginFrame(&view.m[0][0], &projection.m[0][0]);
+	}
+}
+
+void GraphicsEngine::EndFrame()
+{
+	PROFILE_SCOPE("GraphicsEngine::EndFrame");
+
+	// The occluders first, every draw below is tested against them
+	uint32_t instanceCount = static_cast<uint32_t>(m_triangleInstances.size());
+	if (m_occlusionCuller)
+	{
+		for (uint32_t instance : m_occluderInstances)
+		{
+			if (instance < instanceCount)
+			{
+				m_occlusionCuller->RenderOccluder(&m_triangleVertices[0].position.x, sizeof(Vertex), nullptr, 3, &m_triangleInstances[instance].world.m[0][0]);
+			}
+		}
+	}
+
+	// Queue the draws of the frame, hidden objects are never submitted
+	RenderPacket& packet = *m_packet;
+	packet.drawQueue.Clear();
+	packet.objectWorlds.clear();
+	float viewDepth = 0.0f;
+	if (IsDrawVisible(m_triangleBoundsMin, m_triangleBoundsMax, viewDepth))
+	{
+		// draw the triangle (3 vertices, starting at index 0), opaque so front to back
+		uint64_t key = MakeDrawKey(kOpaquePass, kTriangleShader, kTriangleMaterial, GetDrawKeyDepth(viewDepth, false));
+		packet.drawQueue.Add(key, { 3, 0, 0, 0, static_cast<uint32_t>(packet.objectWorlds.size()) });
+		packet.objectWorlds.push_back(m_world);
+	}
+
+	// The visible instances in one draw, sorted by the nearest of them
+	m_visibleInstances = 0;
+	float nearestInstanceDepth = 0.0f;
+	if (instanceCount > 0)
+	{
+		// Indices on the scratch arena, culling every frame doesn't touch the heap
+		ArenaScope scratch(GetScratchArena());
+		uint32_t* visible = scratch.GetArena().Allocate<uint32_t>(instanceCount);
+		const float* bounds = m_instanceBounds.data();
+		BoxArrays boxes = { bounds, bounds + instanceCount, bounds + instanceCount * 2,
+			bounds + instanceCount * 3, bounds + instanceCount * 4, bounds + instanceCount * 5 };
+		m_visibleInstances = CullBoxes(m_frustum, boxes, instanceCount, visible, m_jobs.get());
+		if (m_occlusionCuller)
+		{
+			// Then the occlusion test, on the box of the triangle placed by the instance's world (tighter than
+			// the world box). The occluders are drawn without it, they are in the buffer already.
+			uint32_t kept = 0;
+			for (uint32_t i = 0; i < m_visibleInstances; i++)
+			{
+				uint32_t instance = visible[i];
+				bool occluder = instance < m_isOccluderInstance.size() && m_isOccluderInstance[instance];
+				if (occluder || m_occlusionCuller->IsVisible(m_triangleBoundsMin, m_triangleBoundsMax, &m_triangleInstances[instance].world.m[0][0]))
+				{
+					visible[kept++] = instance;
+				}
+			}
+			m_visibleInstances = kept;
+		}
+		// View space z of the center of an instance's box
+		auto getInstanceDepth = [&](uint32_t instance)
+		{
+			SimdMath::Vector center = SimdMath::VectorSet(bounds[instance], bounds[instanceCount + instance], bounds[instanceCount * 2 + instance], 1.0f);
+			return SimdMath::VectorGetX(SimdMath::Vector4Dot(m_view.r[2], center));
+		};
+		if (m_instancing)
+		{
+			packet.instances.reserve(m_visibleInstances);
+			for (uint32_t i = 0; i < m_visibleInstances; i++)
+			{
+				float depth = getInstanceDepth(visible[i]);
+				nearestInstanceDepth = i == 0 ? depth : std::min(nearestInstanceDepth, depth);
+				packet.instances.push_back(m_triangleInstances[visible[i]]);
+			}
+		}
+		else
+		{
+			// One draw each, sorted front to back by the center of its box
+			packet.objectWorlds.reserve(packet.objectWorlds.size() + m_visibleInstances);
+			for (uint32_t i = 0; i < m_visibleInstances; i++)
+			{
+				uint32_t instance = visible[i];
+				float depth = getInstanceDepth(instance);
+				uint64_t key = MakeDrawKey(kOpaquePass, kTriangleShader, kTriangleMaterial, GetDrawKeyDepth(depth, false));
+				packet.drawQueue.Add(key, { 3, 0, 0, 0, static_cast<uint32_t>(packet.objectWorlds.size()) });
+				packet.objectWorlds.push_back(m_triangleInstances[instance].world);
+			}
+		}
+	}
+	if (!packet.instances.empty())
+	{
+		uint64_t key = MakeDrawKey(kOpaquePass, kInstancedTriangleShader, kTriangleMaterial, GetDrawKeyDepth(nearestInstanceDepth, false));
+		packet.drawQueue.Add(key, { 3, 0, static_cast<uint32_t>(packet.instances.size()), 0, 0 });
+	}
+
+	// Sorted here, the render thread only walks the draws
+	packet.drawQueue.Sort();
+	packet.depthTest = m_depthTest;
+
+	m_packet = nullptr;
+	if (m_renderThread.IsRunning())
+	{
+		m_renderThread.SubmitFrame();
+	}
+	else
+	{
+		RenderFrame(packet);
+	}
+}
+
+void GraphicsEngine::SetRenderThread(uint32_t framesInFlight)
+{
+	m_renderThread.Stop();
+	if (framesInFlight > 0)
+	{
+		m_renderThread.Start(framesInFlight, [this](RenderPacket& packet) { RenderFrame(packet); });
+	}
+}
+
+void GraphicsEngine::Flush()
+{
+	if (m_renderThread.IsRunning())
+	{
+		m_renderThread.Flush();
+	}
+}
+
+void GraphicsEngine::RenderFrame(RenderPacket& packet)
+{
+	PROFILE_SCOPE("GraphicsEngine::RenderFrame");
+
+#ifdef _WIN32
+	if (m_backend == RenderBackend::Direct3D11 && !m_renderTarget)
+	{
+		LogMessage("Render target is null in RenderFrame\n");
+		packet.ResetArena();
 		return;
 	}
+#endif
+	m_renderPacket = &packet;
 
 	// Clear with a VERY different color - bright purple for visibility 
 	float clearColor[4] = { 0.5f, 0.0f, 0.5f, 1.0f }; // Bright purple
-	m_context->ClearRenderTargetView(m_renderTarget.Get(), clearColor); // clear the render target
 
-	// *** IMPORTANT: Re-bind render target every frame ***
-	m_context->OMSetRenderTargets(1, m_renderTarget.GetAddressOf(), nullptr);
+	if (m_backend == RenderBackend::Software)
+	{
+		m_softwareRenderer->SetDepthTest(packet.depthTest);
+		m_softwareRenderer->ClearRenderTarget(clearColor);
+		if (packet.depthTest)
+		{
+			m_softwareRenderer->ClearDepth(1.0f);
+		}
+	}
+#ifdef _WIN32
+	else
+	{
+		m_context->ClearRenderTargetView(m_renderTarget.Get(), clearColor); // clear the render target
+
+		// Reuse the ring memory of the frames the GPU is done with and map the rings for this frame
+		RetireFrames();
+		MapFrameRing(m_instanceRing);
+
+		// The pipeline state is bound by the draw queue below, only for what the draws need
+	}
+#endif
+
+	// Only the bytes that changed since the last frame are uploaded, the object constants go with their draw
+	m_constantStats = {};
+	m_constantBlocks[kFrameConstantsSlot].Write(0, packet.frameConstants);
+	m_constantBlocks[kPassConstantsSlot].Write(0, packet.passConstants);
+	UploadConstants(kFrameConstantsSlot);
+	UploadConstants(kPassConstantsSlot);
+
+	// More instances than the ring holds: the instanced draw is skipped (m_instanceOffset is kAllocationFailed)
+	m_instanceOffset = RingAllocator::kAllocationFailed;
+	if (!packet.instances.empty())
+	{
+		WriteInstances(packet.instances.data(), static_cast<uint32_t>(packet.instances.size()));
+	}
+
+	if (m_backend == RenderBackend::Software)
+	{
+		// Run the recorded work (there is nothing to present)
+		packet.drawQueue.Submit(*this);
+		m_softwareRenderer->Flush();
+
+		// Nothing reads the instances after Flush
+		m_softwareInstanceRing.EndFrame();
+		m_softwareInstanceRing.RetireFrame();
+		packet.ResetArena();
+		m_renderPacket = nullptr;
+		if (m_frameRendered)
+		{
+			m_frameRendered();
+		}
+		return;
+	}
+
+#ifdef _WIN32
+	// The GPU can't read a buffer that's still mapped
+	UnmapFrameRing(m_instanceRing);
+
+	// Sorted by state, BindPass/BindShader/BindMaterial only run when the state changes
+	// and m_state drops what is still bound from the last frame
+	packet.drawQueue.Submit(*this);
+
+	// Present the frame to the screen
+	m_swapChain->Present(1, 0);
+
+	// With the flip model Present unbinds the back buffer, the rest of the state stays
+	m_state.InvalidateRenderTarget();
+	m_stateStats = m_state.GetStats();
+	m_state.ResetStats();
+
+	// The ring memory of this frame is in use until its fence is done
+	m_context->End(m_frameFences[m_frameNumber % kFramesInFlight].Get());
+	m_instanceRing.allocator.EndFrame();
+	m_frameNumber++;
+	packet.ResetArena();
+	m_renderPacket = nullptr;
+	if (m_frameRendered)
+	{
+		m_frameRendered();
+	}
+#endif
+}
+
+void GraphicsEngine::BindPass([[maybe_unused]] uint32_t pass)
+{
+	// Only one pass for now, straight into the back buffer
+	if (m_backend == RenderBackend::Software)
+	{
+		return;
+	}
+#ifdef _WIN32
+	m_state.SetRenderTarget(m_renderTarget.Get(), nullptr);
+	m_state.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// The constant buffers stay bound, updating them doesn't need a rebind, only the first frame binds them
+	for (uint32_t slot = 0; slot < kConstantSlotCount; slot++)
+	{
+		m_state.SetVertexConstantBuffer(slot, m_constantBuffers[slot].Get());
+	}
+#endif
+}
+
+void GraphicsEngine::BindShader(uint32_t shader)
+{
+	bool instanced = shader == kInstancedTriangleShader;
+	if (m_backend == RenderBackend::Software)
+	{
+		// The CPU backend runs the kernels generated from the same HLSL
+		static_assert(sizeof(InstanceData) == sizeof(SoftwareInstance), "InstanceData and SoftwareInstance must match");
+		if (instanced)
+		{
+			m_softwareRenderer->SetVertexShader(MakeSoftwareVertexShader<InstancedVertexShaderKernel>());
+			m_softwareRenderer->SetPixelShader(MakeSoftwarePixelShader<InstancedPixelShaderKernel>());
+			if (m_instanceOffset != RingAllocator::kAllocationFailed)
+			{
+				m_softwareRenderer->SetInstanceBuffer(reinterpret_cast<const SoftwareInstance*>(m_softwareInstanceRing.GetData() + m_instanceOffset), static_cast<uint32_t>(m_renderPacket->instances.size()));
+			}
+		}
+		else
+		{
+			m_softwareRenderer->SetVertexShader(MakeSoftwareVertexShader<VertexShaderKernel>());
+			m_softwareRenderer->SetPixelShader(MakeSoftwarePixelShader<PixelShaderKernel>());
+		}
+		return;
+	}
+
+#ifdef _WIN32
+	if (instanced && m_instanceOffset != RingAllocator::kAllocationFailed)
+	{
+		// The instances come from slot 1, next to the vertices
+		m_state.SetVertexBuffer(1, m_instanceRing.buffer.Get(), sizeof(InstanceData), m_instanceOffset);
+	}
+	m_state.SetInputLayout(instanced ? m_instancedInputLayout.Get() : m_inputLayout.Get());
+	m_state.SetVertexShader(instanced ? m_instancedVertexShader.Get() : m_vertexShader.Get());
+	m_state.SetPixelShader(m_pixelShader.Get());
+#endif
+}
+
+void GraphicsEngine::BindMaterial([[maybe_unused]] uint32_t material)
+{
+	if (m_backend == RenderBackend::Software)
+	{
+		// The CPU backend reads the same vertex layout as the GPU input layout
+		static_assert(sizeof(Vertex) == sizeof(SoftwareVertex), "Vertex and SoftwareVertex must match");
+		m_softwareRenderer->SetVertexBuffer(reinterpret_cast<const SoftwareVertex*>(m_triangleVertices), static_cast<uint32_t>(std::size(m_triangleVertices)));
+		return;
+	}
 
-	// Set up pipeline
+#ifdef _WIN32
 	// Set up vertex buffer with proper stride
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	m_context->IASetVertexBuffers(0, 1, m_vertexBuffer.GetAddressOf(), &stride, &offset);
-	m_context->IASetInputLayout(m_inputLayout.Get());
-	m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	m_context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
-	m_context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
-	
-	// Update the constant buffer
-	// create a simple rotation for the triangle
-	ConstantBufferData cbData;
-	static float rotationAngle = 0.0f;
-	rotationAngle += 0.01f; // increment the rotation angle
-
-	// Create world matrix with rotation
-	cbData.world = DirectX::XMMatrixRotationRollPitchYaw(m_rotationX, m_rotationY, 0.0f);
-
-	// Create view matrix from camera position
-	cbData.view = DirectX::XMMatrixLookAtLH(
-		m_cameraPosition,
-		m_cameraTarget,
-		m_upVector
-	);
+	m_state.SetVertexBuffer(0, m_vertexBuffer.Get(), sizeof(Vertex), 0);
+#endif
+}
 
-	// Create projection matrix
-	cbData.projection = DirectX::XMMatrixPerspectiveFovLH(
-		DirectX::XM_PIDIV4, // 45 degrees
-		static_cast<float>(window.GetWidth()) / static_cast<float>(window.GetHeight()),
-		0.1f, // Near plane
-		100.0f // Far plane
-	);
+void GraphicsEngine::SubmitDraw(const DrawCommand& command)
+{
+	// The instances didn't fit in the ring this frame
+	if (command.instanceCount > 0 && m_instanceOffset == RingAllocator::kAllocationFailed)
+	{
+		return;
+	}
+
+	// The object's constants, only uploaded when it moved (the instances have their own world matrices)
+	if (command.instanceCount == 0)
+	{
+		ObjectConstants objectConstants;
+		objectConstants.world = SimdMath::LoadFloat4x4(&m_renderPacket->objectWorlds[command.object]);
+		m_constantBlocks[kObjectConstantsSlot].Write(0, objectConstants);
+		UploadConstants(kObjectConstantsSlot);
+	}
 
-	// transpose the matrices for the shader
-	cbData.world = DirectX::XMMatrixTranspose(cbData.world);
-	cbData.view = DirectX::XMMatrixTranspose(cbData.view);
-	cbData.projection = DirectX::XMMatrixTranspose(cbData.projection);
+	if (m_backend == RenderBackend::Software)
+	{
+		if (command.instanceCount > 0)
+		{
+			m_softwareRenderer->DrawInstanced(command.vertexCount, command.instanceCount, command.startVertex, command.startInstance);
+		}
+		else
+		{
+			m_softwareRenderer->Draw(command.vertexCount, command.startVertex);
+		}
+		return;
+	}
 
-	m_context->VSSetConstantBuffers(0, 1, m_constantBuffer.GetAddressOf());
-	// Update the constant buffer
-	m_context->UpdateSubresource(m_constantBuffer.Get(), 0, nullptr, &cbData, 0, 0);
+#ifdef _WIN32
+	if (command.instanceCount > 0)
+	{
+		m_context->DrawInstanced(command.vertexCount, command.instanceCount, command.startVertex, command.startInstance);
+	}
+	else
+	{
+		m_context->Draw(command.vertexCount, command.startVertex);
+	}
+#endif
 }
 
-void GraphicsEngine::EndFrame()
+void GraphicsEngine::SetTriangleInstances(const InstanceData* instances, uint32_t instanceCount)
 {
-	//draw the triangle
-	m_context->Draw(3, 0); // draw the triangle (3 vertices, starting at index 0)
+	m_triangleInstances.assign(instances, instances + instanceCount);
 
-	// Present the frame to the screen
-	m_swapChain->Present(1, 0);
+	// World box of every instance, as arrays for the SIMD culler
+	m_instanceBounds.resize(static_cast<size_t>(instanceCount) * 6);
+	const uint32_t kChunkSize = 1024;
+	auto computeBounds = [&](uint32_t chunk, uint32_t)
+	{
+		uint32_t end = std::min(instanceCount, (chunk + 1) * kChunkSize);
+		for (uint32_t i = chunk * kChunkSize; i < end; i++)
+		{
+			float center[3];
+			float extents[3];
+			TransformBounds(m_triangleBoundsMin, m_triangleBoundsMax, &instances[i].world.m[0][0], center, extents);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				m_instanceBounds[axis * instanceCount + i] = center[axis];
+				m_instanceBounds[(axis + 3) * instanceCount + i] = extents[axis];
+			}
+		}
+	};
+	uint32_t chunkCount = (instanceCount + kChunkSize - 1) / kChunkSize;
+	if (m_jobs)
+	{
+		m_jobs->ParallelFor(chunkCount, computeBounds);
+	}
+	else
+	{
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			computeBounds(chunk, 0);
+		}
+	}
 }
 
-bool GraphicsEngine::CreateShaders() {
-	// load and compile the vertex shader
-	Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob;
-	Microsoft::WRL::ComPtr<ID3DBlob> errorBlob;
-
-	HRESULT hr = D3DCompileFromFile(L"VertexShader.hlsl",
-		nullptr, //optional defines
-		nullptr, //optonal include 
-		"main", // entry point function name
-		"vs_5_0", // shader model
-		D3DCOMPILE_DEBUG, // shader compile options
-		0, // effect compile options
-		vertexShaderBlob.GetAddressOf(), // compiled shader
-		errorBlob.GetAddressOf() // error messages
-	);
+void GraphicsEngine::SetTriangleOccluders(const uint32_t* instances, uint32_t count)
+{
+	m_occluderInstances.assign(instances, instances + count);
+	m_isOccluderInstance.clear();
+	for (uint32_t instance : m_occluderInstances)
+	{
+		if (instance >= m_isOccluderInstance.size())
+		{
+			m_isOccluderInstance.resize(instance + 1, 0);
+		}
+		m_isOccluderInstance[instance] = 1;
+	}
+}
 
-	if (FAILED(hr)) {
-		// if the shader failed to compile, display an error message
-		if (errorBlob) {
-			OutputDebugStringA(reinterpret_cast<const char*>(
-				errorBlob->GetBufferPointer()));
+bool GraphicsEngine::WriteInstances(const InstanceData* instanceData, uint32_t instanceCount)
+{
+	uint32_t size = static_cast<uint32_t>(instanceCount * sizeof(InstanceData));
+	void* instances = nullptr;
+	if (m_backend == RenderBackend::Software)
+	{
+		instances = m_softwareInstanceRing.Allocate(size, 16, m_instanceOffset);
+	}
+#ifdef _WIN32
+	else
+	{
+		instances = AllocateFrameData(m_instanceRing, size, 16, m_instanceOffset);
+	}
+#endif
+
+	// More instances than the ring holds, they aren't drawn
+	if (!instances)
+	{
+		return false;
+	}
+	memcpy(instances, instanceData, size);
+	return true;
+}
+
+#ifdef _WIN32
+void GraphicsEngine::RetireFrames()
+{
+	while (m_instanceRing.allocator.GetFramesInFlight() > 0)
+	{
+		uint32_t framesInFlight = m_instanceRing.allocator.GetFramesInFlight();
+		ID3D11Query* fence = m_frameFences[(m_frameNumber - framesInFlight) % kFramesInFlight].Get();
+
+		// When every fence is in use there's nothing to do but wait for the oldest one
+		bool wait = framesInFlight == kFramesInFlight;
+		HRESULT hr;
+		do
+		{
+			hr = m_context->GetData(fence, nullptr, 0, wait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		} while (hr == S_FALSE && wait);
+		if (hr != S_OK)
+		{
+			return;
+		}
+
+		m_instanceRing.allocator.RetireFrame();
+	}
+}
+
+bool GraphicsEngine::MapFrameRing(FrameRing& ring)
+{
+	// NO_OVERWRITE promises not to touch what the GPU may be reading, the fences make sure of it
+	D3D11_MAP mapType = ring.discarded ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(m_context->Map(ring.buffer.Get(), 0, mapType, 0, &mapped)))
+	{
+		ring.mapped = nullptr;
+		return false;
+	}
+	ring.mapped = static_cast<uint8_t*>(mapped.pData);
+	ring.discarded = true;
+	return true;
+}
+#endif
+
+void GraphicsEngine::UploadConstants(uint32_t slot)
+{
+	ConstantBlock& block = m_constantBlocks[slot];
+	m_constantStats.bytesTotal += block.GetSize();
+	if (!block.IsDirty())
+	{
+		return;
+	}
+
+	uint32_t begin = block.GetDirtyBegin();
+	uint32_t end = block.GetDirtyEnd();
+	if (m_backend == RenderBackend::Software)
+	{
+		m_softwareRenderer->UpdateConstantBuffer(slot, begin, block.GetData() + begin, end - begin);
+	}
+#ifdef _WIN32
+	else if (m_partialConstantUpdates)
+	{
+		// The box of a buffer is in bytes, the source is the first byte of the box
+		D3D11_BOX box = { begin, 0, 0, end, 1, 1 };
+		m_context1->UpdateSubresource1(m_constantBuffers[slot].Get(), 0, &box, block.GetData() + begin, 0, 0, 0);
+	}
+	else
+	{
+		// Without driver support a constant buffer can only be updated whole
+		begin = 0;
+		end = block.GetSize();
+		m_context->UpdateSubresource(m_constantBuffers[slot].Get(), 0, nullptr, block.GetData(), 0, 0);
+	}
+#endif
+
+	m_constantStats.uploads++;
+	m_constantStats.bytesUploaded += end - begin;
+	block.ClearDirty();
+}
+
+#ifdef _WIN32
+void GraphicsEngine::UnmapFrameRing(FrameRing& ring)
+{
+	if (ring.mapped)
+	{
+		m_context->Unmap(ring.buffer.Get(), 0);
+		ring.mapped = nullptr;
+	}
+}
+
+void* GraphicsEngine::AllocateFrameData(FrameRing& ring, uint32_t size, uint32_t alignment, uint32_t& offset)
+{
+	offset = RingAllocator::kAllocationFailed;
+	if (!ring.mapped)
+	{
+		return nullptr;
+	}
+	offset = ring.allocator.Allocate(size, alignment);
+	if (offset == RingAllocator::kAllocationFailed)
+	{
+		return nullptr;
+	}
+	return ring.mapped + offset;
+}
+#endif
+
+bool GraphicsEngine::IsDrawVisible(const float boundsMin[3], const float boundsMax[3], float& viewDepth)
+{
+	// Outside the view first, it's much cheaper than the occlusion test
+	float center[3];
+	float extents[3];
+	TransformBounds(boundsMin, boundsMax, &m_world.m[0][0], center, extents);
+	if (!IsBoxInFrustum(m_frustum, center, extents))
+	{
+		return false;
+	}
+
+	// Row 2 of the transposed view matrix gives the view space z
+	viewDepth = SimdMath::VectorGetX(SimdMath::Vector4Dot(m_view.r[2], SimdMath::VectorSet(center[0], center[1], center[2], 1.0f)));
+
+	if (!m_occlusionCuller)
+	{
+		return true;
+	}
+	return m_occlusionCuller->IsVisible(boundsMin, boundsMax, &m_world.m[0][0]);
+}
+
+#ifdef _WIN32
+namespace
+{
+	// Compiled code of a shader, from the precompiled archive when its sources didn't change since,
+	// otherwise from the shader cache, only compiled when the cache doesn't have it yet
+	bool LoadShader(const ShaderArchive& archive, ShaderCache& cache, EngineShaderSet set, ShaderBytecode& bytecode)
+	{
+		const ShaderPermutationSet& permutations = GetEngineShaderSets()[set];
+		ShaderCompileDesc desc = GetPermutationDesc(permutations, 0);
+
+		// Without the sources (a build that only ships the archive) the archive is all there is
+		uint64_t key;
+		bool haveSources = ComputeShaderKey(desc, key);
+		int archiveSet = archive.FindSet(permutations.name);
+		if ((!haveSources || archive.GetSourceKey(archiveSet, 0) == key) && archive.GetPermutation(archiveSet, 0, bytecode))
+		{
+			return true;
+		}
+		if (!haveSources)
+		{
+			LogMessage("Failed to read a shader source\n");
+			return false;
 		}
+
+		auto compile = [&](std::vector<uint8_t>& code)
+		{
+			D3DShaderCompiler compiler;
+			std::string errors;
+			if (!compiler.Compile(desc, code, errors))
+			{
+				// if the shader failed to compile, display an error message
+				LogText(errors.c_str());
+				return false;
+			}
+			return true;
+		};
+		return cache.GetOrCompile(key, compile, bytecode);
+	}
+}
+
+bool GraphicsEngine::CreateShaders() {
+	// The shaders ShaderPrecompiler built, and the ones compiled by the last runs
+	// The bytecode points into the mapped files, the cache's until Save
+	static_assert(kShaderCompileDebug == D3DCOMPILE_DEBUG, "kShaderCompileDebug must be D3DCOMPILE_DEBUG");
+	ShaderArchive shaderArchive;
+	shaderArchive.Open(kShaderArchiveFile, kD3DCompilerTag);
+	ShaderCache shaderCache;
+	shaderCache.Open(kShaderCacheFile);
+
+	// load the vertex shader
+	ShaderBytecode vertexShaderBlob;
+	if (!LoadShader(shaderArchive, shaderCache, kVertexShaderSet, vertexShaderBlob)) {
 		return false;
 	}
 
 	// create the shader object
-	hr = m_device->CreateVertexShader(
-		vertexShaderBlob->GetBufferPointer(),
-		vertexShaderBlob->GetBufferSize(),
+	HRESULT hr = m_device->CreateVertexShader(
+		vertexShaderBlob.data,
+		vertexShaderBlob.size,
 		nullptr,
 		m_vertexShader.GetAddressOf()
 	);
@@ -290,32 +927,16 @@ bool GraphicsEngine::CreateShaders() {
 		return false;
 	}
 
-	// load and compile the pixel shader
-	Microsoft::WRL::ComPtr<ID3DBlob> pixelShaderBlob;
-	hr = D3DCompileFromFile(L"PixelShader.hlsl",
-		nullptr, //optional defines
-		nullptr, //optonal include 
-		"main", // entry point function name
-		"ps_5_0", // shader model
-		D3DCOMPILE_DEBUG, // shader compile options
-		0, // effect compile options
-		pixelShaderBlob.GetAddressOf(), // compiled shader
-		errorBlob.GetAddressOf() // error messages
-	);
-
-	if (FAILED(hr)) {
-		// if the shader failed to compile, display an error message
-		if (errorBlob) {
-			OutputDebugStringA(reinterpret_cast<const char*>(
-				errorBlob->GetBufferPointer()));
-		}
+	// load the pixel shader
+	ShaderBytecode pixelShaderBlob;
+	if (!LoadShader(shaderArchive, shaderCache, kPixelShaderSet, pixelShaderBlob)) {
 		return false;
 	}
 
 	// Create the pixel shader object
 	hr = m_device->CreatePixelShader(
-		pixelShaderBlob->GetBufferPointer(),
-		pixelShaderBlob->GetBufferSize(),
+		pixelShaderBlob.data,
+		pixelShaderBlob.size,
 		nullptr,
 		m_pixelShader.GetAddressOf()
 	);
@@ -335,8 +956,8 @@ bool GraphicsEngine::CreateShaders() {
 	hr = m_device->CreateInputLayout(
 		layout, // input layout description
 		ARRAYSIZE(layout), // number of elements in the layout
-		vertexShaderBlob->GetBufferPointer(), // compiled vertex shader
-		vertexShaderBlob->GetBufferSize(), // size of the compiled shader
+		vertexShaderBlob.data, // compiled vertex shader
+		vertexShaderBlob.size, // size of the compiled shader
 		m_inputLayout.GetAddressOf() // input layout output
 	);
 
@@ -345,20 +966,87 @@ bool GraphicsEngine::CreateShaders() {
 		return false;
 	}
 
-	return SUCCEEDED(hr);
+	// same thing for the instanced vertex shader
+	ShaderBytecode instancedShaderBlob;
+	if (!LoadShader(shaderArchive, shaderCache, kInstancedVertexShaderSet, instancedShaderBlob)) {
+		return false;
+	}
+
+	hr = m_device->CreateVertexShader(
+		instancedShaderBlob.data,
+		instancedShaderBlob.size,
+		nullptr,
+		m_instancedVertexShader.GetAddressOf()
+	);
+
+	if (FAILED(hr)) {
+		return false;
+	}
+
+	// the vertices in slot 0, one InstanceData per instance in slot 1 (the world matrix is 4 rows)
+	D3D11_INPUT_ELEMENT_DESC instancedLayout[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "INSTANCEWORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCEWORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCEWORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCEWORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCECOLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 64, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+	};
+
+	hr = m_device->CreateInputLayout(
+		instancedLayout,
+		ARRAYSIZE(instancedLayout),
+		instancedShaderBlob.data,
+		instancedShaderBlob.size,
+		m_instancedInputLayout.GetAddressOf()
+	);
+
+	if (FAILED(hr)) {
+		return false;
+	}
+
+	// Keep what was compiled for the next run, nothing is written on a warm start
+	shaderCache.Save();
+	return true;
 }
+#endif
 
 bool GraphicsEngine::CreateTriangle() {
 	//define the vertices of our triangle
 	Vertex triangleVertices[] = {
-		{ DirectX::XMFLOAT3(0.0f, 0.9f, 0.5f), DirectX::XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f) },  // Top (YELLOW)
-		{ DirectX::XMFLOAT3(-0.9f, -0.9f, 0.5f), DirectX::XMFLOAT4(0.0f, 1.0f, 1.0f, 1.0f) }, // Bottom left (CYAN)
-		{ DirectX::XMFLOAT3(0.9f, -0.9f, 0.5f), DirectX::XMFLOAT4(1.0f, 0.3f, 0.3f, 1.0f) }   // Bottom right (LIGHT RED)
+		{ SimdMath::Float3(0.0f, 0.9f, 0.5f), SimdMath::Float4(1.0f, 1.0f, 0.0f, 1.0f), SimdMath::Float2(0.5f, 0.0f) },  // Top (YELLOW)
+		{ SimdMath::Float3(-0.9f, -0.9f, 0.5f), SimdMath::Float4(0.0f, 1.0f, 1.0f, 1.0f), SimdMath::Float2(0.0f, 1.0f) }, // Bottom left (CYAN)
+		{ SimdMath::Float3(0.9f, -0.9f, 0.5f), SimdMath::Float4(1.0f, 0.3f, 0.3f, 1.0f), SimdMath::Float2(1.0f, 1.0f) }   // Bottom right (LIGHT RED)
 	};
 
+	// keep a CPU copy for the software backend
+	memcpy(m_triangleVertices, triangleVertices, sizeof(triangleVertices));
+
+	// and its bounds for the occlusion culler
+	SimdMath::Vector boundsMin = SimdMath::LoadFloat3(&triangleVertices[0].position);
+	SimdMath::Vector boundsMax = boundsMin;
+	for (const Vertex& vertex : triangleVertices)
+	{
+		boundsMin = SimdMath::VectorMin(boundsMin, SimdMath::LoadFloat3(&vertex.position));
+		boundsMax = SimdMath::VectorMax(boundsMax, SimdMath::LoadFloat3(&vertex.position));
+	}
+	SimdMath::StoreFloat3(reinterpret_cast<SimdMath::Float3*>(m_triangleBoundsMin), boundsMin);
+	SimdMath::StoreFloat3(reinterpret_cast<SimdMath::Float3*>(m_triangleBoundsMax), boundsMax);
+
+	// the triangle gets its own node in the scene
+	m_scene.Clear();
+	m_triangleNode = m_scene.AddNode(TransformHierarchy::kNoParent, SimdMath::MatrixRotationRollPitchYaw(m_rotationX, m_rotationY, 0.0f));
+
+	if (m_backend == RenderBackend::Software) {
+		return true;
+	}
+
+#ifdef _WIN32
 	// create the vertex buffer description
 	D3D11_BUFFER_DESC vertexBufferDesc = {};
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT; // default usage
+	vertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE; // written once at creation
 	vertexBufferDesc.ByteWidth = sizeof(triangleVertices); // size of the buffer
 	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // bind as a vertex buffer
 	vertexBufferDesc.CPUAccessFlags = 0; // no CPU access
@@ -375,51 +1063,122 @@ bool GraphicsEngine::CreateTriangle() {
 	);
 
 	for (int i = 0; i < 3; i++) {
-		std::ostringstream oss;
-		oss << "Vertex " << i << " Position: ("
-			<< triangleVertices[i].position.x << ", "
-			<< triangleVertices[i].position.y << ", "
-			<< triangleVertices[i].position.z << ") Color: ("
-			<< triangleVertices[i].color.x << ", "
-			<< triangleVertices[i].color.y << ", "
-			<< triangleVertices[i].color.z << ", "
-			<< triangleVertices[i].color.w << ")" << std::endl;
-		OutputDebugStringA(oss.str().c_str());
+		LogMessage("Vertex %d Position: (%g, %g, %g) Color: (%g, %g, %g, %g)\n", i,
+			triangleVertices[i].position.x, triangleVertices[i].position.y, triangleVertices[i].position.z,
+			triangleVertices[i].color.x, triangleVertices[i].color.y, triangleVertices[i].color.z, triangleVertices[i].color.w);
 	}
 
 	D3D11_BUFFER_DESC desc;
 	m_vertexBuffer->GetDesc(&desc);
-	std::ostringstream oss;
-	oss << "Vertex buffer size: " << desc.ByteWidth << " bytes, for "
-		<< (desc.ByteWidth / sizeof(Vertex)) << " vertices" << std::endl;
-	OutputDebugStringA(oss.str().c_str());
+	LogMessage("Vertex buffer size: %u bytes, for %u vertices\n",
+		desc.ByteWidth, static_cast<uint32_t>(desc.ByteWidth / sizeof(Vertex)));
 
 
 
 	// Check if the vertex buffer was created successfully
 	return SUCCEEDED(hr);
+#else
+	return false;
+#endif
+}
+
+bool GraphicsEngine::CreateConstantBuffers()
+{
+	// The CPU copies, the generated kernels of the software backend read the same layouts
+	static_assert(sizeof(FrameConstants) == sizeof(GeneratedFrameConstants), "FrameConstants doesn't match the shaders");
+	static_assert(sizeof(PassConstants) == sizeof(GeneratedPassConstants), "PassConstants doesn't match the shaders");
+	static_assert(sizeof(ObjectConstants) == sizeof(GeneratedObjectConstants), "ObjectConstants doesn't match the shaders");
+	static_assert(kFrameConstantsSlot == kGeneratedFrameConstantsSlot && kPassConstantsSlot == kGeneratedPassConstantsSlot
+		&& kObjectConstantsSlot == kGeneratedObjectConstantsSlot, "the constant buffer slots don't match the registers of the shaders");
+	const uint32_t sizes[kConstantSlotCount] = { sizeof(FrameConstants), sizeof(PassConstants), sizeof(ObjectConstants) };
+	for (uint32_t slot = 0; slot < kConstantSlotCount; slot++)
+	{
+		m_constantBlocks[slot].Initialize(sizes[slot]);
+	}
+
+	if (m_backend == RenderBackend::Software)
+	{
+		return true;
+	}
+
+#ifdef _WIN32
+	// Partial updates are D3D11.1 (Windows 8 and later) and up to the driver, otherwise the blocks are uploaded whole
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(m_context.As(&m_context1))
+		&& SUCCEEDED(m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+	{
+		m_partialConstantUpdates = options.ConstantBufferPartialUpdate != FALSE;
+	}
+
+	for (uint32_t slot = 0; slot < kConstantSlotCount; slot++)
+	{
+		// Create the constant buffer description
+		D3D11_BUFFER_DESC constantBufferDesc = {};
+		constantBufferDesc.Usage = D3D11_USAGE_DEFAULT; // updated with UpdateSubresource, only when something changed
+		constantBufferDesc.ByteWidth = m_constantBlocks[slot].GetSize(); // size of the buffer
+		constantBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; // bind as a constant buffer
+		constantBufferDesc.CPUAccessFlags = 0; // no CPU access
+
+		// Create the constant buffer
+		HRESULT hr = m_device->CreateBuffer(
+			&constantBufferDesc, // buffer description
+			nullptr, // no initial data
+			m_constantBuffers[slot].GetAddressOf() // constant buffer output
+		);
+		if (FAILED(hr))
+		{
+			return false;
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
 }
 
-bool GraphicsEngine::CreateConstantBuffer()
+#ifdef _WIN32
+bool GraphicsEngine::CreateFrameRings()
 {
-	// Create the constant buffer description
-	D3D11_BUFFER_DESC constantBufferDesc = {};
-	constantBufferDesc.Usage = D3D11_USAGE_DEFAULT; // default usage
-	constantBufferDesc.ByteWidth = sizeof(ConstantBufferData); // size of the buffer
-	constantBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; // bind as a constant buffer
-	constantBufferDesc.CPUAccessFlags = 0; // no CPU access
-
-	// Create the constant buffer
+	if (!CreateFrameRing(m_instanceRing, kInstanceRingSize, D3D11_BIND_VERTEX_BUFFER))
+	{
+		return false;
+	}
+
+	// One fence per frame in flight
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (Microsoft::WRL::ComPtr<ID3D11Query>& fence : m_frameFences)
+	{
+		if (FAILED(m_device->CreateQuery(&queryDesc, fence.GetAddressOf())))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool GraphicsEngine::CreateFrameRing(FrameRing& ring, uint32_t size, UINT bindFlags)
+{
+	ring.allocator.Initialize(size);
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC; // written by the CPU every frame
+	bufferDesc.ByteWidth = ring.allocator.GetCapacity();
+	bufferDesc.BindFlags = bindFlags;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
 	HRESULT hr = m_device->CreateBuffer(
-		&constantBufferDesc, // buffer description
+		&bufferDesc, // buffer description
 		nullptr, // no initial data
-		m_constantBuffer.GetAddressOf() // constant buffer output
+		ring.buffer.GetAddressOf() // buffer output
 	);
 
 	return SUCCEEDED(hr);
 }
 
 void GraphicsEngine::ProcessKeyboardInput(const Window& window, float deltaTime) {
+	PROFILE_SCOPE("GraphicsEngine::ProcessKeyboardInput");
+
 	// Rotate triangle with arrow keys
 	if (window.IsKeyPressed(VK_UP)) {
 		m_rotationX += m_rotationSpeed * deltaTime;
@@ -433,74 +1192,38 @@ void GraphicsEngine::ProcessKeyboardInput(const Window& window, float deltaTime)
 	if (window.IsKeyPressed(VK_RIGHT)) {
 		m_rotationY += m_rotationSpeed * deltaTime;
 	}
-	// Camera movement with WASD
-	DirectX::XMVECTOR forward = DirectX::XMVector3Normalize(
-		DirectX::XMVectorSubtract(m_cameraTarget, m_cameraPosition)
-	);
-
-	DirectX::XMVECTOR right = DirectX::XMVector3Normalize(
-		DirectX::XMVector3Cross(forward, m_upVector)
-	);
-
-	if (window.IsKeyPressed('W')) {
-		m_cameraPosition = DirectX::XMVectorAdd(
-			m_cameraPosition,
-			DirectX::XMVectorScale(forward, m_moveSpeed * deltaTime)
-		);
-		m_cameraTarget = DirectX::XMVectorAdd(
-			m_cameraTarget,
-			DirectX::XMVectorScale(forward, m_moveSpeed * deltaTime)
-		);
-	}
-	if (window.IsKeyPressed('S')) {
-		m_cameraPosition = DirectX::XMVectorSubtract(
-			m_cameraPosition,
-			DirectX::XMVectorScale(forward, m_moveSpeed * deltaTime)
-		);
-		m_cameraTarget = DirectX::XMVectorSubtract(
-			m_cameraTarget,
-			DirectX::XMVectorScale(forward, m_moveSpeed * deltaTime)
-		);
-	}
-	if (window.IsKeyPressed('A')) {
-		m_cameraPosition = DirectX::XMVectorSubtract(
-			m_cameraPosition,
-			DirectX::XMVectorScale(right, m_moveSpeed * deltaTime)
-		);
-		m_cameraTarget = DirectX::XMVectorSubtract(
-			m_cameraTarget,
-			DirectX::XMVectorScale(right, m_moveSpeed * deltaTime)
-		);
-	}
-	if (window.IsKeyPressed('D')) {
-		m_cameraPosition = DirectX::XMVectorAdd(
-			m_cameraPosition,
-			DirectX::XMVectorScale(right, m_moveSpeed * deltaTime)
-		);
-		m_cameraTarget = DirectX::XMVectorAdd(
-			m_cameraTarget,
-			DirectX::XMVectorScale(right, m_moveSpeed * deltaTime)
-		);
+	if (window.IsKeyPressed(VK_UP) || window.IsKeyPressed(VK_DOWN) || window.IsKeyPressed(VK_LEFT) || window.IsKeyPressed(VK_RIGHT)) {
+		m_scene.SetLocal(m_triangleNode, SimdMath::MatrixRotationRollPitchYaw(m_rotationX, m_rotationY, 0.0f));
 	}
+	// Camera movement with WASD
+	CameraInput input = {};
+	input.forward = window.IsKeyPressed('W');
+	input.back = window.IsKeyPressed('S');
+	input.left = window.IsKeyPressed('A');
+	input.right = window.IsKeyPressed('D');
+	ProcessCameraInput(input, deltaTime);
 }
 
 void GraphicsEngine::ProcessMouseInput(const Window& window, float deltaTime) {
 	// Use right mouse button to rotate the view
-	if (window.IsMouseButtonPressed(1)) { // 1 = right button
-		float mouseSensitivity = 0.005f;
-		float yawChange = window.GetMouseDeltaX() * mouseSensitivity;
-		float pitchChange = window.GetMouseDeltaY() * mouseSensitivity;
-
-		// Create rotation matrices
-		DirectX::XMMATRIX rotationMatrix = DirectX::XMMatrixRotationRollPitchYaw(pitchChange, yawChange, 0);
-
-		// Get the vector from camera to target
-		DirectX::XMVECTOR directionVector = DirectX::XMVectorSubtract(m_cameraTarget, m_cameraPosition);
-
-		// Apply rotation to this vector
-		directionVector = DirectX::XMVector3Transform(directionVector, rotationMatrix);
+	CameraInput input = {};
+	input.look = window.IsMouseButtonPressed(1); // 1 = right button
+	input.mouseDeltaX = window.GetMouseDeltaX();
+	input.mouseDeltaY = window.GetMouseDeltaY();
+	ProcessCameraInput(input, deltaTime);
+}
+#endif
 
-		// Set new target position based on rotated vector
-		m_cameraTarget = DirectX::XMVectorAdd(m_cameraPosition, directionVector);
+void GraphicsEngine::ProcessCameraInput(const CameraInput& input, float deltaTime)
+{
+	if (m_camera.Update(input, deltaTime))
+	{
+		m_viewDirty = true;
 	}
-}
\ No newline at end of file
+}
+
+void GraphicsEngine::SetCamera(const CameraController& camera)
+{
+	m_camera = camera;
+	m_viewDirty = true;
+}
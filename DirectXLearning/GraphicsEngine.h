@@ -1,90 +1,365 @@
 #pragma once
+#ifdef _WIN32
 #include <windows.h> // Windows header
 #include <d3d11.h> // Main DirectX 11 header
+#include <d3d11_1.h> // partial constant buffer updates (UpdateSubresource1)
 #include <wrl.h> // ComPtr smart pointers
 #include <d3dcompiler.h> // for shader compilation
-#include <sstream> // for error messages
-#include <DirectXMath.h>
+#endif
+#include "SimdMath.h" // matrices and vectors, portable DirectXMath subset
+#include <chrono> // frame time for the constants
+#include <functional> // frame rendered callback
+#include <memory> // unique_ptr
+#include <vector>
+#include "CameraController.h"
+#include "ConstantBlock.h"
+#ifdef _WIN32
+#include "D3D11StateBackend.h"
+#include "D3D11StateCache.h"
+#endif
+#include "DrawQueue.h"
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+#include "LinearArena.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "RenderThread.h"
+#include "RingAllocator.h"
+#include "ShaderCache.h"
+#include "ShaderPermutationList.h"
+#include "SoftwareRenderer.h"
+#include "StateFilteringContext.h" // StateFilterStats
+#include "TransformHierarchy.h"
 
+#ifdef _WIN32
 // We need to link with the DirectX libraries
 #pragma comment(lib, "d3d11.lib")
 // We also need to link with the DirectX shader compiler
 #pragma comment(lib, "d3dcompiler.lib")
+#endif
 
 // Forward declaration of the Window class
 class Window;
 
+// Which implementation of the pipeline the engine draws with
+enum class RenderBackend
+{
+	Direct3D11, // GPU through a swap chain (needs a window)
+	Software // CPU rasterizer into an in-memory render target (headless)
+};
+
 // Class to handle the DirectX rendering
-class GraphicsEngine
+// Draws go through a DrawQueue, the engine is the one binding the state it asks for
+// The window and the Direct3D11 backend are Windows only, the Software backend builds everywhere
+class GraphicsEngine : private DrawSubmitter
 {
 public:
 	GraphicsEngine();
 	~GraphicsEngine();
 
+#ifdef _WIN32
 	// Initialise the Directx for our window
 	bool Initialize(HWND hwnd, int windowWidth, int windowHeight);
+#endif
+	// Initialise the CPU backend instead, no window or GPU needed
+	bool InitializeHeadless(int width, int height, unsigned threadCount = 0);
 
-	// Clear the screen and prepare for drawing
+	// Start recording a frame: clock, scene transforms and camera
+#ifdef _WIN32
 	void BeginFrame(const Window& window);
-	// Present the finished frame to the screen
+#endif
+	void BeginFrame(int viewWidth, int viewHeight);
+	// Cull and queue the draws, then submit the frame (clear, upload, draw, present), right away
+	// or on the render thread
 	void EndFrame();
 
+	// Submit the frames on a render thread, BeginFrame/EndFrame then only record them and frame
+	// N+1 is simulated while frame N is submitted. framesInFlight (see RenderThread.h) is how far
+	// the simulation may run ahead, 0 stops the thread and EndFrame submits again.
+	// The D3D11 context is only used by the render thread while it runs.
+	void SetRenderThread(uint32_t framesInFlight);
+	// Wait until the render thread submitted every frame, the stats and the CPU render target
+	// below are those of the last submitted frame
+	void Flush();
+	// Called at the end of every submitted frame, on the thread that submits it (the render thread
+	// with SetRenderThread): until it returns the stats and the CPU render target are that frame's,
+	// without a Flush. Empty turns it off.
+	void SetFrameRenderedCallback(std::function<void()> callback) { m_frameRendered = std::move(callback); }
+
+#ifdef _WIN32
 	// Input response methods
 	void ProcessKeyboardInput(const Window& window, float deltaTime);
 	void ProcessMouseInput(const Window& window, float deltaTime);
+#endif
+	// Move the camera without a window (scripted paths, the benchmark), what the two above end up calling
+	void ProcessCameraInput(const CameraInput& input, float deltaTime);
+	// Replace the camera (position, target and speed), the next BeginFrame rebuilds the view
+	void SetCamera(const CameraController& camera);
+
+	RenderBackend GetBackend() const { return m_backend; }
+	// What the constant buffer uploads of the last frame cost
+	const ConstantUploadStats& GetConstantUploadStats() const { return m_constantStats; }
+	// State calls of the last frame that reached the D3D11 context and the ones that were dropped, nothing with the Software backend
+	const StateFilterStats& GetStateFilterStats() const { return m_stateStats; }
+	// The CPU render target, only valid with the Software backend
+	const SoftwareRenderer* GetSoftwareRenderer() const { return m_softwareRenderer.get(); }
+	// Worker threads of the engine, for culling/transform batches and other CPU work of the frame
+	// The software backend renders on them too. Created by Initialize/InitializeHeadless.
+	JobSystem* GetJobSystem() { return m_jobs.get(); }
+
+	// Test every draw against the occluders before submitting it, null turns culling off
+	// BeginFrame clears the culler and sets its camera, render the occluders into it before EndFrame
+	void SetOcclusionCuller(OcclusionCuller* culler) { m_occlusionCuller = culler; }
+
+	// One copy of the triangle, drawn with a single instanced draw
+	struct InstanceData
+	{
+		SimdMath::Float4x4 world; // transposed, like the matrices of the constant buffer
+		SimdMath::Float4 color; // multiplies the vertex colors
+	};
+
+	// Copies of the triangle to draw every frame on top of the triangle itself, empty by default
+	// Their world bounds are computed here, EndFrame culls them against the frustum and submits
+	// the visible ones in one instanced draw. Call it after Initialize/InitializeHeadless.
+	void SetTriangleInstances(const InstanceData* instances, uint32_t instanceCount);
+	// Instances (indices of the array above) that hide what is behind them: with an occlusion culler
+	// EndFrame renders them into it, then drops the other instances they hide. Empty by default.
+	void SetTriangleOccluders(const uint32_t* instances, uint32_t count);
+	// Instances that passed the frustum and occlusion tests in the last EndFrame
+	uint32_t GetVisibleInstanceCount() const { return m_visibleInstances; }
+	// Off: every visible instance is a draw of its own with its world in the object constants (and
+	// without its color, the plain shader has none), what instancing saves is the difference
+	void SetInstancing(bool enabled) { m_instancing = enabled; }
+	// Depth test the draws (LESS) against a depth buffer cleared to 1 every frame, off by default
+	// Software backend only, the D3D11 path has no depth buffer
+	void SetDepthTest(bool enabled) { m_depthTest = enabled; }
+	// World space planes of the camera of the last BeginFrame, what the instances are culled against
+	const FrustumPlanes& GetFrustum() const { return m_frustum; }
+	// View and projection of the last BeginFrame, transposed like the constant buffer (kept from one
+	// frame to the next while the camera and the aspect ratio don't change)
+	const SimdMath::Matrix& GetView() const { return m_view; }
+	const SimdMath::Matrix& GetProjection() const { return m_projection; }
+
+	// Clip planes of the projection, a 45 degree vertical field of view
+	static constexpr float kNearPlane = 0.1f;
+	static constexpr float kFarPlane = 100.0f;
 
 private:
-	
+#ifdef _WIN32
 	// Smart pointers for DirectX resources
 	// These will automatically release the resources when they go out of scope
 	Microsoft::WRL::ComPtr<ID3D11Device> m_device; // Creates ressources (textures, buffers, shaders)
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> m_context; // Sends commands to the GPU (Set up rendering pipeline)
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> m_context1; // same context, D3D11.1 interface for the partial constant buffer updates
 	Microsoft::WRL::ComPtr<IDXGISwapChain> m_swapChain; // Presents the rendered image to the screen (screen buffering)
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_renderTarget; // our canvas (where we draw)
 
+	// Blend, rasterizer, depth-stencil and sampler states, created from the saved list at startup
+	D3D11StateCache m_stateCache;
+
+	// Every state the draws bind goes through m_state, it drops what's already bound
+	D3D11StateBackend m_stateBackend;
+	StateFilteringContext m_state{ m_stateBackend };
+
 	// Add shader-related members
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_vertexShader; // Vertex shader
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> m_pixelShader; // Pixel shader
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> m_inputLayout; // Input layout
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_instancedVertexShader; // reads the world matrix from the instance buffer
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> m_instancedInputLayout; // vertex buffer in slot 0, instance buffer in slot 1
 	
-	// constant buffer for the vertex shader
+	// vertices of the triangle, they never change
 	Microsoft::WRL::ComPtr<ID3D11Buffer> m_vertexBuffer;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> m_constantBuffer;
+#endif
+	StateFilterStats m_stateStats = {};
+
+	// Frames the CPU can record ahead of the GPU, every one of them has a fence
+	static constexpr uint32_t kFramesInFlight = 3;
+	// Size of the instance ring, it holds kFramesInFlight frames of instances
+	static constexpr uint32_t kInstanceRingSize = 16 * 1024 * 1024;
+
+#ifdef _WIN32
+	// A dynamic buffer the per-frame data is sub-allocated from (see RingAllocator.h)
+	struct FrameRing
+	{
+		RingAllocator allocator;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		uint8_t* mapped = nullptr; // from BeginFrame to the submit in EndFrame
+		bool discarded = false; // mapped with DISCARD once, with NO_OVERWRITE after that
+	};
+	FrameRing m_instanceRing; // instances of the frame
+	Microsoft::WRL::ComPtr<ID3D11Query> m_frameFences[kFramesInFlight]; // event queries, done when the GPU finished the frame
+#endif
+	uint64_t m_frameNumber = 0; // frames submitted so far, picks the fence
+
+	// Where this frame's instances went in the ring
+	uint32_t m_instanceOffset = RingAllocator::kAllocationFailed;
+
+	// Constant buffers, split by how often they change, the slot is the register in the shaders
+	enum ConstantSlot : uint32_t { kFrameConstantsSlot, kPassConstantsSlot, kObjectConstantsSlot, kConstantSlotCount };
+#ifdef _WIN32
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_constantBuffers[kConstantSlotCount];
+	bool m_partialConstantUpdates = false; // UpdateSubresource1 with a box on a constant buffer needs driver support
+#endif
+	ConstantBlock m_constantBlocks[kConstantSlotCount]; // CPU copies, only their dirty ranges are uploaded
+	ConstantUploadStats m_constantStats = {};
+
+	// Ids packed in the draw keys
+	enum DrawPass : uint32_t { kOpaquePass };
+	enum DrawShader : uint32_t { kTriangleShader, kInstancedTriangleShader };
+	enum DrawMaterial : uint32_t { kTriangleMaterial };
+
+	// Descriptors of the state objects, written when the engine created new ones
+	static constexpr const wchar_t* kStateListFile = L"PipelineStates.bin";
+	// Compiled shaders, recompiled only when a source, an include or the options change
+	static constexpr const char* kShaderCacheFile = "ShaderCache.bin";
+	// Every shader permutation, built offline by ShaderPrecompiler (optional)
+	static constexpr const char* kShaderArchiveFile = "Shaders.pak";
+
+	// Shared by everything below, so it is destroyed last
+	std::unique_ptr<JobSystem> m_jobs;
+
+	// CPU backend
+	RenderBackend m_backend = RenderBackend::Direct3D11;
+	std::unique_ptr<SoftwareRenderer> m_softwareRenderer;
+	CpuRingBuffer m_softwareInstanceRing; // Flush is synchronous, it only ever holds the current frame
 
-	//structure for the constant buffer
-	struct ConstantBufferData
+	// structures for the constant buffers (FrameConstants, PassConstants and ObjectConstants in the shaders)
+	struct FrameConstants
 	{
-		DirectX::XMMATRIX world;
-		DirectX::XMMATRIX view;
-		DirectX::XMMATRIX projection;
+		float time; // seconds since the engine started
+		float deltaTime; // seconds since the last frame
+		float padding[2];
 	};
 
+	struct PassConstants
+	{
+		SimdMath::Matrix view;
+		SimdMath::Matrix projection;
+	};
+
+	struct ObjectConstants
+	{
+		SimdMath::Matrix world;
+	};
+
+	// Everything the submission of a frame reads, recorded by BeginFrame/EndFrame
+	// The render thread never touches the scene or the camera, they change with the next frame
+	// The lists of the frame are on the arena of the packet, reset once the frame is submitted
+	struct RenderPacket
+	{
+		LinearArena arena; // first, the vectors below allocate from it
+		FrameConstants frameConstants;
+		PassConstants passConstants;
+		DrawQueue drawQueue; // visible draws, sorted
+		ArenaVector<SimdMath::Float4x4> objectWorlds{ ArenaAllocator<SimdMath::Float4x4>(&arena) }; // world matrices (transposed) of the draws, DrawCommand::object indexes it
+		ArenaVector<InstanceData> instances{ ArenaAllocator<InstanceData>(&arena) };
+		bool depthTest = false; // SetDepthTest when the frame was recorded
+
+		// Drop the lists of the frame, the arena keeps its blocks for the next one
+		void ResetArena()
+		{
+			ResetArenaVector(objectWorlds, arena);
+			ResetArenaVector(instances, arena);
+			arena.Reset();
+		}
+	};
+
+	// Frames between the simulation and the submission, only used with SetRenderThread
+	RenderThread<RenderPacket> m_renderThread;
+	RenderPacket m_inlinePacket; // without the render thread
+	RenderPacket* m_packet = nullptr; // the frame being recorded, between BeginFrame and EndFrame
+	std::function<void()> m_frameRendered;
+	const RenderPacket* m_renderPacket = nullptr; // the frame being submitted, for the DrawSubmitter calls
+
+	// Clock of FrameConstants
+	std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now();
+	float m_lastFrameTime = 0.0f;
+
 	// Define our vertex structure
 	struct Vertex {
-		DirectX::XMFLOAT3 position; // Position in 3D space
-		DirectX::XMFLOAT4 color; 
-		DirectX::XMFLOAT2 texCoord; // Texture coordinates
+		SimdMath::Float3 position; // Position in 3D space
+		SimdMath::Float4 color; 
+		SimdMath::Float2 texCoord; // Texture coordinates
 	};
 
+	// CPU copy of the triangle, the software backend reads it directly
+	Vertex m_triangleVertices[3] = {};
+	// Object space bounding box of the triangle, for occlusion culling
+	float m_triangleBoundsMin[3] = {};
+	float m_triangleBoundsMax[3] = {};
+	// Instances of the triangle, and their world space boxes for culling (center x/y/z then extents x/y/z, one array each)
+	std::vector<InstanceData> m_triangleInstances;
+	std::vector<float> m_instanceBounds;
+	std::vector<uint32_t> m_occluderInstances;
+	std::vector<uint8_t> m_isOccluderInstance; // by instance, up to the last occluder
+	uint32_t m_visibleInstances = 0;
+	bool m_instancing = true;
+	bool m_depthTest = false;
+
+	// Occlusion culling, the culler is owned by the application
+	OcclusionCuller* m_occlusionCuller = nullptr;
+	SimdMath::Float4x4 m_world = {}; // world matrix of the frame, transposed like in the constant buffer
+
 	// Camera/view control
-	DirectX::XMVECTOR m_cameraPosition = DirectX::XMVectorSet(0.0f, 0.0f, -5.0f, 1.0f);
-	DirectX::XMVECTOR m_cameraTarget = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-	DirectX::XMVECTOR m_upVector = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f);
+	CameraController m_camera;
+
+	// View/projection of the last frame (transposed), only rebuilt when the camera moves or the aspect ratio changes
+	SimdMath::Matrix m_view = SimdMath::MatrixIdentity();
+	SimdMath::Matrix m_projection = SimdMath::MatrixIdentity();
+	bool m_viewDirty = true; // set whenever m_camera moves
+	float m_projectionAspect = 0.0f;
+	FrustumPlanes m_frustum = {}; // rebuilt with the view/projection
+
+	// Scene transforms, the triangle is a root node
+	TransformHierarchy m_scene;
+	uint32_t m_triangleNode = 0;
 
 	// Object control
 	float m_rotationX = 0.0f;
 	float m_rotationY = 0.0f;
 	float m_rotationSpeed = 2.0f;
-	float m_moveSpeed = 3.0f;
 
-	// add a helper function to create our constant buffer
-	bool CreateConstantBuffer();
+	// Create the constant buffers, the instance ring and the frame fences
+	bool CreateConstantBuffers();
+	// Send the dirty range of a constant block to its buffer, nothing when it's clean
+	void UploadConstants(uint32_t slot);
+
+#ifdef _WIN32
+	bool CreateFrameRings();
+	bool CreateFrameRing(FrameRing& ring, uint32_t size, UINT bindFlags);
+
+	// Give back the memory of the frames the GPU finished, waits when every fence is in use
+	void RetireFrames();
+
+	// Map the rings for the frame / unmap them before the draws
+	bool MapFrameRing(FrameRing& ring);
+	void UnmapFrameRing(FrameRing& ring);
+	// size bytes of a mapped ring, null when it's full, safe to call from several threads
+	void* AllocateFrameData(FrameRing& ring, uint32_t size, uint32_t alignment, uint32_t& offset);
 
 	bool CreateShaders(); // Helper function to create the shaders
 
 	// Helper function to create the render target 
 	bool CreateRenderTarget();
+#endif
 
 	// Add a helper function to create our triangle
 	bool CreateTriangle();
+
+	// Submit a recorded frame, on the render thread when there is one
+	void RenderFrame(RenderPacket& packet);
+
+	// Copy the instances into the instance ring of the backend, sets m_instanceOffset
+	bool WriteInstances(const InstanceData* instanceData, uint32_t instanceCount);
+
+	// False when an object with these bounds is outside the view or the occlusion culler says it is hidden
+	// viewDepth gets the distance of the bounds center along the view direction, for the draw key
+	bool IsDrawVisible(const float boundsMin[3], const float boundsMax[3], float& viewDepth);
+
+	// DrawSubmitter, called by the draw queue of the packet for the sorted draws
+	void BindPass(uint32_t pass) override;
+	void BindShader(uint32_t shader) override;
+	void BindMaterial(uint32_t material) override;
+	void SubmitDraw(const DrawCommand& command) override;
 };
\ No newline at end of file
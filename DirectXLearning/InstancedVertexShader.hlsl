@@ -0,0 +1,48 @@
+//same frame and pass constants as VertexShader.hlsl, no object constants (every instance has its own world matrix)
+cbuffer FrameConstants : register(b0)
+{
+    float Time; // seconds since the engine started
+    float DeltaTime; // seconds since the last frame
+};
+
+cbuffer PassConstants : register(b1)
+{
+    matrix View;
+    matrix Projection;
+};
+
+//vertex shader for instanced draws
+struct VertexInput
+{
+    float3 position : POSITION; // Vertex position
+    float4 color : COLOR; // Vertex color
+    // per instance data (second vertex buffer, D3D11_INPUT_PER_INSTANCE_DATA)
+    float4 world0 : INSTANCEWORLD0; // world matrix rows, transposed like the constant buffer
+    float4 world1 : INSTANCEWORLD1;
+    float4 world2 : INSTANCEWORLD2;
+    float4 world3 : INSTANCEWORLD3;
+    float4 tint : INSTANCECOLOR; // multiplies the vertex color
+};
+
+struct VertexOutput
+{
+    float4 position : SV_POSITION; // Screen position (SV means System Value)
+    float4 color : COLOR; // Vertex color
+};
+
+VertexOutput main(VertexInput input)
+{
+    VertexOutput output;
+    
+    // transform position from 3D to screen coordinates
+    float4 pos = float4(input.position, 1.0f);
+    
+    // apply the instance world matrix, then view and projection
+    pos = float4(dot(pos, input.world0), dot(pos, input.world1), dot(pos, input.world2), dot(pos, input.world3));
+    pos = mul(pos, View);
+    pos = mul(pos, Projection);
+    // tint the color
+    output.position = pos;
+    output.color = input.color * input.tint;
+    return output;
+}
@@ -0,0 +1,587 @@
+#include "JobSystem.h"
+#include <algorithm> // std::min
+#include <random> // std::mt19937 for the validation
+#include <string> // worker names in the profiler
+#include "Profiler.h"
+
+struct Job
+{
+	JobFunction function;
+
+	// ParallelFor jobs run a range of the task instead of a function
+	const TaskRef* rangeTask = nullptr;
+	uint32_t begin = 0;
+	uint32_t end = 0;
+
+	JobCounter* counter = nullptr;
+	Job* next = nullptr; // in the waiting list of a dependency, or in a free list
+	uint32_t owner = 0; // thread that allocated it, the one it is recycled by
+};
+
+namespace
+{
+	// Which system the current thread is a worker of, and its index there
+	thread_local const JobSystem* t_jobSystem = nullptr;
+	thread_local uint32_t t_threadIndex = 0;
+
+	// ParallelFor ranges per thread, enough for the stealing to balance uneven tasks
+	const uint32_t kRangesPerThread = 8;
+}
+
+JobSystem::JobSystem(unsigned threadCount)
+	: m_ownerThread(std::this_thread::get_id())
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0)
+	{
+		threadCount = 1; // hardware_concurrency is allowed to return 0
+	}
+
+	m_threadCount = threadCount;
+	for (unsigned i = 0; i < threadCount; i++)
+	{
+		m_threadData.push_back(std::make_unique<ThreadData>());
+	}
+
+	// The creating thread is thread 0, so we only create the others
+	for (unsigned i = 1; i < threadCount; i++)
+	{
+		m_threads.emplace_back(&JobSystem::WorkerMain, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_wakeUp.notify_all();
+
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+
+	// Everyone waited on their jobs, only the recycled storage is left
+	for (std::unique_ptr<ThreadData>& data : m_threadData)
+	{
+		while (Job* job = data->jobs.Pop())
+		{
+			delete job;
+		}
+		for (Job* list : { data->freeJobs, data->returnedJobs.load(std::memory_order_acquire) })
+		{
+			while (list)
+			{
+				Job* next = list->next;
+				delete list;
+				list = next;
+			}
+		}
+	}
+	for (Job* job : m_injected)
+	{
+		delete job;
+	}
+}
+
+void JobSystem::Run(JobFunction function, JobCounter* counter, JobCounter* dependency)
+{
+	uint32_t threadIndex = GetCurrentThreadIndex();
+	Job* job = AllocateJob(threadIndex);
+	job->function = std::move(function);
+	job->counter = counter;
+	if (counter)
+	{
+		counter->m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (dependency)
+	{
+		// Parked on the dependency, the job that brings it to zero queues it
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (dependency->m_count.load(std::memory_order_acquire) != 0)
+		{
+			job->next = dependency->m_waiting;
+			dependency->m_waiting = job;
+			return;
+		}
+	}
+	Enqueue(job, threadIndex, true);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	uint32_t threadIndex = GetCurrentThreadIndex();
+	while (!counter.IsDone())
+	{
+		// Threads of the system help, the others can only wait
+		if (threadIndex != kForeignThread)
+		{
+			if (Job* job = FindJob(threadIndex))
+			{
+				Execute(job, threadIndex);
+				continue;
+			}
+		}
+		std::this_thread::yield();
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t count, TaskRef task)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Not worth a job for a single task (other threads can't run tasks, their index could be in use)
+	uint32_t threadIndex = GetCurrentThreadIndex();
+	if (threadIndex == kForeignThread && m_threadCount == 1)
+	{
+		// Nobody would run the ranges before thread 0 waits on something, they run here
+		std::lock_guard<std::recursive_mutex> lock(m_foreignMutex);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			task(i, m_threadCount);
+		}
+		return;
+	}
+	if (threadIndex != kForeignThread && (count == 1 || m_threadCount == 1))
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			task(i, threadIndex);
+		}
+		return;
+	}
+
+	uint32_t rangeCount = std::min(count, GetThreadCount() * kRangesPerThread);
+	JobCounter counter;
+	counter.m_count.store(rangeCount, std::memory_order_relaxed);
+	for (uint32_t range = 0; range < rangeCount; range++)
+	{
+		Job* job = AllocateJob(threadIndex);
+		job->rangeTask = &task;
+		job->begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * range / rangeCount);
+		job->end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (range + 1) / rangeCount);
+		job->counter = &counter;
+		Enqueue(job, threadIndex, false);
+	}
+	WakeWorkers(rangeCount);
+
+	// The calling thread runs ranges too, from the end the thieves don't take
+	Wait(counter);
+}
+
+void JobSystem::WorkerMain(uint32_t threadIndex)
+{
+	t_jobSystem = this;
+	t_threadIndex = threadIndex;
+	SetProfilerThreadName(("Worker " + std::to_string(threadIndex)).c_str());
+
+	while (true)
+	{
+		if (Job* job = FindJob(threadIndex))
+		{
+			Execute(job, threadIndex);
+			continue;
+		}
+
+		// Nothing anywhere: sleep until a job is queued. m_sleepingWorkers is raised before
+		// m_queuedJobs is checked, so a thread queueing a job either sees the sleeper or the
+		// sleeper sees the job.
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+		m_wakeUp.wait(lock, [this] { return m_quit || m_queuedJobs.load(std::memory_order_seq_cst) > 0; });
+		m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+		if (m_quit)
+		{
+			return;
+		}
+	}
+}
+
+uint32_t JobSystem::GetCurrentThreadIndex() const
+{
+	if (t_jobSystem == this)
+	{
+		return t_threadIndex;
+	}
+	return std::this_thread::get_id() == m_ownerThread ? 0 : kForeignThread;
+}
+
+Job* JobSystem::AllocateJob(uint32_t threadIndex)
+{
+	if (threadIndex == kForeignThread)
+	{
+		Job* job = new Job();
+		job->owner = kForeignThread;
+		return job;
+	}
+
+	ThreadData& data = *m_threadData[threadIndex];
+	if (!data.freeJobs)
+	{
+		// What the other threads ran and gave back, all of it at once
+		data.freeJobs = data.returnedJobs.exchange(nullptr, std::memory_order_acquire);
+	}
+	if (Job* job = data.freeJobs)
+	{
+		data.freeJobs = job->next;
+		job->next = nullptr;
+		return job;
+	}
+	Job* job = new Job();
+	job->owner = threadIndex;
+	return job;
+}
+
+void JobSystem::FreeJob(Job* job, uint32_t threadIndex)
+{
+	// Drop the captures now, not when the storage gets reused
+	job->function = nullptr;
+	job->rangeTask = nullptr;
+	job->counter = nullptr;
+	if (job->owner == kForeignThread)
+	{
+		delete job;
+		return;
+	}
+
+	ThreadData& data = *m_threadData[job->owner];
+	if (job->owner == threadIndex)
+	{
+		job->next = data.freeJobs;
+		data.freeJobs = job;
+		return;
+	}
+	// Only the owner takes from the list and it takes the whole list, a plain push is enough
+	job->next = data.returnedJobs.load(std::memory_order_relaxed);
+	while (!data.returnedJobs.compare_exchange_weak(job->next, job, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+}
+
+void JobSystem::Enqueue(Job* job, uint32_t threadIndex, bool wake)
+{
+	// Counted before it is visible, so a thief never takes the count below zero
+	m_queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+	if (threadIndex == kForeignThread)
+	{
+		if (m_threadCount == 1)
+		{
+			// Nobody would pick it up before thread 0 waits on something
+			m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			Execute(job, kForeignThread);
+			return;
+		}
+		std::lock_guard<std::mutex> lock(m_injectedMutex);
+		m_injected.push_back(job);
+		m_injectedCount.fetch_add(1, std::memory_order_release);
+	}
+	else if (!m_threadData[threadIndex]->jobs.Push(job))
+	{
+		// Deque full, the job runs right away instead
+		m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		Execute(job, threadIndex);
+		return;
+	}
+
+	if (wake)
+	{
+		WakeWorkers(1);
+	}
+}
+
+Job* JobSystem::FindJob(uint32_t threadIndex)
+{
+	// Own jobs first, newest first, they are the ones still in the cache
+	Job* job = m_threadData[threadIndex]->jobs.Pop();
+
+	if (!job && m_injectedCount.load(std::memory_order_acquire) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_injectedMutex);
+		if (!m_injected.empty())
+		{
+			job = m_injected.front();
+			m_injected.pop_front();
+			m_injectedCount.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	// Then the oldest job of the other threads
+	uint32_t threadCount = GetThreadCount();
+	for (uint32_t i = 1; !job && i < threadCount; i++)
+	{
+		job = m_threadData[(threadIndex + i) % threadCount]->jobs.Steal();
+	}
+
+	if (job)
+	{
+		m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+void JobSystem::Execute(Job* job, uint32_t threadIndex)
+{
+	// Only a system without workers runs jobs on other threads, on the index after its own thread
+	std::unique_lock<std::recursive_mutex> foreignLock;
+	uint32_t taskThreadIndex = threadIndex;
+	if (threadIndex == kForeignThread)
+	{
+		foreignLock = std::unique_lock<std::recursive_mutex>(m_foreignMutex);
+		taskThreadIndex = m_threadCount;
+	}
+	{
+		PROFILE_SCOPE("Job");
+		if (job->rangeTask)
+		{
+			for (uint32_t i = job->begin; i < job->end; i++)
+			{
+				(*job->rangeTask)(i, taskThreadIndex);
+			}
+		}
+		else
+		{
+			job->function(taskThreadIndex);
+		}
+	}
+
+	JobCounter* counter = job->counter;
+	FreeJob(job, threadIndex);
+	if (counter)
+	{
+		Finish(counter, threadIndex);
+	}
+}
+
+void JobSystem::Finish(JobCounter* counter, uint32_t threadIndex)
+{
+	// Wait returns once both are zero, after that the counter may be gone
+	counter->m_finishing.fetch_add(1, std::memory_order_seq_cst);
+	if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		// Queue the jobs that waited on it, unless it was reused in the meantime
+		Job* waiting = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(counter->m_mutex);
+			if (counter->m_count.load(std::memory_order_acquire) == 0)
+			{
+				waiting = counter->m_waiting;
+				counter->m_waiting = nullptr;
+			}
+		}
+		while (waiting)
+		{
+			Job* next = waiting->next;
+			waiting->next = nullptr;
+			Enqueue(waiting, threadIndex, true);
+			waiting = next;
+		}
+	}
+	counter->m_finishing.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::WakeWorkers(uint32_t count)
+{
+	uint32_t sleeping = m_sleepingWorkers.load(std::memory_order_seq_cst);
+	if (sleeping == 0)
+	{
+		return;
+	}
+
+	// Taking the lock orders the notify after a sleeper's check of m_queuedJobs
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	if (count >= sleeping)
+	{
+		m_wakeUp.notify_all();
+	}
+	else
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			m_wakeUp.notify_one();
+		}
+	}
+}
+
+namespace
+{
+	// Marks one index as done, false when it already was
+	bool MarkDone(std::atomic<uint32_t>* done, uint32_t index)
+	{
+		return done[index].fetch_add(1, std::memory_order_relaxed) == 0;
+	}
+
+	// Uneven amount of work per index, like the tiles of the software renderer
+	uint32_t Spin(uint32_t amount)
+	{
+		uint32_t value = amount;
+		for (uint32_t i = 0; i < amount; i++)
+		{
+			value = value * 1664525u + 1013904223u;
+		}
+		return value;
+	}
+
+	// From thread 0 and from a thread outside the system at the same time
+	bool ValidateParallelFor(JobSystem& jobs, std::mt19937& random)
+	{
+		// A thread index is only used by one task at a time, it is what per-thread scratch relies on
+		std::unique_ptr<std::atomic<uint32_t>[]> busy(new std::atomic<uint32_t>[jobs.GetThreadIndexCount()]);
+		for (uint32_t i = 0; i < jobs.GetThreadIndexCount(); i++)
+		{
+			busy[i].store(0, std::memory_order_relaxed);
+		}
+
+		std::atomic<bool> failed{ false };
+		std::atomic<uint32_t> sink{ 0 };
+		auto run = [&](uint32_t count, uint32_t heavyEvery)
+		{
+			std::unique_ptr<std::atomic<uint32_t>[]> done(new std::atomic<uint32_t>[count + 1]);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				done[i].store(0, std::memory_order_relaxed);
+			}
+
+			jobs.ParallelFor(count, [&](uint32_t index, uint32_t threadIndex)
+			{
+				if (index >= count || threadIndex >= jobs.GetThreadIndexCount() || busy[threadIndex].exchange(1) != 0)
+				{
+					failed = true;
+					return;
+				}
+				sink.fetch_add(Spin(index % heavyEvery == 0 ? 2000 : 10), std::memory_order_relaxed);
+				if (!MarkDone(done.get(), index))
+				{
+					failed = true;
+				}
+				busy[threadIndex].store(0);
+			});
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (done[i].load(std::memory_order_relaxed) != 1)
+				{
+					failed = true;
+				}
+			}
+		};
+
+		uint32_t counts[2];
+		uint32_t heavyEvery[2];
+		for (int i = 0; i < 2; i++)
+		{
+			counts[i] = std::uniform_int_distribution<uint32_t>(0, 5000)(random);
+			heavyEvery[i] = std::uniform_int_distribution<uint32_t>(1, 64)(random);
+		}
+		std::thread foreign(run, counts[1], heavyEvery[1]);
+		run(counts[0], heavyEvery[0]);
+		foreign.join();
+		return !failed;
+	}
+
+	// Random DAG: every job depends on an earlier one (or nothing) and must start after it ended
+	bool ValidateDependencies(JobSystem& jobs, std::mt19937& random)
+	{
+		uint32_t count = std::uniform_int_distribution<uint32_t>(1, 500)(random);
+		std::unique_ptr<JobCounter[]> counters(new JobCounter[count]);
+		std::vector<uint32_t> dependencies(count);
+		std::unique_ptr<std::atomic<uint32_t>[]> order(new std::atomic<uint32_t>[count]);
+		std::atomic<uint32_t> sequence{ 1 };
+		JobCounter all;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			order[i].store(0, std::memory_order_relaxed);
+			dependencies[i] = std::uniform_int_distribution<uint32_t>(0, i)(random); // i = none
+			JobCounter* dependency = dependencies[i] < i ? &counters[dependencies[i]] : nullptr;
+			uint32_t spin = std::uniform_int_distribution<uint32_t>(0, 500)(random);
+			jobs.Run([&, i, spin](uint32_t)
+			{
+				Spin(spin);
+				order[i].store(sequence.fetch_add(1), std::memory_order_relaxed);
+			}, &counters[i], dependency);
+
+			// Also count it on the counter of all the jobs, through a job that only waits
+			jobs.Run([](uint32_t) {}, &all, &counters[i]);
+		}
+		jobs.Wait(all);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			jobs.Wait(counters[i]);
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t position = order[i].load(std::memory_order_relaxed);
+			if (position == 0 || (dependencies[i] < i && order[dependencies[i]].load(std::memory_order_relaxed) >= position))
+			{
+				return false;
+			}
+		}
+		return sequence == count + 1;
+	}
+
+	// Jobs that start ParallelFors and wait on them, from thread 0 and from a thread outside the system
+	bool ValidateNested(JobSystem& jobs, std::mt19937& random)
+	{
+		const uint32_t kOuter = 16;
+		uint32_t inner = std::uniform_int_distribution<uint32_t>(1, 300)(random);
+		std::atomic<uint64_t> sums[2];
+		sums[0] = 0;
+		sums[1] = 0;
+		auto outer = [&](uint32_t which)
+		{
+			JobCounter counter;
+			for (uint32_t i = 0; i < kOuter; i++)
+			{
+				jobs.Run([&, which, i](uint32_t)
+				{
+					jobs.ParallelFor(inner, [&, which, i](uint32_t index, uint32_t)
+					{
+						sums[which].fetch_add(static_cast<uint64_t>(i) * inner + index + 1, std::memory_order_relaxed);
+					});
+				}, &counter);
+			}
+			jobs.Wait(counter);
+		};
+
+		std::thread foreign(outer, 1);
+		outer(0);
+		foreign.join();
+
+		uint64_t total = static_cast<uint64_t>(kOuter) * inner;
+		uint64_t expected = total * (total + 1) / 2;
+		return sums[0] == expected && sums[1] == expected;
+	}
+}
+
+bool ValidateJobSystem(uint32_t seed, int iterations)
+{
+	std::mt19937 random(seed);
+	const unsigned kThreadCounts[] = { 1, 2, 4, 8 };
+	for (unsigned threadCount : kThreadCounts)
+	{
+		JobSystem jobs(threadCount);
+		if (jobs.GetThreadCount() != threadCount)
+		{
+			return false;
+		}
+		for (int i = 0; i < iterations; i++)
+		{
+			if (!ValidateParallelFor(jobs, random) || !ValidateDependencies(jobs, random) || !ValidateNested(jobs, random))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
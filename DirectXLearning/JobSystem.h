@@ -0,0 +1,155 @@
+#pragma once
+#include <atomic> // counters and the sleep state
+#include <condition_variable> // wake up sleeping workers
+#include <cstdint> // fixed size integers
+#include <deque> // jobs from threads outside the system
+#include <functional> // job callbacks
+#include <memory> // per-thread data
+#include <mutex> // sleep state, injected jobs and dependency lists
+#include <thread> // worker threads
+#include <type_traits> // TaskRef only binds callables
+#include <vector>
+#include "WorkStealingDeque.h"
+
+struct Job;
+
+// Counts the jobs that are still to run, Run adds one and the end of the job removes it
+// A counter can also be the dependency of other jobs, they start when it reaches zero.
+// It must outlive its jobs, Wait on it before it goes out of scope.
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0 && m_finishing.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> m_count{ 0 };
+	std::atomic<uint32_t> m_finishing{ 0 }; // jobs between their decrement and their last access to the counter
+
+	// Jobs waiting for the counter to reach zero, protected by m_mutex
+	std::mutex m_mutex;
+	Job* m_waiting = nullptr;
+};
+
+// threadIndex is in [0, GetThreadIndexCount()) and is stable for the duration of one job
+typedef std::function<void(uint32_t threadIndex)> JobFunction;
+
+// Non-owning reference to a task(index, threadIndex) callable, what ParallelFor takes
+// ParallelFor returns once the tasks ran, so the callable (a lambda passed in place included)
+// outlives them: nothing is copied and whatever the lambda captures, nothing goes on the heap.
+class TaskRef
+{
+public:
+	template<typename Function, typename = std::enable_if_t<!std::is_same<std::decay_t<Function>, TaskRef>::value>>
+	TaskRef(Function&& function)
+		: m_callable(const_cast<void*>(static_cast<const void*>(&function)))
+		, m_call(&Call<std::remove_reference_t<Function>>)
+	{
+	}
+
+	void operator()(uint32_t index, uint32_t threadIndex) const { m_call(m_callable, index, threadIndex); }
+
+private:
+	template<typename Function>
+	static void Call(void* callable, uint32_t index, uint32_t threadIndex)
+	{
+		(*static_cast<Function*>(callable))(index, threadIndex);
+	}
+
+	void* m_callable;
+	void (*m_call)(void* callable, uint32_t index, uint32_t threadIndex);
+};
+
+// Fixed pool of worker threads with one Chase-Lev deque each
+// A thread pushes its jobs on its own deque and runs them LIFO, idle threads steal the
+// oldest jobs of the others. The thread that creates the system is thread 0, it runs
+// jobs while it waits (Wait, ParallelFor), so a system of N threads spawns N - 1 workers.
+// Jobs can start more jobs and wait on them. Other threads can use the system too, their
+// jobs go through a shared queue and they only sleep while waiting. A system of 1 thread has
+// no worker to give them to: other threads run their jobs themselves, one at a time, with
+// a thread index of their own (the last one, see GetThreadIndexCount).
+class JobSystem
+{
+public:
+	// threadCount = 0 means "one thread per hardware core"
+	explicit JobSystem(unsigned threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Number of threads that run jobs (including the creating thread)
+	unsigned GetThreadCount() const { return m_threadCount; }
+	// Number of thread indices the jobs can see, what per-thread storage is sized by: one more than
+	// the threads on a system of 1 thread, for the other threads that run their jobs themselves
+	unsigned GetThreadIndexCount() const { return m_threadCount == 1 ? 2 : m_threadCount; }
+
+	// Queue a job, counter (optional) is incremented now and decremented when the job is done.
+	// With a dependency the job only starts once that counter is zero.
+	void Run(JobFunction function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Run other jobs until the counter is zero
+	void Wait(JobCounter& counter);
+
+	// Run task(index, threadIndex) for every index in [0, count) and wait until all are done
+	// The indices are split in ranges, several per thread so the stealing evens out uneven tasks
+	void ParallelFor(uint32_t count, TaskRef task);
+
+private:
+	// Per-thread state, on its own cache lines
+	struct alignas(64) ThreadData
+	{
+		ThreadData() : jobs(kDequeCapacity) {}
+
+		WorkStealingDeque<Job> jobs;
+		// Recycled storage of the jobs this thread allocated, a job always goes back to the
+		// thread it came from so the threads that queue jobs never run out and allocate again.
+		// The thread frees its jobs on freeJobs (only it touches the list), the others push
+		// them on returnedJobs, which it takes whole when freeJobs is empty.
+		Job* freeJobs = nullptr;
+		std::atomic<Job*> returnedJobs{ nullptr };
+	};
+
+	static const uint32_t kDequeCapacity = 4096;
+	static const uint32_t kForeignThread = ~0u;
+
+	void WorkerMain(uint32_t threadIndex);
+	uint32_t GetCurrentThreadIndex() const;
+	Job* AllocateJob(uint32_t threadIndex);
+	void FreeJob(Job* job, uint32_t threadIndex);
+	void Enqueue(Job* job, uint32_t threadIndex, bool wake);
+	Job* FindJob(uint32_t threadIndex);
+	void Execute(Job* job, uint32_t threadIndex);
+	void Finish(JobCounter* counter, uint32_t threadIndex);
+	void WakeWorkers(uint32_t count);
+
+	std::thread::id m_ownerThread;
+	unsigned m_threadCount = 1; // set before the workers start, they read it
+	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<ThreadData>> m_threadData;
+
+	// Jobs pushed by threads that don't belong to the system, protected by m_injectedMutex
+	std::mutex m_injectedMutex;
+	std::deque<Job*> m_injected;
+	std::atomic<uint32_t> m_injectedCount{ 0 }; // checked without the lock
+
+	// Held by a thread outside a system of 1 thread while it runs its jobs, they all get the same
+	// thread index. Recursive: its jobs can start more jobs, they run right away.
+	std::recursive_mutex m_foreignMutex;
+
+	// Sleep state: workers sleep when no deque has work, m_queuedJobs counts what's in them
+	std::atomic<uint32_t> m_queuedJobs{ 0 };
+	std::atomic<uint32_t> m_sleepingWorkers{ 0 };
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wakeUp;
+	bool m_quit = false;
+};
+
+// Runs the job system through dependencies, nested waits, foreign threads and uneven
+// ParallelFor tasks and checks every job ran exactly once on a valid thread
+bool ValidateJobSystem(uint32_t seed, int iterations);
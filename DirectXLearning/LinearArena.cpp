@@ -0,0 +1,273 @@
+#include "LinearArena.h"
+#include "JobSystem.h"
+#include <random>
+
+namespace
+{
+	std::atomic<uint64_t> g_blockAllocations{ 0 };
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	if (size == 0)
+	{
+		return nullptr;
+	}
+
+	for (;;)
+	{
+		// First block from the current position that has room, the ends of the full ones are skipped
+		while (m_block < m_blocks.size())
+		{
+			Block& block = m_blocks[m_block];
+			uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+			size_t start = static_cast<size_t>(((base + m_offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base);
+			if (start <= block.size && size <= block.size - start)
+			{
+				m_offset = start + size;
+				return block.data.get() + start;
+			}
+			m_block++;
+			m_offset = 0;
+		}
+
+		// Out of blocks, only happens while the arena grows to what the frames need
+		size_t blockSize = m_blocks.empty() ? m_firstBlockSize : m_blocks.back().size * 2;
+		while (blockSize < size + alignment)
+		{
+			blockSize *= 2;
+		}
+		m_blocks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[blockSize]), blockSize });
+		g_blockAllocations.fetch_add(1, std::memory_order_relaxed);
+		m_block = static_cast<uint32_t>(m_blocks.size() - 1);
+		m_offset = 0;
+	}
+}
+
+void LinearArena::Rewind(const Marker& marker)
+{
+	m_block = marker.block;
+	m_offset = marker.offset;
+}
+
+size_t LinearArena::GetUsedSize() const
+{
+	size_t used = m_block < m_blocks.size() ? m_offset : 0;
+	for (uint32_t i = 0; i < m_block && i < m_blocks.size(); i++)
+	{
+		used += m_blocks[i].size;
+	}
+	return used;
+}
+
+size_t LinearArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (const Block& block : m_blocks)
+	{
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+LinearArena& GetScratchArena()
+{
+	thread_local LinearArena arena;
+	return arena;
+}
+
+uint64_t GetArenaBlockAllocationCount()
+{
+	return g_blockAllocations.load(std::memory_order_relaxed);
+}
+
+namespace
+{
+	struct alignas(32) WideValue
+	{
+		uint32_t value[8];
+	};
+
+	uint32_t MakeValue(uint32_t frame, uint32_t list, size_t index)
+	{
+		return static_cast<uint32_t>(frame * 2654435761u + list * 40503u + index);
+	}
+
+	template<typename T>
+	bool IsAligned(const T* pointer)
+	{
+		return reinterpret_cast<uintptr_t>(pointer) % alignof(T) == 0;
+	}
+
+	// Vectors of every alignment filled one after the other, like the lists of a frame
+	// Fewer elements make a prefix of the allocations of more, so the biggest frame is the worst one
+	bool RecordFrame(LinearArena& arena, uint32_t frame, const uint32_t counts[4])
+	{
+		ArenaVector<uint8_t> bytes{ ArenaAllocator<uint8_t>(&arena) };
+		ArenaVector<uint32_t> words{ ArenaAllocator<uint32_t>(&arena) };
+		ArenaVector<double> doubles{ ArenaAllocator<double>(&arena) };
+		ArenaVector<WideValue> wides{ ArenaAllocator<WideValue>(&arena) };
+		for (uint32_t i = 0; i < counts[0]; i++)
+		{
+			bytes.push_back(static_cast<uint8_t>(MakeValue(frame, 0, i)));
+		}
+		for (uint32_t i = 0; i < counts[1]; i++)
+		{
+			words.push_back(MakeValue(frame, 1, i));
+		}
+		for (uint32_t i = 0; i < counts[2]; i++)
+		{
+			doubles.push_back(static_cast<double>(MakeValue(frame, 2, i)));
+		}
+		for (uint32_t i = 0; i < counts[3]; i++)
+		{
+			WideValue wide = {};
+			wide.value[i % 8] = MakeValue(frame, 3, i);
+			wides.push_back(wide);
+		}
+
+		// Nothing was overwritten by the allocations that came after
+		bool valid = (bytes.empty() || IsAligned(bytes.data())) && (words.empty() || IsAligned(words.data()))
+			&& (doubles.empty() || IsAligned(doubles.data())) && (wides.empty() || IsAligned(wides.data()));
+		for (uint32_t i = 0; i < counts[0] && valid; i++)
+		{
+			valid = bytes[i] == static_cast<uint8_t>(MakeValue(frame, 0, i));
+		}
+		for (uint32_t i = 0; i < counts[1] && valid; i++)
+		{
+			valid = words[i] == MakeValue(frame, 1, i);
+		}
+		for (uint32_t i = 0; i < counts[2] && valid; i++)
+		{
+			valid = doubles[i] == static_cast<double>(MakeValue(frame, 2, i));
+		}
+		for (uint32_t i = 0; i < counts[3] && valid; i++)
+		{
+			valid = wides[i].value[i % 8] == MakeValue(frame, 3, i);
+		}
+		return valid;
+	}
+
+	// Nested scratch scopes: each level allocates, recurses, and checks its data and the rewind
+	bool UseScratch(uint32_t seed, uint32_t depth, uint32_t maxCount)
+	{
+		LinearArena& scratch = GetScratchArena();
+		size_t usedBefore = scratch.GetUsedSize();
+		bool valid = true;
+		{
+			ArenaScope scope(scratch);
+			std::mt19937 random(seed);
+			uint32_t count = std::uniform_int_distribution<uint32_t>(1, maxCount)(random);
+			uint32_t* values = scratch.Allocate<uint32_t>(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				values[i] = MakeValue(seed, depth, i);
+			}
+			if (depth > 0)
+			{
+				valid = UseScratch(random(), depth - 1, maxCount);
+			}
+			for (uint32_t i = 0; i < count && valid; i++)
+			{
+				valid = values[i] == MakeValue(seed, depth, i);
+			}
+		}
+		return valid && scratch.GetUsedSize() == usedBefore;
+	}
+}
+
+bool ValidateLinearArena(JobSystem* pool, uint32_t seed, int frames)
+{
+	std::mt19937 random(seed);
+
+	// Alignment, zero sized allocations and markers on a tiny arena that has to grow
+	LinearArena arena(64);
+	if (arena.Allocate(0, 16) != nullptr || arena.GetCapacity() != 0)
+	{
+		return false;
+	}
+	for (size_t alignment = 1; alignment <= 256; alignment *= 2)
+	{
+		void* pointer = arena.Allocate(alignment * 3 + 1, alignment);
+		if (!pointer || reinterpret_cast<uintptr_t>(pointer) % alignment != 0)
+		{
+			return false;
+		}
+	}
+	LinearArena::Marker marker = arena.GetMarker();
+	void* first = arena.Allocate(1000, 8);
+	arena.Rewind(marker);
+	if (arena.Allocate(1000, 8) != first)
+	{
+		return false;
+	}
+	uint32_t blocks = arena.GetBlockAllocationCount();
+	arena.Reset();
+	if (arena.GetUsedSize() != 0 || arena.GetBlockAllocationCount() != blocks)
+	{
+		return false;
+	}
+
+	// Frames: the first ones are as big as any, after them the arenas never grow again
+	const uint32_t kMaxCounts[4] = { 3000, 2000, 1000, 300 };
+	const uint32_t kScratchDepth = 4;
+	const uint32_t kScratchCount = 500;
+	const uint32_t kTasks = 64;
+	int warmFrames = frames / 4 > 2 ? frames / 4 : 2;
+	LinearArena frameArena(1024);
+	uint32_t frameBlocks = 0;
+	uint32_t scratchBlocks = 0;
+	std::atomic<bool> failed{ false };
+	for (int frame = 0; frame < frames + warmFrames; frame++)
+	{
+		bool warming = frame < warmFrames;
+		uint32_t counts[4];
+		for (int i = 0; i < 4; i++)
+		{
+			counts[i] = warming ? kMaxCounts[i] : std::uniform_int_distribution<uint32_t>(0, kMaxCounts[i])(random);
+		}
+		if (!RecordFrame(frameArena, frame, counts))
+		{
+			return false;
+		}
+		frameArena.Reset();
+
+		// Scratch on the calling thread, the deepest nesting while warming up
+		uint32_t scratchSeed = random();
+		if (!UseScratch(scratchSeed, warming ? kScratchDepth : scratchSeed % (kScratchDepth + 1), warming ? 1 : kScratchCount))
+		{
+			return false;
+		}
+
+		// And on the workers, whichever thread runs which task
+		auto task = [&](uint32_t index, uint32_t)
+		{
+			if (!UseScratch(scratchSeed + index, kScratchDepth, kScratchCount))
+			{
+				failed = true;
+			}
+		};
+		if (pool)
+		{
+			pool->ParallelFor(kTasks, task);
+		}
+		else
+		{
+			for (uint32_t index = 0; index < kTasks; index++)
+			{
+				task(index, 0);
+			}
+		}
+		if (failed)
+		{
+			return false;
+		}
+
+		if (frame == warmFrames - 1)
+		{
+			frameBlocks = frameArena.GetBlockAllocationCount();
+			scratchBlocks = GetScratchArena().GetBlockAllocationCount();
+		}
+	}
+	return frameArena.GetBlockAllocationCount() == frameBlocks && GetScratchArena().GetBlockAllocationCount() == scratchBlocks;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic> // heap allocation counter
+#include <cstddef> // size_t, max_align_t
+#include <cstdint> // fixed size integers
+#include <memory> // blocks
+#include <vector>
+
+class JobSystem;
+
+// Bump allocator for data that dies all at once (a frame, a job)
+//
+// Allocating moves an offset in the current block, there is no free: Reset forgets everything,
+// Rewind goes back to a marker (scratch memory, see ArenaScope). When a block is full the next
+// one is used, and only when there is none a new block is taken from the heap, twice as big as
+// the last. Reset/Rewind keep the blocks, so once the arena has grown to what a frame needs
+// the following frames don't touch the heap at all.
+// Not thread safe, every thread has its own (see GetScratchArena).
+class LinearArena
+{
+public:
+	static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+	// Where the arena is, for Rewind
+	struct Marker
+	{
+		uint32_t block;
+		size_t offset;
+	};
+
+	explicit LinearArena(size_t firstBlockSize = kDefaultBlockSize) : m_firstBlockSize(firstBlockSize > 0 ? firstBlockSize : 1) {}
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	// alignment is a power of two, nullptr only when size is 0
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized room for count T
+	template<typename T>
+	T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	Marker GetMarker() const { return { m_block, m_offset }; }
+	// Free everything allocated since the marker was taken
+	void Rewind(const Marker& marker);
+	// Free everything, the blocks are kept for the next frame
+	void Reset() { Rewind({ 0, 0 }); }
+
+	// Bytes handed out since the last Reset (with the padding and the ends of the blocks skipped)
+	size_t GetUsedSize() const;
+	size_t GetCapacity() const;
+	// Blocks this arena took from the heap so far, stays put in steady state
+	uint32_t GetBlockAllocationCount() const { return static_cast<uint32_t>(m_blocks.size()); }
+
+private:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data;
+		size_t size;
+	};
+
+	std::vector<Block> m_blocks;
+	uint32_t m_block = 0; // current block, m_blocks.size() before the first allocation
+	size_t m_offset = 0; // in the current block
+	size_t m_firstBlockSize;
+};
+
+// Frees what was allocated in its scope when it ends, scopes nest like the stack
+class ArenaScope
+{
+public:
+	explicit ArenaScope(LinearArena& arena) : m_arena(arena), m_marker(arena.GetMarker()) {}
+	~ArenaScope() { m_arena.Rewind(m_marker); }
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	LinearArena& GetArena() { return m_arena; }
+
+private:
+	LinearArena& m_arena;
+	LinearArena::Marker m_marker;
+};
+
+// STL allocator on a LinearArena, deallocate does nothing (the arena is reset as a whole)
+// The container must be gone, or emptied with its memory given back, before the arena is reset.
+template<typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(LinearArena* arena) : m_arena(arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.GetArena()) {}
+
+	T* allocate(size_t count) { return m_arena->Allocate<T>(count); }
+	void deallocate(T*, size_t) {}
+
+	LinearArena* GetArena() const { return m_arena; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.GetArena(); }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.GetArena(); }
+
+private:
+	LinearArena* m_arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Empty vector on arena, the way to drop the memory of an ArenaVector before a Reset
+template<typename T>
+void ResetArenaVector(ArenaVector<T>& vector, LinearArena& arena)
+{
+	ArenaVector<T>(ArenaAllocator<T>(&arena)).swap(vector);
+}
+
+// Scratch arena of the calling thread, one per thread (the workers of the job system too)
+// Only use it inside an ArenaScope, whoever called you may have scratch data in it.
+LinearArena& GetScratchArena();
+
+// Heap blocks taken by every arena of the process so far, flat once the frames are warm
+uint64_t GetArenaBlockAllocationCount();
+
+// Frames of random arena vectors and nested scratch scopes, on every thread of pool (can be null):
+// checks the data survives until the reset, the alignment, the rewinds, and that no block is
+// allocated anymore once the first frames warmed the arenas up
+bool ValidateLinearArena(JobSystem* pool, uint32_t seed, int frames);
@@ -0,0 +1,25 @@
+#include "Log.h"
+#include <cstdarg> // va_list
+#include <cstdio> // vsnprintf
+#ifdef _WIN32
+#include <windows.h> // OutputDebugStringA
+#endif
+
+void LogText(const char* text)
+{
+#ifdef _WIN32
+	OutputDebugStringA(text);
+#else
+	std::fputs(text, stderr);
+#endif
+}
+
+void LogMessage(const char* format, ...)
+{
+	char message[1024];
+	va_list arguments;
+	va_start(arguments, format);
+	vsnprintf(message, sizeof(message), format, arguments);
+	va_end(arguments);
+	LogText(message);
+}
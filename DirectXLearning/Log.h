@@ -0,0 +1,8 @@
+#pragma once
+
+// Debug output of the engine: the debugger's output window on Windows (OutputDebugString),
+// stderr everywhere else, so the headless backend logs the same way on a build machine
+void LogText(const char* text);
+
+// printf style, formatted on the stack (messages longer than 1 KB are cut)
+void LogMessage(const char* format, ...);
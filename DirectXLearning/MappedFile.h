@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef> // size_t
+#include <cstdint> // fixed size integers
+#include <string>
+
+// Read-only view of a whole file, mapped instead of read (file mapping on Windows, mmap elsewhere)
+// The pages are only loaded when they're touched
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False when the file doesn't exist, is empty or can't be mapped
+	bool Open(const std::string& path);
+	// The file can be written again after this
+	void Close();
+
+	const uint8_t* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr; // HANDLE
+	void* m_mapping = nullptr; // HANDLE
+#endif
+};
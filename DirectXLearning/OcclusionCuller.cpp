@@ -0,0 +1,460 @@
+#include "OcclusionCuller.h"
+#include <algorithm> // min/max
+#include <cfloat> // FLT_EPSILON
+#include <cmath> // floor
+#include <random>
+#include "SimdMath.h"
+
+namespace
+{
+	// Same guard band as the renderer, keeps the fixed point edge functions small
+	const float kGuardBandPixels = 8192.0f;
+
+	// a * b with both matrices stored transposed (element (row, column) at column * 4 + row)
+	void MultiplyMatrices(const float a[16], const float b[16], float result[16])
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				result[column * 4 + row] = a[0 * 4 + row] * b[column * 4 + 0] + a[1 * 4 + row] * b[column * 4 + 1]
+					+ a[2 * 4 + row] * b[column * 4 + 2] + a[3 * 4 + row] * b[column * 4 + 3];
+			}
+		}
+	}
+
+	// mul(float4(position, 1), m), like the vertex shader
+	void TransformPoint(const float position[3], const float m[16], float result[4])
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			result[j] = position[0] * m[j * 4 + 0] + position[1] * m[j * 4 + 1] + position[2] * m[j * 4 + 2] + m[j * 4 + 3];
+		}
+	}
+
+	// Sutherland-Hodgman against one plane of clip space, only positions
+	template <typename DistanceFunc>
+	int ClipPolygon(const float (*input)[4], int inputCount, float (*output)[4], DistanceFunc distance)
+	{
+		int outputCount = 0;
+		for (int i = 0; i < inputCount; i++)
+		{
+			const float* current = input[i];
+			const float* next = input[(i + 1) % inputCount];
+			float currentDistance = distance(current);
+			float nextDistance = distance(next);
+
+			if (currentDistance >= 0.0f)
+			{
+				std::copy(current, current + 4, output[outputCount++]);
+			}
+			if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			{
+				float t = currentDistance / (currentDistance - nextDistance);
+				for (int c = 0; c < 4; c++)
+				{
+					output[outputCount][c] = current[c] + (next[c] - current[c]) * t;
+				}
+				outputCount++;
+			}
+		}
+		return outputCount;
+	}
+
+	// Pixels of an 8x8 block inside the columns [x0, x1] and rows [y0, y1]
+	uint64_t GetBlockBoundsMask(int x0, int x1, int y0, int y1)
+	{
+		uint64_t row = (0xFFull >> (kRasterBlockSize - 1 - (x1 - x0))) << x0;
+		uint64_t mask = 0;
+		for (int y = y0; y <= y1; y++)
+		{
+			mask |= row << (y * kRasterBlockSize);
+		}
+		return mask;
+	}
+}
+
+bool OcclusionCuller::Initialize(int width, int height)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_blocksX = (width + kRasterBlockSize - 1) / kRasterBlockSize;
+	m_blocksY = (height + kRasterBlockSize - 1) / kRasterBlockSize;
+	m_blocks.assign(static_cast<size_t>(m_blocksX) * m_blocksY, Block{ 0, 1.0f, 1.0f });
+
+	// Blocks on the right/bottom edge can stick out of the screen
+	m_offscreen.assign(m_blocks.size(), 0);
+	for (int by = 0; by < m_blocksY; by++)
+	{
+		for (int bx = 0; bx < m_blocksX; bx++)
+		{
+			int x1 = std::min(m_width - bx * kRasterBlockSize, kRasterBlockSize) - 1;
+			int y1 = std::min(m_height - by * kRasterBlockSize, kRasterBlockSize) - 1;
+			m_offscreen[static_cast<size_t>(by) * m_blocksX + bx] = ~GetBlockBoundsMask(0, x1, 0, y1);
+		}
+	}
+
+	SetSimdIsa(GetBestSimdIsa());
+	return true;
+}
+
+void OcclusionCuller::SetSimdIsa(SimdIsa isa)
+{
+	m_coverageKernel = GetBlockCoverageFunction(isa);
+}
+
+void OcclusionCuller::BeginFrame(const float view[16], const float projection[16])
+{
+	// Nothing drawn yet: every pixel is at the far plane
+	std::fill(m_blocks.begin(), m_blocks.end(), Block{ 0, 1.0f, 1.0f });
+	MultiplyMatrices(view, projection, m_viewProjection);
+	m_stats = {};
+}
+
+void OcclusionCuller::RenderOccluder(const float* positions, uint32_t stride, const uint32_t* indices, uint32_t count, const float world[16])
+{
+	if (m_blocks.empty())
+	{
+		return;
+	}
+
+	float worldViewProjection[16];
+	MultiplyMatrices(world, m_viewProjection, worldViewProjection);
+
+	const uint8_t* base = reinterpret_cast<const uint8_t*>(positions);
+	for (uint32_t i = 0; i + 2 < count; i += 3)
+	{
+		float clip[3][4];
+		for (int v = 0; v < 3; v++)
+		{
+			uint32_t index = indices ? indices[i + v] : i + v;
+			TransformPoint(reinterpret_cast<const float*>(base + static_cast<size_t>(index) * stride), worldViewProjection, clip[v]);
+		}
+		RasterizeTriangle(clip);
+	}
+}
+
+void OcclusionCuller::RasterizeTriangle(const float clip[3][4])
+{
+	// Near plane and guard band, no far plane: occluders past it can't hide anything anyway
+	float polygon[7][4];
+	float clipped[7][4];
+	for (int v = 0; v < 3; v++)
+	{
+		std::copy(clip[v], clip[v] + 4, polygon[v]);
+	}
+	float guardX = 1.0f + 2.0f * kGuardBandPixels / m_width;
+	float guardY = 1.0f + 2.0f * kGuardBandPixels / m_height;
+	int count = ClipPolygon(polygon, 3, clipped, [](const float* p) { return p[2]; });
+	count = ClipPolygon(clipped, count, polygon, [guardX](const float* p) { return guardX * p[3] - p[0]; });
+	count = ClipPolygon(polygon, count, clipped, [guardX](const float* p) { return guardX * p[3] + p[0]; });
+	count = ClipPolygon(clipped, count, polygon, [guardY](const float* p) { return guardY * p[3] - p[1]; });
+	count = ClipPolygon(polygon, count, clipped, [guardY](const float* p) { return guardY * p[3] + p[1]; });
+	if (count < 3)
+	{
+		return;
+	}
+
+	// Same viewport mapping and snapping as the renderer
+	int32_t fixedX[7];
+	int32_t fixedY[7];
+	float depth[7];
+	for (int i = 0; i < count; i++)
+	{
+		float invW = 1.0f / clipped[i][3];
+		float x = (clipped[i][0] * invW * 0.5f + 0.5f) * m_width;
+		float y = (0.5f - clipped[i][1] * invW * 0.5f) * m_height;
+		fixedX[i] = static_cast<int32_t>(std::floor(x * kRasterSubPixelOne + 0.5f));
+		fixedY[i] = static_cast<int32_t>(std::floor(y * kRasterSubPixelOne + 0.5f));
+		depth[i] = clipped[i][2] * invW;
+	}
+
+	for (int i = 1; i + 1 < count; i++)
+	{
+		int32_t x[3] = { fixedX[0], fixedX[i], fixedX[i + 1] };
+		int32_t y[3] = { fixedY[0], fixedY[i], fixedY[i + 1] };
+		float z[3] = { depth[0], depth[i], depth[i + 1] };
+		int64_t area = GetRasterTriangleArea(x, y);
+		if (area == 0)
+		{
+			continue;
+		}
+		if (area < 0)
+		{
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(z[1], z[2]);
+		}
+
+		RasterTriangle raster;
+		SetupRasterTriangle(x, y, raster);
+		int minX = std::max(raster.minX, 0);
+		int minY = std::max(raster.minY, 0);
+		int maxX = std::min(raster.maxX, m_width - 1);
+		int maxY = std::min(raster.maxY, m_height - 1);
+		if (minX > maxX || minY > maxY)
+		{
+			continue;
+		}
+		m_stats.occluderTriangles++;
+
+		// Depth plane, only its farthest value over a block matters
+		const float one = static_cast<float>(kRasterSubPixelOne);
+		float x0 = x[0] / one;
+		float y0 = y[0] / one;
+		float x10 = (x[1] - x[0]) / one;
+		float y10 = (y[1] - y[0]) / one;
+		float x20 = (x[2] - x[0]) / one;
+		float y20 = (y[2] - y[0]) / one;
+		float invArea = 1.0f / (x10 * y20 - y10 * x20);
+		float dzdx = ((z[1] - z[0]) * y20 - (z[2] - z[0]) * y10) * invArea;
+		float dzdy = ((z[2] - z[0]) * x10 - (z[1] - z[0]) * x20) * invArea;
+		float maxDepth = std::max(z[0], std::max(z[1], z[2]));
+		float blockDepthX = std::max(dzdx * (kRasterBlockSize - 1), 0.0f);
+		float blockDepthY = std::max(dzdy * (kRasterBlockSize - 1), 0.0f);
+
+		for (int by = minY / kRasterBlockSize; by <= maxY / kRasterBlockSize; by++)
+		{
+			for (int bx = minX / kRasterBlockSize; bx <= maxX / kRasterBlockSize; bx++)
+			{
+				int blockX = bx * kRasterBlockSize;
+				int blockY = by * kRasterBlockSize;
+				size_t blockIndex = static_cast<size_t>(by) * m_blocksX + bx;
+				Block& block = m_blocks[blockIndex];
+
+				// Farthest depth of the triangle in the block, rounded away from the camera so it stays conservative
+				float px = blockX + 0.5f - x0;
+				float py = blockY + 0.5f - y0;
+				float farthest = std::min(z[0] + dzdx * px + dzdy * py + blockDepthX + blockDepthY, maxDepth);
+				farthest += 4.0f * FLT_EPSILON * (std::fabs(z[0]) + std::fabs(dzdx) * (std::fabs(px) + kRasterBlockSize)
+					+ std::fabs(dzdy) * (std::fabs(py) + kRasterBlockSize));
+				if (farthest >= block.zFar)
+				{
+					continue; // behind what is already there
+				}
+
+				uint64_t coverage = ComputeBlockCoverage(raster, blockX, blockY, m_coverageKernel) & ~m_offscreen[blockIndex];
+				if (coverage == 0)
+				{
+					continue;
+				}
+
+				// The triangle is much nearer than the working layer: start a new layer instead
+				// of pushing this one farther (the old one is still bounded by zFar)
+				if (block.mask != 0 && block.zNear - farthest > block.zFar - block.zNear)
+				{
+					block.mask = 0;
+				}
+				block.zNear = block.mask != 0 ? std::max(block.zNear, farthest) : farthest;
+				block.mask |= coverage;
+
+				// Covered everywhere: the working layer bounds the whole block
+				if ((block.mask | m_offscreen[blockIndex]) == kRasterFullBlock)
+				{
+					block.zFar = block.zNear;
+					block.mask = 0;
+				}
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const float boundsMin[3], const float boundsMax[3], const float world[16])
+{
+	if (m_blocks.empty())
+	{
+		return true;
+	}
+	m_stats.testedBoxes++;
+
+	float worldViewProjection[16];
+	MultiplyMatrices(world, m_viewProjection, worldViewProjection);
+
+	// Screen rectangle and nearest depth of the 8 corners
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		float corner[3] = { (i & 1) ? boundsMax[0] : boundsMin[0], (i & 2) ? boundsMax[1] : boundsMin[1], (i & 4) ? boundsMax[2] : boundsMin[2] };
+		float clip[4];
+		TransformPoint(corner, worldViewProjection, clip);
+		// Crossing the near plane, the projection is meaningless and the box is likely around the camera
+		if (clip[2] < 0.0f || clip[3] <= 0.0f)
+		{
+			return true;
+		}
+
+		float invW = 1.0f / clip[3];
+		float x = (clip[0] * invW * 0.5f + 0.5f) * m_width;
+		float y = (0.5f - clip[1] * invW * 0.5f) * m_height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip[2] * invW);
+	}
+
+	// Every pixel the rectangle touches
+	int x0 = static_cast<int>(std::max(std::floor(minX), 0.0f));
+	int y0 = static_cast<int>(std::max(std::floor(minY), 0.0f));
+	int x1 = static_cast<int>(std::min(std::floor(maxX), m_width - 1.0f));
+	int y1 = static_cast<int>(std::min(std::floor(maxY), m_height - 1.0f));
+	if (x0 > x1 || y0 > y1)
+	{
+		m_stats.culledBoxes++;
+		return false;
+	}
+
+	for (int by = y0 / kRasterBlockSize; by <= y1 / kRasterBlockSize; by++)
+	{
+		for (int bx = x0 / kRasterBlockSize; bx <= x1 / kRasterBlockSize; bx++)
+		{
+			int blockX = bx * kRasterBlockSize;
+			int blockY = by * kRasterBlockSize;
+			uint64_t rectangle = GetBlockBoundsMask(std::max(x0 - blockX, 0), std::min(x1 - blockX, kRasterBlockSize - 1),
+				std::max(y0 - blockY, 0), std::min(y1 - blockY, kRasterBlockSize - 1));
+
+			// The pixels in the mask are bounded by zNear, the others by zFar
+			const Block& block = m_blocks[static_cast<size_t>(by) * m_blocksX + bx];
+			if (((rectangle & ~block.mask) != 0 && nearest < block.zFar) || ((rectangle & block.mask) != 0 && nearest < block.zNear))
+			{
+				return true;
+			}
+		}
+	}
+
+	m_stats.culledBoxes++;
+	return false;
+}
+
+bool ValidateOcclusionCuller(uint32_t seed, int iterations)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	OcclusionCuller culler;
+	if (!culler.Initialize(OcclusionCuller::kDefaultWidth + random() % 64, OcclusionCuller::kDefaultHeight + random() % 64))
+	{
+		return false;
+	}
+
+	// The camera at the origin looking down z, view space is world space
+	const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	SimdMath::Matrix perspective = SimdMath::MatrixPerspectiveFovLH(SimdMath::kPi / 3.0f, static_cast<float>(culler.GetWidth()) / culler.GetHeight(), 0.1f, 1000.0f);
+	SimdMath::Float4x4 projection;
+	SimdMath::StoreFloat4x4(&projection, perspective);
+	float scaleX = projection.m[0][0];
+	float scaleY = projection.m[1][1];
+	SimdMath::StoreFloat4x4(&projection, SimdMath::MatrixTranspose(perspective));
+
+	// Boxes are placed on screen (normalized device coordinates) at a view depth, 3 pixels away from the
+	// occluder's edges: the culler works on whole pixels
+	float marginX = 6.0f / culler.GetWidth();
+	float marginY = 6.0f / culler.GetHeight();
+	auto isVisible = [&](const float rectangle[4], float nearZ, float farZ)
+	{
+		// The largest box whose 8 corners project inside the rectangle at both depths, flat (at nearZ)
+		// when the rectangle is too small for one that deep
+		const float scale[2] = { scaleX, scaleY };
+		float boundsMin[3];
+		float boundsMax[3];
+		for (int pass = 0; pass < 2; pass++)
+		{
+			bool empty = false;
+			for (int axis = 0; axis < 2; axis++)
+			{
+				boundsMin[axis] = std::max(rectangle[axis] * nearZ, rectangle[axis] * farZ) / scale[axis];
+				boundsMax[axis] = std::min(rectangle[axis + 2] * nearZ, rectangle[axis + 2] * farZ) / scale[axis];
+				empty = empty || boundsMin[axis] > boundsMax[axis];
+			}
+			if (!empty)
+			{
+				break;
+			}
+			farZ = nearZ;
+		}
+		boundsMin[2] = nearZ;
+		boundsMax[2] = farZ;
+		return culler.IsVisible(boundsMin, boundsMax, identity);
+	};
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		// A rectangle (two triangles) partly off screen now and then
+		float occluder[4];
+		occluder[0] = -1.2f + 1.2f * unit(random);
+		occluder[1] = -1.2f + 1.2f * unit(random);
+		occluder[2] = occluder[0] + 0.6f + unit(random);
+		occluder[3] = occluder[1] + 0.6f + unit(random);
+		float occluderZ = 1.0f + 50.0f * unit(random);
+		float corners[4][3];
+		for (int corner = 0; corner < 4; corner++)
+		{
+			float x = (corner == 1 || corner == 2) ? occluder[2] : occluder[0];
+			float y = corner >= 2 ? occluder[3] : occluder[1];
+			corners[corner][0] = x * occluderZ / scaleX;
+			corners[corner][1] = y * occluderZ / scaleY;
+			corners[corner][2] = occluderZ;
+		}
+		const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+		culler.BeginFrame(identity, &projection.m[0][0]);
+		culler.RenderOccluder(&corners[0][0], sizeof(corners[0]), indices, 6, identity);
+
+		// A box inside the on-screen part of the rectangle
+		float inner[4] = { std::max(occluder[0], -1.0f) + marginX, std::max(occluder[1], -1.0f) + marginY,
+			std::min(occluder[2], 1.0f) - marginX, std::min(occluder[3], 1.0f) - marginY };
+		float box[4];
+		for (int axis = 0; axis < 2; axis++)
+		{
+			float a = inner[axis] + (inner[axis + 2] - inner[axis]) * unit(random);
+			float b = inner[axis] + (inner[axis + 2] - inner[axis]) * unit(random);
+			box[axis] = std::min(a, b);
+			box[axis + 2] = std::max(a, b);
+		}
+
+		// Behind the occluder: hidden
+		float behindZ = occluderZ * (1.02f + unit(random));
+		if (isVisible(box, behindZ, behindZ + 10.0f * unit(random)))
+		{
+			return false;
+		}
+		// In front of it: visible
+		float frontZ = occluderZ * (0.2f + 0.7f * unit(random));
+		if (!isVisible(box, frontZ, occluderZ * 0.95f))
+		{
+			return false;
+		}
+		// Behind it but reaching past an edge that is on screen: visible
+		int firstEdge = random() % 4;
+		for (int i = 0; i < 4; i++)
+		{
+			int edge = (firstEdge + i) % 4;
+			float margin = edge % 2 == 0 ? marginX : marginY;
+			float outside = edge < 2 ? occluder[edge] - margin : occluder[edge] + margin;
+			if (outside < -1.0f || outside > 1.0f)
+			{
+				continue;
+			}
+			float partial[4] = { box[0], box[1], box[2], box[3] };
+			partial[edge] = outside;
+			if (!isVisible(partial, behindZ, behindZ + 1.0f))
+			{
+				return false;
+			}
+			break;
+		}
+
+		// Nothing hides anything once the buffer is cleared
+		culler.BeginFrame(identity, &projection.m[0][0]);
+		if (!isVisible(box, behindZ, behindZ + 1.0f))
+		{
+			return false;
+		}
+	}
+	return true;
+}
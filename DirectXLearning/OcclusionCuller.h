@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <vector>
+#include "RasterKernels.h"
+
+// Masked software occlusion culling
+//
+// Occluders (big, simple meshes: walls, floors, large props) are rasterized into a
+// small depth buffer, then the bounding boxes of objects are tested against it and
+// hidden objects never reach draw submission.
+//
+// The buffer doesn't store depth per pixel: every 8x8 block keeps a coverage mask
+// and two depths, so rasterizing an occluder is one SIMD coverage kernel call and a
+// few compares per block:
+//   zFar - farthest depth of any pixel of the block
+//   zNear - farthest depth of the pixels in the mask (the "working layer")
+// When the mask fills up the working layer becomes the new zFar. Everything is
+// conservative: a box is only reported hidden when it really is behind the occluders.
+//
+// Matrices use the layout of the constant buffers (transposed, like the matrices we upload).
+
+// Counters of the current frame
+struct OcclusionStats
+{
+	uint32_t occluderTriangles; // triangles rasterized into the buffer
+	uint32_t testedBoxes;
+	uint32_t culledBoxes; // hidden or off screen
+};
+
+class OcclusionCuller
+{
+public:
+	// Default resolution, small enough to rasterize the occluders in a fraction of a millisecond
+	static constexpr int kDefaultWidth = 320;
+	static constexpr int kDefaultHeight = 180;
+
+	bool Initialize(int width = kDefaultWidth, int height = kDefaultHeight);
+
+	// Clear the buffer and set the camera for the frame
+	void BeginFrame(const float view[16], const float projection[16]);
+
+	// Rasterize a triangle list of occluder positions (float3, stride bytes apart)
+	// indices can be null, count is the number of indices or vertices
+	void RenderOccluder(const float* positions, uint32_t stride, const uint32_t* indices, uint32_t count, const float world[16]);
+
+	// False when the box (in object space, placed by world) is completely hidden by the occluders or off screen
+	bool IsVisible(const float boundsMin[3], const float boundsMax[3], const float world[16]);
+
+	const OcclusionStats& GetStats() const { return m_stats; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+	// Instruction set of the coverage kernel, the widest one the CPU supports by default
+	void SetSimdIsa(SimdIsa isa);
+
+private:
+	struct Block
+	{
+		uint64_t mask; // pixels covered by the working layer, bit y * 8 + x
+		float zNear; // farthest depth inside the mask
+		float zFar; // farthest depth of the whole block
+	};
+
+	void RasterizeTriangle(const float clip[3][4]);
+
+	int m_width = 0;
+	int m_height = 0;
+	int m_blocksX = 0;
+	int m_blocksY = 0;
+	std::vector<Block> m_blocks;
+	std::vector<uint64_t> m_offscreen; // pixels of a block outside the screen, they count as covered
+
+	float m_viewProjection[16] = {};
+	BlockCoverageFunction m_coverageKernel = nullptr;
+	OcclusionStats m_stats = {};
+};
+
+// Renders a random rectangle occluder and tests boxes against it: a box behind it, inside its outline, is
+// culled, the same box in front of it or sticking out past an edge is kept. False on the first wrong answer
+bool ValidateOcclusionCuller(uint32_t seed, int iterations);
@@ -0,0 +1,554 @@
+#include "Profiler.h"
+#include <algorithm> // sort
+#include <cstdio> // snprintf, remove
+#include <cstring> // memcpy, strcmp
+#include <fstream>
+#include <iterator> // istreambuf_iterator
+#include <memory> // thread buffers
+#include <mutex> // thread list
+#include <random>
+#include "JobSystem.h"
+#include "SpscRing.h"
+
+std::atomic<bool> g_profilerEnabled{ false };
+
+namespace
+{
+	// "PRF" and the version of the layout
+	const uint32_t kProfileMagic = 0x01465250;
+
+	struct RawEvent
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// Written by its thread only, read by the collecting thread
+	struct ThreadBuffer
+	{
+		explicit ThreadBuffer(uint32_t threadId) : id(threadId) {}
+
+		uint32_t id;
+		std::string name; // protected by g_threadsMutex
+		bool retired = false; // its thread is gone, protected by g_threadsMutex
+		SpscRing<RawEvent> ring{ kProfilerRingCapacity };
+		std::atomic<uint64_t> dropped{ 0 };
+	};
+
+	// Every thread that recorded, the buffers outlive their threads so their last events can be collected,
+	// then a new thread reuses them (job systems come and go, the memory doesn't grow with them)
+	// g_threadsMutex is only taken by the first event of a thread, the naming, the end of a thread and Collect
+	std::mutex g_threadsMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> g_threads;
+	thread_local ThreadBuffer* t_buffer = nullptr;
+	thread_local std::string t_threadName; // until the thread has a buffer
+
+	// Retires the buffer of its thread when the thread ends
+	struct ThreadBufferOwner
+	{
+		ThreadBuffer* buffer = nullptr;
+
+		~ThreadBufferOwner()
+		{
+			if (buffer)
+			{
+				std::lock_guard<std::mutex> lock(g_threadsMutex);
+				buffer->retired = true;
+			}
+		}
+	};
+	thread_local ThreadBufferOwner t_bufferOwner;
+
+	// Only threads that record get a ring, naming a thread doesn't
+	ThreadBuffer& GetThreadBuffer()
+	{
+		if (!t_buffer)
+		{
+			std::lock_guard<std::mutex> lock(g_threadsMutex);
+			for (const std::unique_ptr<ThreadBuffer>& buffer : g_threads)
+			{
+				// Its last events are collected, the thread that wrote them is done with the ring
+				if (buffer->retired && buffer->ring.GetSize() == 0)
+				{
+					t_buffer = buffer.get();
+					break;
+				}
+			}
+			if (!t_buffer)
+			{
+				g_threads.push_back(std::make_unique<ThreadBuffer>(static_cast<uint32_t>(g_threads.size())));
+				t_buffer = g_threads.back().get();
+			}
+			t_buffer->retired = false;
+			t_buffer->name = t_threadName.empty() ? "Thread " + std::to_string(t_buffer->id) : t_threadName;
+			t_bufferOwner.buffer = t_buffer;
+		}
+		return *t_buffer;
+	}
+
+	void AppendEscaped(std::string& json, const std::string& text)
+	{
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				json += '\\';
+				json += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				json += escaped;
+			}
+			else
+			{
+				json += c;
+			}
+		}
+	}
+
+	template<typename T>
+	void Append(std::string& data, const T& value)
+	{
+		data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void AppendString(std::string& data, const std::string& text)
+	{
+		Append(data, static_cast<uint32_t>(text.size()));
+		data += text;
+	}
+
+	// Reads what Append wrote, fails once past the end
+	struct BinaryReader
+	{
+		const std::string& data;
+		size_t offset;
+
+		template<typename T>
+		bool Read(T& value)
+		{
+			if (data.size() - offset < sizeof(T))
+			{
+				return false;
+			}
+			memcpy(&value, data.data() + offset, sizeof(T));
+			offset += sizeof(T);
+			return true;
+		}
+
+		bool ReadString(std::string& text)
+		{
+			uint32_t size;
+			if (!Read(size) || data.size() - offset < size)
+			{
+				return false;
+			}
+			text.assign(data, offset, size);
+			offset += size;
+			return true;
+		}
+	};
+
+	bool ReadFile(const std::string& path, std::string& contents)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	bool WriteFile(const std::string& path, const std::string& contents)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		return static_cast<bool>(file.write(contents.data(), contents.size()));
+	}
+}
+
+void SetProfilerThreadName(const char* name)
+{
+	t_threadName = name;
+	if (t_buffer)
+	{
+		std::lock_guard<std::mutex> lock(g_threadsMutex);
+		t_buffer->name = name;
+	}
+}
+
+void RecordProfileEvent(const char* name, uint64_t start, uint64_t end)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	RawEvent* event = buffer.ring.BeginWrite();
+	if (!event)
+	{
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	event->name = name;
+	event->start = start;
+	event->end = end;
+	buffer.ring.EndWrite();
+}
+
+void ProfileCapture::Collect()
+{
+	std::lock_guard<std::mutex> lock(g_threadsMutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : g_threads)
+	{
+		// Threads without events in the capture don't show up
+		uint32_t thread = UINT32_MAX;
+		while (const RawEvent* event = buffer->ring.BeginRead())
+		{
+			thread = thread == UINT32_MAX ? GetThread(buffer->id, buffer->name) : thread;
+			m_events.push_back({ thread, GetName(event->name), event->start, event->end - event->start });
+			buffer->ring.EndRead();
+		}
+		m_droppedEvents += buffer->dropped.exchange(0, std::memory_order_relaxed);
+	}
+}
+
+void ProfileCapture::Clear()
+{
+	m_threads.clear();
+	m_names.clear();
+	m_events.clear();
+	m_droppedEvents = 0;
+	m_nameIndices.clear();
+}
+
+uint32_t ProfileCapture::GetThread(uint32_t id, const std::string& name)
+{
+	for (uint32_t i = 0; i < m_threads.size(); i++)
+	{
+		if (m_threads[i].id == id)
+		{
+			m_threads[i].name = name;
+			return i;
+		}
+	}
+	m_threads.push_back({ id, name });
+	return static_cast<uint32_t>(m_threads.size() - 1);
+}
+
+uint32_t ProfileCapture::GetName(const char* name)
+{
+	auto found = m_nameIndices.find(name);
+	if (found != m_nameIndices.end())
+	{
+		return found->second;
+	}
+
+	// The same text from another literal (another translation unit) is the same name
+	uint32_t index = static_cast<uint32_t>(std::find(m_names.begin(), m_names.end(), name) - m_names.begin());
+	if (index == m_names.size())
+	{
+		m_names.push_back(name);
+	}
+	m_nameIndices.emplace(name, index);
+	return index;
+}
+
+std::string ProfileCapture::ToChromeTrace() const
+{
+	// Microseconds from the first event, the viewers don't like the raw clock
+	uint64_t origin = UINT64_MAX;
+	for (const ProfileEvent& event : m_events)
+	{
+		origin = event.start < origin ? event.start : origin;
+	}
+
+	std::string json = "{\"traceEvents\":[\n";
+	char number[64];
+	bool first = true;
+	for (const ProfileThread& thread : m_threads)
+	{
+		json += first ? "" : ",\n";
+		first = false;
+		snprintf(number, sizeof(number), "%u", thread.id);
+		json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+		json += number;
+		json += ",\"args\":{\"name\":\"";
+		AppendEscaped(json, thread.name);
+		json += "\"}}";
+	}
+	for (const ProfileEvent& event : m_events)
+	{
+		json += first ? "" : ",\n";
+		first = false;
+		json += "{\"name\":\"";
+		AppendEscaped(json, m_names[event.name]);
+		snprintf(number, sizeof(number), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u", m_threads[event.thread].id);
+		json += number;
+		snprintf(number, sizeof(number), ",\"ts\":%.3f,\"dur\":%.3f}", (event.start - origin) / 1000.0, event.duration / 1000.0);
+		json += number;
+	}
+	snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(m_droppedEvents));
+	json += "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":";
+	json += number;
+	json += "}}\n";
+	return json;
+}
+
+bool ProfileCapture::WriteChromeTrace(const std::string& path) const
+{
+	return WriteFile(path, ToChromeTrace());
+}
+
+bool ProfileCapture::WriteBinary(const std::string& path) const
+{
+	std::string data;
+	data.reserve(64 + m_events.size() * sizeof(ProfileEvent));
+	Append(data, kProfileMagic);
+	Append(data, static_cast<uint32_t>(m_threads.size()));
+	Append(data, static_cast<uint32_t>(m_names.size()));
+	Append(data, static_cast<uint64_t>(m_events.size()));
+	Append(data, m_droppedEvents);
+	for (const ProfileThread& thread : m_threads)
+	{
+		Append(data, thread.id);
+		AppendString(data, thread.name);
+	}
+	for (const std::string& name : m_names)
+	{
+		AppendString(data, name);
+	}
+	for (const ProfileEvent& event : m_events)
+	{
+		Append(data, event.thread);
+		Append(data, event.name);
+		Append(data, event.start);
+		Append(data, event.duration);
+	}
+	return WriteFile(path, data);
+}
+
+bool ProfileCapture::ReadBinary(const std::string& path)
+{
+	Clear();
+	std::string data;
+	if (!ReadFile(path, data))
+	{
+		return false;
+	}
+
+	BinaryReader reader = { data, 0 };
+	uint32_t magic, threadCount, nameCount;
+	uint64_t eventCount;
+	if (!reader.Read(magic) || magic != kProfileMagic || !reader.Read(threadCount) || !reader.Read(nameCount)
+		|| !reader.Read(eventCount) || !reader.Read(m_droppedEvents))
+	{
+		Clear();
+		return false;
+	}
+
+	// Sizes are checked against the file before anything is allocated
+	bool valid = threadCount <= data.size() && nameCount <= data.size() && eventCount <= data.size() / sizeof(ProfileEvent);
+	m_threads.resize(valid ? threadCount : 0);
+	for (uint32_t i = 0; i < threadCount && valid; i++)
+	{
+		valid = reader.Read(m_threads[i].id) && reader.ReadString(m_threads[i].name);
+	}
+	m_names.resize(valid ? nameCount : 0);
+	for (uint32_t i = 0; i < nameCount && valid; i++)
+	{
+		valid = reader.ReadString(m_names[i]);
+	}
+	m_events.resize(valid ? static_cast<size_t>(eventCount) : 0);
+	for (ProfileEvent& event : m_events)
+	{
+		valid = valid && reader.Read(event.thread) && reader.Read(event.name) && reader.Read(event.start) && reader.Read(event.duration)
+			&& event.thread < threadCount && event.name < nameCount;
+	}
+	if (!valid || reader.offset != data.size())
+	{
+		Clear();
+		return false;
+	}
+	return true;
+}
+
+namespace
+{
+	// Nested markers, every one counted in scopes
+	void RecordNestedScopes(std::mt19937& random, uint32_t depth, std::atomic<uint64_t>& scopes)
+	{
+		uint32_t children = std::uniform_int_distribution<uint32_t>(0, 3)(random);
+		for (uint32_t i = 0; i < children && depth > 0; i++)
+		{
+			PROFILE_SCOPE("Scope");
+			scopes.fetch_add(1, std::memory_order_relaxed);
+			RecordNestedScopes(random, depth - 1, scopes);
+		}
+	}
+
+	uint64_t CountEvents(const ProfileCapture& capture, const char* name)
+	{
+		auto found = std::find(capture.GetNames().begin(), capture.GetNames().end(), name);
+		uint32_t index = static_cast<uint32_t>(found - capture.GetNames().begin());
+		uint64_t count = 0;
+		for (const ProfileEvent& event : capture.GetEvents())
+		{
+			count += event.name == index ? 1 : 0;
+		}
+		return count;
+	}
+
+	// The events are in [begin, end] and those of a thread are disjoint or contain each other, never overlap partially
+	bool AreNested(const ProfileCapture& capture, uint64_t begin, uint64_t end)
+	{
+		std::vector<ProfileEvent> events = capture.GetEvents();
+		std::sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b)
+		{
+			if (a.thread != b.thread)
+			{
+				return a.thread < b.thread;
+			}
+			return a.start != b.start ? a.start < b.start : a.duration > b.duration;
+		});
+		std::vector<uint64_t> ends;
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			if (i > 0 && events[i].thread != events[i - 1].thread)
+			{
+				ends.clear();
+			}
+			while (!ends.empty() && ends.back() <= events[i].start)
+			{
+				ends.pop_back();
+			}
+			uint64_t eventEnd = events[i].start + events[i].duration;
+			if (events[i].start < begin || events[i].duration > end - events[i].start || (!ends.empty() && eventEnd > ends.back()))
+			{
+				return false;
+			}
+			ends.push_back(eventEnd);
+		}
+		return true;
+	}
+
+	bool AreEqual(const ProfileCapture& a, const ProfileCapture& b)
+	{
+		if (a.GetThreads().size() != b.GetThreads().size() || a.GetNames() != b.GetNames()
+			|| a.GetEvents().size() != b.GetEvents().size() || a.GetDroppedEventCount() != b.GetDroppedEventCount())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.GetThreads().size(); i++)
+		{
+			if (a.GetThreads()[i].id != b.GetThreads()[i].id || a.GetThreads()[i].name != b.GetThreads()[i].name)
+			{
+				return false;
+			}
+		}
+		for (size_t i = 0; i < a.GetEvents().size(); i++)
+		{
+			const ProfileEvent& x = a.GetEvents()[i];
+			const ProfileEvent& y = b.GetEvents()[i];
+			if (x.thread != y.thread || x.name != y.name || x.start != y.start || x.duration != y.duration)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t CountOccurrences(const std::string& text, const std::string& pattern)
+	{
+		size_t count = 0;
+		for (size_t i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + pattern.size()))
+		{
+			count++;
+		}
+		return count;
+	}
+}
+
+bool ValidateProfiler(JobSystem* pool, const std::string& directory, uint32_t seed, int frames)
+{
+	bool wasEnabled = IsProfilerEnabled();
+	std::mt19937 random(seed);
+	ProfileCapture capture;
+
+	// What earlier markers left in the rings
+	SetProfilerEnabled(true);
+	capture.Collect();
+	capture.Clear();
+
+	// Frames of nested markers on every thread, collected each frame like the engine does
+	const uint32_t kTasks = 32;
+	std::atomic<uint64_t> scopes{ 0 };
+	std::atomic<uint64_t> tasks{ 0 };
+	uint64_t begin = GetProfilerTime();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		{
+			PROFILE_SCOPE("Frame");
+			RecordNestedScopes(random, 4, scopes);
+			uint32_t frameSeed = random();
+			auto task = [&](uint32_t index, uint32_t)
+			{
+				PROFILE_SCOPE("Task");
+				tasks.fetch_add(1, std::memory_order_relaxed);
+				std::mt19937 taskRandom(frameSeed + index);
+				RecordNestedScopes(taskRandom, 3, scopes);
+			};
+			if (pool)
+			{
+				pool->ParallelFor(kTasks, task);
+			}
+			else
+			{
+				for (uint32_t index = 0; index < kTasks; index++)
+				{
+					task(index, 0);
+				}
+			}
+		}
+		capture.Collect();
+	}
+	uint64_t end = GetProfilerTime();
+
+	// Nothing is recorded while disabled
+	SetProfilerEnabled(false);
+	{
+		PROFILE_SCOPE("Disabled");
+	}
+	capture.Collect();
+	bool valid = capture.GetDroppedEventCount() == 0 && CountEvents(capture, "Frame") == static_cast<uint64_t>(frames)
+		&& CountEvents(capture, "Task") == tasks && CountEvents(capture, "Scope") == scopes
+		&& CountEvents(capture, "Disabled") == 0 && AreNested(capture, begin, end);
+
+	// Both exports, the binary one reads back the same capture and a truncated one fails
+	std::string jsonPath = directory + "/ValidateProfile.json";
+	std::string binaryPath = directory + "/ValidateProfile.bin";
+	std::string json;
+	valid = valid && capture.WriteChromeTrace(jsonPath) && ReadFile(jsonPath, json) && json.compare(0, 16, "{\"traceEvents\":[") == 0
+		&& CountOccurrences(json, "\"ph\":\"X\"") == capture.GetEvents().size()
+		&& CountOccurrences(json, "\"ph\":\"M\"") == capture.GetThreads().size();
+	ProfileCapture loaded;
+	std::string binary;
+	valid = valid && capture.WriteBinary(binaryPath) && loaded.ReadBinary(binaryPath) && AreEqual(capture, loaded)
+		&& ReadFile(binaryPath, binary) && WriteFile(binaryPath, binary.substr(0, binary.size() - 1))
+		&& !loaded.ReadBinary(binaryPath) && loaded.GetEvents().empty();
+	std::remove(jsonPath.c_str());
+	std::remove(binaryPath.c_str());
+
+	// A full ring keeps what it has and counts the rest
+	SetProfilerEnabled(true);
+	capture.Clear();
+	uint64_t now = GetProfilerTime();
+	for (uint32_t i = 0; i < kProfilerRingCapacity + 10; i++)
+	{
+		RecordProfileEvent("Overflow", now, now);
+	}
+	capture.Collect();
+	valid = valid && CountEvents(capture, "Overflow") == kProfilerRingCapacity && capture.GetDroppedEventCount() == 10;
+
+	SetProfilerEnabled(wasEnabled);
+	return valid;
+}
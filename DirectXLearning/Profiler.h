@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic> // enabled flag
+#include <chrono> // timestamps
+#include <cstdint> // fixed size integers
+#include <string>
+#include <unordered_map> // name interning
+#include <vector>
+
+class JobSystem;
+
+// Scoped CPU markers for every thread, exported as Chrome/Perfetto traces
+//
+// PROFILE_SCOPE("Name") times the rest of the scope. Each thread writes its events into its
+// own lock-free ring (single producer, the collecting thread is the single consumer), so a
+// marker costs two clock reads and a ring slot, and nothing at all while the profiler is
+// disabled (one relaxed load). ProfileCapture::Collect drains the rings, call it often enough
+// (every frame) that they don't fill up: what doesn't fit is dropped and counted.
+// Define PROFILER_DISABLED to compile the markers out entirely.
+// The names must outlive the capture, string literals.
+
+// Events a thread can hold between two Collect calls
+const uint32_t kProfilerRingCapacity = 16384;
+
+extern std::atomic<bool> g_profilerEnabled;
+
+inline bool IsProfilerEnabled() { return g_profilerEnabled.load(std::memory_order_relaxed); }
+inline void SetProfilerEnabled(bool enabled) { g_profilerEnabled.store(enabled, std::memory_order_relaxed); }
+
+// Nanoseconds, steady clock (QueryPerformanceCounter on Windows)
+inline uint64_t GetProfilerTime()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Name of the calling thread in the exports (copied), "Thread N" by default
+void SetProfilerThreadName(const char* name);
+
+// Event of the calling thread, what PROFILE_SCOPE does at the end of the scope
+void RecordProfileEvent(const char* name, uint64_t start, uint64_t end);
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name) : m_name(IsProfilerEnabled() ? name : nullptr), m_start(m_name ? GetProfilerTime() : 0) {}
+	~ProfileScope()
+	{
+		if (m_name)
+		{
+			RecordProfileEvent(m_name, m_start, GetProfilerTime());
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const char* m_name; // null when the profiler was disabled at the start of the scope
+	uint64_t m_start;
+};
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE_CONCAT_INNER(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_CONCAT(profileScope, __LINE__)(name)
+#endif
+
+struct ProfileThread
+{
+	uint32_t id; // order in which the threads recorded their first event
+	std::string name;
+};
+
+// start and duration in nanoseconds
+struct ProfileEvent
+{
+	uint32_t thread; // index in GetThreads
+	uint32_t name; // index in GetNames
+	uint64_t start;
+	uint64_t duration;
+};
+
+// Events collected from the rings, or read back from a binary capture
+class ProfileCapture
+{
+public:
+	// Move the events of every thread's ring into the capture, one thread collects at a time
+	void Collect();
+	void Clear();
+
+	const std::vector<ProfileThread>& GetThreads() const { return m_threads; }
+	const std::vector<std::string>& GetNames() const { return m_names; }
+	const std::vector<ProfileEvent>& GetEvents() const { return m_events; }
+	// Events lost to full rings, counted by the Collect calls since the capture was cleared
+	uint64_t GetDroppedEventCount() const { return m_droppedEvents; }
+
+	// Chrome trace event JSON, opens in chrome://tracing and ui.perfetto.dev
+	std::string ToChromeTrace() const;
+	bool WriteChromeTrace(const std::string& path) const;
+
+	// Compact form: the thread and name tables then 24 bytes per event
+	bool WriteBinary(const std::string& path) const;
+	bool ReadBinary(const std::string& path);
+
+private:
+	uint32_t GetThread(uint32_t id, const std::string& name);
+	uint32_t GetName(const char* name);
+
+	std::vector<ProfileThread> m_threads;
+	std::vector<std::string> m_names;
+	std::vector<ProfileEvent> m_events;
+	uint64_t m_droppedEvents = 0;
+
+	// Collect only, the marker names by address (the same literal is one name)
+	std::unordered_map<const char*, uint32_t> m_nameIndices;
+};
+
+// Random nested markers on the calling thread and on every thread of pool (can be null):
+// checks the events are all collected and nest per thread, that nothing is recorded while
+// disabled, that full rings drop and count, and the JSON and binary exports (written to directory)
+bool ValidateProfiler(JobSystem* pool, const std::string& directory, uint32_t seed, int frames);
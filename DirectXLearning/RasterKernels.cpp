@@ -0,0 +1,264 @@
+#include "RasterKernels.h"
+#include <algorithm> // min/max
+#include <cstdlib> // abs
+#include <random> // validation
+
+#if CPU_FEATURES_X86
+#include <immintrin.h> // SSE2/AVX2 intrinsics
+#endif
+
+namespace
+{
+	// Distance from the first to the last pixel center of a block, in fixed point
+	const int64_t kBlockExtent = (kRasterBlockSize - 1) * kRasterSubPixelOne;
+
+	// Reference kernel, one pixel and one edge at a time
+	uint64_t BlockCoverageScalar(const int32_t* origin, const int32_t* stepX, const int32_t* stepY, int edgeCount)
+	{
+		uint64_t mask = 0;
+		for (int y = 0; y < kRasterBlockSize; y++)
+		{
+			for (int x = 0; x < kRasterBlockSize; x++)
+			{
+				bool inside = true;
+				for (int e = 0; e < edgeCount; e++)
+				{
+					inside = inside && origin[e] + x * stepX[e] + y * stepY[e] >= 0;
+				}
+				if (inside)
+				{
+					mask |= 1ull << (y * kRasterBlockSize + x);
+				}
+			}
+		}
+		return mask;
+	}
+
+#if CPU_FEATURES_X86
+	// 4 pixels per instruction, a row is two halves
+	// A pixel is outside as soon as one edge is negative, so OR the values and look at the sign bits
+	uint64_t BlockCoverageSSE2(const int32_t* origin, const int32_t* stepX, const int32_t* stepY, int edgeCount)
+	{
+		__m128i left[3];
+		__m128i right[3];
+		__m128i down[3];
+		for (int e = 0; e < edgeCount; e++)
+		{
+			left[e] = _mm_add_epi32(_mm_set1_epi32(origin[e]), _mm_setr_epi32(0, stepX[e], 2 * stepX[e], 3 * stepX[e]));
+			right[e] = _mm_add_epi32(left[e], _mm_set1_epi32(4 * stepX[e]));
+			down[e] = _mm_set1_epi32(stepY[e]);
+		}
+
+		uint64_t mask = 0;
+		for (int y = 0; y < kRasterBlockSize; y++)
+		{
+			__m128i outsideLeft = _mm_setzero_si128();
+			__m128i outsideRight = _mm_setzero_si128();
+			for (int e = 0; e < edgeCount; e++)
+			{
+				outsideLeft = _mm_or_si128(outsideLeft, left[e]);
+				outsideRight = _mm_or_si128(outsideRight, right[e]);
+				left[e] = _mm_add_epi32(left[e], down[e]);
+				right[e] = _mm_add_epi32(right[e], down[e]);
+			}
+			uint64_t row = static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(outsideLeft)))
+				| (static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(outsideRight))) << 4);
+			mask |= (~row & 0xFF) << (y * kRasterBlockSize);
+		}
+		return mask;
+	}
+
+	// 8 pixels per instruction, one instruction per row and edge
+	TARGET_AVX2 uint64_t BlockCoverageAVX2(const int32_t* origin, const int32_t* stepX, const int32_t* stepY, int edgeCount)
+	{
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		__m256i row[3];
+		__m256i down[3];
+		for (int e = 0; e < edgeCount; e++)
+		{
+			row[e] = _mm256_add_epi32(_mm256_set1_epi32(origin[e]), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stepX[e])));
+			down[e] = _mm256_set1_epi32(stepY[e]);
+		}
+
+		uint64_t mask = 0;
+		for (int y = 0; y < kRasterBlockSize; y++)
+		{
+			__m256i outside = _mm256_setzero_si256();
+			for (int e = 0; e < edgeCount; e++)
+			{
+				outside = _mm256_or_si256(outside, row[e]);
+				row[e] = _mm256_add_epi32(row[e], down[e]);
+			}
+			uint64_t bits = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(outside)));
+			mask |= (~bits & 0xFF) << (y * kRasterBlockSize);
+		}
+		return mask;
+	}
+#endif
+
+	// Floor division by the sub-pixel size that also works for negative values
+	int32_t FixedToPixelFloor(int64_t value)
+	{
+		return static_cast<int32_t>(value >= 0 ? value / kRasterSubPixelOne : -((-value + kRasterSubPixelOne - 1) / kRasterSubPixelOne));
+	}
+}
+
+int64_t GetRasterTriangleArea(const int32_t x[3], const int32_t y[3])
+{
+	return static_cast<int64_t>(x[1] - x[0]) * (y[2] - y[0]) - static_cast<int64_t>(y[1] - y[0]) * (x[2] - x[0]);
+}
+
+void SetupRasterTriangle(const int32_t x[3], const int32_t y[3], RasterTriangle& triangle)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		int v0 = (i + 1) % 3;
+		int v1 = (i + 2) % 3;
+		triangle.a[i] = static_cast<int64_t>(y[v0]) - y[v1];
+		triangle.b[i] = static_cast<int64_t>(x[v1]) - x[v0];
+		triangle.c[i] = static_cast<int64_t>(x[v0]) * y[v1] - static_cast<int64_t>(y[v0]) * x[v1];
+
+		// Top-left fill rule: a pixel center exactly on an edge only belongs to the
+		// triangle for top (horizontal, inside below) and left (inside to the right) edges,
+		// for the other edges E == 0 has to count as outside, and E > 0 is E - 1 >= 0
+		bool topLeft = triangle.a[i] > 0 || (triangle.a[i] == 0 && triangle.b[i] > 0);
+		if (!topLeft)
+		{
+			triangle.c[i] -= 1;
+		}
+	}
+
+	// Pixel x is inside the box when its center (x * 16 + 8) is
+	int32_t minX = std::min(x[0], std::min(x[1], x[2]));
+	int32_t maxX = std::max(x[0], std::max(x[1], x[2]));
+	int32_t minY = std::min(y[0], std::min(y[1], y[2]));
+	int32_t maxY = std::max(y[0], std::max(y[1], y[2]));
+	const int32_t half = kRasterSubPixelOne / 2;
+	triangle.minX = FixedToPixelFloor(static_cast<int64_t>(minX) - half + kRasterSubPixelOne - 1);
+	triangle.minY = FixedToPixelFloor(static_cast<int64_t>(minY) - half + kRasterSubPixelOne - 1);
+	triangle.maxX = FixedToPixelFloor(static_cast<int64_t>(maxX) - half);
+	triangle.maxY = FixedToPixelFloor(static_cast<int64_t>(maxY) - half);
+}
+
+BlockCoverageFunction GetBlockCoverageFunction(SimdIsa isa)
+{
+	switch (ClampSimdIsa(isa))
+	{
+#if CPU_FEATURES_X86
+	case SimdIsa::AVX2:
+		return BlockCoverageAVX2;
+	case SimdIsa::SSE2:
+		return BlockCoverageSSE2;
+#endif
+	default:
+		return BlockCoverageScalar;
+	}
+}
+
+uint64_t ComputeBlockCoverage(const RasterTriangle& triangle, int blockX, int blockY, BlockCoverageFunction kernel)
+{
+	// Center of the first pixel of the block
+	int64_t px = static_cast<int64_t>(blockX) * kRasterSubPixelOne + kRasterSubPixelOne / 2;
+	int64_t py = static_cast<int64_t>(blockY) * kRasterSubPixelOne + kRasterSubPixelOne / 2;
+
+	int32_t origin[3];
+	int32_t stepX[3];
+	int32_t stepY[3];
+	int edgeCount = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		// The edge function is linear, so its extremes over the block are at two of the corners
+		int64_t value = triangle.a[i] * px + triangle.b[i] * py + triangle.c[i];
+		int64_t dx = triangle.a[i] * kBlockExtent;
+		int64_t dy = triangle.b[i] * kBlockExtent;
+		int64_t lowest = value + std::min<int64_t>(dx, 0) + std::min<int64_t>(dy, 0);
+		int64_t highest = value + std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0);
+
+		if (highest < 0)
+		{
+			return 0; // the whole block is outside this edge
+		}
+		if (lowest >= 0)
+		{
+			continue; // the whole block is inside this edge, no need to look at it per pixel
+		}
+
+		// The edge crosses the block, so its values here are small enough for 32 bits
+		origin[edgeCount] = static_cast<int32_t>(value);
+		stepX[edgeCount] = static_cast<int32_t>(triangle.a[i] * kRasterSubPixelOne);
+		stepY[edgeCount] = static_cast<int32_t>(triangle.b[i] * kRasterSubPixelOne);
+		edgeCount++;
+	}
+
+	if (edgeCount == 0)
+	{
+		return kRasterFullBlock;
+	}
+	return kernel(origin, stepX, stepY, edgeCount);
+}
+
+bool ValidateBlockCoverage(SimdIsa isa, uint32_t seed, int iterations)
+{
+	BlockCoverageFunction reference = GetBlockCoverageFunction(SimdIsa::Scalar);
+	BlockCoverageFunction tested = GetBlockCoverageFunction(isa);
+
+	std::mt19937 random(seed);
+	// Same ranges the rasterizer produces: edges crossing a block, guard band sized coordinates
+	std::uniform_int_distribution<int32_t> stepRange(-(1 << 20), 1 << 20);
+	std::uniform_int_distribution<int32_t> coordinateRange(-(1 << 17), 1 << 17);
+	std::uniform_int_distribution<int> edgeRange(1, 3);
+
+	for (int i = 0; i < iterations; i++)
+	{
+		// Raw kernel on edges crossing the block
+		int32_t origin[3], stepX[3], stepY[3];
+		int edgeCount = edgeRange(random);
+		for (int e = 0; e < edgeCount; e++)
+		{
+			stepX[e] = stepRange(random);
+			stepY[e] = stepRange(random);
+			int64_t extent = (static_cast<int64_t>(std::abs(stepX[e])) + std::abs(stepY[e])) * (kRasterBlockSize - 1);
+			origin[e] = static_cast<int32_t>(std::uniform_int_distribution<int64_t>(-extent, extent)(random));
+		}
+		if (tested(origin, stepX, stepY, edgeCount) != reference(origin, stepX, stepY, edgeCount))
+		{
+			return false;
+		}
+
+		// Whole triangles, on the blocks around the first vertex
+		int32_t x[3], y[3];
+		for (int v = 0; v < 3; v++)
+		{
+			x[v] = coordinateRange(random) / 64;
+			y[v] = coordinateRange(random) / 64;
+		}
+		if (GetRasterTriangleArea(x, y) < 0)
+		{
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+		}
+		if (GetRasterTriangleArea(x, y) == 0)
+		{
+			continue;
+		}
+
+		RasterTriangle triangle;
+		SetupRasterTriangle(x, y, triangle);
+		int blockX = (FixedToPixelFloor(x[0]) / kRasterBlockSize - 2) * kRasterBlockSize;
+		int blockY = (FixedToPixelFloor(y[0]) / kRasterBlockSize - 2) * kRasterBlockSize;
+		for (int by = 0; by < 4; by++)
+		{
+			for (int bx = 0; bx < 4; bx++)
+			{
+				int px = blockX + bx * kRasterBlockSize;
+				int py = blockY + by * kRasterBlockSize;
+				if (ComputeBlockCoverage(triangle, px, py, tested) != ComputeBlockCoverage(triangle, px, py, reference))
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
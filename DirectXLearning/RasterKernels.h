@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include "CpuFeatures.h"
+
+// Half-space triangle rasterization in fixed point
+//
+// Vertices are snapped to 1/16th of a pixel, every edge becomes an integer
+// function E(x, y) = a * x + b * y + c that is >= 0 inside the triangle, and the
+// screen is walked in 8x8 pixel blocks. A block is rejected or accepted as a whole
+// from its corners and only blocks an edge goes through are evaluated per pixel,
+// by a kernel that steps the edge functions 4 (SSE2) or 8 (AVX2) pixels at a time.
+// Everything is integer math, so every kernel gives bit-identical results.
+
+// Sub-pixel precision of the snapped vertices
+const int kRasterSubPixelBits = 4;
+const int kRasterSubPixelOne = 1 << kRasterSubPixelBits;
+
+// Width/height of the blocks the rasterizer classifies and evaluates
+const int kRasterBlockSize = 8;
+
+// Coverage of an 8x8 block, bit (y * 8 + x) is set when pixel (x, y) is inside
+const uint64_t kRasterFullBlock = ~0ull;
+
+// A triangle ready to be rasterized
+struct RasterTriangle
+{
+	// Edge functions in fixed point, edge i is opposite to vertex i
+	// The top-left fill rule is already folded into c (inside means E >= 0)
+	int64_t a[3];
+	int64_t b[3];
+	int64_t c[3];
+	// Pixels whose center can be inside (inclusive, not clamped to the screen)
+	int32_t minX, minY, maxX, maxY;
+};
+
+// Twice the signed area of a snapped triangle, positive when the vertices wind the way SetupRasterTriangle expects
+int64_t GetRasterTriangleArea(const int32_t x[3], const int32_t y[3]);
+
+// Build the edge functions of a snapped triangle, the area has to be positive
+void SetupRasterTriangle(const int32_t x[3], const int32_t y[3], RasterTriangle& triangle);
+
+// Evaluate edgeCount edges over an 8x8 block, origin is the value at the center of the block's
+// first pixel and stepX/stepY the change for one pixel, the returned mask has the pixels where every edge is >= 0
+typedef uint64_t (*BlockCoverageFunction)(const int32_t* origin, const int32_t* stepX, const int32_t* stepY, int edgeCount);
+
+// Kernel for an instruction set (clamped to what the CPU supports)
+BlockCoverageFunction GetBlockCoverageFunction(SimdIsa isa);
+
+// Coverage of the 8x8 block whose first pixel is (blockX, blockY)
+// Whole blocks are rejected or accepted from their corners, the kernel only runs for edges crossing the block
+uint64_t ComputeBlockCoverage(const RasterTriangle& triangle, int blockX, int blockY, BlockCoverageFunction kernel);
+
+// Run random edges and triangles through the kernel of an instruction set and compare
+// with the scalar reference, returns false on the first mismatch
+bool ValidateBlockCoverage(SimdIsa isa, uint32_t seed, int iterations);
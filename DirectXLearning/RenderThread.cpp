@@ -0,0 +1,99 @@
+#include "RenderThread.h"
+#include <atomic> // packet state shared by both threads
+#include <random> // std::mt19937 for the validation
+#include <vector>
+
+namespace
+{
+	// Fixed amount of arithmetic, CPU bound on purpose (a sleep or a clock wait would overlap even on one core)
+	uint32_t Work(uint64_t iterations)
+	{
+		uint32_t value = static_cast<uint32_t>(iterations);
+		for (uint64_t i = 0; i < iterations; i++)
+		{
+			value = value * 1664525u + 1013904223u;
+		}
+		return value;
+	}
+
+	struct TestPacket
+	{
+		uint64_t frame = 0;
+		std::vector<uint32_t> values;
+		std::atomic<bool> rendering{ false };
+	};
+
+	uint32_t MakeValue(uint64_t frame, size_t index)
+	{
+		return static_cast<uint32_t>(frame * 2654435761u + index);
+	}
+}
+
+bool ValidateRenderThread(uint32_t seed, int frames)
+{
+	std::mt19937 random(seed);
+	for (uint32_t framesInFlight = 1; framesInFlight <= 4; framesInFlight++)
+	{
+		std::atomic<bool> failed{ false };
+		uint64_t nextFrame = 0;
+		uint32_t renderSeed = random();
+		std::mt19937 renderRandom(renderSeed);
+		RenderThread<TestPacket> thread;
+		thread.Start(framesInFlight, [&](TestPacket& packet)
+		{
+			packet.rendering = true;
+			if (packet.frame != nextFrame++)
+			{
+				failed = true;
+			}
+			Work(std::uniform_int_distribution<uint32_t>(0, 20000)(renderRandom));
+			for (size_t i = 0; i < packet.values.size(); i++)
+			{
+				if (packet.values[i] != MakeValue(packet.frame, i))
+				{
+					failed = true;
+				}
+			}
+			packet.rendering = false;
+		});
+		if (thread.GetFramesInFlight() != framesInFlight)
+		{
+			return false;
+		}
+
+		for (int frame = 0; frame < frames; frame++)
+		{
+			TestPacket& packet = thread.BeginFrame();
+			if (packet.rendering)
+			{
+				return false;
+			}
+			packet.frame = frame;
+			packet.values.resize(std::uniform_int_distribution<uint32_t>(0, 256)(random));
+			for (size_t i = 0; i < packet.values.size(); i++)
+			{
+				packet.values[i] = MakeValue(frame, i);
+			}
+			Work(std::uniform_int_distribution<uint32_t>(0, 20000)(random));
+			thread.SubmitFrame();
+
+			// Now and then the simulation needs what the render thread owns
+			if (frame % 37 == 0)
+			{
+				thread.Flush();
+				if (thread.GetStats().framesRendered != static_cast<uint64_t>(frame) + 1)
+				{
+					return false;
+				}
+			}
+		}
+
+		// Stop renders what's left
+		thread.Stop();
+		if (failed || nextFrame != static_cast<uint64_t>(frames))
+		{
+			return false;
+		}
+	}
+	return true;
+}
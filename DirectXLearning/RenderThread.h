@@ -0,0 +1,156 @@
+#pragma once
+#include <chrono> // wait times
+#include <condition_variable> // sleep while the ring is full/empty
+#include <cstdint> // fixed size integers
+#include <functional> // render callback
+#include <mutex> // only guards the sleeping, the packets go through the ring
+#include <thread> // render thread
+#include "Profiler.h"
+#include "SpscRing.h"
+
+// Time each side spent waiting for the other one, since Start
+struct RenderThreadStats
+{
+	uint64_t framesRendered;
+	double simulationWaitSeconds; // BeginFrame waiting for a free packet (render bound)
+	double renderWaitSeconds; // render thread waiting for a packet (simulation bound)
+};
+
+// Runs the submission of the frames on its own thread
+// The simulation thread fills a Packet per frame (BeginFrame/SubmitFrame) and the render
+// thread calls render(packet) for each one in order. framesInFlight packets exist: with 1 the
+// simulation waits for every frame to be rendered (same as no thread), with 2 frame N+1 is
+// simulated while frame N is submitted, more lets the simulation run further ahead when
+// frame times vary (one frame of latency per extra packet).
+// The packets are reused, whatever they hold (vectors...) keeps its memory between frames.
+template<typename Packet>
+class RenderThread
+{
+public:
+	typedef std::function<void(Packet& packet)> RenderFunction;
+
+	RenderThread() = default;
+	~RenderThread() { Stop(); }
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	void Start(uint32_t framesInFlight, RenderFunction render)
+	{
+		Stop();
+		m_ring.Reset(framesInFlight);
+		m_render = std::move(render);
+		m_quit = false;
+		m_submitted = 0;
+		m_rendered = 0;
+		m_stats = {};
+		m_thread = std::thread(&RenderThread::ThreadMain, this);
+	}
+
+	// Render what was submitted and end the thread
+	void Stop()
+	{
+		if (!m_thread.joinable())
+		{
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_frameSubmitted.notify_one();
+		m_thread.join();
+	}
+
+	bool IsRunning() const { return m_thread.joinable(); }
+	uint32_t GetFramesInFlight() const { return m_ring.GetCapacity(); }
+
+	// Simulation thread: the packet of the next frame, waits while all of them are in use
+	Packet& BeginFrame()
+	{
+		Packet* packet = m_ring.BeginWrite();
+		if (!packet)
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_frameRendered.wait(lock, [&] { return (packet = m_ring.BeginWrite()) != nullptr; });
+			m_stats.simulationWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		return *packet;
+	}
+
+	// Simulation thread: hand the packet of BeginFrame to the render thread
+	void SubmitFrame()
+	{
+		m_ring.EndWrite();
+		{
+			// Orders the notify after the render thread's check of the ring
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_submitted++;
+		}
+		m_frameSubmitted.notify_one();
+	}
+
+	// Simulation thread: wait until every submitted frame is rendered, to read what the render side owns
+	void Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_frameRendered.wait(lock, [this] { return m_rendered == m_submitted; });
+	}
+
+	// Simulation thread, exact after Flush
+	RenderThreadStats GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		RenderThreadStats stats = m_stats;
+		stats.framesRendered = m_rendered;
+		return stats;
+	}
+
+private:
+	void ThreadMain()
+	{
+		SetProfilerThreadName("Render");
+		while (true)
+		{
+			Packet* packet = m_ring.BeginRead();
+			if (!packet)
+			{
+				auto start = std::chrono::steady_clock::now();
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_frameSubmitted.wait(lock, [&] { return (packet = m_ring.BeginRead()) != nullptr || m_quit; });
+				if (!packet)
+				{
+					return; // quit with nothing left to render
+				}
+				m_stats.renderWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+
+			m_render(*packet);
+
+			m_ring.EndRead();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_rendered++;
+			}
+			m_frameRendered.notify_one();
+		}
+	}
+
+	SpscRing<Packet> m_ring;
+	RenderFunction m_render;
+	std::thread m_thread;
+
+	// Sleeping only, protected by m_mutex
+	std::mutex m_mutex;
+	std::condition_variable m_frameSubmitted; // wakes the render thread
+	std::condition_variable m_frameRendered; // wakes the simulation thread (BeginFrame, Flush)
+	bool m_quit = false;
+	uint64_t m_submitted = 0;
+	uint64_t m_rendered = 0;
+	RenderThreadStats m_stats = {};
+};
+
+// Pushes numbered packets with random simulation/render costs through 1 to 4 frames in
+// flight and checks every frame is rendered once, in order, and never while being written
+bool ValidateRenderThread(uint32_t seed, int frames);
@@ -0,0 +1,210 @@
+#include "RingAllocator.h"
+#include "JobSystem.h"
+#include <cstring> // memset
+#include <random>
+
+void RingAllocator::Initialize(uint32_t capacity)
+{
+	m_capacity = (capacity + kMaxAlignment - 1) & ~(kMaxAlignment - 1);
+	m_head.store(0, std::memory_order_relaxed);
+	m_tail = 0;
+	m_firstFrame = 0;
+	m_frameCount = 0;
+}
+
+uint32_t RingAllocator::Allocate(uint32_t size, uint32_t alignment)
+{
+	if (size == 0 || size > m_capacity || alignment == 0 || alignment > kMaxAlignment || (alignment & (alignment - 1)) != 0)
+	{
+		return kAllocationFailed;
+	}
+
+	uint64_t head = m_head.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		uint64_t start = (head + alignment - 1) & ~static_cast<uint64_t>(alignment - 1);
+
+		// Skip the end of the buffer when the allocation doesn't fit before it
+		// The capacity is a multiple of every alignment, so the start of the buffer is aligned
+		uint64_t lapEnd = (start / m_capacity + 1) * m_capacity;
+		if (start + size > lapEnd)
+		{
+			start = lapEnd;
+		}
+
+		// m_tail only moves between frames, while nobody allocates
+		uint64_t end = start + size;
+		if (end - m_tail > m_capacity)
+		{
+			return kAllocationFailed;
+		}
+
+		// Another thread allocated in the meantime: head is reloaded, try again after it
+		if (m_head.compare_exchange_weak(head, end, std::memory_order_relaxed))
+		{
+			return static_cast<uint32_t>(start % m_capacity);
+		}
+	}
+}
+
+bool RingAllocator::EndFrame()
+{
+	if (m_frameCount == kMaxFramesInFlight)
+	{
+		return false;
+	}
+	m_frameEnds[(m_firstFrame + m_frameCount) % kMaxFramesInFlight] = m_head.load(std::memory_order_relaxed);
+	m_frameCount++;
+	return true;
+}
+
+void RingAllocator::RetireFrame()
+{
+	if (m_frameCount == 0)
+	{
+		return;
+	}
+	m_tail = m_frameEnds[m_firstFrame];
+	m_firstFrame = (m_firstFrame + 1) % kMaxFramesInFlight;
+	m_frameCount--;
+}
+
+void CpuRingBuffer::Initialize(uint32_t capacity)
+{
+	m_allocator.Initialize(capacity);
+	m_memory.resize(m_allocator.GetCapacity() / RingAllocator::kMaxAlignment);
+}
+
+void* CpuRingBuffer::Allocate(uint32_t size, uint32_t alignment, uint32_t& offset)
+{
+	offset = m_allocator.Allocate(size, alignment);
+	if (offset == RingAllocator::kAllocationFailed)
+	{
+		return nullptr;
+	}
+	return GetData() + offset;
+}
+
+namespace
+{
+	// An allocation of the validation, filled with its tag
+	struct TaggedRange
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint8_t tag;
+	};
+
+	bool IsFilledWith(const uint8_t* data, const TaggedRange& range)
+	{
+		for (uint32_t i = 0; i < range.size; i++)
+		{
+			if (data[range.offset + i] != range.tag)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+bool ValidateRingAllocator(JobSystem* pool, uint32_t framesInFlight, uint32_t seed, int frames)
+{
+	const uint32_t kCapacity = 64 * 1024;
+	const uint32_t kTasks = 16;
+	const uint32_t kAllocationsPerTask = 32;
+	if (framesInFlight == 0 || framesInFlight > RingAllocator::kMaxFramesInFlight)
+	{
+		return false;
+	}
+
+	CpuRingBuffer ring;
+	ring.Initialize(kCapacity);
+	uint8_t* data = ring.GetData();
+	memset(data, 0, kCapacity);
+
+	// Allocations of the frames still in flight, oldest first
+	std::vector<std::vector<TaggedRange>> liveFrames;
+	std::vector<std::vector<TaggedRange>> taskRanges(kTasks);
+	std::atomic<bool> misaligned{ false };
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		// The fence of the oldest frame passed
+		if (ring.GetAllocator().GetFramesInFlight() == framesInFlight)
+		{
+			ring.RetireFrame();
+			liveFrames.erase(liveFrames.begin());
+		}
+
+		// Every task allocates and fills its ranges, the tags tell who wrote what
+		uint8_t frameTag = static_cast<uint8_t>(frame * kTasks);
+		auto task = [&](uint32_t index, uint32_t)
+		{
+			std::mt19937 random(seed + frame * kTasks + index);
+			std::uniform_int_distribution<uint32_t> sizeRange(1, 300);
+			std::uniform_int_distribution<uint32_t> alignmentShift(0, 8);
+
+			std::vector<TaggedRange>& ranges = taskRanges[index];
+			ranges.clear();
+			for (uint32_t i = 0; i < kAllocationsPerTask; i++)
+			{
+				uint32_t size = sizeRange(random);
+				uint32_t alignment = 1u << alignmentShift(random);
+				uint32_t offset;
+				uint8_t* memory = static_cast<uint8_t*>(ring.Allocate(size, alignment, offset));
+				if (!memory)
+				{
+					continue; // full, the other frames haven't been retired yet
+				}
+				if ((offset & (alignment - 1)) != 0 || offset + size > kCapacity)
+				{
+					misaligned = true;
+					continue;
+				}
+				uint8_t tag = static_cast<uint8_t>(frameTag + index + 1);
+				memset(memory, tag, size);
+				ranges.push_back({ offset, size, tag });
+			}
+		};
+		if (pool)
+		{
+			pool->ParallelFor(kTasks, task);
+		}
+		else
+		{
+			for (uint32_t index = 0; index < kTasks; index++)
+			{
+				task(index, 0);
+			}
+		}
+		if (misaligned)
+		{
+			return false;
+		}
+
+		// Two allocations that overlap lose a tag, and so does a frame in flight that got overwritten
+		std::vector<TaggedRange> frameRanges;
+		for (const std::vector<TaggedRange>& ranges : taskRanges)
+		{
+			frameRanges.insert(frameRanges.end(), ranges.begin(), ranges.end());
+		}
+		liveFrames.push_back(frameRanges);
+		for (const std::vector<TaggedRange>& ranges : liveFrames)
+		{
+			for (const TaggedRange& range : ranges)
+			{
+				if (!IsFilledWith(data, range))
+				{
+					return false;
+				}
+			}
+		}
+
+		if (!ring.EndFrame())
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic> // head of the ring
+#include <cstdint> // fixed size integers
+#include <vector>
+
+class JobSystem;
+
+// Sub-allocation of one big buffer for data that only lives for a frame (dynamic vertices, constants...)
+//
+// Allocating is a bump of an atomic position, so several threads can record into the same
+// ring without a lock. The owner closes every frame with EndFrame, which remembers where the
+// frame ended, and calls RetireFrame once the GPU is done with the oldest frame (its fence
+// passed): only then is that memory handed out again. An allocation never straddles the end
+// of the buffer, it starts over at the beginning instead.
+//
+// The allocator only deals in offsets, the memory is up to the backend: a dynamic D3D11
+// buffer mapped with NO_OVERWRITE, or CpuRingBuffer below.
+
+class RingAllocator
+{
+public:
+	// Returned by Allocate when the frames in flight still use the memory
+	static constexpr uint32_t kAllocationFailed = ~0u;
+	// Biggest alignment Allocate supports, the capacity is rounded up to it
+	static constexpr uint32_t kMaxAlignment = 256;
+	// Frames that can be closed and not retired yet
+	static constexpr uint32_t kMaxFramesInFlight = 8;
+
+	// Forget every allocation and frame and start over with this many bytes
+	void Initialize(uint32_t capacity);
+
+	// Offset of size bytes aligned to alignment (a power of two up to kMaxAlignment)
+	// Safe to call from any number of threads at once
+	uint32_t Allocate(uint32_t size, uint32_t alignment);
+
+	// Not thread safe, call them between frames while nobody allocates
+	// The allocations made since the last EndFrame belong to this frame, false when kMaxFramesInFlight are already waiting
+	bool EndFrame();
+	// The oldest closed frame isn't used anymore
+	void RetireFrame();
+
+	uint32_t GetCapacity() const { return m_capacity; }
+	uint32_t GetFramesInFlight() const { return m_frameCount; }
+	// Bytes allocated and not retired yet (padding included)
+	uint32_t GetUsedSize() const { return static_cast<uint32_t>(m_head.load(std::memory_order_relaxed) - m_tail); }
+
+private:
+	uint32_t m_capacity = 0;
+
+	// Positions since Initialize, they never wrap, the offset in the buffer is position % capacity
+	std::atomic<uint64_t> m_head{ 0 }; // end of the last allocation
+	uint64_t m_tail = 0; // start of the oldest frame still in use
+
+	// Where every frame in flight ends, oldest first
+	uint64_t m_frameEnds[kMaxFramesInFlight] = {};
+	uint32_t m_firstFrame = 0;
+	uint32_t m_frameCount = 0;
+};
+
+// Ring over memory the CPU owns, for the software backend
+class CpuRingBuffer
+{
+public:
+	void Initialize(uint32_t capacity);
+
+	// Pointer to size bytes, null when the ring is full, offset gets their place in the buffer
+	void* Allocate(uint32_t size, uint32_t alignment, uint32_t& offset);
+
+	bool EndFrame() { return m_allocator.EndFrame(); }
+	void RetireFrame() { m_allocator.RetireFrame(); }
+
+	const RingAllocator& GetAllocator() const { return m_allocator; }
+	uint8_t* GetData() { return m_memory.empty() ? nullptr : m_memory[0].bytes; }
+
+private:
+	struct alignas(RingAllocator::kMaxAlignment) Block
+	{
+		uint8_t bytes[RingAllocator::kMaxAlignment];
+	};
+
+	RingAllocator m_allocator;
+	std::vector<Block> m_memory;
+};
+
+// Run frames of random allocations from every thread of pool (can be null) with framesInFlight
+// frames waiting for their fence, returns false when two live allocations overlap, an allocation
+// is misaligned, or the memory of a frame in flight is overwritten
+bool ValidateRingAllocator(JobSystem* pool, uint32_t framesInFlight, uint32_t seed, int frames);
@@ -0,0 +1,449 @@
+#include "ShaderCache.h"
+#include <algorithm> // stable_sort, unique, lower_bound
+#include <cstring> // memcpy
+#include <fstream>
+#include <iterator> // istreambuf_iterator
+#include <cstdio> // remove
+#include <random>
+
+namespace
+{
+	// "SHC" and the version of the layout
+	const uint32_t kShaderCacheMagic = 0x01434853;
+	// Includes deeper than this are a cycle
+	const int kMaxIncludeDepth = 32;
+
+	// 64-bit FNV-1a, continued from hash
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Strings are hashed with their size, so "ab" + "c" and "a" + "bc" differ
+	uint64_t HashString(uint64_t hash, const std::string& text)
+	{
+		uint64_t size = text.size();
+		hash = HashBytes(hash, &size, sizeof(size));
+		return HashBytes(hash, text.data(), text.size());
+	}
+
+	bool ReadFile(const std::string& path, std::string& contents)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	std::string GetDirectory(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	// Name of a line's #include "name", empty when it isn't one (system includes aren't followed)
+	std::string GetIncludeName(const std::string& source, size_t begin, size_t end)
+	{
+		size_t i = begin;
+		auto skipSpaces = [&]()
+		{
+			while (i < end && (source[i] == ' ' || source[i] == '\t'))
+			{
+				i++;
+			}
+		};
+		skipSpaces();
+		if (i == end || source[i] != '#')
+		{
+			return std::string();
+		}
+		i++;
+		skipSpaces();
+		if (source.compare(i, 7, "include") != 0)
+		{
+			return std::string();
+		}
+		i += 7;
+		skipSpaces();
+		if (i == end || source[i] != '"')
+		{
+			return std::string();
+		}
+		size_t nameEnd = source.find('"', i + 1);
+		if (nameEnd == std::string::npos || nameEnd >= end)
+		{
+			return std::string();
+		}
+		return source.substr(i + 1, nameEnd - i - 1);
+	}
+
+	// The file and everything it includes, in the order the compiler sees them
+	bool HashSourceFile(const std::string& path, int depth, uint64_t& hash)
+	{
+		std::string source;
+		if (depth > kMaxIncludeDepth || !ReadFile(path, source))
+		{
+			return false;
+		}
+		hash = HashString(hash, source);
+
+		std::string directory = GetDirectory(path);
+		for (size_t begin = 0; begin < source.size();)
+		{
+			size_t end = source.find('\n', begin);
+			if (end == std::string::npos)
+			{
+				end = source.size();
+			}
+			std::string include = GetIncludeName(source, begin, end);
+			if (!include.empty())
+			{
+				hash = HashString(hash, include);
+				if (!HashSourceFile(directory + include, depth + 1, hash))
+				{
+					return false;
+				}
+			}
+			begin = end + 1;
+		}
+		return true;
+	}
+}
+
+bool ComputeShaderKey(const ShaderCompileDesc& desc, uint64_t& key)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = HashString(hash, desc.entryPoint);
+	hash = HashString(hash, desc.target);
+	hash = HashBytes(hash, &desc.flags, sizeof(desc.flags));
+	for (const ShaderDefine& define : desc.defines)
+	{
+		hash = HashString(hash, define.name);
+		hash = HashString(hash, define.value);
+	}
+	if (!HashSourceFile(desc.path, 0, hash))
+	{
+		return false;
+	}
+	key = hash;
+	return true;
+}
+
+bool ShaderCache::Open(const std::string& path)
+{
+	Close();
+	m_path = path;
+	if (!m_file.Open(path))
+	{
+		return false;
+	}
+
+	// Anything that doesn't look right is dropped, Save writes a good file again
+	const uint8_t* data = m_file.GetData();
+	size_t size = m_file.GetSize();
+	uint32_t header[2];
+	if (size < sizeof(header))
+	{
+		m_file.Close();
+		return false;
+	}
+	memcpy(header, data, sizeof(header));
+	if (header[0] != kShaderCacheMagic || (size - sizeof(header)) / sizeof(Entry) < header[1])
+	{
+		m_file.Close();
+		return false;
+	}
+	m_entryCount = header[1];
+	const Entry* entries = GetEntries();
+	for (uint32_t i = 0; i < m_entryCount; i++)
+	{
+		if (entries[i].offset > size || entries[i].size > size - entries[i].offset
+			|| (i > 0 && entries[i - 1].key >= entries[i].key))
+		{
+			m_file.Close();
+			m_entryCount = 0;
+			return false;
+		}
+	}
+	return true;
+}
+
+void ShaderCache::Close()
+{
+	m_file.Close();
+	m_entryCount = 0;
+	m_pending.clear();
+	m_stats = {};
+}
+
+const ShaderCache::Entry* ShaderCache::GetEntries() const
+{
+	// The table follows the header, 8 bytes into a page aligned mapping
+	return m_file.GetData() ? reinterpret_cast<const Entry*>(m_file.GetData() + 2 * sizeof(uint32_t)) : nullptr;
+}
+
+bool ShaderCache::Find(uint64_t key, ShaderBytecode& bytecode) const
+{
+	const Entry* entries = GetEntries();
+	if (entries)
+	{
+		const Entry* end = entries + m_entryCount;
+		const Entry* entry = std::lower_bound(entries, end, key, [](const Entry& left, uint64_t right) { return left.key < right; });
+		if (entry != end && entry->key == key)
+		{
+			bytecode.data = m_file.GetData() + entry->offset;
+			bytecode.size = entry->size;
+			return true;
+		}
+	}
+	for (const PendingBlob& blob : m_pending)
+	{
+		if (blob.key == key)
+		{
+			bytecode.data = blob.bytecode.data();
+			bytecode.size = blob.bytecode.size();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ShaderCache::GetOrCompile(uint64_t key, const CompileFunction& compile, ShaderBytecode& bytecode)
+{
+	if (Find(key, bytecode))
+	{
+		m_stats.hits++;
+		return true;
+	}
+
+	m_stats.misses++;
+	std::vector<uint8_t> compiled;
+	if (!compile(compiled) || compiled.empty())
+	{
+		return false;
+	}
+	bytecode = Add(key, std::move(compiled));
+	return true;
+}
+
+ShaderBytecode ShaderCache::Add(uint64_t key, std::vector<uint8_t> bytecode)
+{
+	// Moving the vector keeps its buffer, so the blobs stay where they are when m_pending grows
+	m_pending.push_back({ key, std::move(bytecode) });
+	ShaderBytecode result;
+	result.data = m_pending.back().bytecode.data();
+	result.size = m_pending.back().bytecode.size();
+	return result;
+}
+
+bool ShaderCache::Save()
+{
+	if (m_pending.empty() || m_path.empty())
+	{
+		return true;
+	}
+
+	// Every blob, old and new, sorted by key
+	struct Blob
+	{
+		uint64_t key;
+		const uint8_t* data;
+		uint32_t size;
+	};
+	std::vector<Blob> blobs;
+	const Entry* entries = GetEntries();
+	for (uint32_t i = 0; i < m_entryCount; i++)
+	{
+		blobs.push_back({ entries[i].key, m_file.GetData() + entries[i].offset, entries[i].size });
+	}
+	for (const PendingBlob& blob : m_pending)
+	{
+		blobs.push_back({ blob.key, blob.bytecode.data(), static_cast<uint32_t>(blob.bytecode.size()) });
+	}
+	// The same key added twice is the same blob, the table has to be strictly sorted
+	std::stable_sort(blobs.begin(), blobs.end(), [](const Blob& left, const Blob& right) { return left.key < right.key; });
+	blobs.erase(std::unique(blobs.begin(), blobs.end(), [](const Blob& left, const Blob& right) { return left.key == right.key; }), blobs.end());
+
+	// Header, table, then the blobs 16 byte aligned
+	uint32_t header[2] = { kShaderCacheMagic, static_cast<uint32_t>(blobs.size()) };
+	std::vector<uint8_t> image(sizeof(header) + blobs.size() * sizeof(Entry));
+	memcpy(image.data(), header, sizeof(header));
+	for (size_t i = 0; i < blobs.size(); i++)
+	{
+		image.resize((image.size() + 15) & ~static_cast<size_t>(15));
+		Entry entry = { blobs[i].key, static_cast<uint32_t>(image.size()), blobs[i].size };
+		memcpy(image.data() + sizeof(header) + i * sizeof(Entry), &entry, sizeof(Entry));
+		image.insert(image.end(), blobs[i].data, blobs[i].data + blobs[i].size);
+	}
+
+	// The mapping has to go before the file can be written (Windows keeps it locked)
+	std::string path = m_path;
+	ShaderCacheStats stats = m_stats;
+	Close();
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.write(reinterpret_cast<const char*>(image.data()), image.size()))
+		{
+			return false;
+		}
+	}
+	bool opened = Open(path);
+	m_stats = stats;
+	return opened;
+}
+
+namespace
+{
+	// Bytes a fake compiler makes for a key, different sizes and contents for every key
+	std::vector<uint8_t> FakeBytecode(uint64_t key)
+	{
+		std::vector<uint8_t> bytecode(1 + key % 300);
+		for (size_t i = 0; i < bytecode.size(); i++)
+		{
+			bytecode[i] = static_cast<uint8_t>((key >> (i % 8 * 8)) + i);
+		}
+		return bytecode;
+	}
+
+	bool WriteFile(const std::string& path, const std::string& contents)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		return static_cast<bool>(file.write(contents.data(), contents.size()));
+	}
+
+	bool Matches(const ShaderBytecode& bytecode, uint64_t key)
+	{
+		std::vector<uint8_t> expected = FakeBytecode(key);
+		return bytecode.size == expected.size() && memcmp(bytecode.data, expected.data(), expected.size()) == 0;
+	}
+}
+
+bool ValidateShaderCache(const std::string& directory, uint32_t seed)
+{
+	// The key follows the includes and every part of the desc
+	std::string shaderPath = directory + "/ValidateShader.hlsl";
+	std::string includePath = directory + "/ValidateInclude.hlsli";
+	if (!WriteFile(shaderPath, "  #  include \"ValidateInclude.hlsli\"\nfloat4 main() : SV_TARGET { return Color; }\n")
+		|| !WriteFile(includePath, "static const float4 Color = 1;\n"))
+	{
+		return false;
+	}
+	ShaderCompileDesc desc;
+	desc.path = shaderPath;
+	desc.entryPoint = "main";
+	desc.target = "ps_5_0";
+	uint64_t key, includeKey, defineKey, flagsKey;
+	if (!ComputeShaderKey(desc, key) || !WriteFile(includePath, "static const float4 Color = 0;\n") || !ComputeShaderKey(desc, includeKey))
+	{
+		return false;
+	}
+	desc.defines.push_back({ "FAST", "1" });
+	ComputeShaderKey(desc, defineKey);
+	desc.flags = 1;
+	ComputeShaderKey(desc, flagsKey);
+	if (key == includeKey || includeKey == defineKey || defineKey == flagsKey)
+	{
+		return false;
+	}
+	desc.path = directory + "/Missing.hlsl";
+	if (ComputeShaderKey(desc, key))
+	{
+		return false;
+	}
+
+	// Cold: every shader compiles, then the file holds them
+	std::string cachePath = directory + "/ValidateShaderCache.bin";
+	std::remove(cachePath.c_str());
+	std::mt19937_64 random(seed);
+	std::vector<uint64_t> keys(64);
+	for (uint64_t& shaderKey : keys)
+	{
+		shaderKey = random();
+	}
+	uint32_t compilations = 0;
+	uint64_t compiling = 0;
+	auto compile = [&](std::vector<uint8_t>& bytecode)
+	{
+		compilations++;
+		bytecode = FakeBytecode(compiling);
+		return true;
+	};
+
+	ShaderCache cache;
+	if (cache.Open(cachePath))
+	{
+		return false;
+	}
+	ShaderBytecode bytecode;
+	for (size_t i = 0; i < keys.size() / 2; i++)
+	{
+		compiling = keys[i];
+		if (!cache.GetOrCompile(keys[i], compile, bytecode) || !Matches(bytecode, keys[i]))
+		{
+			return false;
+		}
+	}
+	if (compilations != keys.size() / 2 || !cache.Save())
+	{
+		return false;
+	}
+
+	// Warm: the first half never compiles, the second half is added to the file
+	for (int run = 0; run < 2; run++)
+	{
+		ShaderCache warm;
+		if (!warm.Open(cachePath))
+		{
+			return false;
+		}
+		compilations = 0;
+		for (uint64_t shaderKey : keys)
+		{
+			compiling = shaderKey;
+			if (!warm.GetOrCompile(shaderKey, compile, bytecode) || !Matches(bytecode, shaderKey))
+			{
+				return false;
+			}
+		}
+		uint32_t expected = run == 0 ? static_cast<uint32_t>(keys.size() / 2) : 0;
+		if (compilations != expected || warm.GetStats().misses != expected || !warm.Save())
+		{
+			return false;
+		}
+		for (uint64_t shaderKey : keys)
+		{
+			if (!warm.Find(shaderKey, bytecode) || !Matches(bytecode, shaderKey))
+			{
+				return false;
+			}
+		}
+	}
+
+	// A truncated file is refused, the cache starts empty
+	{
+		std::string contents;
+		if (!ReadFile(cachePath, contents) || !WriteFile(cachePath, contents.substr(0, contents.size() / 2)))
+		{
+			return false;
+		}
+		ShaderCache truncated;
+		if (truncated.Open(cachePath) || truncated.Find(keys[0], bytecode))
+		{
+			return false;
+		}
+	}
+
+	std::remove(cachePath.c_str());
+	std::remove(shaderPath.c_str());
+	std::remove(includePath.c_str());
+	return true;
+}
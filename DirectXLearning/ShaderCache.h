@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <functional>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Compiled shaders by the hash of everything the compilation depends on
+//
+// The key covers the source, every file it includes (#include "..." is followed from the
+// source, recursively), the defines, the entry point, the target and the compiler flags,
+// so changing any of them misses. The blobs live in one file that is mapped at startup:
+// a hit is a binary search in its table and a pointer into the mapping, so a warm start
+// only costs reading the pages of the shaders it uses. Only a miss compiles, through the
+// callback, and Save writes the file again with the new blobs.
+//
+// File: magic, entry count, entries sorted by key {key, offset, size}, then the blobs.
+
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+// What a compilation reads
+struct ShaderCompileDesc
+{
+	std::string path; // the includes are relative to its directory
+	std::string entryPoint;
+	std::string target; // vs_5_0...
+	uint32_t flags = 0; // D3DCOMPILE_*
+	std::vector<ShaderDefine> defines;
+};
+
+// Hash of the desc and of the contents of the source and its includes, false when one of the files can't be read
+bool ComputeShaderKey(const ShaderCompileDesc& desc, uint64_t& key);
+
+// Compiled code, valid until the cache is saved or closed
+struct ShaderBytecode
+{
+	const void* data = nullptr;
+	size_t size = 0;
+};
+
+struct ShaderCacheStats
+{
+	uint32_t hits;
+	uint32_t misses; // compiled
+};
+
+class ShaderCache
+{
+public:
+	// Fill bytecode with the compiled shader, false when the compilation failed
+	using CompileFunction = std::function<bool(std::vector<uint8_t>& bytecode)>;
+
+	// Map the cache file, false when it's missing or isn't a cache file (the cache starts empty then)
+	bool Open(const std::string& path);
+	void Close();
+
+	bool Find(uint64_t key, ShaderBytecode& bytecode) const;
+	// Find, and compile on a miss, the new blob stays in memory until Save
+	bool GetOrCompile(uint64_t key, const CompileFunction& compile, ShaderBytecode& bytecode);
+	// Keep a blob compiled elsewhere (several at once on other threads, the cache itself isn't thread safe)
+	ShaderBytecode Add(uint64_t key, std::vector<uint8_t> bytecode);
+
+	// Write the file with the blobs compiled since Open and map it again, nothing when there are none
+	// Every ShaderBytecode from before is invalid after it
+	bool Save();
+
+	const ShaderCacheStats& GetStats() const { return m_stats; }
+
+private:
+	// Entry of the table in the file
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t offset; // from the start of the file
+		uint32_t size;
+	};
+
+	// Entries of the mapped file, null when there is none
+	const Entry* GetEntries() const;
+
+	std::string m_path;
+	MappedFile m_file;
+	uint32_t m_entryCount = 0;
+
+	// Compiled since Open
+	struct PendingBlob
+	{
+		uint64_t key;
+		std::vector<uint8_t> bytecode;
+	};
+	std::vector<PendingBlob> m_pending;
+
+	ShaderCacheStats m_stats = {};
+};
+
+// Key files in directory, compile fake shaders into a cache there, save, reopen and add more,
+// returns false when a key doesn't follow the includes, a warm cache compiles, or a blob comes back different
+bool ValidateShaderCache(const std::string& directory, uint32_t seed);
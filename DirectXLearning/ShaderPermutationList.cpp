@@ -0,0 +1,25 @@
+#include "ShaderPermutationList.h"
+
+const std::vector<ShaderPermutationSet>& GetEngineShaderSets()
+{
+	// No features yet, every set is its one permutation (mask 0)
+	static const std::vector<ShaderPermutationSet> sets = []()
+	{
+		std::vector<ShaderPermutationSet> result(kEngineShaderSetCount);
+		result[kVertexShaderSet].name = "VertexShader";
+		result[kVertexShaderSet].path = "VertexShader.hlsl";
+		result[kVertexShaderSet].target = "vs_5_0";
+		result[kPixelShaderSet].name = "PixelShader";
+		result[kPixelShaderSet].path = "PixelShader.hlsl";
+		result[kPixelShaderSet].target = "ps_5_0";
+		result[kInstancedVertexShaderSet].name = "InstancedVertexShader";
+		result[kInstancedVertexShaderSet].path = "InstancedVertexShader.hlsl";
+		result[kInstancedVertexShaderSet].target = "vs_5_0";
+		for (ShaderPermutationSet& set : result)
+		{
+			set.flags = kShaderCompileDebug;
+		}
+		return result;
+	}();
+	return sets;
+}
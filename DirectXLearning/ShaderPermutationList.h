@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include "ShaderPermutations.h"
+
+// The shaders of the engine, what ShaderPrecompiler compiles and GraphicsEngine looks up
+// The paths are relative to DirectXLearning/, where both of them run
+
+// Indices in GetEngineShaderSets
+enum EngineShaderSet
+{
+	kVertexShaderSet,
+	kPixelShaderSet,
+	kInstancedVertexShaderSet,
+	kEngineShaderSetCount
+};
+
+// Tag of the archives compiled with D3DCompile, the engine refuses the others
+const uint32_t kD3DCompilerTag = 0x43443344; // "D3DC"
+
+// D3DCOMPILE_DEBUG, without including d3dcompiler.h
+const uint32_t kShaderCompileDebug = 1;
+
+const std::vector<ShaderPermutationSet>& GetEngineShaderSets();
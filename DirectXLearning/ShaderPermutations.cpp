@@ -0,0 +1,525 @@
+#include "ShaderPermutations.h"
+#include "JobSystem.h"
+#include <cstdio> // remove, snprintf
+#include <cstring> // memcpy, strncmp
+#include <fstream>
+#include <functional>
+#include <random>
+#include <unordered_map>
+#include <utility> // pair
+
+namespace
+{
+	// "SPA" and the version of the layout
+	const uint32_t kShaderArchiveMagic = 0x01415053;
+
+	// File: header, set table, permutation table (every set's permutations in mask order), then the blobs
+	struct ArchiveHeader
+	{
+		uint32_t magic;
+		uint32_t tag; // of the compiler
+		uint32_t setCount;
+		uint32_t permutationCount;
+	};
+
+	struct ArchiveSet
+	{
+		char name[48]; // null terminated
+		uint32_t featureCount;
+		uint32_t firstPermutation; // in the permutation table
+	};
+
+	struct ArchivePermutation
+	{
+		uint64_t sourceKey; // ComputeShaderKey of the permutation when it was compiled
+		uint32_t offset; // from the start of the file
+		uint32_t size;
+	};
+
+	// The sets and permutations of the file, a blob is found at firstPermutation + mask
+	const ArchiveSet* GetSets(const uint8_t* sets) { return reinterpret_cast<const ArchiveSet*>(sets); }
+	const ArchivePermutation* GetPermutations(const uint8_t* permutations) { return reinterpret_cast<const ArchivePermutation*>(permutations); }
+
+	void RunTasks(JobSystem* pool, uint32_t count, const std::function<void(uint32_t index, uint32_t threadIndex)>& task)
+	{
+		if (pool)
+		{
+			pool->ParallelFor(count, task);
+		}
+		else
+		{
+			for (uint32_t index = 0; index < count; index++)
+			{
+				task(index, 0);
+			}
+		}
+	}
+
+	// 64-bit FNV-1a, continued from hash
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+ShaderCompileDesc GetPermutationDesc(const ShaderPermutationSet& set, uint32_t mask)
+{
+	ShaderCompileDesc desc;
+	desc.path = set.path;
+	desc.entryPoint = set.entryPoint;
+	desc.target = set.target;
+	desc.flags = set.flags;
+	for (uint32_t bit = 0; bit < set.features.size(); bit++)
+	{
+		if (mask & (1u << bit))
+		{
+			desc.defines.insert(desc.defines.end(), set.features[bit].defines.begin(), set.features[bit].defines.end());
+		}
+	}
+	return desc;
+}
+
+bool StubShaderCompiler::Compile(const ShaderCompileDesc& desc, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+	// Reads the same files as a real compilation, so a missing source fails the same way
+	uint64_t sourceKey;
+	if (!ComputeShaderKey(desc, sourceKey))
+	{
+		errors = desc.path + ": can't read the source or one of its includes";
+		return false;
+	}
+	std::string text = "STUB " + desc.target + " " + desc.entryPoint;
+	for (const ShaderDefine& define : desc.defines)
+	{
+		text += " " + define.name + "=" + define.value;
+	}
+	bytecode.assign(text.begin(), text.end());
+	const uint8_t* keyBytes = reinterpret_cast<const uint8_t*>(&sourceKey);
+	bytecode.insert(bytecode.end(), keyBytes, keyBytes + sizeof(sourceKey));
+	return true;
+}
+
+bool PrecompileShaders(const std::vector<ShaderPermutationSet>& sets, ShaderCompiler& compiler, JobSystem* pool,
+	ShaderCache* cache, const std::string& archivePath, PrecompileStats& stats, std::string& errors)
+{
+	stats = {};
+	errors.clear();
+
+	// One job per permutation, in archive order
+	struct Job
+	{
+		uint32_t set;
+		uint32_t mask;
+		uint64_t sourceKey;
+		uint64_t key; // sourceKey and the compiler
+		bool keyed; // false when the sources couldn't be hashed, it's compiled and not cached then
+		ShaderBytecode bytecode;
+		std::vector<uint8_t> compiled;
+		std::string errors;
+	};
+	std::vector<Job> jobs;
+	for (uint32_t setIndex = 0; setIndex < sets.size(); setIndex++)
+	{
+		const ShaderPermutationSet& set = sets[setIndex];
+		if (set.features.size() > kMaxShaderFeatures || set.name.empty() || set.name.size() >= sizeof(ArchiveSet::name))
+		{
+			errors = set.name + ": too many features or a name that doesn't fit the archive";
+			return false;
+		}
+		for (uint32_t other = 0; other < setIndex; other++)
+		{
+			if (sets[other].name == set.name)
+			{
+				errors = set.name + ": two sets with that name";
+				return false;
+			}
+		}
+		for (uint32_t mask = 0; mask < set.GetPermutationCount(); mask++)
+		{
+			jobs.push_back({ setIndex, mask, 0, 0, false, {}, {}, {} });
+		}
+	}
+	stats.permutations = static_cast<uint32_t>(jobs.size());
+
+	// Hash the sources of every permutation, then take what the cache already has
+	RunTasks(pool, static_cast<uint32_t>(jobs.size()), [&](uint32_t index, uint32_t)
+	{
+		Job& job = jobs[index];
+		job.keyed = ComputeShaderKey(GetPermutationDesc(sets[job.set], job.mask), job.sourceKey);
+		// The compiler goes in the key, so a cache shared by two compilers never mixes their blobs
+		uint32_t tag = compiler.GetTag();
+		job.key = HashBytes(job.sourceKey, &tag, sizeof(tag));
+	});
+	// Permutations whose features add no defines are the same compilation, it only runs once
+	std::vector<uint32_t> misses;
+	std::vector<std::pair<uint32_t, uint32_t>> duplicates; // job, the job it's the same as
+	std::unordered_map<uint64_t, uint32_t> missByKey;
+	for (uint32_t index = 0; index < jobs.size(); index++)
+	{
+		Job& job = jobs[index];
+		if (cache && job.keyed && cache->Find(job.key, job.bytecode))
+		{
+			stats.cached++;
+			continue;
+		}
+		if (job.keyed)
+		{
+			auto first = missByKey.emplace(job.key, index);
+			if (!first.second)
+			{
+				duplicates.push_back({ index, first.first->second });
+				continue;
+			}
+		}
+		misses.push_back(index);
+	}
+
+	// The misses compile on every thread
+	RunTasks(pool, static_cast<uint32_t>(misses.size()), [&](uint32_t index, uint32_t)
+	{
+		Job& job = jobs[misses[index]];
+		if (!compiler.Compile(GetPermutationDesc(sets[job.set], job.mask), job.compiled, job.errors) || job.compiled.empty())
+		{
+			job.compiled.clear();
+		}
+	});
+	for (uint32_t index : misses)
+	{
+		Job& job = jobs[index];
+		if (job.compiled.empty())
+		{
+			stats.failed++;
+			char mask[16];
+			std::snprintf(mask, sizeof(mask), "%u", job.mask);
+			errors += sets[job.set].name + " (mask " + mask + "): " + job.errors + "\n";
+			continue;
+		}
+		stats.compiled++;
+		if (cache && job.keyed)
+		{
+			job.bytecode = cache->Add(job.key, std::move(job.compiled));
+		}
+		else
+		{
+			job.bytecode.data = job.compiled.data();
+			job.bytecode.size = job.compiled.size();
+		}
+	}
+	for (const std::pair<uint32_t, uint32_t>& duplicate : duplicates)
+	{
+		const Job& source = jobs[duplicate.second];
+		if (source.bytecode.data)
+		{
+			jobs[duplicate.first].bytecode = source.bytecode;
+			stats.compiled++;
+		}
+		else
+		{
+			stats.failed++;
+		}
+	}
+
+	// What compiled is kept even when something failed, the next run only retries the failures
+	bool written = false;
+	if (stats.failed == 0)
+	{
+		ArchiveHeader header = { kShaderArchiveMagic, compiler.GetTag(), static_cast<uint32_t>(sets.size()), stats.permutations };
+		size_t tablesSize = sizeof(header) + sets.size() * sizeof(ArchiveSet) + jobs.size() * sizeof(ArchivePermutation);
+		std::vector<uint8_t> image(tablesSize);
+		memcpy(image.data(), &header, sizeof(header));
+		uint32_t firstPermutation = 0;
+		for (uint32_t setIndex = 0; setIndex < sets.size(); setIndex++)
+		{
+			ArchiveSet set = {};
+			memcpy(set.name, sets[setIndex].name.c_str(), sets[setIndex].name.size());
+			set.featureCount = static_cast<uint32_t>(sets[setIndex].features.size());
+			set.firstPermutation = firstPermutation;
+			memcpy(image.data() + sizeof(header) + setIndex * sizeof(ArchiveSet), &set, sizeof(set));
+			firstPermutation += sets[setIndex].GetPermutationCount();
+		}
+
+		// Permutations a feature doesn't change come out the same, they share one blob
+		std::unordered_map<uint64_t, std::vector<ArchivePermutation>> blobsByHash;
+		uint8_t* permutationTable = image.data() + sizeof(header) + sets.size() * sizeof(ArchiveSet);
+		for (uint32_t index = 0; index < jobs.size(); index++)
+		{
+			const ShaderBytecode& bytecode = jobs[index].bytecode;
+			const uint8_t* data = static_cast<const uint8_t*>(bytecode.data);
+			std::vector<ArchivePermutation>& candidates = blobsByHash[HashBytes(14695981039346656037ull, data, bytecode.size)];
+			ArchivePermutation permutation = {};
+			for (const ArchivePermutation& candidate : candidates)
+			{
+				if (candidate.size == bytecode.size && memcmp(image.data() + candidate.offset, data, bytecode.size) == 0)
+				{
+					permutation = candidate;
+					break;
+				}
+			}
+			permutation.sourceKey = jobs[index].sourceKey;
+			if (permutation.size == 0)
+			{
+				image.resize((image.size() + 15) & ~static_cast<size_t>(15));
+				permutation.offset = static_cast<uint32_t>(image.size());
+				permutation.size = static_cast<uint32_t>(bytecode.size);
+				image.insert(image.end(), data, data + bytecode.size);
+				candidates.push_back(permutation);
+				// image may have moved
+				permutationTable = image.data() + sizeof(header) + sets.size() * sizeof(ArchiveSet);
+			}
+			memcpy(permutationTable + index * sizeof(ArchivePermutation), &permutation, sizeof(permutation));
+		}
+
+		std::ofstream file(archivePath, std::ios::binary | std::ios::trunc);
+		written = static_cast<bool>(file.write(reinterpret_cast<const char*>(image.data()), image.size()));
+		if (!written)
+		{
+			errors += archivePath + ": can't write the archive\n";
+		}
+	}
+
+	// Last, the blobs the jobs point to belong to the cache until it saves
+	if (cache)
+	{
+		cache->Save();
+	}
+	return written;
+}
+
+bool ShaderArchive::Open(const std::string& path, uint32_t tag)
+{
+	Close();
+	if (!m_file.Open(path))
+	{
+		return false;
+	}
+
+	// Everything is checked once here, the lookups trust the tables
+	const uint8_t* data = m_file.GetData();
+	size_t size = m_file.GetSize();
+	ArchiveHeader header;
+	if (size < sizeof(header))
+	{
+		Close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	size_t tablesSize = sizeof(header) + static_cast<size_t>(header.setCount) * sizeof(ArchiveSet)
+		+ static_cast<size_t>(header.permutationCount) * sizeof(ArchivePermutation);
+	if (header.magic != kShaderArchiveMagic || header.tag != tag || size < tablesSize)
+	{
+		Close();
+		return false;
+	}
+	const ArchiveSet* sets = reinterpret_cast<const ArchiveSet*>(data + sizeof(header));
+	const ArchivePermutation* permutations = reinterpret_cast<const ArchivePermutation*>(sets + header.setCount);
+	for (uint32_t i = 0; i < header.setCount; i++)
+	{
+		if (sets[i].featureCount > kMaxShaderFeatures || sets[i].name[sizeof(sets[i].name) - 1] != 0
+			|| sets[i].firstPermutation > header.permutationCount
+			|| header.permutationCount - sets[i].firstPermutation < (1u << sets[i].featureCount))
+		{
+			Close();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header.permutationCount; i++)
+	{
+		if (permutations[i].offset > size || permutations[i].size > size - permutations[i].offset)
+		{
+			Close();
+			return false;
+		}
+	}
+	m_sets = reinterpret_cast<const uint8_t*>(sets);
+	m_setCount = header.setCount;
+	m_permutations = reinterpret_cast<const uint8_t*>(permutations);
+	return true;
+}
+
+void ShaderArchive::Close()
+{
+	m_file.Close();
+	m_sets = nullptr;
+	m_setCount = 0;
+	m_permutations = nullptr;
+}
+
+int ShaderArchive::FindSet(const std::string& name) const
+{
+	const ArchiveSet* sets = GetSets(m_sets);
+	for (uint32_t i = 0; i < m_setCount; i++)
+	{
+		if (name.size() < sizeof(sets[i].name) && strncmp(sets[i].name, name.c_str(), sizeof(sets[i].name)) == 0)
+		{
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+uint64_t ShaderArchive::GetSourceKey(int set, uint32_t mask) const
+{
+	if (set < 0 || static_cast<uint32_t>(set) >= m_setCount || (mask >> GetSets(m_sets)[set].featureCount) != 0)
+	{
+		return 0;
+	}
+	return GetPermutations(m_permutations)[GetSets(m_sets)[set].firstPermutation + mask].sourceKey;
+}
+
+uint32_t ShaderArchive::GetFeatureCount(int set) const
+{
+	return set >= 0 && static_cast<uint32_t>(set) < m_setCount ? GetSets(m_sets)[set].featureCount : 0;
+}
+
+bool ShaderArchive::GetPermutation(int set, uint32_t mask, ShaderBytecode& bytecode) const
+{
+	if (set < 0 || static_cast<uint32_t>(set) >= m_setCount)
+	{
+		return false;
+	}
+	const ArchiveSet& entry = GetSets(m_sets)[set];
+	if ((mask >> entry.featureCount) != 0)
+	{
+		return false;
+	}
+	const ArchivePermutation& permutation = GetPermutations(m_permutations)[entry.firstPermutation + mask];
+	bytecode.data = m_file.GetData() + permutation.offset;
+	bytecode.size = permutation.size;
+	return true;
+}
+
+namespace
+{
+	bool WriteFile(const std::string& path, const std::string& contents)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		return static_cast<bool>(file.write(contents.data(), contents.size()));
+	}
+
+	// Every permutation of the archive has to be what the stub makes for it
+	bool CheckArchive(const ShaderArchive& archive, const std::vector<ShaderPermutationSet>& sets)
+	{
+		StubShaderCompiler compiler;
+		for (const ShaderPermutationSet& set : sets)
+		{
+			int index = archive.FindSet(set.name);
+			if (index < 0 || archive.GetFeatureCount(index) != set.features.size())
+			{
+				return false;
+			}
+			ShaderBytecode bytecode;
+			for (uint32_t mask = 0; mask < set.GetPermutationCount(); mask++)
+			{
+				std::vector<uint8_t> expected;
+				std::string errors;
+				uint64_t sourceKey;
+				if (!compiler.Compile(GetPermutationDesc(set, mask), expected, errors)
+					|| !ComputeShaderKey(GetPermutationDesc(set, mask), sourceKey) || archive.GetSourceKey(index, mask) != sourceKey
+					|| !archive.GetPermutation(index, mask, bytecode)
+					|| bytecode.size != expected.size() || memcmp(bytecode.data, expected.data(), expected.size()) != 0)
+				{
+					return false;
+				}
+			}
+			if (archive.GetPermutation(index, set.GetPermutationCount(), bytecode))
+			{
+				return false;
+			}
+		}
+		return archive.FindSet("Missing") < 0;
+	}
+}
+
+bool ValidateShaderPermutations(JobSystem* pool, const std::string& directory, uint32_t seed)
+{
+	std::string shaderPath = directory + "/PermutationShader.hlsl";
+	std::string includePath = directory + "/PermutationCommon.hlsli";
+	std::string cachePath = directory + "/PermutationCache.bin";
+	std::string archivePath = directory + "/Permutations.pak";
+	std::remove(cachePath.c_str());
+	if (!WriteFile(shaderPath, "#include \"PermutationCommon.hlsli\"\nfloat4 main() : SV_TARGET { return Shade(); }\n")
+		|| !WriteFile(includePath, "float4 Shade() { return 1; }\n"))
+	{
+		return false;
+	}
+
+	// Random sets, some features without defines so some permutations share their blob
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<uint32_t> featureRange(0, 5);
+	std::uniform_int_distribution<uint32_t> defineRange(0, 2);
+	std::vector<ShaderPermutationSet> sets(4);
+	uint32_t permutationCount = 0;
+	for (uint32_t i = 0; i < sets.size(); i++)
+	{
+		ShaderPermutationSet& set = sets[i];
+		set.name = "Set" + std::to_string(i);
+		set.path = shaderPath;
+		set.target = i & 1 ? "ps_5_0" : "vs_5_0";
+		set.features.resize(featureRange(random));
+		for (uint32_t bit = 0; bit < set.features.size(); bit++)
+		{
+			uint32_t defines = defineRange(random);
+			for (uint32_t define = 0; define < defines; define++)
+			{
+				set.features[bit].defines.push_back({ "FEATURE" + std::to_string(bit) + "_" + std::to_string(define), "1" });
+			}
+		}
+		permutationCount += set.GetPermutationCount();
+	}
+
+	StubShaderCompiler compiler;
+	PrecompileStats stats;
+	std::string errors;
+	ShaderArchive archive;
+	for (int run = 0; run < 3; run++)
+	{
+		// Third run: the include changed, everything compiles again
+		if (run == 2 && !WriteFile(includePath, "float4 Shade() { return 0; }\n"))
+		{
+			return false;
+		}
+		ShaderCache cache;
+		cache.Open(cachePath);
+		if (!PrecompileShaders(sets, compiler, pool, &cache, archivePath, stats, errors))
+		{
+			return false;
+		}
+		uint32_t expectedCompiled = run == 1 ? 0 : permutationCount;
+		if (stats.permutations != permutationCount || stats.compiled != expectedCompiled
+			|| stats.cached != permutationCount - expectedCompiled || stats.failed != 0)
+		{
+			return false;
+		}
+		if (!archive.Open(archivePath, StubShaderCompiler::kTag) || !CheckArchive(archive, sets))
+		{
+			return false;
+		}
+		archive.Close();
+	}
+
+	// Another compiler's archive is refused, and a failed precompile leaves the archive alone
+	if (archive.Open(archivePath, 0))
+	{
+		return false;
+	}
+	std::vector<ShaderPermutationSet> broken = sets;
+	broken[0].path = directory + "/Missing.hlsl";
+	if (PrecompileShaders(broken, compiler, pool, nullptr, archivePath, stats, errors) || stats.failed != broken[0].GetPermutationCount()
+		|| !archive.Open(archivePath, StubShaderCompiler::kTag) || !CheckArchive(archive, sets))
+	{
+		return false;
+	}
+	archive.Close();
+
+	std::remove(shaderPath.c_str());
+	std::remove(includePath.c_str());
+	std::remove(cachePath.c_str());
+	std::remove(archivePath.c_str());
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "ShaderCache.h"
+
+class JobSystem;
+
+// Shader variants selected by a mask of feature bits, compiled ahead of time into one archive
+//
+// A ShaderPermutationSet is one source and entry point, every feature bit adds its defines
+// (the D3D_SHADER_MACROs of the compilation), so a set with N features has 2^N permutations,
+// the mask is the index of the permutation. PrecompileShaders compiles them all on every
+// thread through a ShaderCompiler (D3DCompile in the tool, a stub anywhere else) and writes
+// a ShaderArchive: a table per set indexed by the mask, so finding a blob at runtime is one
+// lookup into the mapped file.
+
+// Features of a set, 2^8 permutations at most
+const uint32_t kMaxShaderFeatures = 8;
+
+struct ShaderFeature
+{
+	std::string name; // for messages
+	std::vector<ShaderDefine> defines; // on when the bit is set
+};
+
+struct ShaderPermutationSet
+{
+	std::string name; // what the archive is searched by
+	std::string path;
+	std::string entryPoint = "main";
+	std::string target; // vs_5_0...
+	uint32_t flags = 0; // D3DCOMPILE_*
+	std::vector<ShaderFeature> features; // bit i of the mask is features[i]
+
+	uint32_t GetPermutationCount() const { return 1u << features.size(); }
+};
+
+// The compilation of one permutation, the defines of every bit set in mask in bit order
+ShaderCompileDesc GetPermutationDesc(const ShaderPermutationSet& set, uint32_t mask);
+
+// Turns a compile desc into bytecode, called from several threads at once
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() = default;
+
+	// Four characters saved in the archive and mixed in the cache keys, so blobs of two compilers never mix
+	virtual uint32_t GetTag() const = 0;
+	// errors gets the messages of a failed compilation
+	virtual bool Compile(const ShaderCompileDesc& desc, std::vector<uint8_t>& bytecode, std::string& errors) = 0;
+};
+
+// Compiler without a compiler, its "bytecode" is the text of the desc and a hash of the source
+// Lets the tool, the cache and the archive run where there is no D3DCompiler
+class StubShaderCompiler : public ShaderCompiler
+{
+public:
+	static constexpr uint32_t kTag = 0x42555453; // "STUB"
+
+	uint32_t GetTag() const override { return kTag; }
+	bool Compile(const ShaderCompileDesc& desc, std::vector<uint8_t>& bytecode, std::string& errors) override;
+};
+
+struct PrecompileStats
+{
+	uint32_t permutations;
+	uint32_t compiled; // misses of the cache
+	uint32_t cached; // found in the cache
+	uint32_t failed;
+};
+
+// Compile every permutation of sets on every thread of pool (can be null) and write the archive
+// cache (can be null) gives the permutations that didn't change and gets the new ones, it's saved after
+// False when a permutation fails, errors has the messages, no archive is written then
+bool PrecompileShaders(const std::vector<ShaderPermutationSet>& sets, ShaderCompiler& compiler, JobSystem* pool,
+	ShaderCache* cache, const std::string& archivePath, PrecompileStats& stats, std::string& errors);
+
+// Reads an archive written by PrecompileShaders
+class ShaderArchive
+{
+public:
+	// False when it's missing, damaged, or from another compiler than tag
+	bool Open(const std::string& path, uint32_t tag);
+	void Close();
+
+	// Index of a set, -1 when the archive doesn't have it, look them up once at load
+	int FindSet(const std::string& name) const;
+	uint32_t GetFeatureCount(int set) const;
+	// The blob of a permutation, false when mask has bits the set doesn't have
+	bool GetPermutation(int set, uint32_t mask, ShaderBytecode& bytecode) const;
+	// ComputeShaderKey of the permutation when it was compiled, a different key now means the sources changed since
+	uint64_t GetSourceKey(int set, uint32_t mask) const;
+
+private:
+	// Tables of the mapped file, their layout is in ShaderPermutations.cpp
+	MappedFile m_file;
+	const uint8_t* m_sets = nullptr;
+	uint32_t m_setCount = 0;
+	const uint8_t* m_permutations = nullptr;
+};
+
+// Precompile random sets with the stub compiler into directory, twice to go through the cache,
+// returns false when a lookup gives the wrong blob or the second run compiles anything
+bool ValidateShaderPermutations(JobSystem* pool, const std::string& directory, uint32_t seed);
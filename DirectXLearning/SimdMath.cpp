@@ -0,0 +1,292 @@
+#include "SimdMath.h"
+#include <algorithm> // max, swap
+#include <random>
+
+namespace
+{
+	// The references work on plain double arrays, the textbook way, nothing shared with SimdMath
+	struct Reference
+	{
+		double m[4][4];
+	};
+
+	Reference ToReference(const SimdMath::Matrix& matrix)
+	{
+		SimdMath::Float4x4 stored;
+		SimdMath::StoreFloat4x4(&stored, matrix);
+		Reference result;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				result.m[row][column] = stored.m[row][column];
+			}
+		}
+		return result;
+	}
+
+	Reference ReferenceMultiply(const Reference& a, const Reference& b)
+	{
+		Reference result = {};
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				for (int k = 0; k < 4; k++)
+				{
+					result.m[row][column] += a.m[row][k] * b.m[k][column];
+				}
+			}
+		}
+		return result;
+	}
+
+	// Gauss-Jordan elimination with partial pivoting, returns the determinant
+	double ReferenceInverse(const Reference& matrix, Reference& inverse)
+	{
+		Reference a = matrix;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				inverse.m[row][column] = row == column ? 1.0 : 0.0;
+			}
+		}
+
+		double determinant = 1.0;
+		for (int column = 0; column < 4; column++)
+		{
+			int pivot = column;
+			for (int row = column + 1; row < 4; row++)
+			{
+				if (std::abs(a.m[row][column]) > std::abs(a.m[pivot][column]))
+				{
+					pivot = row;
+				}
+			}
+			if (pivot != column)
+			{
+				std::swap(a.m[pivot], a.m[column]);
+				std::swap(inverse.m[pivot], inverse.m[column]);
+				determinant = -determinant;
+			}
+
+			double diagonal = a.m[column][column];
+			determinant *= diagonal;
+			for (int k = 0; k < 4; k++)
+			{
+				a.m[column][k] /= diagonal;
+				inverse.m[column][k] /= diagonal;
+			}
+			for (int row = 0; row < 4; row++)
+			{
+				if (row != column)
+				{
+					double factor = a.m[row][column];
+					for (int k = 0; k < 4; k++)
+					{
+						a.m[row][k] -= factor * a.m[column][k];
+						inverse.m[row][k] -= factor * inverse.m[column][k];
+					}
+				}
+			}
+		}
+		return determinant;
+	}
+
+	// Rows are the camera axes as columns, then the eye moved into view space
+	Reference ReferenceLookAt(const double eye[3], const double focus[3], const double up[3])
+	{
+		auto normalize = [](double v[3])
+		{
+			double length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		};
+		auto cross = [](const double a[3], const double b[3], double result[3])
+		{
+			result[0] = a[1] * b[2] - a[2] * b[1];
+			result[1] = a[2] * b[0] - a[0] * b[2];
+			result[2] = a[0] * b[1] - a[1] * b[0];
+		};
+
+		double zAxis[3] = { focus[0] - eye[0], focus[1] - eye[1], focus[2] - eye[2] };
+		normalize(zAxis);
+		double xAxis[3];
+		cross(up, zAxis, xAxis);
+		normalize(xAxis);
+		double yAxis[3];
+		cross(zAxis, xAxis, yAxis);
+
+		Reference result = {};
+		for (int c = 0; c < 3; c++)
+		{
+			result.m[c][0] = xAxis[c];
+			result.m[c][1] = yAxis[c];
+			result.m[c][2] = zAxis[c];
+			result.m[3][0] -= xAxis[c] * eye[c];
+			result.m[3][1] -= yAxis[c] * eye[c];
+			result.m[3][2] -= zAxis[c] * eye[c];
+		}
+		result.m[3][3] = 1.0;
+		return result;
+	}
+
+	Reference ReferencePerspective(double fovAngleY, double aspectRatio, double nearZ, double farZ)
+	{
+		double height = 1.0 / std::tan(0.5 * fovAngleY);
+		Reference result = {};
+		result.m[0][0] = height / aspectRatio;
+		result.m[1][1] = height;
+		result.m[2][2] = farZ / (farZ - nearZ);
+		result.m[2][3] = 1.0;
+		result.m[3][2] = -nearZ * farZ / (farZ - nearZ);
+		return result;
+	}
+
+	// Every element within tolerance, relative to the element for the big ones
+	bool IsNear(const SimdMath::Matrix& matrix, const Reference& reference, double tolerance)
+	{
+		Reference tested = ToReference(matrix);
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				double expected = reference.m[row][column];
+				if (!(std::abs(tested.m[row][column] - expected) <= tolerance * std::max(1.0, std::abs(expected))))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool IsNear(float value, double expected, double tolerance)
+	{
+		return std::abs(value - expected) <= tolerance * std::max(1.0, std::abs(expected));
+	}
+}
+
+bool ValidateSimdMath(uint32_t seed, int iterations)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> angle(-SimdMath::kPi, SimdMath::kPi);
+	std::uniform_real_distribution<float> scale(0.25f, 4.0f);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+
+	auto randomMatrix = [&](float range)
+	{
+		SimdMath::Float4x4 values;
+		for (auto& row : values.m)
+		{
+			for (float& value : row)
+			{
+				value = range * unit(random);
+			}
+		}
+		return SimdMath::LoadFloat4x4(&values);
+	};
+
+	// What the engine builds its worlds from: scale, rotation, translation
+	auto randomTransform = [&]()
+	{
+		return SimdMath::MatrixMultiply(SimdMath::MatrixMultiply(
+			SimdMath::MatrixScaling(scale(random), scale(random), scale(random)),
+			SimdMath::MatrixRotationRollPitchYaw(angle(random), angle(random), angle(random))),
+			SimdMath::MatrixTranslation(position(random), position(random), position(random)));
+	};
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		// Multiply, single precision sums of 4 products (fused or not)
+		SimdMath::Matrix a = randomMatrix(10.0f);
+		SimdMath::Matrix b = randomMatrix(10.0f);
+		Reference product = ReferenceMultiply(ToReference(a), ToReference(b));
+		if (!IsNear(SimdMath::MatrixMultiply(a, b), product, 1e-4))
+		{
+			return false;
+		}
+
+		// Inverse of a transform and of a well conditioned (diagonally dominant) general matrix,
+		// the projective column included
+		for (int kind = 0; kind < 2; kind++)
+		{
+			SimdMath::Matrix matrix = kind == 0 ? randomTransform() : randomMatrix(1.0f);
+			if (kind == 1)
+			{
+				for (int i = 0; i < 4; i++)
+				{
+					matrix.r[i] = SimdMath::VectorAdd(matrix.r[i], SimdMath::VectorScale(SimdMath::MatrixIdentity().r[i], 4.0f));
+				}
+			}
+			Reference expected;
+			double expectedDeterminant = ReferenceInverse(ToReference(matrix), expected);
+			SimdMath::Vector determinant;
+			SimdMath::Matrix inverse = SimdMath::MatrixInverse(&determinant, matrix);
+			if (!IsNear(inverse, expected, 1e-4)
+				|| !IsNear(SimdMath::VectorGetX(determinant), expectedDeterminant, 1e-4)
+				|| SimdMath::VectorGetX(determinant) != SimdMath::VectorGetW(determinant))
+			{
+				return false;
+			}
+		}
+
+		// Look-at from anywhere, up kept away from the view direction
+		double eye[3];
+		double focus[3];
+		double up[3];
+		SimdMath::Vector direction;
+		SimdMath::Vector upVector;
+		do
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				eye[c] = position(random);
+				focus[c] = static_cast<float>(eye[c] + 50.0f * unit(random));
+				up[c] = unit(random);
+			}
+			direction = SimdMath::VectorSet(static_cast<float>(focus[0] - eye[0]), static_cast<float>(focus[1] - eye[1]), static_cast<float>(focus[2] - eye[2]), 0.0f);
+			upVector = SimdMath::VectorSet(static_cast<float>(up[0]), static_cast<float>(up[1]), static_cast<float>(up[2]), 0.0f);
+		} while (SimdMath::VectorGetX(SimdMath::Vector3Length(direction)) < 1.0f
+			|| SimdMath::VectorGetX(SimdMath::Vector3Length(SimdMath::Vector3Cross(SimdMath::Vector3Normalize(direction), SimdMath::Vector3Normalize(upVector)))) < 0.2f);
+		SimdMath::Matrix lookAt = SimdMath::MatrixLookAtLH(
+			SimdMath::VectorSet(static_cast<float>(eye[0]), static_cast<float>(eye[1]), static_cast<float>(eye[2]), 1.0f),
+			SimdMath::VectorSet(static_cast<float>(focus[0]), static_cast<float>(focus[1]), static_cast<float>(focus[2]), 1.0f),
+			upVector);
+		// The translation row is a dot product with the eye, its error grows with the distance
+		if (!IsNear(lookAt, ReferenceLookAt(eye, focus, up), 1e-4))
+		{
+			return false;
+		}
+
+		// Perspective over the range of fields of view, aspects and depth ranges a camera uses
+		float fovAngleY = 0.2f + 2.6f * (0.5f + 0.5f * unit(random));
+		float aspectRatio = 0.5f + 2.0f * (0.5f + 0.5f * unit(random));
+		float nearZ = 0.01f + (0.5f + 0.5f * unit(random));
+		float farZ = nearZ + 1.0f + 1000.0f * (0.5f + 0.5f * unit(random));
+		if (!IsNear(SimdMath::MatrixPerspectiveFovLH(fovAngleY, aspectRatio, nearZ, farZ), ReferencePerspective(fovAngleY, aspectRatio, nearZ, farZ), 1e-5))
+		{
+			return false;
+		}
+
+		// Plane normalize, the normal comes out unit length and d scales with it
+		SimdMath::Float4 plane(position(random), position(random), position(random), position(random));
+		SimdMath::Float4 normalized;
+		SimdMath::StoreFloat4(&normalized, SimdMath::PlaneNormalize(SimdMath::LoadFloat4(&plane)));
+		double length = std::sqrt(static_cast<double>(plane.x) * plane.x + static_cast<double>(plane.y) * plane.y + static_cast<double>(plane.z) * plane.z);
+		if (!IsNear(normalized.x, plane.x / length, 1e-6) || !IsNear(normalized.y, plane.y / length, 1e-6)
+			|| !IsNear(normalized.z, plane.z / length, 1e-6) || !IsNear(normalized.w, plane.w / length, 1e-6))
+		{
+			return false;
+		}
+	}
+
+	// A plane without a normal stays as it is
+	SimdMath::Float4 degenerate(0.0f, 0.0f, 0.0f, 5.0f);
+	SimdMath::Float4 result;
+	SimdMath::StoreFloat4(&result, SimdMath::PlaneNormalize(SimdMath::LoadFloat4(&degenerate)));
+	return result.x == 0.0f && result.y == 0.0f && result.z == 0.0f && result.w == 5.0f;
+}
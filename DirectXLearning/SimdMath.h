@@ -0,0 +1,623 @@
+#pragma once
+#include <cmath> // sqrt, sin, cos
+#include <cstdint> // fixed size integers
+
+// Portable replacement for the parts of DirectXMath the engine uses
+//
+// Same conventions as DirectXMath: row vectors, v * M, matrices are 4 rows, left-handed
+// view/projection helpers, and the same function names without the XM prefix
+// (XMMatrixLookAtLH -> SimdMath::MatrixLookAtLH). Vector/Matrix live in registers,
+// Float3/Float4/Float4x4 are the unaligned types to store in structs and buffers.
+//
+// The backend is picked at compile time:
+//   SSE2 (SSE4.1 dot products, FMA when AVX2 is enabled), NEON, or plain C++.
+// Define SIMD_MATH_FORCE_SCALAR to get the plain C++ version anywhere.
+
+#if defined(SIMD_MATH_FORCE_SCALAR)
+#define SIMD_MATH_SCALAR 1
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+#define SIMD_MATH_NEON 1
+#include <arm_neon.h>
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_MATH_SSE 1
+#include <emmintrin.h> // SSE2
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define SIMD_MATH_SSE4 1
+#include <smmintrin.h> // _mm_dp_ps
+#endif
+#if defined(__AVX2__)
+#define SIMD_MATH_FMA 1
+#include <immintrin.h> // _mm_fmadd_ps
+#endif
+#else
+#define SIMD_MATH_SCALAR 1
+#endif
+
+namespace SimdMath
+{
+	const float kPi = 3.141592654f;
+	const float kPiDiv2 = 1.570796327f;
+	const float kPiDiv4 = 0.785398163f;
+
+	// Storage types, same layout as XMFLOAT2/XMFLOAT3/XMFLOAT4/XMFLOAT4X4
+	struct Float2
+	{
+		float x, y;
+		Float2() = default;
+		constexpr Float2(float x_, float y_) : x(x_), y(y_) {}
+	};
+
+	struct Float3
+	{
+		float x, y, z;
+		Float3() = default;
+		constexpr Float3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+	};
+
+	struct Float4
+	{
+		float x, y, z, w;
+		Float4() = default;
+		constexpr Float4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+	};
+
+	struct Float4x4
+	{
+		float m[4][4];
+	};
+
+	// Register types
+#if SIMD_MATH_SSE
+	typedef __m128 Vector;
+#elif SIMD_MATH_NEON
+	typedef float32x4_t Vector;
+#else
+	struct Vector
+	{
+		float v[4];
+	};
+#endif
+
+	struct alignas(16) Matrix
+	{
+		Vector r[4];
+	};
+
+	// Backend name, for logs and benchmark results
+	inline const char* GetBackendName()
+	{
+#if SIMD_MATH_SSE && SIMD_MATH_FMA
+		return "SSE4+FMA";
+#elif SIMD_MATH_SSE4
+		return "SSE4";
+#elif SIMD_MATH_SSE
+		return "SSE2";
+#elif SIMD_MATH_NEON
+		return "NEON";
+#else
+		return "Scalar";
+#endif
+	}
+
+	// ---- Per-backend primitives, everything else is built on top of them ----
+
+	inline Vector VectorSet(float x, float y, float z, float w)
+	{
+#if SIMD_MATH_SSE
+		return _mm_set_ps(w, z, y, x);
+#elif SIMD_MATH_NEON
+		const float values[4] = { x, y, z, w };
+		return vld1q_f32(values);
+#else
+		return { { x, y, z, w } };
+#endif
+	}
+
+	inline Vector VectorReplicate(float value)
+	{
+#if SIMD_MATH_SSE
+		return _mm_set1_ps(value);
+#elif SIMD_MATH_NEON
+		return vdupq_n_f32(value);
+#else
+		return { { value, value, value, value } };
+#endif
+	}
+
+	inline Vector VectorZero()
+	{
+		return VectorReplicate(0.0f);
+	}
+
+	inline float VectorGetX(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_cvtss_f32(v);
+#elif SIMD_MATH_NEON
+		return vgetq_lane_f32(v, 0);
+#else
+		return v.v[0];
+#endif
+	}
+
+	inline float VectorGetY(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif SIMD_MATH_NEON
+		return vgetq_lane_f32(v, 1);
+#else
+		return v.v[1];
+#endif
+	}
+
+	inline float VectorGetZ(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+#elif SIMD_MATH_NEON
+		return vgetq_lane_f32(v, 2);
+#else
+		return v.v[2];
+#endif
+	}
+
+	inline float VectorGetW(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+#elif SIMD_MATH_NEON
+		return vgetq_lane_f32(v, 3);
+#else
+		return v.v[3];
+#endif
+	}
+
+	inline Vector VectorSplatX(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+#elif SIMD_MATH_NEON
+		return vdupq_laneq_f32(v, 0);
+#else
+		return VectorReplicate(v.v[0]);
+#endif
+	}
+
+	inline Vector VectorSplatY(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+#elif SIMD_MATH_NEON
+		return vdupq_laneq_f32(v, 1);
+#else
+		return VectorReplicate(v.v[1]);
+#endif
+	}
+
+	inline Vector VectorSplatZ(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+#elif SIMD_MATH_NEON
+		return vdupq_laneq_f32(v, 2);
+#else
+		return VectorReplicate(v.v[2]);
+#endif
+	}
+
+	inline Vector VectorSplatW(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+#elif SIMD_MATH_NEON
+		return vdupq_laneq_f32(v, 3);
+#else
+		return VectorReplicate(v.v[3]);
+#endif
+	}
+
+	inline Vector VectorAdd(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE
+		return _mm_add_ps(a, b);
+#elif SIMD_MATH_NEON
+		return vaddq_f32(a, b);
+#else
+		return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } };
+#endif
+	}
+
+	inline Vector VectorSubtract(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE
+		return _mm_sub_ps(a, b);
+#elif SIMD_MATH_NEON
+		return vsubq_f32(a, b);
+#else
+		return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+#endif
+	}
+
+	inline Vector VectorMultiply(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE
+		return _mm_mul_ps(a, b);
+#elif SIMD_MATH_NEON
+		return vmulq_f32(a, b);
+#else
+		return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } };
+#endif
+	}
+
+	inline Vector VectorDivide(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE
+		return _mm_div_ps(a, b);
+#elif SIMD_MATH_NEON
+		return vdivq_f32(a, b);
+#else
+		return { { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } };
+#endif
+	}
+
+	// a * b + c, fused when the CPU can
+	inline Vector VectorMultiplyAdd(Vector a, Vector b, Vector c)
+	{
+#if SIMD_MATH_FMA
+		return _mm_fmadd_ps(a, b, c);
+#elif SIMD_MATH_SSE
+		return _mm_add_ps(_mm_mul_ps(a, b), c);
+#elif SIMD_MATH_NEON
+		return vfmaq_f32(c, a, b);
+#else
+		return VectorAdd(VectorMultiply(a, b), c);
+#endif
+	}
+
+	inline Vector VectorSqrt(Vector v)
+	{
+#if SIMD_MATH_SSE
+		return _mm_sqrt_ps(v);
+#elif SIMD_MATH_NEON
+		return vsqrtq_f32(v);
+#else
+		return { { std::sqrt(v.v[0]), std::sqrt(v.v[1]), std::sqrt(v.v[2]), std::sqrt(v.v[3]) } };
+#endif
+	}
+
+	inline Vector VectorMin(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE
+		return _mm_min_ps(a, b);
+#elif SIMD_MATH_NEON
+		return vminq_f32(a, b);
+#else
+		return { { a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1], a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3] } };
+#endif
+	}
+
+	inline Vector VectorMax(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE
+		return _mm_max_ps(a, b);
+#elif SIMD_MATH_NEON
+		return vmaxq_f32(a, b);
+#else
+		return { { a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1], a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3] } };
+#endif
+	}
+
+	// Dot product of x, y, z replicated in every component
+	inline Vector Vector3Dot(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE4
+		return _mm_dp_ps(a, b, 0x7F);
+#elif SIMD_MATH_SSE
+		__m128 product = _mm_mul_ps(a, b);
+		__m128 sum = _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1)));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2)));
+		return _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+#elif SIMD_MATH_NEON
+		float32x4_t product = vmulq_f32(a, b);
+		return vdupq_n_f32(vgetq_lane_f32(product, 0) + vgetq_lane_f32(product, 1) + vgetq_lane_f32(product, 2));
+#else
+		return VectorReplicate(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2]);
+#endif
+	}
+
+	// Dot product of all 4 components replicated in every component
+	inline Vector Vector4Dot(Vector a, Vector b)
+	{
+#if SIMD_MATH_SSE4
+		return _mm_dp_ps(a, b, 0xFF);
+#elif SIMD_MATH_SSE
+		__m128 product = _mm_mul_ps(a, b);
+		__m128 sum = _mm_add_ps(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+#elif SIMD_MATH_NEON
+		return vdupq_n_f32(vaddvq_f32(vmulq_f32(a, b)));
+#else
+		return VectorReplicate(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + a.v[3] * b.v[3]);
+#endif
+	}
+
+	// ---- Loads and stores ----
+
+	inline Vector LoadFloat3(const Float3* source)
+	{
+		return VectorSet(source->x, source->y, source->z, 0.0f);
+	}
+
+	inline Vector LoadFloat4(const Float4* source)
+	{
+#if SIMD_MATH_SSE
+		return _mm_loadu_ps(&source->x);
+#elif SIMD_MATH_NEON
+		return vld1q_f32(&source->x);
+#else
+		return VectorSet(source->x, source->y, source->z, source->w);
+#endif
+	}
+
+	inline void StoreFloat3(Float3* destination, Vector v)
+	{
+		destination->x = VectorGetX(v);
+		destination->y = VectorGetY(v);
+		destination->z = VectorGetZ(v);
+	}
+
+	inline void StoreFloat4(Float4* destination, Vector v)
+	{
+#if SIMD_MATH_SSE
+		_mm_storeu_ps(&destination->x, v);
+#elif SIMD_MATH_NEON
+		vst1q_f32(&destination->x, v);
+#else
+		destination->x = v.v[0];
+		destination->y = v.v[1];
+		destination->z = v.v[2];
+		destination->w = v.v[3];
+#endif
+	}
+
+	inline Matrix LoadFloat4x4(const Float4x4* source)
+	{
+		Matrix m;
+		for (int i = 0; i < 4; i++)
+		{
+			m.r[i] = LoadFloat4(reinterpret_cast<const Float4*>(source->m[i]));
+		}
+		return m;
+	}
+
+	inline void StoreFloat4x4(Float4x4* destination, const Matrix& m)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			StoreFloat4(reinterpret_cast<Float4*>(destination->m[i]), m.r[i]);
+		}
+	}
+
+	// ---- Vectors ----
+
+	inline Vector VectorScale(Vector v, float scale)
+	{
+		return VectorMultiply(v, VectorReplicate(scale));
+	}
+
+	inline Vector VectorNegate(Vector v)
+	{
+		return VectorSubtract(VectorZero(), v);
+	}
+
+	inline Vector Vector3Cross(Vector a, Vector b)
+	{
+		float ax = VectorGetX(a), ay = VectorGetY(a), az = VectorGetZ(a);
+		float bx = VectorGetX(b), by = VectorGetY(b), bz = VectorGetZ(b);
+		return VectorSet(ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx, 0.0f);
+	}
+
+	inline Vector Vector3Length(Vector v)
+	{
+		return VectorSqrt(Vector3Dot(v, v));
+	}
+
+	// Zero stays zero, like XMVector3Normalize (all 4 components are divided by the length)
+	inline Vector Vector3Normalize(Vector v)
+	{
+		float length = VectorGetX(Vector3Length(v));
+		return length > 0.0f ? VectorScale(v, 1.0f / length) : VectorZero();
+	}
+
+	// (x, y, z, 1) * m, w is not divided out
+	inline Vector Vector3Transform(Vector v, const Matrix& m)
+	{
+		Vector result = VectorMultiplyAdd(VectorSplatZ(v), m.r[2], m.r[3]);
+		result = VectorMultiplyAdd(VectorSplatY(v), m.r[1], result);
+		return VectorMultiplyAdd(VectorSplatX(v), m.r[0], result);
+	}
+
+	// (x, y, z, 0) * m
+	inline Vector Vector3TransformNormal(Vector v, const Matrix& m)
+	{
+		Vector result = VectorMultiply(VectorSplatZ(v), m.r[2]);
+		result = VectorMultiplyAdd(VectorSplatY(v), m.r[1], result);
+		return VectorMultiplyAdd(VectorSplatX(v), m.r[0], result);
+	}
+
+	inline Vector Vector4Transform(Vector v, const Matrix& m)
+	{
+		Vector result = VectorMultiply(VectorSplatW(v), m.r[3]);
+		result = VectorMultiplyAdd(VectorSplatZ(v), m.r[2], result);
+		result = VectorMultiplyAdd(VectorSplatY(v), m.r[1], result);
+		return VectorMultiplyAdd(VectorSplatX(v), m.r[0], result);
+	}
+
+	// ---- Planes ----
+
+	// (a, b, c, d) divided by the length of (a, b, c), a plane with no normal is returned as it is
+	inline Vector PlaneNormalize(Vector plane)
+	{
+		Vector length = Vector3Length(plane);
+		return VectorGetX(length) > 0.0f ? VectorDivide(plane, length) : plane;
+	}
+
+	// ---- Matrices ----
+
+	inline Matrix MatrixSet(float m00, float m01, float m02, float m03,
+		float m10, float m11, float m12, float m13,
+		float m20, float m21, float m22, float m23,
+		float m30, float m31, float m32, float m33)
+	{
+		Matrix m;
+		m.r[0] = VectorSet(m00, m01, m02, m03);
+		m.r[1] = VectorSet(m10, m11, m12, m13);
+		m.r[2] = VectorSet(m20, m21, m22, m23);
+		m.r[3] = VectorSet(m30, m31, m32, m33);
+		return m;
+	}
+
+	inline Matrix MatrixIdentity()
+	{
+		return MatrixSet(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	// a then b (row vectors: v * a * b)
+	inline Matrix MatrixMultiply(const Matrix& a, const Matrix& b)
+	{
+		Matrix result;
+		for (int i = 0; i < 4; i++)
+		{
+			result.r[i] = Vector4Transform(a.r[i], b);
+		}
+		return result;
+	}
+
+	inline Matrix MatrixTranspose(const Matrix& m)
+	{
+#if SIMD_MATH_SSE
+		Matrix result = m;
+		_MM_TRANSPOSE4_PS(result.r[0], result.r[1], result.r[2], result.r[3]);
+		return result;
+#else
+		Float4x4 source;
+		Float4x4 transposed;
+		StoreFloat4x4(&source, m);
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				transposed.m[row][column] = source.m[column][row];
+			}
+		}
+		return LoadFloat4x4(&transposed);
+#endif
+	}
+
+	// Inverse by cofactors, determinant (replicated) goes to determinant when it isn't null
+	// A singular matrix gives infinities, like XMMatrixInverse
+	inline Matrix MatrixInverse(Vector* determinant, const Matrix& m)
+	{
+		Float4x4 a;
+		StoreFloat4x4(&a, m);
+
+		// 2x2 minors of the first two rows and of the last two
+		float s0 = a.m[0][0] * a.m[1][1] - a.m[1][0] * a.m[0][1];
+		float s1 = a.m[0][0] * a.m[1][2] - a.m[1][0] * a.m[0][2];
+		float s2 = a.m[0][0] * a.m[1][3] - a.m[1][0] * a.m[0][3];
+		float s3 = a.m[0][1] * a.m[1][2] - a.m[1][1] * a.m[0][2];
+		float s4 = a.m[0][1] * a.m[1][3] - a.m[1][1] * a.m[0][3];
+		float s5 = a.m[0][2] * a.m[1][3] - a.m[1][2] * a.m[0][3];
+		float c5 = a.m[2][2] * a.m[3][3] - a.m[3][2] * a.m[2][3];
+		float c4 = a.m[2][1] * a.m[3][3] - a.m[3][1] * a.m[2][3];
+		float c3 = a.m[2][1] * a.m[3][2] - a.m[3][1] * a.m[2][2];
+		float c2 = a.m[2][0] * a.m[3][3] - a.m[3][0] * a.m[2][3];
+		float c1 = a.m[2][0] * a.m[3][2] - a.m[3][0] * a.m[2][2];
+		float c0 = a.m[2][0] * a.m[3][1] - a.m[3][0] * a.m[2][1];
+
+		float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+		if (determinant)
+		{
+			*determinant = VectorReplicate(det);
+		}
+		float inv = 1.0f / det;
+
+		return MatrixSet(
+			(a.m[1][1] * c5 - a.m[1][2] * c4 + a.m[1][3] * c3) * inv,
+			(-a.m[0][1] * c5 + a.m[0][2] * c4 - a.m[0][3] * c3) * inv,
+			(a.m[3][1] * s5 - a.m[3][2] * s4 + a.m[3][3] * s3) * inv,
+			(-a.m[2][1] * s5 + a.m[2][2] * s4 - a.m[2][3] * s3) * inv,
+			(-a.m[1][0] * c5 + a.m[1][2] * c2 - a.m[1][3] * c1) * inv,
+			(a.m[0][0] * c5 - a.m[0][2] * c2 + a.m[0][3] * c1) * inv,
+			(-a.m[3][0] * s5 + a.m[3][2] * s2 - a.m[3][3] * s1) * inv,
+			(a.m[2][0] * s5 - a.m[2][2] * s2 + a.m[2][3] * s1) * inv,
+			(a.m[1][0] * c4 - a.m[1][1] * c2 + a.m[1][3] * c0) * inv,
+			(-a.m[0][0] * c4 + a.m[0][1] * c2 - a.m[0][3] * c0) * inv,
+			(a.m[3][0] * s4 - a.m[3][1] * s2 + a.m[3][3] * s0) * inv,
+			(-a.m[2][0] * s4 + a.m[2][1] * s2 - a.m[2][3] * s0) * inv,
+			(-a.m[1][0] * c3 + a.m[1][1] * c1 - a.m[1][2] * c0) * inv,
+			(a.m[0][0] * c3 - a.m[0][1] * c1 + a.m[0][2] * c0) * inv,
+			(-a.m[3][0] * s3 + a.m[3][1] * s1 - a.m[3][2] * s0) * inv,
+			(a.m[2][0] * s3 - a.m[2][1] * s1 + a.m[2][2] * s0) * inv);
+	}
+
+	inline Matrix MatrixTranslation(float x, float y, float z)
+	{
+		return MatrixSet(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, x, y, z, 1.0f);
+	}
+
+	inline Matrix MatrixScaling(float x, float y, float z)
+	{
+		return MatrixSet(x, 0.0f, 0.0f, 0.0f, 0.0f, y, 0.0f, 0.0f, 0.0f, 0.0f, z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	// Roll around z, then pitch around x, then yaw around y (angles in radians)
+	inline Matrix MatrixRotationRollPitchYaw(float pitch, float yaw, float roll)
+	{
+		float cp = std::cos(pitch), sp = std::sin(pitch);
+		float cy = std::cos(yaw), sy = std::sin(yaw);
+		float cr = std::cos(roll), sr = std::sin(roll);
+		return MatrixSet(
+			cr * cy + sr * sp * sy, sr * cp, sr * sp * cy - cr * sy, 0.0f,
+			cr * sp * sy - sr * cy, cr * cp, sr * sy + cr * sp * cy, 0.0f,
+			cp * sy, -sp, cp * cy, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	// Left-handed view matrix looking along direction
+	inline Matrix MatrixLookToLH(Vector eye, Vector direction, Vector up)
+	{
+		Vector r2 = Vector3Normalize(direction);
+		Vector r0 = Vector3Normalize(Vector3Cross(up, r2));
+		Vector r1 = Vector3Cross(r2, r0);
+		Vector negEye = VectorNegate(eye);
+		return MatrixSet(
+			VectorGetX(r0), VectorGetX(r1), VectorGetX(r2), 0.0f,
+			VectorGetY(r0), VectorGetY(r1), VectorGetY(r2), 0.0f,
+			VectorGetZ(r0), VectorGetZ(r1), VectorGetZ(r2), 0.0f,
+			VectorGetX(Vector3Dot(r0, negEye)), VectorGetX(Vector3Dot(r1, negEye)), VectorGetX(Vector3Dot(r2, negEye)), 1.0f);
+	}
+
+	inline Matrix MatrixLookAtLH(Vector eye, Vector focus, Vector up)
+	{
+		return MatrixLookToLH(eye, VectorSubtract(focus, eye), up);
+	}
+
+	// Left-handed perspective projection, depth goes from 0 at nearZ to 1 at farZ
+	inline Matrix MatrixPerspectiveFovLH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+	{
+		float height = std::cos(0.5f * fovAngleY) / std::sin(0.5f * fovAngleY);
+		float width = height / aspectRatio;
+		float range = farZ / (farZ - nearZ);
+		return MatrixSet(
+			width, 0.0f, 0.0f, 0.0f,
+			0.0f, height, 0.0f, 0.0f,
+			0.0f, 0.0f, range, 1.0f,
+			0.0f, 0.0f, -range * nearZ, 0.0f);
+	}
+}
+
+// Compares the multiply, inverse, look-at, perspective and plane functions of the compiled backend
+// with plain double precision versions, returns false on the first result out of tolerance
+bool ValidateSimdMath(uint32_t seed, int iterations);
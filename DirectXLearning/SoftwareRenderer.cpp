@@ -0,0 +1,1066 @@
+#include "SoftwareRenderer.h"
+#include "GeneratedShaders.h"
+#include "JobSystem.h"
+#include <algorithm> // min/max
+#include <cfloat> // FLT_EPSILON
+#include <cmath> // floor/ceil
+#include <cstring> // memset
+#include <random>
+
+namespace
+{
+	// Don't split the geometry work into ranges smaller than this many triangles
+	const uint32_t kMinTrianglesPerBin = 64;
+
+	// Vertices per batch when setting up triangles, small enough to stay in cache
+	const uint32_t kTrianglesPerBatch = 256;
+
+	// Shaders of ValidateDepthTest: the vertex position in clip space scaled by w (from texCoord.x),
+	// the vertex color straight to the render target
+	struct DepthTestVertexShader
+	{
+		static const int kVaryingCount = 4;
+
+		void operator()(const void* const*, const VertexShaderInput& input, VertexShaderOutput& output) const
+		{
+			for (int lane = 0; lane < kVertexShaderLanes; lane++)
+			{
+				float w = input.texCoord[0][lane];
+				for (int c = 0; c < 3; c++)
+				{
+					output.position[c][lane] = input.position[c][lane] * w;
+				}
+				output.position[3][lane] = w;
+				for (int c = 0; c < 4; c++)
+				{
+					output.varyings[c][lane] = input.color[c][lane];
+				}
+			}
+		}
+	};
+
+	struct DepthTestPixelShader
+	{
+		void operator()(const void* const*, const PixelShaderInput& input, PixelShaderOutput& output) const
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				for (int lane = 0; lane < kPixelShaderLanes; lane++)
+				{
+					output.color[c][lane] = input.varyings[c][lane];
+				}
+			}
+		}
+	};
+
+	// FNV-1a of the render target and of the depth of every pixel
+	uint64_t HashColorAndDepth(const SoftwareRenderer& renderer)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+		add(renderer.GetRenderTarget(), static_cast<size_t>(renderer.GetWidth()) * renderer.GetHeight() * sizeof(uint32_t));
+		for (int y = 0; y < renderer.GetHeight(); y++)
+		{
+			for (int x = 0; x < renderer.GetWidth(); x++)
+			{
+				float depth = renderer.GetDepth(x, y);
+				add(&depth, sizeof(depth));
+			}
+		}
+		return hash;
+	}
+
+	template <typename Vertex>
+	Vertex Lerp(const Vertex& a, const Vertex& b, float t)
+	{
+		Vertex result;
+		for (int i = 0; i < 4; i++)
+		{
+			result.position[i] = a.position[i] + (b.position[i] - a.position[i]) * t;
+		}
+		for (int i = 0; i < kMaxShaderVaryings; i++)
+		{
+			result.varyings[i] = a.varyings[i] + (b.varyings[i] - a.varyings[i]) * t;
+		}
+		return result;
+	}
+
+	// Clip a polygon against one plane (distance >= 0 is kept)
+	// Sutherland-Hodgman, the output has at most one more vertex than the input
+	template <typename Vertex, typename DistanceFunc>
+	int ClipPolygon(const Vertex* input, int inputCount, Vertex* output, DistanceFunc distance)
+	{
+		int outputCount = 0;
+		for (int i = 0; i < inputCount; i++)
+		{
+			const Vertex& current = input[i];
+			const Vertex& next = input[(i + 1) % inputCount];
+			float currentDistance = distance(current);
+			float nextDistance = distance(next);
+
+			if (currentDistance >= 0.0f)
+			{
+				output[outputCount++] = current;
+			}
+			// The edge crosses the plane, add the intersection point
+			if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			{
+				float t = currentDistance / (currentDistance - nextDistance);
+				output[outputCount++] = Lerp(current, next, t);
+			}
+		}
+		return outputCount;
+	}
+
+	// Convert a float color to R8G8B8A8_UNORM the same way the GPU does (saturate, round to nearest)
+	uint32_t PackColor(const float color[4])
+	{
+		uint32_t packed = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			float c = std::min(std::max(color[i], 0.0f), 1.0f);
+			packed |= static_cast<uint32_t>(c * 255.0f + 0.5f) << (i * 8);
+		}
+		return packed;
+	}
+
+	// Triangles are clipped to this many pixels around the screen before snapping,
+	// which keeps the fixed point edge functions far away from overflowing
+	const float kGuardBandPixels = 8192.0f;
+
+	// Pixels of an 8x8 block inside the columns [x0, x1] and rows [y0, y1]
+	uint64_t GetBlockBoundsMask(int x0, int x1, int y0, int y1)
+	{
+		uint64_t row = (0xFFull >> (kRasterBlockSize - 1 - (x1 - x0))) << x0;
+		uint64_t mask = 0;
+		for (int y = y0; y <= y1; y++)
+		{
+			mask |= row << (y * kRasterBlockSize);
+		}
+		return mask;
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer()
+{
+	for (uint32_t& snapshot : m_constantSnapshots)
+	{
+		snapshot = kNoSnapshot;
+	}
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	// unique_ptr joins the worker threads
+}
+
+bool SoftwareRenderer::Initialize(int width, int height, unsigned threadCount)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+	m_ownedWorkers = std::make_unique<JobSystem>(threadCount);
+	return Initialize(width, height, *m_ownedWorkers);
+}
+
+bool SoftwareRenderer::Initialize(int width, int height, JobSystem& jobs)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_tilesX = (width + kTileSize - 1) / kTileSize;
+	m_tilesY = (height + kTileSize - 1) / kTileSize;
+	m_colorBuffer.assign(static_cast<size_t>(width) * height, 0);
+	m_depthBuffer.assign(static_cast<size_t>(m_tilesX) * m_tilesY * kTileSize * kTileSize, 1.0f);
+	m_depthClearValue = 1.0f;
+	m_depthTiles.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+	for (DepthTile& tile : m_depthTiles)
+	{
+		ResetDepthTile(tile);
+	}
+	if (&jobs != m_ownedWorkers.get())
+	{
+		m_ownedWorkers.reset();
+	}
+	m_workers = &jobs;
+	SetSimdIsa(GetBestSimdIsa());
+	m_vertexShader = MakeSoftwareVertexShader<VertexShaderKernel>();
+	m_pixelShader = MakeSoftwarePixelShader<PixelShaderKernel>();
+
+	// Per-worker storage, allocated once and reused every frame
+	unsigned workerCount = m_workers->GetThreadCount();
+	m_bins.resize(workerCount);
+	for (Bin& bin : m_bins)
+	{
+		ResetBin(bin);
+		bin.tiles.assign(static_cast<size_t>(m_tilesX) * m_tilesY, ArenaVector<uint32_t>(ArenaAllocator<uint32_t>(bin.arena.get())));
+	}
+	// One per thread index, a thread outside a pool of 1 thread rasterizes on an index of its own
+	m_tileBuffers.clear();
+	for (unsigned i = 0; i < m_workers->GetThreadIndexCount(); i++)
+	{
+		m_tileBuffers.push_back(std::make_unique<TileBuffer>());
+	}
+	return true;
+}
+
+unsigned SoftwareRenderer::GetThreadCount() const
+{
+	return m_workers ? m_workers->GetThreadCount() : 0;
+}
+
+float SoftwareRenderer::GetDepth(int x, int y) const
+{
+	size_t tile = static_cast<size_t>(y / kTileSize) * m_tilesX + x / kTileSize;
+	int localX = x % kTileSize;
+	int localY = y % kTileSize;
+	int block = (localY / kRasterBlockSize) * kTileBlocks + localX / kRasterBlockSize;
+	if ((m_depthTiles[tile].clearedBlocks >> block) & 1)
+	{
+		return m_depthClearValue;
+	}
+	return m_depthBuffer[tile * kTileSize * kTileSize + localY * kTileSize + localX];
+}
+
+void SoftwareRenderer::SetSimdIsa(SimdIsa isa)
+{
+	m_simdIsa = ClampSimdIsa(isa);
+	m_coverageKernel = GetBlockCoverageFunction(m_simdIsa);
+
+#ifdef _DEBUG
+	// Check the SIMD kernel against the scalar reference, and don't trust it if they disagree
+	if (!ValidateBlockCoverage(m_simdIsa, 1234, 1024))
+	{
+		m_simdIsa = SimdIsa::Scalar;
+		m_coverageKernel = GetBlockCoverageFunction(m_simdIsa);
+	}
+#endif
+}
+
+void SoftwareRenderer::ClearRenderTarget(const float clearColor[4])
+{
+	// Draws recorded before the clear have to land first
+	if (!m_draws.empty())
+	{
+		Flush();
+	}
+	m_clearPending = true;
+	m_clearColor = PackColor(clearColor);
+}
+
+void SoftwareRenderer::ClearDepth(float depth)
+{
+	if (!m_draws.empty())
+	{
+		Flush();
+	}
+	m_depthClearPending = true;
+	m_depthClearValue = depth;
+}
+
+void SoftwareRenderer::SetDepthTest(bool enable)
+{
+	// The depth state is global to a Flush, so finish the work done with the old state
+	if (enable != m_depthTest && !m_draws.empty())
+	{
+		Flush();
+	}
+	m_depthTest = enable;
+}
+
+void SoftwareRenderer::SetCoarseDepthTest(bool enable)
+{
+	if (enable != m_coarseDepthTest && !m_draws.empty())
+	{
+		Flush();
+	}
+	m_coarseDepthTest = enable;
+}
+
+void SoftwareRenderer::SetVertexBuffer(const SoftwareVertex* vertices, uint32_t vertexCount)
+{
+	m_vertices = vertices;
+	m_vertexCount = vertexCount;
+}
+
+void SoftwareRenderer::SetInstanceBuffer(const SoftwareInstance* instances, uint32_t instanceCount)
+{
+	m_instances = instances;
+	m_instanceCount = instanceCount;
+}
+
+void SoftwareRenderer::UpdateConstantBuffer(uint32_t slot, uint32_t offset, const void* data, uint32_t size)
+{
+	if (slot >= kMaxConstantBuffers || (offset % 4) != 0 || (size % 4) != 0)
+	{
+		return;
+	}
+
+	std::vector<float>& buffer = m_constantBuffers[slot];
+	if (buffer.size() < (offset + size) / 4)
+	{
+		buffer.resize((offset + size) / 4);
+	}
+	memcpy(buffer.data() + offset / 4, data, size);
+	m_constantSnapshots[slot] = kNoSnapshot;
+}
+
+void SoftwareRenderer::SnapshotConstants(DrawCall& draw)
+{
+	// Like a GPU renaming a buffer, the draws recorded so far keep the copy they saw
+	for (int slot = 0; slot < kMaxConstantBuffers; slot++)
+	{
+		const std::vector<float>& buffer = m_constantBuffers[slot];
+		if (m_constantSnapshots[slot] == kNoSnapshot && !buffer.empty())
+		{
+			m_constantSnapshots[slot] = static_cast<uint32_t>(m_frameConstants.size());
+			m_frameConstants.insert(m_frameConstants.end(), buffer.begin(), buffer.end());
+		}
+		draw.constantSnapshots[slot] = m_constantSnapshots[slot];
+		draw.constants[slot] = nullptr;
+	}
+}
+
+void SoftwareRenderer::SetVertexShader(const SoftwareVertexShader& shader)
+{
+	m_vertexShader = shader;
+}
+
+void SoftwareRenderer::SetPixelShader(const SoftwarePixelShader& shader)
+{
+	m_pixelShader = shader;
+}
+
+void SoftwareRenderer::Draw(uint32_t vertexCount, uint32_t startVertex)
+{
+	if (!m_workers || !m_vertices)
+	{
+		return;
+	}
+
+	// Ignore vertices past the end of the buffer, like the debug layer would complain about
+	if (startVertex >= m_vertexCount)
+	{
+		return;
+	}
+	vertexCount = std::min(vertexCount, m_vertexCount - startVertex);
+	if (vertexCount < 3)
+	{
+		return;
+	}
+
+	DrawCall draw;
+	draw.vertices = m_vertices;
+	draw.instances = nullptr;
+	draw.startVertex = startVertex;
+	draw.startInstance = 0;
+	draw.trianglesPerInstance = vertexCount / 3;
+	draw.triangleCount = draw.trianglesPerInstance;
+	draw.firstTriangle = m_frameTriangles;
+	SnapshotConstants(draw);
+	draw.vertexShader = m_vertexShader;
+	draw.pixelShader = m_pixelShader;
+	m_draws.push_back(draw);
+	m_frameTriangles += draw.triangleCount;
+}
+
+void SoftwareRenderer::DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance)
+{
+	if (!m_workers || !m_vertices || !m_instances)
+	{
+		return;
+	}
+
+	// Same clamping as Draw, for the vertices and the instances
+	if (startVertex >= m_vertexCount || startInstance >= m_instanceCount)
+	{
+		return;
+	}
+	vertexCountPerInstance = std::min(vertexCountPerInstance, m_vertexCount - startVertex);
+	instanceCount = std::min(instanceCount, m_instanceCount - startInstance);
+	if (vertexCountPerInstance < 3 || instanceCount == 0)
+	{
+		return;
+	}
+
+	// One recorded draw for all the instances, the geometry stage splits it over the bins like any other
+	DrawCall draw;
+	draw.vertices = m_vertices;
+	draw.instances = m_instances;
+	draw.startVertex = startVertex;
+	draw.startInstance = startInstance;
+	draw.trianglesPerInstance = vertexCountPerInstance / 3;
+	draw.triangleCount = draw.trianglesPerInstance * instanceCount;
+	draw.firstTriangle = m_frameTriangles;
+	SnapshotConstants(draw);
+	draw.vertexShader = m_vertexShader;
+	draw.pixelShader = m_pixelShader;
+	m_draws.push_back(draw);
+	m_frameTriangles += draw.triangleCount;
+}
+
+void SoftwareRenderer::Flush()
+{
+	if (!m_workers || (m_draws.empty() && !m_clearPending && !m_depthClearPending))
+	{
+		return;
+	}
+
+	// Nothing is recorded anymore, the copies of the constants stay where they are
+	for (DrawCall& draw : m_draws)
+	{
+		for (int slot = 0; slot < kMaxConstantBuffers; slot++)
+		{
+			if (draw.constantSnapshots[slot] != kNoSnapshot)
+			{
+				draw.constants[slot] = m_frameConstants.data() + draw.constantSnapshots[slot];
+			}
+		}
+	}
+
+	// Geometry stage: split the frame's triangles in contiguous ranges, one per bin
+	uint32_t binCount = static_cast<uint32_t>(m_bins.size());
+	binCount = std::max(1u, std::min(binCount, (m_frameTriangles + kMinTrianglesPerBin - 1) / kMinTrianglesPerBin));
+	uint32_t trianglesPerBin = (m_frameTriangles + binCount - 1) / binCount;
+
+	m_workers->ParallelFor(binCount, [this, trianglesPerBin](uint32_t binIndex, uint32_t)
+	{
+		Bin& bin = m_bins[binIndex];
+		ResetBin(bin);
+
+		uint32_t first = binIndex * trianglesPerBin;
+		uint32_t last = std::min(first + trianglesPerBin, m_frameTriangles);
+		if (first >= last)
+		{
+			return;
+		}
+		// Clipping can split a triangle, but most make one screen triangle or none
+		bin.triangles.reserve(last - first);
+
+		// Find the draw the range starts in, draws are sorted by firstTriangle
+		size_t drawIndex = std::upper_bound(m_draws.begin(), m_draws.end(), first,
+			[](uint32_t value, const DrawCall& d) { return value < d.firstTriangle; }) - m_draws.begin() - 1;
+
+		uint32_t triangle = first;
+		while (triangle < last)
+		{
+			while (triangle >= m_draws[drawIndex].firstTriangle + m_draws[drawIndex].triangleCount)
+			{
+				drawIndex++;
+			}
+			const DrawCall& draw = m_draws[drawIndex];
+
+			// Shade a batch of vertices, then set up the triangles they make
+			uint32_t count = std::min(std::min(last, draw.firstTriangle + draw.triangleCount) - triangle, kTrianglesPerBatch);
+			ShadeVertices(draw, triangle - draw.firstTriangle, count, bin);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				SetupTriangle(static_cast<uint32_t>(drawIndex), &bin.vertices[i * 3], bin);
+			}
+			triangle += count;
+		}
+	});
+
+	// Bins that were not used this frame still hold last frame's triangles
+	for (uint32_t i = binCount; i < m_bins.size(); i++)
+	{
+		ResetBin(m_bins[i]);
+	}
+
+	// Raster stage: every tile is owned by exactly one worker, so nothing is shared
+	uint32_t tileCount = static_cast<uint32_t>(m_tilesX * m_tilesY);
+	m_workers->ParallelFor(tileCount, [this](uint32_t tile, uint32_t threadIndex)
+	{
+		RasterizeTile(tile, *m_tileBuffers[threadIndex]);
+	});
+
+	m_draws.clear();
+	m_frameConstants.clear();
+	for (uint32_t& snapshot : m_constantSnapshots)
+	{
+		snapshot = kNoSnapshot;
+	}
+	m_frameTriangles = 0;
+	m_clearPending = false;
+	m_depthClearPending = false;
+}
+
+void SoftwareRenderer::ResetBin(Bin& bin)
+{
+	ResetArenaVector(bin.triangles, *bin.arena);
+	for (ArenaVector<uint32_t>& tile : bin.tiles)
+	{
+		ResetArenaVector(tile, *bin.arena);
+	}
+	bin.arena->Reset();
+}
+
+void SoftwareRenderer::ShadeVertices(const DrawCall& draw, uint32_t firstTriangle, uint32_t triangleCount, Bin& bin) const
+{
+	uint32_t vertexCount = triangleCount * 3;
+	bin.vertices.resize(vertexCount);
+	int varyingCount = draw.vertexShader.varyingCount;
+
+	// Where the range starts: which instance, and which vertex of the instance's triangles
+	uint32_t verticesPerInstance = draw.trianglesPerInstance * 3;
+	uint32_t instance = firstTriangle / draw.trianglesPerInstance;
+	uint32_t instanceVertex = (firstTriangle % draw.trianglesPerInstance) * 3;
+
+	VertexShaderInput input;
+	if (!draw.instances)
+	{
+		// Like an unbound stream on the GPU, instanced shaders read zeros
+		memset(input.instanceWorld, 0, sizeof(input.instanceWorld));
+		memset(input.instanceColor, 0, sizeof(input.instanceColor));
+	}
+	VertexShaderOutput output;
+	const SoftwareVertex* vertex = nullptr;
+	const SoftwareInstance* instanceData = nullptr;
+	for (uint32_t first = 0; first < vertexCount; first += kVertexShaderLanes)
+	{
+		// Transpose the vertices into lanes, the last batch repeats its last vertex
+		uint32_t laneCount = std::min<uint32_t>(kVertexShaderLanes, vertexCount - first);
+		for (uint32_t lane = 0; lane < kVertexShaderLanes; lane++)
+		{
+			if (lane < laneCount)
+			{
+				vertex = &draw.vertices[draw.startVertex + instanceVertex];
+				instanceData = draw.instances ? &draw.instances[draw.startInstance + instance] : nullptr;
+				if (++instanceVertex == verticesPerInstance)
+				{
+					instanceVertex = 0;
+					instance++;
+				}
+			}
+
+			for (int c = 0; c < 3; c++)
+			{
+				input.position[c][lane] = vertex->position[c];
+			}
+			for (int c = 0; c < 4; c++)
+			{
+				input.color[c][lane] = vertex->color[c];
+			}
+			for (int c = 0; c < 2; c++)
+			{
+				input.texCoord[c][lane] = vertex->texCoord[c];
+			}
+			if (instanceData)
+			{
+				for (int c = 0; c < 16; c++)
+				{
+					input.instanceWorld[c][lane] = instanceData->world[c];
+				}
+				for (int c = 0; c < 4; c++)
+				{
+					input.instanceColor[c][lane] = instanceData->color[c];
+				}
+			}
+		}
+
+		draw.vertexShader.run(draw.constants, input, output);
+
+		for (uint32_t lane = 0; lane < laneCount; lane++)
+		{
+			ShadedVertex& vertex = bin.vertices[first + lane];
+			for (int c = 0; c < 4; c++)
+			{
+				vertex.position[c] = output.position[c][lane];
+			}
+			for (int v = 0; v < kMaxShaderVaryings; v++)
+			{
+				vertex.varyings[v] = v < varyingCount ? output.varyings[v][lane] : 0.0f;
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::SetupTriangle(uint32_t drawIndex, const ShadedVertex* vertices, Bin& bin) const
+{
+	// Worst case the 6 planes add one vertex each
+	ShadedVertex polygon[9];
+	ShadedVertex clipped[9];
+	for (int i = 0; i < 3; i++)
+	{
+		polygon[i] = vertices[i];
+	}
+
+	// Clip against the near (z >= 0) and far (z <= w) planes like the GPU,
+	// and against a guard band around the screen so the snapped coordinates stay small
+	float guardX = 1.0f + 2.0f * kGuardBandPixels / m_width;
+	float guardY = 1.0f + 2.0f * kGuardBandPixels / m_height;
+	int count = ClipPolygon(polygon, 3, clipped, [](const ShadedVertex& v) { return v.position[2]; });
+	count = ClipPolygon(clipped, count, polygon, [](const ShadedVertex& v) { return v.position[3] - v.position[2]; });
+	count = ClipPolygon(polygon, count, clipped, [guardX](const ShadedVertex& v) { return guardX * v.position[3] - v.position[0]; });
+	count = ClipPolygon(clipped, count, polygon, [guardX](const ShadedVertex& v) { return guardX * v.position[3] + v.position[0]; });
+	count = ClipPolygon(polygon, count, clipped, [guardY](const ShadedVertex& v) { return guardY * v.position[3] - v.position[1]; });
+	count = ClipPolygon(clipped, count, polygon, [guardY](const ShadedVertex& v) { return guardY * v.position[3] + v.position[1]; });
+	if (count < 3)
+	{
+		return;
+	}
+
+	// Project to the screen (same mapping as the D3D viewport) and snap to the sub-pixel grid
+	int32_t fixedX[9];
+	int32_t fixedY[9];
+	float attributes[9][kAttributeCount];
+	for (int i = 0; i < count; i++)
+	{
+		float invW = 1.0f / polygon[i].position[3];
+		float x = (polygon[i].position[0] * invW * 0.5f + 0.5f) * m_width;
+		float y = (0.5f - polygon[i].position[1] * invW * 0.5f) * m_height;
+		fixedX[i] = static_cast<int32_t>(std::floor(x * kRasterSubPixelOne + 0.5f));
+		fixedY[i] = static_cast<int32_t>(std::floor(y * kRasterSubPixelOne + 0.5f));
+
+		attributes[i][kAttributeDepth] = polygon[i].position[2] * invW;
+		attributes[i][kAttributeInvW] = invW;
+		for (int v = 0; v < kMaxShaderVaryings; v++)
+		{
+			attributes[i][kAttributeVaryings + v] = polygon[i].varyings[v] * invW;
+		}
+	}
+
+	// The clipped polygon is convex, so a fan covers it
+	for (int i = 1; i + 1 < count; i++)
+	{
+		int indices[3] = { 0, i, i + 1 };
+		int32_t x[3] = { fixedX[0], fixedX[i], fixedX[i + 1] };
+		int32_t y[3] = { fixedY[0], fixedY[i], fixedY[i + 1] };
+
+		int64_t area = GetRasterTriangleArea(x, y);
+		if (area == 0)
+		{
+			continue; // degenerate after snapping
+		}
+		// No culling (the rasterizer state uses D3D11_CULL_NONE), just make every triangle wind the same way
+		if (area < 0)
+		{
+			std::swap(indices[1], indices[2]);
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			area = -area;
+		}
+
+		ScreenTriangle triangle;
+		triangle.draw = drawIndex;
+		triangle.minDepth = std::min(attributes[indices[0]][kAttributeDepth], std::min(attributes[indices[1]][kAttributeDepth], attributes[indices[2]][kAttributeDepth]));
+		triangle.maxDepth = std::max(attributes[indices[0]][kAttributeDepth], std::max(attributes[indices[1]][kAttributeDepth], attributes[indices[2]][kAttributeDepth]));
+		SetupRasterTriangle(x, y, triangle.raster);
+		RasterTriangle& raster = triangle.raster;
+		raster.minX = std::max(raster.minX, 0);
+		raster.minY = std::max(raster.minY, 0);
+		raster.maxX = std::min(raster.maxX, m_width - 1);
+		raster.maxY = std::min(raster.maxY, m_height - 1);
+		if (raster.minX > raster.maxX || raster.minY > raster.maxY)
+		{
+			continue; // off screen
+		}
+
+		// Attribute gradients from the snapped positions
+		float x0 = x[0] / static_cast<float>(kRasterSubPixelOne);
+		float y0 = y[0] / static_cast<float>(kRasterSubPixelOne);
+		float x10 = (x[1] - x[0]) / static_cast<float>(kRasterSubPixelOne);
+		float y10 = (y[1] - y[0]) / static_cast<float>(kRasterSubPixelOne);
+		float x20 = (x[2] - x[0]) / static_cast<float>(kRasterSubPixelOne);
+		float y20 = (y[2] - y[0]) / static_cast<float>(kRasterSubPixelOne);
+		float invArea = 1.0f / (x10 * y20 - y10 * x20);
+
+		triangle.originX = x0;
+		triangle.originY = y0;
+		for (int a = 0; a < kAttributeCount; a++)
+		{
+			float a0 = attributes[indices[0]][a];
+			float a10 = attributes[indices[1]][a] - a0;
+			float a20 = attributes[indices[2]][a] - a0;
+			triangle.origin[a] = a0;
+			triangle.dx[a] = (a10 * y20 - a20 * y10) * invArea;
+			triangle.dy[a] = (a20 * x10 - a10 * x20) * invArea;
+		}
+
+		// Add the triangle to every tile its bounding box touches
+		uint32_t index = static_cast<uint32_t>(bin.triangles.size());
+		bin.triangles.push_back(triangle);
+		for (int tileY = raster.minY / kTileSize; tileY <= raster.maxY / kTileSize; tileY++)
+		{
+			for (int tileX = raster.minX / kTileSize; tileX <= raster.maxX / kTileSize; tileX++)
+			{
+				bin.tiles[static_cast<size_t>(tileY) * m_tilesX + tileX].push_back(index);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::RasterizeTile(uint32_t tile, TileBuffer& buffer)
+{
+	int tileX = static_cast<int>(tile % m_tilesX) * kTileSize;
+	int tileY = static_cast<int>(tile / m_tilesX) * kTileSize;
+	int tileWidth = std::min(kTileSize, m_width - tileX);
+	int tileHeight = std::min(kTileSize, m_height - tileY);
+
+	bool hasTriangles = false;
+	for (const Bin& bin : m_bins)
+	{
+		hasTriangles = hasTriangles || !bin.tiles[tile].empty();
+	}
+
+	// Nothing to draw: only apply the clears, straight into the render target
+	uint32_t* target = m_colorBuffer.data() + static_cast<size_t>(tileY) * m_width + tileX;
+	float* depth = m_depthBuffer.data() + static_cast<size_t>(tile) * kTileSize * kTileSize;
+	if (!hasTriangles)
+	{
+		if (m_clearPending)
+		{
+			for (int y = 0; y < tileHeight; y++)
+			{
+				std::fill(target + static_cast<size_t>(y) * m_width, target + static_cast<size_t>(y) * m_width + tileWidth, m_clearColor);
+			}
+		}
+		if (m_depthClearPending)
+		{
+			ResetDepthTile(m_depthTiles[tile]);
+		}
+		return;
+	}
+
+	// Load the tile, a pending clear means there is nothing to read back
+	for (int y = 0; y < tileHeight; y++)
+	{
+		uint32_t* row = buffer.color + y * kTileSize;
+		if (m_clearPending)
+		{
+			std::fill(row, row + tileWidth, m_clearColor);
+		}
+		else
+		{
+			std::copy(target + static_cast<size_t>(y) * m_width, target + static_cast<size_t>(y) * m_width + tileWidth, row);
+		}
+	}
+	// A depth clear only resets the coarse level, and cleared blocks are filled when they are first drawn to
+	DepthTile& coarse = m_depthTiles[tile];
+	if (m_depthClearPending)
+	{
+		ResetDepthTile(coarse);
+	}
+	if (m_depthTest)
+	{
+		buffer.coarse = coarse;
+		if (coarse.clearedBlocks != kRasterFullBlock)
+		{
+			std::copy(depth, depth + kTileSize * kTileSize, buffer.depth);
+		}
+	}
+
+	// Walk the bins in order so triangles are drawn in submission order
+	for (const Bin& bin : m_bins)
+	{
+		for (uint32_t index : bin.tiles[tile])
+		{
+			RasterizeTriangle(bin.triangles[index], tileX, tileY, tileWidth, tileHeight, buffer);
+		}
+	}
+
+	// Write the finished tile back
+	for (int y = 0; y < tileHeight; y++)
+	{
+		const uint32_t* row = buffer.color + y * kTileSize;
+		std::copy(row, row + tileWidth, target + static_cast<size_t>(y) * m_width);
+	}
+	if (m_depthTest)
+	{
+		coarse = buffer.coarse;
+		if (coarse.clearedBlocks != kRasterFullBlock)
+		{
+			std::copy(buffer.depth, buffer.depth + kTileSize * kTileSize, depth);
+		}
+	}
+}
+
+void SoftwareRenderer::ResetDepthTile(DepthTile& tile) const
+{
+	tile.clearedBlocks = kRasterFullBlock;
+	std::fill(tile.blockMin, tile.blockMin + kBlocksPerTile, m_depthClearValue);
+	std::fill(tile.blockMax, tile.blockMax + kBlocksPerTile, m_depthClearValue);
+}
+
+void SoftwareRenderer::RasterizeTriangle(const ScreenTriangle& triangle, int tileX, int tileY, int tileWidth, int tileHeight, TileBuffer& buffer) const
+{
+	const RasterTriangle& raster = triangle.raster;
+	int minX = std::max(raster.minX, tileX);
+	int maxX = std::min(raster.maxX, tileX + tileWidth - 1);
+	int minY = std::max(raster.minY, tileY);
+	int maxY = std::min(raster.maxY, tileY + tileHeight - 1);
+	if (minX > maxX || minY > maxY)
+	{
+		return;
+	}
+
+	// Depth is a plane, so over a block it is extreme at the corner pixels
+	// The bounds are widened by the rounding error of evaluating the plane per pixel,
+	// so the coarse test never disagrees with the per-pixel one
+	const float depthX = triangle.dx[kAttributeDepth];
+	const float depthY = triangle.dy[kAttributeDepth];
+	const float blockDepthX = depthX * (kRasterBlockSize - 1);
+	const float blockDepthY = depthY * (kRasterBlockSize - 1);
+
+	// Walk the 8x8 blocks of the tile the bounding box touches (tiles are a multiple of the block size)
+	int firstBlockX = minX - (minX - tileX) % kRasterBlockSize;
+	int firstBlockY = minY - (minY - tileY) % kRasterBlockSize;
+	for (int blockY = firstBlockY; blockY <= maxY; blockY += kRasterBlockSize)
+	{
+		for (int blockX = firstBlockX; blockX <= maxX; blockX += kRasterBlockSize)
+		{
+			int block = ((blockY - tileY) / kRasterBlockSize) * kTileBlocks + (blockX - tileX) / kRasterBlockSize;
+			bool depthPasses = false;
+			if (m_depthTest && m_coarseDepthTest)
+			{
+				float px = blockX + 0.5f - triangle.originX;
+				float py = blockY + 0.5f - triangle.originY;
+				float corner = triangle.origin[kAttributeDepth] + depthX * px + depthY * py;
+				float slack = 4.0f * FLT_EPSILON * (std::fabs(triangle.origin[kAttributeDepth])
+					+ std::fabs(depthX) * (std::fabs(px) + kRasterBlockSize) + std::fabs(depthY) * (std::fabs(py) + kRasterBlockSize));
+				float nearest = std::max(corner + std::min(blockDepthX, 0.0f) + std::min(blockDepthY, 0.0f), triangle.minDepth) - slack;
+				float farthest = std::min(corner + std::max(blockDepthX, 0.0f) + std::max(blockDepthY, 0.0f), triangle.maxDepth) + slack;
+
+				// LESS test: behind everything in the block, nothing to do
+				if (nearest >= buffer.coarse.blockMax[block])
+				{
+					continue;
+				}
+				// In front of everything in the block, the per-pixel test can't fail
+				depthPasses = farthest < buffer.coarse.blockMin[block];
+			}
+
+			uint64_t mask = ComputeBlockCoverage(raster, blockX, blockY, m_coverageKernel);
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			// Drop the pixels outside the bounding box and the tile
+			int x0 = std::max(minX - blockX, 0);
+			int x1 = std::min(maxX - blockX, kRasterBlockSize - 1);
+			int y0 = std::max(minY - blockY, 0);
+			int y1 = std::min(maxY - blockY, kRasterBlockSize - 1);
+			mask &= GetBlockBoundsMask(x0, x1, y0, y1);
+
+			// First draw into a cleared block, write the clear value its depth values never got
+			float* blockDepth = buffer.depth + (blockY - tileY) * kTileSize + (blockX - tileX);
+			if (m_depthTest && ((buffer.coarse.clearedBlocks >> block) & 1))
+			{
+				for (int y = 0; y < kRasterBlockSize; y++)
+				{
+					std::fill(blockDepth + y * kTileSize, blockDepth + y * kTileSize + kRasterBlockSize, m_depthClearValue);
+				}
+				buffer.coarse.clearedBlocks &= ~(1ull << block);
+			}
+
+			// Shade the block one 2x2 quad at a time
+			bool depthWritten = false;
+			for (int quadY = 0; quadY < kRasterBlockSize && mask != 0; quadY += 2)
+			{
+				uint64_t rows = mask >> (quadY * kRasterBlockSize);
+				if ((rows & 0xFFFF) == 0)
+				{
+					continue;
+				}
+				for (int quadX = 0; quadX < kRasterBlockSize; quadX += 2)
+				{
+					uint32_t quadMask = static_cast<uint32_t>((rows >> quadX) & 0x3)
+						| (static_cast<uint32_t>((rows >> (kRasterBlockSize + quadX)) & 0x3) << 2);
+					if (quadMask != 0)
+					{
+						depthWritten |= ShadeQuad(triangle, blockX + quadX, blockY + quadY, quadMask, depthPasses, tileX, tileY, buffer);
+					}
+				}
+			}
+
+			// Refresh the block's range, pixels outside the screen keep the clear value which only makes it wider
+			if (depthWritten)
+			{
+				float nearest = blockDepth[0];
+				float farthest = blockDepth[0];
+				for (int y = 0; y < kRasterBlockSize; y++)
+				{
+					for (int x = 0; x < kRasterBlockSize; x++)
+					{
+						nearest = std::min(nearest, blockDepth[y * kTileSize + x]);
+						farthest = std::max(farthest, blockDepth[y * kTileSize + x]);
+					}
+				}
+				buffer.coarse.blockMin[block] = nearest;
+				buffer.coarse.blockMax[block] = farthest;
+			}
+		}
+	}
+}
+
+bool SoftwareRenderer::ShadeQuad(const ScreenTriangle& triangle, int pixelX, int pixelY, uint32_t mask, bool depthPasses, int tileX, int tileY, TileBuffer& buffer) const
+{
+	const int laneX[kPixelShaderLanes] = { 0, 1, 0, 1 };
+	const int laneY[kPixelShaderLanes] = { 0, 0, 1, 1 };
+	int index = (pixelY - tileY) * kTileSize + (pixelX - tileX);
+	const int laneOffset[kPixelShaderLanes] = { 0, 1, kTileSize, kTileSize + 1 };
+
+	// Attribute plane positions of the 4 pixel centers
+	float px[kPixelShaderLanes];
+	float py[kPixelShaderLanes];
+	for (int lane = 0; lane < kPixelShaderLanes; lane++)
+	{
+		px[lane] = pixelX + laneX[lane] + 0.5f - triangle.originX;
+		py[lane] = pixelY + laneY[lane] + 0.5f - triangle.originY;
+	}
+
+	PixelShaderInput input;
+	for (int lane = 0; lane < kPixelShaderLanes; lane++)
+	{
+		input.position[0][lane] = pixelX + laneX[lane] + 0.5f;
+		input.position[1][lane] = pixelY + laneY[lane] + 0.5f;
+		input.position[2][lane] = triangle.origin[kAttributeDepth] + triangle.dx[kAttributeDepth] * px[lane] + triangle.dy[kAttributeDepth] * py[lane];
+		input.position[3][lane] = triangle.origin[kAttributeInvW] + triangle.dx[kAttributeInvW] * px[lane] + triangle.dy[kAttributeInvW] * py[lane];
+	}
+
+	// Early depth test, the pixel shader never writes depth
+	if (m_depthTest)
+	{
+		for (int lane = 0; lane < kPixelShaderLanes; lane++)
+		{
+			float& depth = buffer.depth[index + laneOffset[lane]];
+			if ((mask & (1u << lane)) != 0)
+			{
+				if (depthPasses || input.position[2][lane] < depth)
+				{
+					depth = input.position[2][lane];
+				}
+				else
+				{
+					mask &= ~(1u << lane);
+				}
+			}
+		}
+		if (mask == 0)
+		{
+			return false;
+		}
+	}
+
+	// Perspective-correct varyings
+	const DrawCall& draw = m_draws[triangle.draw];
+	float w[kPixelShaderLanes];
+	for (int lane = 0; lane < kPixelShaderLanes; lane++)
+	{
+		w[lane] = 1.0f / input.position[3][lane];
+	}
+	for (int v = 0; v < draw.vertexShader.varyingCount; v++)
+	{
+		int a = kAttributeVaryings + v;
+		for (int lane = 0; lane < kPixelShaderLanes; lane++)
+		{
+			input.varyings[v][lane] = (triangle.origin[a] + triangle.dx[a] * px[lane] + triangle.dy[a] * py[lane]) * w[lane];
+		}
+	}
+
+	PixelShaderOutput output;
+	draw.pixelShader.run(draw.constants, input, output);
+
+	for (int lane = 0; lane < kPixelShaderLanes; lane++)
+	{
+		if ((mask & (1u << lane)) != 0)
+		{
+			float color[4] = { output.color[0][lane], output.color[1][lane], output.color[2][lane], output.color[3][lane] };
+			buffer.color[index + laneOffset[lane]] = PackColor(color);
+		}
+	}
+	return m_depthTest;
+}
+
+bool ValidateDepthTest(JobSystem& jobs, uint32_t seed, int frames)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// Not a multiple of the tile size, the last tiles are partial
+	int width = 160 + random() % 160;
+	int height = 100 + random() % 120;
+	SoftwareRenderer coarse;
+	SoftwareRenderer perPixel;
+	if (!coarse.Initialize(width, height, jobs) || !perPixel.Initialize(width, height, jobs))
+	{
+		return false;
+	}
+	perPixel.SetCoarseDepthTest(false);
+
+	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	std::vector<SoftwareVertex> vertices;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		// Big triangles in layers: most of them overlap most of the screen, some are flat, some
+		// repeat the depth of the one before (LESS keeps the first), some reach past the near and far planes
+		uint32_t triangleCount = 64 + random() % 256;
+		vertices.resize(triangleCount * 3);
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++)
+		{
+			SoftwareVertex* corners = &vertices[triangle * 3];
+			uint32_t kind = random() % 8;
+			float flatDepth = unit(random);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				SoftwareVertex& vertex = corners[corner];
+				if (kind == 0 && triangle > 0)
+				{
+					vertex = vertices[(triangle - 1) * 3 + corner];
+				}
+				else
+				{
+					vertex.position[0] = 2.6f * unit(random) - 1.3f;
+					vertex.position[1] = 2.6f * unit(random) - 1.3f;
+					vertex.position[2] = kind == 1 ? flatDepth : (kind == 2 ? 1.4f * unit(random) - 0.2f : unit(random));
+					vertex.texCoord[0] = 0.5f + 1.5f * unit(random); // w
+				}
+				vertex.color[0] = unit(random);
+				vertex.color[1] = unit(random);
+				vertex.color[2] = unit(random);
+				vertex.color[3] = 1.0f;
+				vertex.texCoord[1] = 0.0f;
+			}
+		}
+
+		// The same frame in both renderers: most frames clear depth (not always to 1), some draw
+		// on top of the depth of the last one
+		bool clearDepth = frame == 0 || random() % 4 != 0;
+		float clearValue = random() % 2 == 0 ? 1.0f : 0.5f + 0.5f * unit(random);
+		uint32_t split = 1 + random() % triangleCount;
+		for (SoftwareRenderer* renderer : { &coarse, &perPixel })
+		{
+			renderer->SetVertexShader(MakeSoftwareVertexShader<DepthTestVertexShader>());
+			renderer->SetPixelShader(MakeSoftwarePixelShader<DepthTestPixelShader>());
+			renderer->SetDepthTest(true);
+			renderer->ClearRenderTarget(clearColor);
+			if (clearDepth)
+			{
+				renderer->ClearDepth(clearValue);
+			}
+			renderer->SetVertexBuffer(vertices.data(), static_cast<uint32_t>(vertices.size()));
+			renderer->Draw(split * 3, 0);
+			renderer->Draw((triangleCount - split) * 3, split * 3);
+			renderer->Flush();
+		}
+
+		if (HashColorAndDepth(coarse) != HashColorAndDepth(perPixel))
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <memory> // unique_ptr
+#include <vector>
+#include "LinearArena.h" // per-frame bin storage
+#include "RasterKernels.h"
+
+#include "SoftwareShaders.h"
+
+class JobSystem;
+
+// CPU implementation of the small part of the D3D11 pipeline the engine uses:
+// clear, bind vertex buffers, update constant buffers and draw a triangle list
+// into an in-memory R8G8B8A8_UNORM render target
+// It needs no window and no GPU, so it runs on headless machines
+//
+// Rendering is deferred like on a tiled GPU: Draw only records the call, Flush
+// shades and bins every triangle into screen tiles (each worker fills its own bins,
+// no locks) and then rasterizes the tiles in parallel, each worker owning the
+// color/depth of one tile at a time while it stays in cache
+//
+// The depth buffer has a coarse level with the depth range of every 8x8 block, so
+// blocks a triangle is completely behind are rejected before coverage and shading,
+// and depth clears only reset the coarse level, the depth values of a block are
+// written the first time something is drawn into it
+class SoftwareRenderer
+{
+public:
+	// Width/height of a screen tile in pixels
+	static constexpr int kTileSize = 64;
+
+	SoftwareRenderer();
+	~SoftwareRenderer();
+
+	// Create the render target, threadCount = 0 uses every core
+	bool Initialize(int width, int height, unsigned threadCount = 0);
+	// Same, running on the threads of jobs (it has to outlive the renderer)
+	bool Initialize(int width, int height, JobSystem& jobs);
+
+	// Equivalent of ClearRenderTargetView
+	void ClearRenderTarget(const float clearColor[4]);
+	// Equivalent of ClearDepthStencilView (depth only)
+	void ClearDepth(float depth);
+	// Enable the LESS depth test, off by default like the GPU path which binds no depth buffer
+	void SetDepthTest(bool enable);
+	// Reject blocks with the coarse depth level, on by default. Off, every covered pixel goes through
+	// the per-pixel test: the same images, only slower (the reference the coarse test is checked against)
+	void SetCoarseDepthTest(bool enable);
+
+	// Equivalent of IASetVertexBuffers (the data is not copied, it has to stay alive until Flush)
+	void SetVertexBuffer(const SoftwareVertex* vertices, uint32_t vertexCount);
+
+	// Equivalent of UpdateSubresource1 on the constant buffer of a slot (b0, b1...) with a byte range
+	// Buffers keep their contents between frames and grow to fit, the draws recorded before the update keep the old contents
+	void UpdateConstantBuffer(uint32_t slot, uint32_t offset, const void* data, uint32_t size);
+
+	// Equivalent of VSSetShader/PSSetShader, the kernels generated from VertexShader.hlsl and PixelShader.hlsl are bound by default
+	void SetVertexShader(const SoftwareVertexShader& shader);
+	void SetPixelShader(const SoftwarePixelShader& shader);
+
+	// Equivalent of binding the per-instance vertex buffer (not copied either), read by DrawInstanced
+	void SetInstanceBuffer(const SoftwareInstance* instances, uint32_t instanceCount);
+
+	// Equivalent of Draw with a triangle list topology, the draw is recorded and runs in Flush
+	void Draw(uint32_t vertexCount, uint32_t startVertex);
+	// Equivalent of DrawInstanced: the vertices are drawn once per instance, the vertex shader
+	// gets the instance's SoftwareInstance in its INSTANCE inputs
+	void DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance);
+
+	// Execute every recorded clear and draw, call it before reading the render target
+	void Flush();
+
+	// Depth of a pixel after the last Flush (tests and debugging, not fast)
+	float GetDepth(int x, int y) const;
+
+	// Access the finished image (one R8G8B8A8 pixel per uint32, rows are GetWidth() pixels long)
+	const uint32_t* GetRenderTarget() const { return m_colorBuffer.data(); }
+	uint32_t GetPixel(int x, int y) const { return m_colorBuffer[static_cast<size_t>(y) * m_width + x]; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+	// Number of threads the rasterizer spreads the work over
+	unsigned GetThreadCount() const;
+
+	// Instruction set of the edge evaluation kernel, the widest one the CPU supports by default
+	void SetSimdIsa(SimdIsa isa);
+	SimdIsa GetSimdIsa() const { return m_simdIsa; }
+
+private:
+	// Interpolated per pixel: depth, 1/w and every varying divided by w (perspective-correct)
+	static constexpr int kAttributeDepth = 0;
+	static constexpr int kAttributeInvW = 1;
+	static constexpr int kAttributeVaryings = 2;
+	static constexpr int kAttributeCount = kAttributeVaryings + kMaxShaderVaryings;
+
+	// 8x8 blocks of a tile, they fit in the bits of a uint64_t
+	static constexpr int kTileBlocks = kTileSize / kRasterBlockSize;
+	static constexpr int kBlocksPerTile = kTileBlocks * kTileBlocks;
+	static_assert(kBlocksPerTile == 64, "block masks are 64-bit");
+
+	// Output of the vertex shader for one vertex
+	struct ShadedVertex
+	{
+		float position[4];
+		float varyings[kMaxShaderVaryings];
+	};
+
+	// A triangle after clipping, perspective divide and viewport transform
+	struct ScreenTriangle
+	{
+		RasterTriangle raster; // snapped edge functions and bounding box
+		uint32_t draw; // index of the draw call, for its shaders and constants
+		float minDepth, maxDepth; // depth range of the vertices
+		// Attributes as planes value = origin + dx * (x - originX) + dy * (y - originY)
+		float originX, originY;
+		float dx[kAttributeCount];
+		float dy[kAttributeCount];
+		float origin[kAttributeCount];
+	};
+
+	// A recorded Draw/DrawInstanced call
+	struct DrawCall
+	{
+		const SoftwareVertex* vertices;
+		const SoftwareInstance* instances; // null for Draw
+		uint32_t startVertex;
+		uint32_t startInstance;
+		uint32_t trianglesPerInstance; // the draw's triangles are instance after instance
+		uint32_t triangleCount;
+		uint32_t firstTriangle; // index of the first triangle of this draw in the whole frame
+		uint32_t constantSnapshots[kMaxConstantBuffers]; // where the contents of every slot were copied, kNoSnapshot when empty
+		const void* constants[kMaxConstantBuffers]; // the same, as pointers once the frame stops recording (Flush)
+		SoftwareVertexShader vertexShader;
+		SoftwarePixelShader pixelShader;
+	};
+
+	// Output of the geometry stage for one contiguous range of the frame's triangles
+	// Only the worker processing the range writes to it, and ranges are in submission
+	// order, so walking the bins range by range keeps the draw order
+	// The triangles and tile lists are rebuilt every frame on the bin's arena: a frame that puts
+	// more triangles in a tile than any before takes room in the arena instead of the heap.
+	struct Bin
+	{
+		Bin() : arena(std::make_unique<LinearArena>()), triangles(ArenaAllocator<ScreenTriangle>(arena.get())) {}
+
+		std::unique_ptr<LinearArena> arena; // on the heap, it stays put when the bins move
+		ArenaVector<ScreenTriangle> triangles;
+		std::vector<ArenaVector<uint32_t>> tiles; // triangle indices for every screen tile
+		std::vector<ShadedVertex> vertices; // vertex shader output for the draw being set up
+	};
+
+	// Coarse depth of one tile: the nearest/farthest depth stored in each 8x8 block (bit/index y * 8 + x)
+	// A cleared block holds the clear value everywhere and its depth values are not stored yet
+	struct DepthTile
+	{
+		uint64_t clearedBlocks;
+		float blockMin[kBlocksPerTile];
+		float blockMax[kBlocksPerTile];
+	};
+
+	// Tile-sized color/depth a worker renders into before writing the tile back
+	struct TileBuffer
+	{
+		alignas(64) uint32_t color[kTileSize * kTileSize];
+		alignas(64) float depth[kTileSize * kTileSize];
+		DepthTile coarse;
+	};
+
+	static constexpr uint32_t kNoSnapshot = ~0u;
+
+	// Copy the bound constant buffers for a new draw, only the ones updated since the last draw are copied
+	void SnapshotConstants(DrawCall& draw);
+
+	// Forget the bin's triangles, its arena keeps the memory for the next frame
+	static void ResetBin(Bin& bin);
+	// Run the vertex shader over the vertices of a range of a draw's triangles, 8 at a time, into bin.vertices
+	void ShadeVertices(const DrawCall& draw, uint32_t firstTriangle, uint32_t triangleCount, Bin& bin) const;
+	// Clip and set up one shaded triangle, then add it to the bins it touches
+	void SetupTriangle(uint32_t drawIndex, const ShadedVertex* vertices, Bin& bin) const;
+	// Rasterize every binned triangle that touches one tile
+	void RasterizeTile(uint32_t tile, TileBuffer& buffer);
+	void RasterizeTriangle(const ScreenTriangle& triangle, int tileX, int tileY, int tileWidth, int tileHeight, TileBuffer& buffer) const;
+	// Depth test and shade the covered pixels of one 2x2 quad (mask bit i is lane i), returns true when depth was written
+	// depthPasses skips the per-pixel test when the coarse level already proved every pixel is in front
+	bool ShadeQuad(const ScreenTriangle& triangle, int pixelX, int pixelY, uint32_t mask, bool depthPasses, int tileX, int tileY, TileBuffer& buffer) const;
+	// Coarse level of a tile after a depth clear
+	void ResetDepthTile(DepthTile& tile) const;
+
+	int m_width = 0;
+	int m_height = 0;
+	int m_tilesX = 0;
+	int m_tilesY = 0;
+	std::vector<uint32_t> m_colorBuffer; // R8G8B8A8_UNORM render target, row major
+	std::vector<float> m_depthBuffer; // stored tile by tile so a tile's depth is contiguous
+	std::vector<DepthTile> m_depthTiles; // coarse level, one per tile
+
+	// Pipeline state
+	const SoftwareVertex* m_vertices = nullptr;
+	uint32_t m_vertexCount = 0;
+	const SoftwareInstance* m_instances = nullptr;
+	uint32_t m_instanceCount = 0;
+	std::vector<float> m_constantBuffers[kMaxConstantBuffers]; // current contents
+	uint32_t m_constantSnapshots[kMaxConstantBuffers]; // copy of the current contents in m_frameConstants, kNoSnapshot when modified since
+	SoftwareVertexShader m_vertexShader;
+	SoftwarePixelShader m_pixelShader;
+	bool m_depthTest = false;
+	bool m_coarseDepthTest = true;
+	SimdIsa m_simdIsa = SimdIsa::Scalar;
+	BlockCoverageFunction m_coverageKernel = nullptr;
+
+	// Work recorded since the last Flush
+	std::vector<DrawCall> m_draws;
+	std::vector<float> m_frameConstants; // contents of the constant buffers as the draws saw them, one copy per update
+	uint32_t m_frameTriangles = 0;
+	bool m_clearPending = false;
+	uint32_t m_clearColor = 0;
+	bool m_depthClearPending = false;
+	float m_depthClearValue = 1.0f;
+
+	std::vector<Bin> m_bins; // one per worker
+	std::vector<std::unique_ptr<TileBuffer>> m_tileBuffers; // one per worker
+	JobSystem* m_workers = nullptr;
+	std::unique_ptr<JobSystem> m_ownedWorkers; // when Initialize created its own
+};
+
+// Renders random overlapping triangles at random depths with the depth test on, once with the coarse
+// depth level and once with the per-pixel test alone, returns false when the color or depth differ
+bool ValidateDepthTest(JobSystem& jobs, uint32_t seed, int frames);
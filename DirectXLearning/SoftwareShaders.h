@@ -0,0 +1,121 @@
+#pragma once
+
+// Programmable stages of the CPU renderer
+//
+// Shaders are functors that run on several vertices or pixels at once, with every
+// value stored as one array per component (SoA), so the loops over the lanes
+// compile to SIMD instructions. The renderer calls them through one function
+// pointer per batch instead of one call per vertex or pixel.
+//
+// The kernels for VertexShader.hlsl and PixelShader.hlsl are generated into
+// GeneratedShaders.h by the ShaderTranspiler project, and the instanced variant
+// (InstancedVertexShader.hlsl) into GeneratedInstancedShaders.h, don't port shaders by hand.
+
+// Vertices per vertex shader call
+const int kVertexShaderLanes = 8;
+// Pixels per pixel shader call (one 2x2 quad: top-left, top-right, bottom-left, bottom-right)
+const int kPixelShaderLanes = 4;
+// Floats a vertex shader can pass to the pixel shader (the HLSL output semantics besides SV_POSITION)
+const int kMaxShaderVaryings = 8;
+// Constant buffer slots (b0 to b3), the generated kernels read their cbuffers from the slot of their register
+const int kMaxConstantBuffers = 4;
+
+// Vertex layout used by the CPU renderer
+// Same memory layout as GraphicsEngine::Vertex (float3 position, float4 color, float2 texCoord)
+struct SoftwareVertex
+{
+	float position[3];
+	float color[4];
+	float texCoord[2];
+};
+
+// Per-instance data of instanced draws
+// Same memory layout as GraphicsEngine::InstanceData (and the second vertex buffer of the GPU path)
+struct SoftwareInstance
+{
+	float world[16]; // transposed, like the matrices of the constant buffer
+	float color[4]; // tint
+};
+
+// Input of a vertex shader call, in the order of the input layout
+struct VertexShaderInput
+{
+	float position[3][kVertexShaderLanes]; // POSITION
+	float color[4][kVertexShaderLanes]; // COLOR
+	float texCoord[2][kVertexShaderLanes]; // TEXCOORD
+	// Instance stream, only filled for instanced draws (zero otherwise)
+	float instanceWorld[16][kVertexShaderLanes]; // INSTANCEWORLD0-3, 4 floats each
+	float instanceColor[4][kVertexShaderLanes]; // INSTANCECOLOR
+};
+
+struct VertexShaderOutput
+{
+	float position[4][kVertexShaderLanes]; // SV_POSITION, in clip space
+	float varyings[kMaxShaderVaryings][kVertexShaderLanes];
+};
+
+struct PixelShaderInput
+{
+	float position[4][kPixelShaderLanes]; // SV_POSITION: pixel center x/y, depth, 1/w
+	float varyings[kMaxShaderVaryings][kPixelShaderLanes]; // perspective-correct
+};
+
+struct PixelShaderOutput
+{
+	float color[4][kPixelShaderLanes]; // SV_TARGET
+};
+
+// One input or output of a shader, the shader transpiler writes these next to the kernels it generates
+// The lists end with a null semantic
+struct SoftwareShaderElement
+{
+	const char* semantic; // upper case, without the index
+	int semanticIndex;
+	int components;
+	int offset; // vertex shader inputs: byte offset in SoftwareVertex (SoftwareInstance for INSTANCE*), varyings: first slot, system values: -1
+};
+
+// Type-erased shaders the renderer stores, built from a functor with MakeSoftwareVertexShader/MakeSoftwarePixelShader
+// constants[slot] points to the contents of the constant buffer in that slot (see SoftwareRenderer::UpdateConstantBuffer), null when it's empty
+struct SoftwareVertexShader
+{
+	void (*run)(const void* const* constants, const VertexShaderInput& input, VertexShaderOutput& output);
+	int varyingCount;
+};
+
+struct SoftwarePixelShader
+{
+	void (*run)(const void* const* constants, const PixelShaderInput& input, PixelShaderOutput& output);
+};
+
+// A vertex shader functor provides:
+//   static const int kVaryingCount;
+//   void operator()(const void* const* constants, const VertexShaderInput&, VertexShaderOutput&) const;
+template <typename Shader>
+SoftwareVertexShader MakeSoftwareVertexShader()
+{
+	struct Entry
+	{
+		static void Run(const void* const* constants, const VertexShaderInput& input, VertexShaderOutput& output)
+		{
+			Shader()(constants, input, output);
+		}
+	};
+	static_assert(Shader::kVaryingCount <= kMaxShaderVaryings, "too many varyings");
+	return { &Entry::Run, Shader::kVaryingCount };
+}
+
+// A pixel shader functor provides:
+//   void operator()(const void* const* constants, const PixelShaderInput&, PixelShaderOutput&) const;
+template <typename Shader>
+SoftwarePixelShader MakeSoftwarePixelShader()
+{
+	struct Entry
+	{
+		static void Run(const void* const* constants, const PixelShaderInput& input, PixelShaderOutput& output)
+		{
+			Shader()(constants, input, output);
+		}
+	};
+	return { &Entry::Run };
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic> // read/write positions
+#include <cstdint> // fixed size integers
+#include <memory> // slots
+
+// Bounded single producer / single consumer ring of preallocated slots
+// The producer fills a slot in place (BeginWrite/EndWrite) and the consumer reads it in place
+// (BeginRead/EndRead), so slots holding vectors keep their memory from one lap to the next.
+// No locks: each side owns one position and only reads the other one, with a cached copy
+// so it only touches the other side's cache line when the cached value says full/empty.
+template<typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(uint32_t capacity = 1) { Reset(capacity); }
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// Not thread safe, only while neither side uses the ring
+	void Reset(uint32_t capacity)
+	{
+		m_capacity = capacity > 0 ? capacity : 1;
+		m_slots.reset(new T[m_capacity]);
+		m_write.store(0, std::memory_order_relaxed);
+		m_read.store(0, std::memory_order_relaxed);
+		m_cachedRead = 0;
+		m_cachedWrite = 0;
+	}
+
+	uint32_t GetCapacity() const { return m_capacity; }
+
+	// Producer: the slot to fill, nullptr when every slot is written and not read yet
+	T* BeginWrite()
+	{
+		uint64_t write = m_write.load(std::memory_order_relaxed);
+		if (write - m_cachedRead >= m_capacity)
+		{
+			m_cachedRead = m_read.load(std::memory_order_acquire);
+			if (write - m_cachedRead >= m_capacity)
+			{
+				return nullptr;
+			}
+		}
+		return &m_slots[write % m_capacity];
+	}
+
+	// Producer: hand the slot of BeginWrite to the consumer
+	void EndWrite()
+	{
+		m_write.store(m_write.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: the oldest written slot, nullptr when there is none
+	T* BeginRead()
+	{
+		uint64_t read = m_read.load(std::memory_order_relaxed);
+		if (read == m_cachedWrite)
+		{
+			m_cachedWrite = m_write.load(std::memory_order_acquire);
+			if (read == m_cachedWrite)
+			{
+				return nullptr;
+			}
+		}
+		return &m_slots[read % m_capacity];
+	}
+
+	// Consumer: give the slot of BeginRead back to the producer
+	void EndRead()
+	{
+		m_read.store(m_read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Slots written and not read yet (a snapshot when the other side is busy)
+	uint32_t GetSize() const
+	{
+		// Read position first, it never passes the write position
+		uint64_t read = m_read.load(std::memory_order_acquire);
+		return static_cast<uint32_t>(m_write.load(std::memory_order_acquire) - read);
+	}
+
+private:
+	// Producer side
+	alignas(64) std::atomic<uint64_t> m_write{ 0 };
+	uint64_t m_cachedRead = 0;
+
+	// Consumer side
+	alignas(64) std::atomic<uint64_t> m_read{ 0 };
+	uint64_t m_cachedWrite = 0;
+
+	alignas(64) std::unique_ptr<T[]> m_slots;
+	uint32_t m_capacity = 0;
+};
@@ -0,0 +1,328 @@
+#include "StateFilteringContext.h"
+#include <cstring> // memcmp
+#include <random>
+
+namespace
+{
+	// The slots get their own bits above the calls, so binding one slot doesn't make the others known
+	const uint32_t kVertexBufferKnownBit = 8;
+	const uint32_t kConstantBufferKnownBit = 16;
+	static_assert(kStateCallCount <= kVertexBufferKnownBit, "Call bits overlap the slot bits");
+	static_assert(kVertexBufferKnownBit + kStateVertexBufferSlots <= kConstantBufferKnownBit, "Vertex buffer bits overlap");
+	static_assert(kConstantBufferKnownBit + kStateConstantBufferSlots <= 32, "Constant buffer bits don't fit");
+
+	uint32_t GetKnownBit(StateCall call, uint32_t slot)
+	{
+		switch (call)
+		{
+		case kVertexBufferCall: return 1u << (kVertexBufferKnownBit + slot);
+		case kConstantBufferCall: return 1u << (kConstantBufferKnownBit + slot);
+		default: return 1u << call;
+		}
+	}
+}
+
+const char* GetStateCallName(StateCall call)
+{
+	switch (call)
+	{
+	case kRenderTargetCall: return "OMSetRenderTargets";
+	case kVertexBufferCall: return "IASetVertexBuffers";
+	case kInputLayoutCall: return "IASetInputLayout";
+	case kTopologyCall: return "IASetPrimitiveTopology";
+	case kVertexShaderCall: return "VSSetShader";
+	case kPixelShaderCall: return "PSSetShader";
+	case kConstantBufferCall: return "VSSetConstantBuffers";
+	default: return "Unknown";
+	}
+}
+
+uint32_t StateFilterStats::GetIssued() const
+{
+	uint32_t total = 0;
+	for (uint32_t count : issued)
+	{
+		total += count;
+	}
+	return total;
+}
+
+uint32_t StateFilterStats::GetFiltered() const
+{
+	uint32_t total = 0;
+	for (uint32_t count : filtered)
+	{
+		total += count;
+	}
+	return total;
+}
+
+StateFilteringContext::StateFilteringContext(StateBackend& backend)
+	: m_backend(backend)
+{
+}
+
+bool StateFilteringContext::Update(StateCall call, uint32_t knownBit, bool changed)
+{
+	// Nothing is known before the first call of a kind, whatever the shadow copy says
+	if (!changed && (m_known & knownBit) != 0)
+	{
+		m_stats.filtered[call]++;
+		return false;
+	}
+	m_known |= knownBit;
+	m_stats.issued[call]++;
+	return true;
+}
+
+void StateFilteringContext::SetRenderTarget(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil)
+{
+	bool changed = renderTarget != m_state.renderTarget || depthStencil != m_state.depthStencil;
+	if (Update(kRenderTargetCall, GetKnownBit(kRenderTargetCall, 0), changed))
+	{
+		m_state.renderTarget = renderTarget;
+		m_state.depthStencil = depthStencil;
+		m_backend.SetRenderTarget(renderTarget, depthStencil);
+	}
+}
+
+void StateFilteringContext::SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset)
+{
+	if (slot >= kStateVertexBufferSlots)
+	{
+		return;
+	}
+	// The offset matters as much as the buffer, the instance ring is bound at a new offset every frame
+	bool changed = buffer != m_state.vertexBuffers[slot] || stride != m_state.vertexStrides[slot] || offset != m_state.vertexOffsets[slot];
+	if (Update(kVertexBufferCall, GetKnownBit(kVertexBufferCall, slot), changed))
+	{
+		m_state.vertexBuffers[slot] = buffer;
+		m_state.vertexStrides[slot] = stride;
+		m_state.vertexOffsets[slot] = offset;
+		m_backend.SetVertexBuffer(slot, buffer, stride, offset);
+	}
+}
+
+void StateFilteringContext::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Update(kInputLayoutCall, GetKnownBit(kInputLayoutCall, 0), layout != m_state.inputLayout))
+	{
+		m_state.inputLayout = layout;
+		m_backend.SetInputLayout(layout);
+	}
+}
+
+void StateFilteringContext::SetPrimitiveTopology(uint32_t topology)
+{
+	if (Update(kTopologyCall, GetKnownBit(kTopologyCall, 0), topology != m_state.topology))
+	{
+		m_state.topology = topology;
+		m_backend.SetPrimitiveTopology(topology);
+	}
+}
+
+void StateFilteringContext::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (Update(kVertexShaderCall, GetKnownBit(kVertexShaderCall, 0), shader != m_state.vertexShader))
+	{
+		m_state.vertexShader = shader;
+		m_backend.SetVertexShader(shader);
+	}
+}
+
+void StateFilteringContext::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (Update(kPixelShaderCall, GetKnownBit(kPixelShaderCall, 0), shader != m_state.pixelShader))
+	{
+		m_state.pixelShader = shader;
+		m_backend.SetPixelShader(shader);
+	}
+}
+
+void StateFilteringContext::SetVertexConstantBuffer(uint32_t slot, ID3D11Buffer* buffer)
+{
+	if (slot >= kStateConstantBufferSlots)
+	{
+		return;
+	}
+	if (Update(kConstantBufferCall, GetKnownBit(kConstantBufferCall, slot), buffer != m_state.constantBuffers[slot]))
+	{
+		m_state.constantBuffers[slot] = buffer;
+		m_backend.SetVertexConstantBuffer(slot, buffer);
+	}
+}
+
+void StateFilteringContext::Invalidate()
+{
+	m_known = 0;
+}
+
+void RecordingStateBackend::SetRenderTarget(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil)
+{
+	m_state.renderTarget = renderTarget;
+	m_state.depthStencil = depthStencil;
+	m_callCount++;
+}
+
+void RecordingStateBackend::SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset)
+{
+	m_state.vertexBuffers[slot] = buffer;
+	m_state.vertexStrides[slot] = stride;
+	m_state.vertexOffsets[slot] = offset;
+	m_callCount++;
+}
+
+void RecordingStateBackend::SetInputLayout(ID3D11InputLayout* layout)
+{
+	m_state.inputLayout = layout;
+	m_callCount++;
+}
+
+void RecordingStateBackend::SetPrimitiveTopology(uint32_t topology)
+{
+	m_state.topology = topology;
+	m_callCount++;
+}
+
+void RecordingStateBackend::SetVertexShader(ID3D11VertexShader* shader)
+{
+	m_state.vertexShader = shader;
+	m_callCount++;
+}
+
+void RecordingStateBackend::SetPixelShader(ID3D11PixelShader* shader)
+{
+	m_state.pixelShader = shader;
+	m_callCount++;
+}
+
+void RecordingStateBackend::SetVertexConstantBuffer(uint32_t slot, ID3D11Buffer* buffer)
+{
+	m_state.constantBuffers[slot] = buffer;
+	m_callCount++;
+}
+
+namespace
+{
+	// Fake objects for the validation, only their addresses are ever used
+	template <typename T>
+	T* MakeHandle(uint32_t index)
+	{
+		static char handles[4];
+		return reinterpret_cast<T*>(&handles[index % 4]);
+	}
+
+	bool operator==(const PipelineState& left, const PipelineState& right)
+	{
+		return memcmp(&left, &right, sizeof(PipelineState)) == 0;
+	}
+}
+
+bool ValidateStateFiltering(uint32_t seed, int iterations)
+{
+	RecordingStateBackend filteredBackend;
+	RecordingStateBackend reference;
+	StateFilteringContext context(filteredBackend);
+
+	// Which call and slot the context has seen since it was last invalidated
+	bool known[kStateCallCount][kStateConstantBufferSlots] = {};
+	uint32_t calls = 0;
+	uint32_t outsideCalls = 0;
+
+	// Few distinct values, so most calls repeat what is bound
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<uint32_t> callRange(0, kStateCallCount + 1);
+	std::uniform_int_distribution<uint32_t> valueRange(0, 2);
+	std::uniform_int_distribution<uint32_t> slotRange(0, kStateConstantBufferSlots - 1);
+
+	for (int i = 0; i < iterations; i++)
+	{
+		uint32_t call = callRange(random);
+		uint32_t value = valueRange(random);
+		uint32_t slot = slotRange(random);
+		uint32_t callsBefore = filteredBackend.GetCallCount();
+		PipelineState stateBefore = filteredBackend.GetState();
+
+		switch (call)
+		{
+		case kRenderTargetCall:
+		{
+			slot = 0;
+			ID3D11DepthStencilView* depthStencil = value == 2 ? nullptr : MakeHandle<ID3D11DepthStencilView>(value);
+			context.SetRenderTarget(MakeHandle<ID3D11RenderTargetView>(value), depthStencil);
+			reference.SetRenderTarget(MakeHandle<ID3D11RenderTargetView>(value), depthStencil);
+			break;
+		}
+		case kVertexBufferCall:
+		{
+			slot %= kStateVertexBufferSlots;
+			uint32_t offset = (slotRange(random) & 1) * 64;
+			context.SetVertexBuffer(slot, MakeHandle<ID3D11Buffer>(value), 32, offset);
+			reference.SetVertexBuffer(slot, MakeHandle<ID3D11Buffer>(value), 32, offset);
+			break;
+		}
+		case kInputLayoutCall:
+			slot = 0;
+			context.SetInputLayout(MakeHandle<ID3D11InputLayout>(value));
+			reference.SetInputLayout(MakeHandle<ID3D11InputLayout>(value));
+			break;
+		case kTopologyCall:
+			slot = 0;
+			context.SetPrimitiveTopology(value);
+			reference.SetPrimitiveTopology(value);
+			break;
+		case kVertexShaderCall:
+			slot = 0;
+			context.SetVertexShader(MakeHandle<ID3D11VertexShader>(value));
+			reference.SetVertexShader(MakeHandle<ID3D11VertexShader>(value));
+			break;
+		case kPixelShaderCall:
+			slot = 0;
+			context.SetPixelShader(MakeHandle<ID3D11PixelShader>(value));
+			reference.SetPixelShader(MakeHandle<ID3D11PixelShader>(value));
+			break;
+		case kConstantBufferCall:
+			// Null unbinds, it has to be filtered like any other value
+			context.SetVertexConstantBuffer(slot, value == 2 ? nullptr : MakeHandle<ID3D11Buffer>(value));
+			reference.SetVertexConstantBuffer(slot, value == 2 ? nullptr : MakeHandle<ID3D11Buffer>(value));
+			break;
+		default:
+			// Something else touched the real state, the context is told so
+			if (value == 0)
+			{
+				// ClearState
+				filteredBackend.ClearState();
+				reference.ClearState();
+				context.Invalidate();
+				memset(known, 0, sizeof(known));
+			}
+			else
+			{
+				// Present unbinding the back buffer
+				filteredBackend.SetRenderTarget(nullptr, nullptr);
+				reference.SetRenderTarget(nullptr, nullptr);
+				outsideCalls++;
+				context.InvalidateRenderTarget();
+				known[kRenderTargetCall][0] = false;
+			}
+			continue;
+		}
+		calls++;
+
+		// Nothing that changes the state may be dropped
+		if (!(filteredBackend.GetState() == reference.GetState()))
+		{
+			return false;
+		}
+		// And nothing that doesn't may go through, unless the context had forgotten that state
+		bool issued = filteredBackend.GetCallCount() != callsBefore;
+		if (issued && known[call][slot] && filteredBackend.GetState() == stateBefore)
+		{
+			return false;
+		}
+		known[call][slot] = true;
+	}
+
+	const StateFilterStats& stats = context.GetStats();
+	return stats.GetIssued() + outsideCalls == filteredBackend.GetCallCount() && stats.GetIssued() + stats.GetFiltered() == calls;
+}
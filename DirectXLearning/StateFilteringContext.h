@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint> // fixed size integers
+
+// Pipeline state binding that skips the calls which wouldn't change anything
+//
+// StateFilteringContext keeps a copy of what is bound and only forwards a call to
+// its backend when the value differs. The backend is the D3D11 context in the
+// engine (D3D11StateBackend.h) or RecordingStateBackend below, which only remembers
+// what it was told, so the filtering runs and can be checked without a GPU.
+//
+// The D3D types are only declared here, the portable code never looks inside them.
+
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+struct ID3D11Buffer;
+struct ID3D11InputLayout;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+
+// Vertex buffer and constant buffer slots the context tracks
+const uint32_t kStateVertexBufferSlots = 2;
+const uint32_t kStateConstantBufferSlots = 4;
+
+// The calls the context filters, for the counters
+enum StateCall : uint32_t
+{
+	kRenderTargetCall, // OMSetRenderTargets
+	kVertexBufferCall, // IASetVertexBuffers
+	kInputLayoutCall, // IASetInputLayout
+	kTopologyCall, // IASetPrimitiveTopology
+	kVertexShaderCall, // VSSetShader
+	kPixelShaderCall, // PSSetShader
+	kConstantBufferCall, // VSSetConstantBuffers
+	kStateCallCount
+};
+
+const char* GetStateCallName(StateCall call);
+
+// Calls that reached the backend and calls that were dropped, since the last ResetStats
+struct StateFilterStats
+{
+	uint32_t issued[kStateCallCount];
+	uint32_t filtered[kStateCallCount];
+
+	uint32_t GetIssued() const;
+	uint32_t GetFiltered() const;
+};
+
+// Receives the calls that change something, one slot at a time
+// topology is a D3D11_PRIMITIVE_TOPOLOGY
+class StateBackend
+{
+public:
+	virtual ~StateBackend() = default;
+
+	virtual void SetRenderTarget(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil) = 0;
+	virtual void SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset) = 0;
+	virtual void SetInputLayout(ID3D11InputLayout* layout) = 0;
+	virtual void SetPrimitiveTopology(uint32_t topology) = 0;
+	virtual void SetVertexShader(ID3D11VertexShader* shader) = 0;
+	virtual void SetPixelShader(ID3D11PixelShader* shader) = 0;
+	virtual void SetVertexConstantBuffer(uint32_t slot, ID3D11Buffer* buffer) = 0;
+};
+
+// Everything the context can bind, the shadow copy of the context and what RecordingStateBackend holds
+struct PipelineState
+{
+	ID3D11RenderTargetView* renderTarget;
+	ID3D11DepthStencilView* depthStencil;
+	ID3D11Buffer* vertexBuffers[kStateVertexBufferSlots];
+	uint32_t vertexStrides[kStateVertexBufferSlots];
+	uint32_t vertexOffsets[kStateVertexBufferSlots];
+	ID3D11InputLayout* inputLayout;
+	uint32_t topology;
+	ID3D11VertexShader* vertexShader;
+	ID3D11PixelShader* pixelShader;
+	ID3D11Buffer* constantBuffers[kStateConstantBufferSlots];
+};
+
+class StateFilteringContext
+{
+public:
+	explicit StateFilteringContext(StateBackend& backend);
+
+	// Same calls as the backend, slots past the tracked ones are ignored
+	void SetRenderTarget(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil);
+	void SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(uint32_t topology);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetVertexConstantBuffer(uint32_t slot, ID3D11Buffer* buffer);
+
+	// Forget what is bound, the next call of every kind goes through
+	// For when something else changed the real state (Present unbinding the back buffer, ClearState...)
+	void Invalidate();
+	void InvalidateRenderTarget() { m_known &= ~(1u << kRenderTargetCall); }
+
+	const StateFilterStats& GetStats() const { return m_stats; }
+	void ResetStats() { m_stats = {}; }
+
+private:
+	// True when the call has to go through, counts it either way
+	bool Update(StateCall call, uint32_t knownBit, bool changed);
+
+	StateBackend& m_backend;
+	PipelineState m_state = {};
+	// Which parts of m_state are known to be bound: the bit of the call, for the slots see GetKnownBit
+	uint32_t m_known = 0;
+	StateFilterStats m_stats = {};
+};
+
+// Backend that only keeps the state it was given, and counts the calls
+class RecordingStateBackend : public StateBackend
+{
+public:
+	void SetRenderTarget(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil) override;
+	void SetVertexBuffer(uint32_t slot, ID3D11Buffer* buffer, uint32_t stride, uint32_t offset) override;
+	void SetInputLayout(ID3D11InputLayout* layout) override;
+	void SetPrimitiveTopology(uint32_t topology) override;
+	void SetVertexShader(ID3D11VertexShader* shader) override;
+	void SetPixelShader(ID3D11PixelShader* shader) override;
+	void SetVertexConstantBuffer(uint32_t slot, ID3D11Buffer* buffer) override;
+
+	// Unbind everything, like ID3D11DeviceContext::ClearState, not counted as a call
+	void ClearState() { m_state = {}; }
+
+	const PipelineState& GetState() const { return m_state; }
+	uint32_t GetCallCount() const { return m_callCount; }
+
+private:
+	PipelineState m_state = {};
+	uint32_t m_callCount = 0;
+};
+
+// Run random calls through a filtering context and straight into a second backend, returns
+// false when the two states ever differ or when a call that got through changed nothing
+bool ValidateStateFiltering(uint32_t seed, int iterations);
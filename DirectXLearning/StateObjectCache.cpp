@@ -0,0 +1,141 @@
+#include "StateObjectCache.h"
+#include "JobSystem.h"
+#include <random>
+
+uint64_t HashStateDesc(const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+namespace
+{
+	// Stands in for a D3D descriptor, no padding like the real ones once zeroed
+	struct TestDesc
+	{
+		uint32_t mode;
+		uint32_t mask;
+		float bias;
+	};
+
+	// What the fake creation function makes, the descriptor it came from
+	struct TestObject
+	{
+		uint32_t id = 0;
+		uint32_t mode = 0;
+	};
+
+	TestDesc MakeTestDesc(uint32_t index)
+	{
+		TestDesc desc = {};
+		desc.mode = index % 7;
+		desc.mask = index / 7;
+		desc.bias = static_cast<float>(index & 1);
+		return desc;
+	}
+}
+
+bool ValidateStateObjectCache(JobSystem* pool, uint32_t seed, int lookups)
+{
+	const uint32_t kDistinct = 200;
+	const uint32_t kTasks = 16;
+
+	std::atomic<uint32_t> creations{ 0 };
+	auto create = [&](const TestDesc& desc, TestObject& object)
+	{
+		object.id = creations.fetch_add(1, std::memory_order_relaxed) + 1;
+		object.mode = desc.mode;
+		return true;
+	};
+
+	StateObjectCache<TestDesc, TestObject> cache;
+	cache.Initialize(kDistinct, create);
+
+	// Every thread asks for random descriptors, the first answer for each one is the only valid one
+	std::unique_ptr<std::atomic<const TestObject*>[]> seen(new std::atomic<const TestObject*>[kDistinct]);
+	for (uint32_t i = 0; i < kDistinct; i++)
+	{
+		seen[i].store(nullptr, std::memory_order_relaxed);
+	}
+	std::atomic<bool> failed{ false };
+	auto task = [&](uint32_t index, uint32_t)
+	{
+		std::mt19937 random(seed + index);
+		std::uniform_int_distribution<uint32_t> descRange(0, kDistinct - 1);
+		for (int i = 0; i < lookups / static_cast<int>(kTasks); i++)
+		{
+			uint32_t descIndex = descRange(random);
+			TestDesc desc = MakeTestDesc(descIndex);
+			const TestObject* object = (i & 1) ? cache.Find(desc) : cache.GetOrCreate(desc);
+			if (!object)
+			{
+				// Only a lookup may miss, the state wasn't created yet
+				if (!(i & 1))
+				{
+					failed = true;
+				}
+				continue;
+			}
+			const TestObject* expected = nullptr;
+			if (object->mode != desc.mode
+				|| (!seen[descIndex].compare_exchange_strong(expected, object) && expected != object))
+			{
+				failed = true;
+			}
+		}
+	};
+	if (pool)
+	{
+		pool->ParallelFor(kTasks, task);
+	}
+	else
+	{
+		for (uint32_t index = 0; index < kTasks; index++)
+		{
+			task(index, 0);
+		}
+	}
+	if (failed || creations != cache.GetSize())
+	{
+		return false;
+	}
+
+	// A full cache refuses new states but still finds the old ones
+	for (uint32_t i = 0; i < kDistinct; i++)
+	{
+		if (!cache.GetOrCreate(MakeTestDesc(i)))
+		{
+			return false;
+		}
+	}
+	if (cache.GetSize() != kDistinct || cache.GetOrCreate(MakeTestDesc(kDistinct)))
+	{
+		return false;
+	}
+
+	// The next run warms up from the list, after that nothing gets created
+	std::vector<uint8_t> list;
+	cache.Serialize(list);
+	StateObjectCache<TestDesc, TestObject> warmed;
+	warmed.Initialize(kDistinct, create);
+	if (warmed.Warm(list.data(), list.size()) != list.size() || warmed.Warm(list.data(), list.size() - 1) != 0)
+	{
+		return false;
+	}
+	uint32_t warmedCreations = creations;
+	for (uint32_t i = 0; i < kDistinct; i++)
+	{
+		const TestObject* object = warmed.GetOrCreate(MakeTestDesc(i));
+		if (!object || object->mode != MakeTestDesc(i).mode)
+		{
+			return false;
+		}
+	}
+	return creations == warmedCreations && warmed.GetSize() == kDistinct;
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <atomic> // lock free lookups
+#include <cstdint> // fixed size integers
+#include <cstring> // memcmp, memcpy
+#include <functional>
+#include <memory> // unique_ptr
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+class JobSystem;
+
+// Immutable state objects (blend, rasterizer, depth-stencil, samplers...) by their full descriptor
+//
+// Asking twice for the same descriptor gives the same object, from anywhere in the engine.
+// The key is the descriptor's bytes, so they have to be fully written, padding included
+// (D3D11StateCache zeroes it). Lookups are lock free: entries are only ever added, and an
+// entry is complete before its slot of the hash table points to it. Creating takes a lock,
+// it's meant for loading, the list of descriptors is saved with Serialize and every state
+// is created up front with Warm on the next run, so a frame only ever finds what it needs.
+
+// 64-bit FNV-1a of the bytes
+uint64_t HashStateDesc(const void* data, size_t size);
+
+template <typename Desc, typename Object>
+class StateObjectCache
+{
+	static_assert(std::is_trivially_copyable<Desc>::value, "the descriptors are compared and saved as bytes");
+
+public:
+	// Fill object from desc, false when it can't be created
+	using CreateFunction = std::function<bool(const Desc& desc, Object& object)>;
+
+	// Room for capacity states, forgets the ones created before
+	// Not thread safe
+	void Initialize(uint32_t capacity, CreateFunction create)
+	{
+		uint32_t tableSize = 16;
+		while (tableSize < capacity * 2)
+		{
+			tableSize *= 2;
+		}
+		m_capacity = capacity;
+		m_tableMask = tableSize - 1;
+		m_slots.reset(new std::atomic<uint32_t>[tableSize]);
+		for (uint32_t i = 0; i < tableSize; i++)
+		{
+			m_slots[i].store(0, std::memory_order_relaxed);
+		}
+		m_entries.reset(new Entry[capacity]);
+		m_count.store(0, std::memory_order_relaxed);
+		m_create = std::move(create);
+	}
+
+	// The state of desc, null when it was never created
+	// Lock free, safe from any thread while others create
+	const Object* Find(const Desc& desc) const
+	{
+		return Find(desc, HashStateDesc(&desc, sizeof(Desc)));
+	}
+
+	// Find, or create the state when it's new, null when creating it failed or the cache is full
+	const Object* GetOrCreate(const Desc& desc)
+	{
+		uint64_t hash = HashStateDesc(&desc, sizeof(Desc));
+		if (const Object* object = Find(desc, hash))
+		{
+			return object;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// Another thread may have created it while this one waited
+		uint32_t slot = 0;
+		for (uint32_t i = static_cast<uint32_t>(hash) & m_tableMask;; i = (i + 1) & m_tableMask)
+		{
+			uint32_t entry = m_slots[i].load(std::memory_order_relaxed);
+			if (entry == 0)
+			{
+				slot = i;
+				break;
+			}
+			if (Matches(m_entries[entry - 1], desc, hash))
+			{
+				return &m_entries[entry - 1].object;
+			}
+		}
+
+		uint32_t count = m_count.load(std::memory_order_relaxed);
+		if (count == m_capacity)
+		{
+			return nullptr;
+		}
+		Entry& entry = m_entries[count];
+		entry.hash = hash;
+		memcpy(&entry.desc, &desc, sizeof(Desc));
+		if (!m_create || !m_create(desc, entry.object))
+		{
+			entry.object = Object();
+			return nullptr;
+		}
+
+		// Publish the entry once it's complete
+		m_count.store(count + 1, std::memory_order_release);
+		m_slots[slot].store(count + 1, std::memory_order_release);
+		return &entry.object;
+	}
+
+	// Append the descriptors of every state, the list Warm reads
+	void Serialize(std::vector<uint8_t>& data) const
+	{
+		uint32_t count = m_count.load(std::memory_order_acquire);
+		uint32_t header[2] = { static_cast<uint32_t>(sizeof(Desc)), count };
+		const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(header);
+		data.insert(data.end(), headerBytes, headerBytes + sizeof(header));
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint8_t* descBytes = reinterpret_cast<const uint8_t*>(&m_entries[i].desc);
+			data.insert(data.end(), descBytes, descBytes + sizeof(Desc));
+		}
+	}
+
+	// Create every state of a list from Serialize, returns the bytes it took
+	// 0 when the list is truncated or made of another kind of descriptor, nothing is created then
+	size_t Warm(const uint8_t* data, size_t size)
+	{
+		uint32_t header[2];
+		if (size < sizeof(header))
+		{
+			return 0;
+		}
+		memcpy(header, data, sizeof(header));
+		size_t listSize = sizeof(header) + static_cast<size_t>(header[1]) * sizeof(Desc);
+		if (header[0] != sizeof(Desc) || size < listSize)
+		{
+			return 0;
+		}
+		for (uint32_t i = 0; i < header[1]; i++)
+		{
+			Desc desc;
+			memcpy(&desc, data + sizeof(header) + static_cast<size_t>(i) * sizeof(Desc), sizeof(Desc));
+			GetOrCreate(desc);
+		}
+		return listSize;
+	}
+
+	// States created so far
+	uint32_t GetSize() const { return m_count.load(std::memory_order_acquire); }
+	uint32_t GetCapacity() const { return m_capacity; }
+
+private:
+	struct Entry
+	{
+		uint64_t hash = 0;
+		Desc desc;
+		Object object = Object();
+	};
+
+	static bool Matches(const Entry& entry, const Desc& desc, uint64_t hash)
+	{
+		return entry.hash == hash && memcmp(&entry.desc, &desc, sizeof(Desc)) == 0;
+	}
+
+	const Object* Find(const Desc& desc, uint64_t hash) const
+	{
+		if (!m_slots)
+		{
+			return nullptr;
+		}
+		// Linear probing, the table is never more than half full so there's always an empty slot to stop at
+		for (uint32_t i = static_cast<uint32_t>(hash) & m_tableMask;; i = (i + 1) & m_tableMask)
+		{
+			uint32_t entry = m_slots[i].load(std::memory_order_acquire);
+			if (entry == 0)
+			{
+				return nullptr;
+			}
+			if (Matches(m_entries[entry - 1], desc, hash))
+			{
+				return &m_entries[entry - 1].object;
+			}
+		}
+	}
+
+	uint32_t m_capacity = 0;
+	uint32_t m_tableMask = 0;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_slots; // entry index + 1, 0 is empty
+	std::unique_ptr<Entry[]> m_entries; // in creation order, never moved
+	std::atomic<uint32_t> m_count{ 0 };
+	std::mutex m_mutex; // creation only
+	CreateFunction m_create;
+};
+
+// Look up and create random descriptors from every thread of pool (can be null), then warm a
+// second cache from the list of the first, returns false when a descriptor ever gets two objects,
+// is created twice, or the warmed cache has to create anything
+bool ValidateStateObjectCache(JobSystem* pool, uint32_t seed, int lookups);
@@ -0,0 +1,158 @@
+#include "TransformHierarchy.h"
+#include <algorithm> // fill
+#include <cstring> // memcmp
+#include <random>
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const SimdMath::Matrix& local)
+{
+	uint32_t node = GetNodeCount();
+	// Children are appended after their parent, that's what keeps a single pass enough
+	if (parent != kNoParent && parent >= node)
+	{
+		parent = kNoParent;
+	}
+
+	m_parent.push_back(parent);
+	m_local.push_back(local);
+	m_world.push_back(local);
+	m_dirty.push_back(1);
+	if (node < m_firstDirty)
+	{
+		m_firstDirty = node;
+	}
+	return node;
+}
+
+void TransformHierarchy::Clear()
+{
+	m_parent.clear();
+	m_local.clear();
+	m_world.clear();
+	m_dirty.clear();
+	m_firstDirty = 0;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const SimdMath::Matrix& local)
+{
+	m_local[node] = local;
+	m_dirty[node] = 1;
+	if (node < m_firstDirty)
+	{
+		m_firstDirty = node;
+	}
+}
+
+uint32_t TransformHierarchy::Update()
+{
+	uint32_t nodeCount = GetNodeCount();
+	uint32_t updated = 0;
+
+	for (uint32_t node = m_firstDirty; node < nodeCount; node++)
+	{
+		uint32_t parent = m_parent[node];
+		if (parent != kNoParent && m_dirty[parent])
+		{
+			m_dirty[node] = 1; // the parent moved, so does the whole subtree
+		}
+		if (!m_dirty[node])
+		{
+			continue;
+		}
+
+		// Row vectors: local first, then the parent's world
+		m_world[node] = parent == kNoParent ? m_local[node] : SimdMath::MatrixMultiply(m_local[node], m_world[parent]);
+		updated++;
+	}
+
+	// The flags are read by the children during the pass, so they are cleared afterwards
+	if (m_firstDirty < nodeCount)
+	{
+		std::fill(m_dirty.begin() + m_firstDirty, m_dirty.end(), static_cast<uint8_t>(0));
+	}
+	m_firstDirty = nodeCount;
+	return updated;
+}
+
+bool ValidateTransformHierarchy(uint32_t seed, int iterations)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> angle(-SimdMath::kPi, SimdMath::kPi);
+	std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+	auto randomLocal = [&]()
+	{
+		return SimdMath::MatrixMultiply(SimdMath::MatrixRotationRollPitchYaw(angle(random), angle(random), angle(random)),
+			SimdMath::MatrixTranslation(offset(random), offset(random), offset(random)));
+	};
+
+	TransformHierarchy hierarchy;
+	std::vector<uint8_t> edited;
+	std::vector<SimdMath::Matrix> worlds;
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		// A forest, a root now and then and the other nodes under any node before them
+		hierarchy.Clear();
+		edited.clear();
+		uint32_t nodeCount = 1 + random() % 300;
+		for (uint32_t round = 0; round < 16; round++)
+		{
+			// The first round adds every node, the next ones edit a few and sometimes add some
+			uint32_t added = round == 0 ? nodeCount : (random() % 4 == 0 ? 1 + random() % 3 : 0);
+			edited.assign(hierarchy.GetNodeCount(), 0);
+			uint32_t edits = round == 0 ? 0 : random() % 4;
+			for (uint32_t i = 0; i < edits; i++)
+			{
+				uint32_t node = random() % hierarchy.GetNodeCount();
+				hierarchy.SetLocal(node, randomLocal());
+				edited[node] = 1;
+			}
+			for (uint32_t i = 0; i < added; i++)
+			{
+				uint32_t node = hierarchy.GetNodeCount();
+				uint32_t parent = node == 0 || random() % 8 == 0 ? TransformHierarchy::kNoParent : random() % node;
+				hierarchy.AddNode(parent, randomLocal());
+				edited.push_back(1);
+			}
+
+			// Recomputed: a node with an edited node on its way to the root, itself included
+			uint32_t expectedUpdated = 0;
+			for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node++)
+			{
+				for (uint32_t ancestor = node; ancestor != TransformHierarchy::kNoParent; ancestor = hierarchy.GetParent(ancestor))
+				{
+					if (edited[ancestor])
+					{
+						expectedUpdated++;
+						break;
+					}
+				}
+			}
+			if (hierarchy.Update() != expectedUpdated)
+			{
+				return false;
+			}
+
+			// Every world, updated or kept, is what a full top-down pass gives
+			worlds.resize(hierarchy.GetNodeCount());
+			for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node++)
+			{
+				uint32_t parent = hierarchy.GetParent(node);
+				worlds[node] = parent == TransformHierarchy::kNoParent ? hierarchy.GetLocal(node) : SimdMath::MatrixMultiply(hierarchy.GetLocal(node), worlds[parent]);
+				SimdMath::Float4x4 expected;
+				SimdMath::Float4x4 cached;
+				SimdMath::StoreFloat4x4(&expected, worlds[node]);
+				SimdMath::StoreFloat4x4(&cached, hierarchy.GetWorld(node));
+				if (memcmp(&expected, &cached, sizeof(expected)) != 0)
+				{
+					return false;
+				}
+			}
+		}
+
+		// Nothing changed since, nothing to recompute
+		if (hierarchy.Update() != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
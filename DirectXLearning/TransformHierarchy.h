@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint> // fixed size integers
+#include <vector>
+#include "SimdMath.h"
+
+// Parent/child transforms of the scene
+//
+// Nodes live in flat arrays (parent index, local matrix, world matrix, dirty flag)
+// and are only ever appended under a node that already exists, so a parent always
+// comes before its children: the arrays are always sorted parents first and one
+// forward pass is a top-down traversal, no recursion and no pointer chasing.
+//
+// SetLocal only marks the node dirty. Update walks the arrays from the first dirty
+// node, the flag is inherited by the children, and only the dirty subtrees get their
+// local-to-world matrix recomputed. Everything before the first dirty node is skipped.
+class TransformHierarchy
+{
+public:
+	static constexpr uint32_t kNoParent = ~0u;
+
+	// Add a node under parent (kNoParent for a root), returns its index
+	uint32_t AddNode(uint32_t parent, const SimdMath::Matrix& local);
+
+	// Remove every node
+	void Clear();
+
+	// Change the local matrix (relative to the parent), the world matrix is updated by the next Update
+	void SetLocal(uint32_t node, const SimdMath::Matrix& local);
+	const SimdMath::Matrix& GetLocal(uint32_t node) const { return m_local[node]; }
+
+	// Local-to-world matrix as of the last Update
+	const SimdMath::Matrix& GetWorld(uint32_t node) const { return m_world[node]; }
+
+	uint32_t GetParent(uint32_t node) const { return m_parent[node]; }
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_parent.size()); }
+
+	// Recompute the world matrices of the dirty nodes and their descendants
+	// Returns how many matrices were recomputed (0 when nothing changed)
+	uint32_t Update();
+
+private:
+	std::vector<uint32_t> m_parent;
+	std::vector<SimdMath::Matrix> m_local;
+	std::vector<SimdMath::Matrix> m_world;
+	std::vector<uint8_t> m_dirty;
+
+	// Lowest dirty index, GetNodeCount() when everything is up to date
+	uint32_t m_firstDirty = 0;
+};
+
+// Random forests edited and grown between updates: Update must recompute exactly the edited nodes
+// and their descendants, and leave every world matrix equal to a recompute of the whole hierarchy
+bool ValidateTransformHierarchy(uint32_t seed, int iterations);
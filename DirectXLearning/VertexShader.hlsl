@@ -1,11 +1,21 @@
-//define our constant buffer
-cbuffer ConstantBuffer : register(b0)
+//constant buffers, split by how often they change (the engine only uploads the bytes that changed)
+cbuffer FrameConstants : register(b0)
+{
+    float Time; // seconds since the engine started
+    float DeltaTime; // seconds since the last frame
+};
+
+cbuffer PassConstants : register(b1)
 {
-    matrix World;
     matrix View;
     matrix Projection;
 };
 
+cbuffer ObjectConstants : register(b2)
+{
+    matrix World;
+};
+
 //vertex shader
 struct VertexInput
 {
@@ -1,11 +1,20 @@
 #include <windows.h>
 #include <windowsx.h> // Add this at the top of Window.cpp
+#include <cstdio> // snprintf for the profile capture message
 #include <string>
 #include "Window.h"
 #include "GraphicsEngine.h"
 
 //Keyboard inputes
 void Window::OnKeyDown(unsigned int key) {
+	// Only the first press, not the repeats while the key is held
+	if (key == VK_F11 && !m_keys[key]) {
+		StartProfileCapture();
+	}
+	if (key == VK_F9 && !m_keys[key]) {
+		bool written = m_frameStats.WriteJson("frame_stats.json");
+		OutputDebugString(written ? L"Frame statistics written to frame_stats.json\n" : L"Failed to write frame_stats.json\n");
+	}
 	m_keys[key] = true;
 }
 
@@ -73,6 +82,10 @@ Window::Window(const std::wstring& title, int width,int height)
 	, m_height(height)
 	, m_handle(nullptr) //we start with no handle
 {
+	// Phases of Render in the frame statistics
+	m_inputPhase = m_frameStats.AddPhase("Input");
+	m_beginFramePhase = m_frameStats.AddPhase("BeginFrame");
+	m_endFramePhase = m_frameStats.AddPhase("EndFrame");
 }
 
 Window::~Window()
@@ -144,11 +157,14 @@ bool Window::Initialize() {
 	UpdateWindow(m_handle);
 
 	// Create the graphics engine
+	SetProfilerThreadName("Main");
 	m_graphicsEngine = std::make_unique<GraphicsEngine>();
 	if (!m_graphicsEngine->Initialize(m_handle, m_width, m_height))
 	{
 		return false;
 	}
+	// This thread pumps the messages and simulates, the render thread submits one frame behind
+	m_graphicsEngine->SetRenderThread(2);
 
 	// Set up mouse tracking
 	TRACKMOUSEEVENT tme;
@@ -214,21 +230,94 @@ bool Window::Initialize() {
 
 	void Window::Render()
 	{
-		Window* window = (Window*)GetWindowLongPtr(m_handle, GWLP_USERDATA);
-		// Calculate delta time
-		static float lastTime = 0.0f;
-		float currentTime = static_cast<float>(GetTickCount64()) / 1000.0f;
-		float deltaTime = (lastTime == 0.0f) ? 0.016f : currentTime - lastTime;
-		lastTime = currentTime;
-
-		// Process input
-		m_graphicsEngine->ProcessKeyboardInput(*this, deltaTime);
-		m_graphicsEngine->ProcessMouseInput(*this, deltaTime);
-
-		// begin rendering
-		m_graphicsEngine->BeginFrame(*this);
-		// render the scene
-		m_graphicsEngine->EndFrame();
+		{
+			PROFILE_SCOPE("Window::Render");
+			Window* window = (Window*)GetWindowLongPtr(m_handle, GWLP_USERDATA);
+			// Calculate delta time, the last frame goes into the statistics with its phases
+			double frameSeconds = m_frameTimer.Tick();
+			bool firstFrame = m_frameTimer.GetTicks() == 1;
+			if (!firstFrame) {
+				m_frameStats.EndFrame(frameSeconds);
+				LogFrameStats();
+			}
+			float deltaTime = firstFrame ? 0.016f : static_cast<float>(frameSeconds);
+
+			// Process input
+			double phaseStart = m_frameTimer.GetTime();
+			m_graphicsEngine->ProcessKeyboardInput(*this, deltaTime);
+			m_graphicsEngine->ProcessMouseInput(*this, deltaTime);
+			double phaseEnd = m_frameTimer.GetTime();
+			m_frameStats.SetPhaseTime(m_inputPhase, phaseEnd - phaseStart);
+
+			// begin rendering
+			phaseStart = phaseEnd;
+			m_graphicsEngine->BeginFrame(*this);
+			phaseEnd = m_frameTimer.GetTime();
+			m_frameStats.SetPhaseTime(m_beginFramePhase, phaseEnd - phaseStart);
+
+			// render the scene
+			phaseStart = phaseEnd;
+			m_graphicsEngine->EndFrame();
+			m_frameStats.SetPhaseTime(m_endFramePhase, m_frameTimer.GetTime() - phaseStart);
+		}
+
+		// After the frame's markers, so they are in this frame's collection
+		UpdateProfileCapture();
+	}
+
+	void Window::LogFrameStats()
+	{
+		// One line per window of frames
+		if (m_frameStats.GetFrameCount() % m_frameStats.GetWindowSize() != 0) {
+			return;
+		}
+		FrameTimeSummary summary = m_frameStats.GetFrameSummary(true);
+		char message[256];
+		snprintf(message, sizeof(message), "Frame time over %llu frames: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms, %llu hitches\n",
+			static_cast<unsigned long long>(summary.frames), summary.mean, summary.p50, summary.p99, summary.max,
+			static_cast<unsigned long long>(m_frameStats.GetHitchCount(true)));
+		OutputDebugStringA(message);
+	}
+
+	void Window::StartProfileCapture()
+	{
+		if (m_profileFramesLeft > 0) {
+			return;
+		}
+
+		// Drop what the markers still running at the end of the last capture recorded
+		m_profileCapture.Collect();
+		m_profileCapture.Clear();
+		SetProfilerEnabled(true);
+		m_profileFramesLeft = kProfileCaptureFrames;
+		OutputDebugString(L"Profile capture started\n");
+	}
+
+	void Window::UpdateProfileCapture()
+	{
+		if (m_profileFramesLeft == 0) {
+			return;
+		}
+
+		// The rings are drained every frame so they never fill up
+		bool done = --m_profileFramesLeft == 0;
+		if (done) {
+			SetProfilerEnabled(false);
+			// The render thread finishes the frames of the capture
+			m_graphicsEngine->Flush();
+		}
+		m_profileCapture.Collect();
+		if (!done) {
+			return;
+		}
+
+		bool written = m_profileCapture.WriteChromeTrace("profile.json") && m_profileCapture.WriteBinary("profile.bin");
+		char message[256];
+		snprintf(message, sizeof(message), "Profile capture %s: %zu events on %zu threads, %llu dropped\n",
+			written ? "written to profile.json and profile.bin" : "failed to write", m_profileCapture.GetEvents().size(),
+			m_profileCapture.GetThreads().size(), static_cast<unsigned long long>(m_profileCapture.GetDroppedEventCount()));
+		OutputDebugStringA(message);
+		m_profileCapture.Clear();
 	}
 
 	LRESULT Window::HandleMessage(UINT message, WPARAM wParam, LPARAM lParam) {
@@ -295,6 +384,8 @@ bool Window::Initialize() {
 
 		case WM_CLOSE:
 			OutputDebugString(L"Window Closing\n");
+			// Nothing presents to the window once it's gone
+			if (m_graphicsEngine) m_graphicsEngine->SetRenderThread(0);
 			DestroyWindow(m_handle);
 			return 0;
 
@@ -2,7 +2,9 @@
 #include <windows.h>
 #include <string>
 #include <memory>
+#include "FrameStats.h"
 #include "GraphicsEngine.h"
+#include "Profiler.h"
 
 class Window {
 public:
@@ -39,6 +41,12 @@ public:
 	void SetWidth(int width) { m_width = width; }
 	int GetHeight() const { return m_height; }
 	void SetHeight(int height) { m_height = height; }
+
+	// Frame time statistics, F9 writes them to frame_stats.json
+	const FrameStats& GetFrameStats() const { return m_frameStats; }
+
+	// Frames recorded by a profile capture, F11 starts one
+	static constexpr int kProfileCaptureFrames = 300;
 private:
     // keyboard state
     bool m_keys[256] = {false};
@@ -54,6 +62,21 @@ private:
     bool m_mouseInWindow = false;
 
 	std::unique_ptr<GraphicsEngine> m_graphicsEngine;
+
+	// Frame time and the phases of Render, a line in the debug output every window of frames
+	void LogFrameStats();
+	FrameTimer m_frameTimer;
+	FrameStats m_frameStats;
+	uint32_t m_inputPhase;
+	uint32_t m_beginFramePhase;
+	uint32_t m_endFramePhase;
+
+	// Profile capture, written to profile.json (chrome://tracing, ui.perfetto.dev) and profile.bin when done
+	void StartProfileCapture();
+	void UpdateProfileCapture();
+	ProfileCapture m_profileCapture;
+	int m_profileFramesLeft = 0;
+
     // Message handlers
     static LRESULT CALLBACK WindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
     LRESULT HandleMessage(UINT msg, WPARAM wParam, LPARAM lParam);
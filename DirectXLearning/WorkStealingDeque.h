@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic> // top/bottom indices and the slots
+#include <cstdint> // fixed size integers
+#include <memory> // slot array
+
+// Chase-Lev work-stealing deque of pointers with a fixed capacity (a power of two)
+// The owner thread pushes and pops at the bottom (LIFO, the hot end), any other
+// thread steals from the top (FIFO, the oldest and usually biggest work).
+// Push returns false when the deque is full, the caller runs the work itself then.
+// Every access to top/bottom is seq_cst instead of the relaxed + fence version of
+// the paper: same cost on x86 (the fence is the xchg) and the thread sanitizer
+// understands it.
+template<typename T>
+class WorkStealingDeque
+{
+public:
+	explicit WorkStealingDeque(uint32_t capacity)
+		: m_slots(new std::atomic<T*>[capacity])
+		, m_mask(static_cast<int64_t>(capacity) - 1)
+	{
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	// Owner thread only
+	bool Push(T* item)
+	{
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		int64_t top = m_top.load(std::memory_order_acquire);
+		if (bottom - top > m_mask)
+		{
+			return false;
+		}
+		m_slots[bottom & m_mask].store(item, std::memory_order_relaxed);
+		m_bottom.store(bottom + 1, std::memory_order_seq_cst);
+		return true;
+	}
+
+	// Owner thread only, nullptr when empty
+	T* Pop()
+	{
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_seq_cst);
+		int64_t top = m_top.load(std::memory_order_seq_cst);
+		if (top > bottom)
+		{
+			// Empty, undo the reservation
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		T* item = m_slots[bottom & m_mask].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			// Last item, race the thieves for it
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				item = nullptr;
+			}
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	// Any thread, nullptr when empty or when another thread won the race
+	T* Steal()
+	{
+		int64_t top = m_top.load(std::memory_order_seq_cst);
+		int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		// The slot can only be overwritten after top moved past it, then the CAS fails
+		T* item = m_slots[top & m_mask].load(std::memory_order_relaxed);
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+		return item;
+	}
+
+	// Approximate when other threads are working on it
+	bool IsEmpty() const
+	{
+		return m_top.load(std::memory_order_relaxed) >= m_bottom.load(std::memory_order_relaxed);
+	}
+
+private:
+	// Thieves and the owner hit different ends, keep the indices on different cache lines
+	alignas(64) std::atomic<int64_t> m_top{ 0 };
+	alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+	std::unique_ptr<std::atomic<T*>[]> m_slots;
+	int64_t m_mask;
+};
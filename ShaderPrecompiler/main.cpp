@@ -0,0 +1,121 @@
+#include <cstdio> // fprintf
+#include <cstdlib> // atoi
+#include <cstring> // strcmp
+#include <string>
+#include "ShaderPermutationList.h"
+#include "ShaderPermutations.h"
+#include "JobSystem.h"
+#ifdef _WIN32
+#include "D3DShaderCompiler.h"
+#endif
+
+// ShaderPrecompiler --out Shaders.pak [--cache ShaderPrecompilerCache.bin] [--threads N] [--stub]
+// ShaderPrecompiler --validate <scratch directory>
+//
+// Offline tool that compiles every permutation of the engine's shaders (ShaderPermutationList.cpp)
+// on every core into the archive GraphicsEngine loads, run it from DirectXLearning/ whenever a
+// shader changes. Only the permutations whose sources changed since the last run are compiled
+// again, the cache file keeps the others.
+//
+// --stub compiles with the stub compiler, the only one outside Windows, its archive is only good
+// for checking the tool. Without Visual Studio:
+// g++ -std=c++17 -O2 -pthread -I../DirectXLearning main.cpp ../DirectXLearning/{ShaderPermutations,ShaderPermutationList,ShaderCache,MappedFile,JobSystem,Profiler}.cpp -o ShaderPrecompiler
+
+namespace
+{
+	int Validate(const std::string& directory)
+	{
+		JobSystem pool;
+		for (uint32_t seed = 0; seed < 8; seed++)
+		{
+			if (!ValidateShaderCache(directory, seed) || !ValidateShaderPermutations(&pool, directory, seed)
+				|| !ValidateShaderPermutations(nullptr, directory, seed))
+			{
+				std::fprintf(stderr, "validation failed (seed %u)\n", seed);
+				return 1;
+			}
+		}
+		std::printf("shader cache and permutations: ok\n");
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string archivePath;
+	std::string cachePath = "ShaderPrecompilerCache.bin";
+	std::string validateDirectory;
+	unsigned threadCount = 0;
+	bool stub = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--stub") == 0)
+		{
+			stub = true;
+		}
+		else if (i + 1 < argc && std::strcmp(argv[i], "--out") == 0)
+		{
+			archivePath = argv[++i];
+		}
+		else if (i + 1 < argc && std::strcmp(argv[i], "--cache") == 0)
+		{
+			cachePath = argv[++i];
+		}
+		else if (i + 1 < argc && std::strcmp(argv[i], "--threads") == 0)
+		{
+			threadCount = static_cast<unsigned>(std::atoi(argv[++i]));
+		}
+		else if (i + 1 < argc && std::strcmp(argv[i], "--validate") == 0)
+		{
+			validateDirectory = argv[++i];
+		}
+		else
+		{
+			archivePath.clear();
+			validateDirectory.clear();
+			break;
+		}
+	}
+	if (!validateDirectory.empty())
+	{
+		return Validate(validateDirectory);
+	}
+	if (archivePath.empty())
+	{
+		std::fprintf(stderr, "usage: ShaderPrecompiler --out Shaders.pak [--cache ShaderPrecompilerCache.bin] [--threads N] [--stub]\n"
+			"       ShaderPrecompiler --validate <scratch directory>\n");
+		return 1;
+	}
+
+	StubShaderCompiler stubCompiler;
+	ShaderCompiler* compiler = &stubCompiler;
+#ifdef _WIN32
+	D3DShaderCompiler d3dCompiler;
+	if (!stub)
+	{
+		compiler = &d3dCompiler;
+	}
+#else
+	if (!stub)
+	{
+		std::fprintf(stderr, "D3DCompile is Windows only, use --stub\n");
+		return 1;
+	}
+#endif
+
+	JobSystem pool(threadCount);
+	ShaderCache cache;
+	cache.Open(cachePath);
+	PrecompileStats stats;
+	std::string errors;
+	bool succeeded = PrecompileShaders(GetEngineShaderSets(), *compiler, &pool, &cache, archivePath, stats, errors);
+	std::printf("%u permutations: %u compiled, %u from the cache, %u failed (%u threads)\n",
+		stats.permutations, stats.compiled, stats.cached, stats.failed, pool.GetThreadCount());
+	if (!succeeded)
+	{
+		std::fprintf(stderr, "%s", errors.c_str());
+		return 1;
+	}
+	return 0;
+}
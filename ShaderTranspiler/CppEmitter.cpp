@@ -0,0 +1,1097 @@
+#include "CppEmitter.h"
+#include <algorithm> // min, sort
+#include <cctype> // isdigit
+#include <cstdio> // snprintf
+#include <cstdlib> // atoi
+
+namespace
+{
+	// Semantics like TEXCOORD1 are a name and an index
+	void SplitSemantic(const std::string& semantic, std::string& name, int& index)
+	{
+		size_t end = semantic.size();
+		while (end > 0 && std::isdigit(static_cast<unsigned char>(semantic[end - 1])))
+		{
+			end--;
+		}
+		name = semantic.substr(0, end);
+		index = end < semantic.size() ? std::atoi(semantic.c_str() + end) : 0;
+	}
+
+	// Shortest text that reads back as the same float
+	std::string FormatFloat(float value)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+		std::string text = buffer;
+		if (text.find_first_of(".e") == std::string::npos)
+		{
+			text += ".0";
+		}
+		return text + "f";
+	}
+
+	std::string TypeName(const HlslType& type)
+	{
+		switch (type.base)
+		{
+		case HlslBaseType::Void:
+			return "void";
+		case HlslBaseType::Matrix:
+			return "matrix";
+		case HlslBaseType::Struct:
+			return type.structName;
+		default:
+			return type.components == 1 ? "float" : "float" + std::to_string(type.components);
+		}
+	}
+
+	HlslType FloatType(int components)
+	{
+		HlslType type;
+		type.base = HlslBaseType::Float;
+		type.components = components;
+		return type;
+	}
+
+	HlslType MatrixType()
+	{
+		HlslType type;
+		type.base = HlslBaseType::Matrix;
+		type.components = 16;
+		return type;
+	}
+
+	// Where the renderer stores the vertex attributes of a semantic
+	// The INSTANCE semantics come from the per-instance stream (SoftwareInstance) of instanced draws
+	struct VertexAttribute
+	{
+		const char* semantic;
+		int semanticIndex;
+		const char* member;
+		int firstComponent; // attributes can be a slice of a member, like the rows of the instance matrix
+		int components;
+		const char* offset; // byte offset in SoftwareVertex/SoftwareInstance
+	};
+
+	const VertexAttribute kVertexAttributes[] =
+	{
+		{ "POSITION", 0, "position", 0, 3, "offsetof(SoftwareVertex, position)" },
+		{ "COLOR", 0, "color", 0, 4, "offsetof(SoftwareVertex, color)" },
+		{ "TEXCOORD", 0, "texCoord", 0, 2, "offsetof(SoftwareVertex, texCoord)" },
+		{ "INSTANCEWORLD", 0, "instanceWorld", 0, 4, "offsetof(SoftwareInstance, world)" },
+		{ "INSTANCEWORLD", 1, "instanceWorld", 4, 4, "offsetof(SoftwareInstance, world) + 16" },
+		{ "INSTANCEWORLD", 2, "instanceWorld", 8, 4, "offsetof(SoftwareInstance, world) + 32" },
+		{ "INSTANCEWORLD", 3, "instanceWorld", 12, 4, "offsetof(SoftwareInstance, world) + 48" },
+		{ "INSTANCECOLOR", 0, "instanceColor", 0, 4, "offsetof(SoftwareInstance, color)" },
+	};
+
+	// Members the input assembler fills in when the vertex has fewer components than the shader reads
+	const char* const kDefaultComponents[] = { "0.0f", "0.0f", "0.0f", "1.0f" };
+}
+
+bool CppEmitter::Emit(const HlslProgram& vertexProgram, const std::string& vertexFile,
+	const HlslProgram& pixelProgram, const std::string& pixelFile,
+	const std::string& entryPoint, const std::string& prefix, std::string& output)
+{
+	*this = CppEmitter();
+	m_prefix = prefix;
+
+	const HlslFunction* vertexFunction = vertexProgram.FindFunction(entryPoint);
+	const HlslFunction* pixelFunction = pixelProgram.FindFunction(entryPoint);
+	if (!vertexFunction || !pixelFunction)
+	{
+		m_error = (vertexFunction ? pixelFile : vertexFile) + ": no entry point named " + entryPoint;
+		return false;
+	}
+
+	std::string constants;
+	std::string vertexKernel;
+	std::string pixelKernel;
+	m_file = vertexFile;
+	if (!EmitConstants(vertexProgram, pixelProgram, constants))
+	{
+		return false;
+	}
+	// The vertex shader goes first, it decides the varying slots the pixel shader reads
+	if (!EmitKernel(ShaderStage::Vertex, vertexProgram, *vertexFunction, vertexKernel))
+	{
+		return false;
+	}
+	m_file = pixelFile;
+	if (!EmitKernel(ShaderStage::Pixel, pixelProgram, *pixelFunction, pixelKernel))
+	{
+		return false;
+	}
+
+	output += "#pragma once\n";
+	output += "#include <algorithm> // min/max\n";
+	output += "#include <cmath> // sqrt\n";
+	output += "#include <cstddef> // offsetof\n";
+	output += "#include \"SoftwareShaders.h\"\n\n";
+	output += constants;
+	output += "// Input/output layouts\n";
+	EmitElements("kGenerated" + m_prefix + "VertexInputs", m_vertexInputs, output);
+	EmitElements("kGenerated" + m_prefix + "VertexOutputs", m_vertexOutputs, output);
+	EmitElements("kGenerated" + m_prefix + "PixelInputs", m_pixelInputs, output);
+	EmitElements("kGenerated" + m_prefix + "PixelOutputs", m_pixelOutputs, output);
+	output += "\n// " + vertexFile + "\n" + vertexKernel;
+	output += "\n// " + pixelFile + "\n" + pixelKernel;
+	return true;
+}
+
+bool CppEmitter::EmitConstants(const HlslProgram& vertexProgram, const HlslProgram& pixelProgram, std::string& output)
+{
+	// Both stages read the blocks the renderer binds to the slots, a slot has to mean the same block in both
+	for (const HlslProgram* program : { &vertexProgram, &pixelProgram })
+	{
+		for (const HlslCBuffer& cbuffer : program->cbuffers)
+		{
+			int line = cbuffer.fields.empty() ? 0 : cbuffer.fields[0].line;
+			int slot = cbuffer.registerIndex;
+			if (slot < 0)
+			{
+				// Without a register the slot depends on what the HLSL compiler does, only a lone cbuffer is unambiguous
+				if (program->cbuffers.size() > 1)
+				{
+					return Fail(line, "cbuffer " + cbuffer.name + " needs a register(bN) when there are several cbuffers");
+				}
+				slot = 0;
+			}
+
+			const ConstantBuffer* existing = nullptr;
+			for (const ConstantBuffer& candidate : m_constantBuffers)
+			{
+				if (candidate.slot == slot || candidate.name == cbuffer.name)
+				{
+					existing = &candidate;
+				}
+			}
+			if (existing)
+			{
+				bool same = existing->slot == slot && existing->name == cbuffer.name && existing->fields.size() == cbuffer.fields.size();
+				for (size_t i = 0; same && i < cbuffer.fields.size(); i++)
+				{
+					same = cbuffer.fields[i].name == existing->fields[i].name
+						&& cbuffer.fields[i].type.base == existing->fields[i].type.base
+						&& cbuffer.fields[i].type.components == existing->fields[i].type.components;
+				}
+				if (!same)
+				{
+					return Fail(line, "cbuffer " + cbuffer.name + " does not match " + existing->name + " (b" + std::to_string(existing->slot)
+						+ "), the CPU renderer binds the same constant buffers for both stages");
+				}
+				continue;
+			}
+
+			// The members are globals in HLSL, two cbuffers can't declare the same name
+			for (const HlslField& field : cbuffer.fields)
+			{
+				for (const ConstantBuffer& other : m_constantBuffers)
+				{
+					for (const HlslField& otherField : other.fields)
+					{
+						if (field.name == otherField.name)
+						{
+							return Fail(field.line, field.name + " is already defined in cbuffer " + other.name);
+						}
+					}
+				}
+			}
+
+			ConstantBuffer constantBuffer;
+			constantBuffer.name = cbuffer.name;
+			constantBuffer.typeName = "Generated" + m_prefix + cbuffer.name;
+			constantBuffer.slot = slot;
+			constantBuffer.fields = cbuffer.fields;
+			m_constantBuffers.push_back(constantBuffer);
+		}
+	}
+
+	std::sort(m_constantBuffers.begin(), m_constantBuffers.end(),
+		[](const ConstantBuffer& a, const ConstantBuffer& b) { return a.slot < b.slot; });
+
+	for (const ConstantBuffer& cbuffer : m_constantBuffers)
+	{
+		output += "// cbuffer " + cbuffer.name + " : register(b" + std::to_string(cbuffer.slot) + ")\n";
+		output += "// HLSL packing: vectors don't cross 16 byte boundaries, matrices start on one\n";
+		output += "struct " + cbuffer.typeName + "\n{\n";
+
+		int offset = 0;
+		int paddingCount = 0;
+		auto pad = [&](int to)
+		{
+			if (to > offset)
+			{
+				output += "\tfloat padding" + std::to_string(paddingCount++) + "[" + std::to_string((to - offset) / 4) + "];\n";
+				offset = to;
+			}
+		};
+
+		for (const HlslField& field : cbuffer.fields)
+		{
+			int size = field.type.components * 4;
+			if (field.type.base == HlslBaseType::Matrix || (offset % 16) + size > 16)
+			{
+				pad((offset + 15) / 16 * 16);
+			}
+
+			output += "\tfloat " + field.name;
+			if (field.type.components > 1)
+			{
+				output += "[" + std::to_string(field.type.components) + "]";
+			}
+			output += "; // " + TypeName(field.type) + ", offset " + std::to_string(offset) + "\n";
+			offset += size;
+		}
+		pad((offset + 15) / 16 * 16);
+
+		output += "};\n";
+		output += "static_assert(sizeof(" + cbuffer.typeName + ") == " + std::to_string(offset) + ", \"cbuffer packing\");\n";
+		output += "const int k" + cbuffer.typeName + "Slot = " + std::to_string(cbuffer.slot) + ";\n";
+		output += "static_assert(k" + cbuffer.typeName + "Slot < kMaxConstantBuffers, \"the CPU renderer has fewer constant buffer slots\");\n\n";
+	}
+	return true;
+}
+
+void CppEmitter::EmitElements(const std::string& name, const std::vector<Element>& elements, std::string& output) const
+{
+	output += "const SoftwareShaderElement " + name + "[] =\n{\n";
+	for (const Element& element : elements)
+	{
+		output += "\t{ \"" + element.semantic + "\", " + std::to_string(element.semanticIndex) + ", "
+			+ std::to_string(element.components) + ", " + element.offset + " },\n";
+	}
+	output += "\t{ nullptr, 0, 0, 0 },\n";
+	output += "};\n";
+}
+
+bool CppEmitter::EmitKernel(ShaderStage stage, const HlslProgram& program, const HlslFunction& function, std::string& output)
+{
+	m_stage = stage;
+	m_program = &program;
+	m_variableNames.clear();
+	m_variables.clear();
+	m_lines.clear();
+	m_temporaryCount = 0;
+
+	// The constant buffer members are globals, read through a reference named after the register (b0, b1...)
+	for (const ConstantBuffer& cbuffer : m_constantBuffers)
+	{
+		std::string reference = "b" + std::to_string(cbuffer.slot) + ".";
+		for (const HlslField& field : cbuffer.fields)
+		{
+			Value value;
+			value.type = field.type;
+			for (int c = 0; c < field.type.components; c++)
+			{
+				value.components.push_back(field.type.components == 1 ? reference + field.name : reference + field.name + "[" + std::to_string(c) + "]");
+			}
+			m_variableNames.push_back(field.name);
+			m_variables.push_back(value);
+		}
+	}
+
+	for (const HlslField& parameter : function.parameters)
+	{
+		Value value;
+		if (!BindInput(parameter, value))
+		{
+			return false;
+		}
+		m_variableNames.push_back(parameter.name);
+		m_variables.push_back(value);
+	}
+
+	if (!BindOutput(function.returnType, function.returnSemantic, 0, m_returnTarget))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < function.body.size(); i++)
+	{
+		const HlslStatement& statement = function.body[i];
+		if (statement.kind == HlslStatement::Kind::Return && i + 1 != function.body.size())
+		{
+			return Fail(statement.line, "return has to be the last statement");
+		}
+		if (statement.kind != HlslStatement::Kind::Return && i + 1 == function.body.size())
+		{
+			return Fail(statement.line, function.name + " has to end with a return");
+		}
+		if (!EmitStatement(statement))
+		{
+			return false;
+		}
+	}
+	if (function.body.empty())
+	{
+		return Fail(0, function.name + " has to end with a return");
+	}
+
+	std::string body;
+	for (const std::string& line : m_lines)
+	{
+		body += line.empty() ? "\n" : "\t\t\t" + line + "\n";
+	}
+
+	// Only the blocks the body reads get a reference
+	std::string references;
+	for (const ConstantBuffer& cbuffer : m_constantBuffers)
+	{
+		std::string reference = "b" + std::to_string(cbuffer.slot);
+		if (body.find(reference + ".") != std::string::npos)
+		{
+			references += "\t\tconst " + cbuffer.typeName + "& " + reference + " = *static_cast<const " + cbuffer.typeName
+				+ "*>(constants[" + std::to_string(cbuffer.slot) + "]);\n";
+		}
+	}
+
+	// Leave unused parameters unnamed so the kernels compile without warnings
+	bool vertex = stage == ShaderStage::Vertex;
+	std::string constantsName = !references.empty() ? " constants" : "";
+	std::string inputName = body.find("input.") != std::string::npos ? " input" : "";
+
+	output += "struct " + m_prefix + (vertex ? "VertexShaderKernel" : "PixelShaderKernel") + "\n{\n";
+	if (vertex)
+	{
+		output += "\tstatic const int kVaryingCount = " + std::to_string(m_varyingCount) + ";\n\n";
+	}
+	output += "\tvoid operator()(const void* const*" + constantsName + ", const " + (vertex ? "VertexShaderInput&" : "PixelShaderInput&") + inputName
+		+ ", " + (vertex ? "VertexShaderOutput&" : "PixelShaderOutput&") + " output) const\n";
+	output += "\t{\n";
+	output += references;
+	output += std::string("\t\tfor (int lane = 0; lane < ") + (vertex ? "kVertexShaderLanes" : "kPixelShaderLanes") + "; lane++)\n";
+	output += "\t\t{\n";
+	output += body;
+	output += "\t\t}\n";
+	output += "\t}\n";
+	output += "};\n";
+	return true;
+}
+
+bool CppEmitter::BindInput(const HlslField& parameter, Value& value)
+{
+	if (parameter.type.base != HlslBaseType::Struct)
+	{
+		return BindInputSemantic(parameter.semantic, parameter.type, parameter.line, value);
+	}
+
+	const HlslStruct* structure = m_program->FindStruct(parameter.type.structName);
+	value.type = parameter.type;
+	for (const HlslField& field : structure->fields)
+	{
+		Value fieldValue;
+		if (!BindInputSemantic(field.semantic, field.type, field.line, fieldValue))
+		{
+			return false;
+		}
+		value.fieldNames.push_back(field.name);
+		value.fields.push_back(fieldValue);
+	}
+	return true;
+}
+
+bool CppEmitter::BindInputSemantic(const std::string& semantic, const HlslType& type, int line, Value& value)
+{
+	if (semantic.empty())
+	{
+		return Fail(line, "entry point inputs need a semantic");
+	}
+	if (type.base != HlslBaseType::Float)
+	{
+		return Fail(line, "inputs have to be float or floatN");
+	}
+
+	Element element;
+	SplitSemantic(semantic, element.semantic, element.semanticIndex);
+	element.components = type.components;
+	value.type = type;
+
+	if (m_stage == ShaderStage::Vertex)
+	{
+		// Straight from the vertex buffer
+		const VertexAttribute* attribute = nullptr;
+		for (const VertexAttribute& candidate : kVertexAttributes)
+		{
+			if (element.semantic == candidate.semantic && element.semanticIndex == candidate.semanticIndex)
+			{
+				attribute = &candidate;
+			}
+		}
+		if (!attribute)
+		{
+			return Fail(line, "the CPU renderer's vertices have no " + semantic);
+		}
+
+		for (int c = 0; c < type.components; c++)
+		{
+			value.components.push_back(c < attribute->components
+				? std::string("input.") + attribute->member + "[" + std::to_string(attribute->firstComponent + c) + "][lane]"
+				: kDefaultComponents[c]);
+		}
+		element.offset = attribute->offset;
+		m_vertexInputs.push_back(element);
+		return true;
+	}
+
+	// Pixel shader: the rasterizer's position or an interpolated vertex output
+	if (element.semantic == "SV_POSITION")
+	{
+		if (type.components > 4)
+		{
+			return Fail(line, "SV_POSITION has 4 components");
+		}
+		for (int c = 0; c < type.components; c++)
+		{
+			value.components.push_back("input.position[" + std::to_string(c) + "][lane]");
+		}
+		element.offset = "-1";
+		m_pixelInputs.push_back(element);
+		return true;
+	}
+
+	for (const Element& output : m_vertexOutputs)
+	{
+		if (output.semantic == element.semantic && output.semanticIndex == element.semanticIndex)
+		{
+			if (type.components > output.components)
+			{
+				return Fail(line, semantic + " only has " + std::to_string(output.components) + " components in the vertex shader");
+			}
+			int slot = std::atoi(output.offset.c_str());
+			for (int c = 0; c < type.components; c++)
+			{
+				value.components.push_back("input.varyings[" + std::to_string(slot + c) + "][lane]");
+			}
+			element.offset = output.offset;
+			m_pixelInputs.push_back(element);
+			return true;
+		}
+	}
+	return Fail(line, "the vertex shader doesn't output " + semantic);
+}
+
+bool CppEmitter::BindOutput(const HlslType& type, const std::string& semantic, int line, Value& value)
+{
+	if (type.base != HlslBaseType::Struct)
+	{
+		return BindOutputSemantic(semantic, type, line, value);
+	}
+
+	const HlslStruct* structure = m_program->FindStruct(type.structName);
+	value = Value();
+	value.type = type;
+	value.writable = true;
+	for (const HlslField& field : structure->fields)
+	{
+		Value fieldValue;
+		if (!BindOutputSemantic(field.semantic, field.type, field.line, fieldValue))
+		{
+			return false;
+		}
+		value.fieldNames.push_back(field.name);
+		value.fields.push_back(fieldValue);
+	}
+	return true;
+}
+
+bool CppEmitter::BindOutputSemantic(const std::string& semantic, const HlslType& type, int line, Value& value)
+{
+	if (semantic.empty())
+	{
+		return Fail(line, "entry point outputs need a semantic");
+	}
+	if (type.base != HlslBaseType::Float)
+	{
+		return Fail(line, "outputs have to be float or floatN");
+	}
+
+	Element element;
+	SplitSemantic(semantic, element.semantic, element.semanticIndex);
+	element.components = type.components;
+	value = Value();
+	value.type = type;
+	value.writable = true;
+
+	if (m_stage == ShaderStage::Vertex)
+	{
+		if (element.semantic == "SV_POSITION")
+		{
+			if (type.components != 4)
+			{
+				return Fail(line, "SV_POSITION has to be a float4");
+			}
+			for (int c = 0; c < 4; c++)
+			{
+				value.components.push_back("output.position[" + std::to_string(c) + "][lane]");
+			}
+			element.offset = "-1";
+		}
+		else
+		{
+			// Everything else is interpolated, packed into the next free varyings
+			for (int c = 0; c < type.components; c++)
+			{
+				value.components.push_back("output.varyings[" + std::to_string(m_varyingCount + c) + "][lane]");
+			}
+			element.offset = std::to_string(m_varyingCount);
+			m_varyingCount += type.components;
+		}
+		m_vertexOutputs.push_back(element);
+		return true;
+	}
+
+	if (element.semantic != "SV_TARGET" || element.semanticIndex != 0)
+	{
+		return Fail(line, "the CPU renderer has one render target, pixel shaders output SV_TARGET");
+	}
+	for (int c = 0; c < type.components; c++)
+	{
+		value.components.push_back("output.color[" + std::to_string(c) + "][lane]");
+	}
+	element.offset = "0";
+	m_pixelOutputs.push_back(element);
+	return true;
+}
+
+bool CppEmitter::EmitStatement(const HlslStatement& statement)
+{
+	if (!m_lines.empty())
+	{
+		m_lines.push_back("");
+	}
+	m_lines.push_back("// " + m_file + "(" + std::to_string(statement.line) + ")");
+
+	Value value;
+	switch (statement.kind)
+	{
+	case HlslStatement::Kind::Declare:
+	{
+		Value variable;
+		if (!Declare(statement.name, statement.type, statement.line, variable))
+		{
+			return false;
+		}
+		if (statement.value)
+		{
+			if (!Evaluate(*statement.value, value) || !Store(variable, value, statement.line))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	case HlslStatement::Kind::Assign:
+	{
+		Value target;
+		if (!Evaluate(*statement.target, target) || !Evaluate(*statement.value, value))
+		{
+			return false;
+		}
+		if (!target.writable)
+		{
+			return Fail(statement.line, "can only assign to locals");
+		}
+		return Store(target, value, statement.line);
+	}
+
+	default:
+		if (!statement.value)
+		{
+			return Fail(statement.line, "return needs a value");
+		}
+		return Evaluate(*statement.value, value) && Store(m_returnTarget, value, statement.line);
+	}
+}
+
+bool CppEmitter::Declare(const std::string& name, const HlslType& type, int line, Value& value)
+{
+	for (const std::string& existing : m_variableNames)
+	{
+		if (existing == name)
+		{
+			return Fail(line, name + " is already defined");
+		}
+	}
+
+	value.type = type;
+	value.writable = true;
+	if (type.base == HlslBaseType::Struct)
+	{
+		// Structs are split into one array per member
+		const HlslStruct* structure = m_program->FindStruct(type.structName);
+		for (const HlslField& field : structure->fields)
+		{
+			Value fieldValue;
+			std::string fieldName = "l_" + name + "_" + field.name;
+			m_lines.push_back("float " + fieldName + "[" + std::to_string(field.type.components) + "] = {};");
+			fieldValue.type = field.type;
+			fieldValue.writable = true;
+			for (int c = 0; c < field.type.components; c++)
+			{
+				fieldValue.components.push_back(fieldName + "[" + std::to_string(c) + "]");
+			}
+			value.fieldNames.push_back(field.name);
+			value.fields.push_back(fieldValue);
+		}
+	}
+	else if (type.base == HlslBaseType::Void)
+	{
+		return Fail(line, "void variables");
+	}
+	else
+	{
+		m_lines.push_back("float l_" + name + "[" + std::to_string(type.components) + "] = {};");
+		for (int c = 0; c < type.components; c++)
+		{
+			value.components.push_back("l_" + name + "[" + std::to_string(c) + "]");
+		}
+	}
+
+	m_variableNames.push_back(name);
+	m_variables.push_back(value);
+	return true;
+}
+
+bool CppEmitter::Store(const Value& target, const Value& value, int line)
+{
+	if (target.type.base == HlslBaseType::Struct || value.type.base == HlslBaseType::Struct)
+	{
+		if (target.type.structName != value.type.structName)
+		{
+			return Fail(line, "can't convert " + TypeName(value.type) + " to " + TypeName(target.type));
+		}
+		for (size_t i = 0; i < target.fields.size(); i++)
+		{
+			if (!Store(target.fields[i], value.fields[i], line))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	if ((target.type.base == HlslBaseType::Matrix) != (value.type.base == HlslBaseType::Matrix))
+	{
+		return Fail(line, "can't convert " + TypeName(value.type) + " to " + TypeName(target.type));
+	}
+
+	// Scalars are broadcast, longer vectors are truncated like HLSL does
+	size_t count = target.components.size();
+	if (value.components.size() != 1 && value.components.size() < count)
+	{
+		return Fail(line, "can't convert " + TypeName(value.type) + " to " + TypeName(target.type));
+	}
+
+	// When the value reads the variable it writes to (pos = pos.yxzw), compute everything before storing
+	bool aliased = false;
+	for (const std::string& component : target.components)
+	{
+		std::string array = component.substr(0, component.find('['));
+		for (const std::string& source : value.components)
+		{
+			aliased = aliased || source.find(array + "[") != std::string::npos;
+		}
+	}
+
+	std::vector<std::string> sources;
+	for (size_t c = 0; c < count; c++)
+	{
+		const std::string& source = value.components[value.components.size() == 1 ? 0 : c];
+		sources.push_back(aliased && source != target.components[c] ? Temporary(source) : source);
+	}
+	for (size_t c = 0; c < count; c++)
+	{
+		if (sources[c] != target.components[c])
+		{
+			m_lines.push_back(target.components[c] + " = " + sources[c] + ";");
+		}
+	}
+	return true;
+}
+
+bool CppEmitter::Evaluate(const HlslExpression& expression, Value& value)
+{
+	switch (expression.kind)
+	{
+	case HlslExpression::Kind::Literal:
+		value = Value();
+		value.type = FloatType(1);
+		value.components.push_back(FormatFloat(expression.value));
+		return true;
+
+	case HlslExpression::Kind::Identifier:
+		for (size_t i = m_variableNames.size(); i-- > 0;)
+		{
+			if (m_variableNames[i] == expression.text)
+			{
+				value = m_variables[i];
+				return true;
+			}
+		}
+		return Fail(expression.line, "unknown identifier " + expression.text);
+
+	case HlslExpression::Kind::Member:
+	{
+		Value object;
+		if (!Evaluate(*expression.arguments[0], object))
+		{
+			return false;
+		}
+		if (object.type.base == HlslBaseType::Struct)
+		{
+			for (size_t i = 0; i < object.fieldNames.size(); i++)
+			{
+				if (object.fieldNames[i] == expression.text)
+				{
+					value = object.fields[i];
+					return true;
+				}
+			}
+			return Fail(expression.line, object.type.structName + " has no member " + expression.text);
+		}
+		return Swizzle(object, expression.text, expression.line, value);
+	}
+
+	case HlslExpression::Kind::Call:
+		return EvaluateCall(expression, value);
+
+	case HlslExpression::Kind::Negate:
+		if (!Evaluate(*expression.arguments[0], value))
+		{
+			return false;
+		}
+		if (value.type.base == HlslBaseType::Struct)
+		{
+			return Fail(expression.line, "can't negate a struct");
+		}
+		for (std::string& component : value.components)
+		{
+			component = "(-" + component + ")";
+		}
+		value.writable = false;
+		return true;
+
+	default:
+	{
+		Value left;
+		Value right;
+		if (!Evaluate(*expression.arguments[0], left) || !Evaluate(*expression.arguments[1], right) || !Broadcast(left, right, expression.line))
+		{
+			return false;
+		}
+		// Component-wise, also for matrices (* is not a matrix product in HLSL)
+		value = Value();
+		value.type = left.type;
+		for (size_t c = 0; c < left.components.size(); c++)
+		{
+			value.components.push_back("(" + left.components[c] + " " + expression.text + " " + right.components[c] + ")");
+		}
+		return true;
+	}
+	}
+}
+
+bool CppEmitter::EvaluateCall(const HlslExpression& expression, Value& value)
+{
+	const std::string& name = expression.text;
+	int line = expression.line;
+
+	std::vector<Value> arguments(expression.arguments.size());
+	for (size_t i = 0; i < arguments.size(); i++)
+	{
+		if (!Evaluate(*expression.arguments[i], arguments[i]))
+		{
+			return false;
+		}
+		if (arguments[i].type.base == HlslBaseType::Struct)
+		{
+			return Fail(line, "can't pass a struct to " + name);
+		}
+	}
+	auto expectArguments = [&](size_t count)
+	{
+		return arguments.size() == count || Fail(line, name + " takes " + std::to_string(count) + " arguments");
+	};
+	auto isVector = [](const Value& argument)
+	{
+		return argument.type.base == HlslBaseType::Float;
+	};
+
+	value = Value();
+
+	// Constructors: float4(position, 1.0f), float3(0.5f)
+	if (name == "float" || name == "float2" || name == "float3" || name == "float4")
+	{
+		int components = name == "float" ? 1 : name[5] - '0';
+		value.type = FloatType(components);
+		if (arguments.size() == 1 && arguments[0].components.size() == 1)
+		{
+			value.components.assign(components, arguments[0].components[0]);
+			return true;
+		}
+		for (const Value& argument : arguments)
+		{
+			if (!isVector(argument))
+			{
+				return Fail(line, "can't build " + name + " from a matrix");
+			}
+			value.components.insert(value.components.end(), argument.components.begin(), argument.components.end());
+		}
+		if (static_cast<int>(value.components.size()) != components)
+		{
+			return Fail(line, name + " needs " + std::to_string(components) + " components, got " + std::to_string(value.components.size()));
+		}
+		return true;
+	}
+
+	if (name == "mul")
+	{
+		if (!expectArguments(2))
+		{
+			return false;
+		}
+		const Value& a = arguments[0];
+		const Value& b = arguments[1];
+
+		// A scalar times anything is component-wise
+		if (a.components.size() == 1 || b.components.size() == 1)
+		{
+			value.type = a.components.size() == 1 ? b.type : a.type;
+			for (int c = 0; c < value.type.components; c++)
+			{
+				value.components.push_back(Temporary(a.components[a.components.size() == 1 ? 0 : c] + " * " + b.components[b.components.size() == 1 ? 0 : c]));
+			}
+			return true;
+		}
+
+		// Matrices are column-major in memory, element (row, column) is at column * 4 + row
+		auto element = [](const Value& matrix, int row, int column) { return matrix.components[column * 4 + row]; };
+		bool aMatrix = a.type.base == HlslBaseType::Matrix;
+		bool bMatrix = b.type.base == HlslBaseType::Matrix;
+		if ((!aMatrix && a.components.size() != 4) || (!bMatrix && b.components.size() != 4))
+		{
+			return Fail(line, "mul works on float4 and matrix");
+		}
+
+		if (aMatrix && bMatrix)
+		{
+			value.type = MatrixType();
+			value.components.resize(16);
+			for (int column = 0; column < 4; column++)
+			{
+				for (int row = 0; row < 4; row++)
+				{
+					std::string sum;
+					for (int k = 0; k < 4; k++)
+					{
+						sum += (k ? " + " : "") + element(a, row, k) + " * " + element(b, k, column);
+					}
+					value.components[column * 4 + row] = Temporary(sum);
+				}
+			}
+			return true;
+		}
+
+		// mul(v, M) is a row vector, mul(M, v) a column vector
+		value.type = FloatType(4);
+		for (int i = 0; i < 4; i++)
+		{
+			std::string sum;
+			for (int k = 0; k < 4; k++)
+			{
+				sum += (k ? " + " : "") + (aMatrix ? element(a, i, k) + " * " + b.components[k] : a.components[k] + " * " + element(b, k, i));
+			}
+			value.components.push_back(Temporary(sum));
+		}
+		return true;
+	}
+
+	if (name == "dot" || name == "length" || name == "normalize")
+	{
+		if (!expectArguments(name == "dot" ? 2 : 1))
+		{
+			return false;
+		}
+		const Value& a = arguments[0];
+		const Value& b = arguments[name == "dot" ? 1 : 0];
+		if (!isVector(a) || !isVector(b) || a.components.size() != b.components.size())
+		{
+			return Fail(line, name + " needs vectors of the same size");
+		}
+
+		std::string sum;
+		for (size_t c = 0; c < a.components.size(); c++)
+		{
+			sum += (c ? " + " : "") + a.components[c] + " * " + b.components[c];
+		}
+
+		if (name == "dot")
+		{
+			value.type = FloatType(1);
+			value.components.push_back(Temporary(sum));
+		}
+		else if (name == "length")
+		{
+			value.type = FloatType(1);
+			value.components.push_back(Temporary("std::sqrt(" + sum + ")"));
+		}
+		else
+		{
+			std::string scale = Temporary("1.0f / std::sqrt(" + sum + ")");
+			value.type = a.type;
+			for (const std::string& component : a.components)
+			{
+				value.components.push_back(Temporary(component + " * " + scale));
+			}
+		}
+		return true;
+	}
+
+	if (name == "lerp")
+	{
+		if (!expectArguments(3) || !Broadcast(arguments[0], arguments[1], line) || !Broadcast(arguments[0], arguments[2], line) || !Broadcast(arguments[1], arguments[2], line))
+		{
+			return false;
+		}
+		value.type = arguments[0].type;
+		for (size_t c = 0; c < arguments[0].components.size(); c++)
+		{
+			const std::string& a = arguments[0].components[c];
+			value.components.push_back(Temporary(a + " + (" + arguments[1].components[c] + " - " + a + ") * " + arguments[2].components[c]));
+		}
+		return true;
+	}
+
+	if (name == "min" || name == "max")
+	{
+		if (!expectArguments(2) || !Broadcast(arguments[0], arguments[1], line))
+		{
+			return false;
+		}
+		value.type = arguments[0].type;
+		for (size_t c = 0; c < arguments[0].components.size(); c++)
+		{
+			value.components.push_back("std::" + name + "(" + arguments[0].components[c] + ", " + arguments[1].components[c] + ")");
+		}
+		return true;
+	}
+
+	// One argument, component-wise
+	const char* format = nullptr;
+	if (name == "saturate")
+	{
+		format = "std::min(std::max(%s, 0.0f), 1.0f)";
+	}
+	else if (name == "abs")
+	{
+		format = "std::fabs(%s)";
+	}
+	else if (name == "sqrt")
+	{
+		format = "std::sqrt(%s)";
+	}
+	else if (name == "rsqrt")
+	{
+		format = "(1.0f / std::sqrt(%s))";
+	}
+	if (format)
+	{
+		if (!expectArguments(1))
+		{
+			return false;
+		}
+		std::string text = format;
+		size_t at = text.find("%s");
+		value.type = arguments[0].type;
+		for (const std::string& component : arguments[0].components)
+		{
+			value.components.push_back(text.substr(0, at) + component + text.substr(at + 2));
+		}
+		return true;
+	}
+
+	return Fail(line, "unsupported function " + name);
+}
+
+bool CppEmitter::Swizzle(const Value& value, const std::string& swizzle, int line, Value& result)
+{
+	if (value.type.base != HlslBaseType::Float)
+	{
+		return Fail(line, "can only swizzle vectors");
+	}
+	if (swizzle.size() > 4)
+	{
+		return Fail(line, "swizzle ." + swizzle + " is too long");
+	}
+
+	result = Value();
+	result.type = FloatType(static_cast<int>(swizzle.size()));
+	result.writable = value.writable;
+	for (size_t i = 0; i < swizzle.size(); i++)
+	{
+		size_t index = std::string("xyzw").find(swizzle[i]);
+		if (index == std::string::npos)
+		{
+			index = std::string("rgba").find(swizzle[i]);
+		}
+		if (index == std::string::npos || index >= value.components.size())
+		{
+			return Fail(line, "invalid swizzle ." + swizzle + " on " + TypeName(value.type));
+		}
+		// pos.xx can be read, not written
+		if (swizzle.find(swizzle[i]) != i)
+		{
+			result.writable = false;
+		}
+		result.components.push_back(value.components[index]);
+	}
+	return true;
+}
+
+bool CppEmitter::Broadcast(Value& left, Value& right, int line)
+{
+	if ((left.type.base == HlslBaseType::Matrix) != (right.type.base == HlslBaseType::Matrix)
+		&& left.components.size() != 1 && right.components.size() != 1)
+	{
+		return Fail(line, "can't mix " + TypeName(left.type) + " and " + TypeName(right.type));
+	}
+
+	if (left.components.size() == 1 && right.components.size() > 1)
+	{
+		left.type = right.type;
+		left.components.assign(right.components.size(), left.components[0]);
+	}
+	else if (right.components.size() == 1 && left.components.size() > 1)
+	{
+		right.type = left.type;
+		right.components.assign(left.components.size(), right.components[0]);
+	}
+	else if (left.components.size() != right.components.size())
+	{
+		// HLSL truncates the longer vector (with a warning)
+		size_t count = std::min(left.components.size(), right.components.size());
+		left.components.resize(count);
+		right.components.resize(count);
+		left.type = FloatType(static_cast<int>(count));
+		right.type = left.type;
+	}
+	return true;
+}
+
+std::string CppEmitter::Temporary(const std::string& expression)
+{
+	std::string name = "t" + std::to_string(m_temporaryCount++);
+	m_lines.push_back("const float " + name + " = " + expression + ";");
+	return name;
+}
+
+bool CppEmitter::Fail(int line, const std::string& message)
+{
+	if (m_error.empty())
+	{
+		m_error = m_file + (line > 0 ? "(" + std::to_string(line) + ")" : "") + ": " + message;
+	}
+	return false;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "HlslParser.h"
+
+// Turns a vertex/pixel shader pair into the SoA kernels of the CPU renderer (see SoftwareShaders.h)
+//
+// Every statement becomes straight-line float math inside one loop over the lanes of
+// a batch, locals live in registers and matrices are read straight from the constant
+// buffers, so the compiler vectorizes the loop like it does the hand-written kernels.
+// Every cbuffer becomes a struct the kernels read from the slot of its register(bN).
+// The pixel shader inputs are linked to the vertex shader outputs by semantic.
+
+enum class ShaderStage
+{
+	Vertex,
+	Pixel
+};
+
+class CppEmitter
+{
+public:
+	// Emit the constant buffer structs, the layout metadata and both kernels
+	// The file names are only used in error messages and comments
+	// prefix goes in front of every generated name, so several shader pairs can be included together
+	bool Emit(const HlslProgram& vertexProgram, const std::string& vertexFile,
+		const HlslProgram& pixelProgram, const std::string& pixelFile,
+		const std::string& entryPoint, const std::string& prefix, std::string& output);
+	const std::string& GetError() const { return m_error; }
+
+private:
+	// A shader input or output, written to the generated metadata
+	struct Element
+	{
+		std::string semantic; // without the index
+		int semanticIndex = 0;
+		int components = 0;
+		std::string offset; // C++ expression, see SoftwareShaderElement
+	};
+
+	// A value during code generation, one C++ expression per component
+	struct Value
+	{
+		HlslType type;
+		std::vector<std::string> components; // float: 1..4, matrix: 16 in memory order (column-major)
+		std::vector<std::string> fieldNames; // struct only
+		std::vector<Value> fields;
+		bool writable = false;
+	};
+
+	bool EmitConstants(const HlslProgram& vertexProgram, const HlslProgram& pixelProgram, std::string& output);
+	void EmitElements(const std::string& name, const std::vector<Element>& elements, std::string& output) const;
+	bool EmitKernel(ShaderStage stage, const HlslProgram& program, const HlslFunction& function, std::string& output);
+
+	// Inputs and outputs of the entry point, by semantic
+	bool BindInput(const HlslField& parameter, Value& value);
+	bool BindInputSemantic(const std::string& semantic, const HlslType& type, int line, Value& value);
+	bool BindOutput(const HlslType& type, const std::string& semantic, int line, Value& value);
+	bool BindOutputSemantic(const std::string& semantic, const HlslType& type, int line, Value& value);
+
+	bool EmitStatement(const HlslStatement& statement);
+	bool Declare(const std::string& name, const HlslType& type, int line, Value& value);
+	bool Store(const Value& target, const Value& value, int line);
+
+	bool Evaluate(const HlslExpression& expression, Value& value);
+	bool EvaluateCall(const HlslExpression& expression, Value& value);
+	bool Swizzle(const Value& value, const std::string& swizzle, int line, Value& result);
+	bool Broadcast(Value& left, Value& right, int line);
+	std::string Temporary(const std::string& expression);
+
+	bool Fail(int line, const std::string& message);
+
+	// Prefix of the generated names
+	std::string m_prefix;
+
+	// The cbuffers of both stages, by slot
+	struct ConstantBuffer
+	{
+		std::string name;
+		std::string typeName; // of the generated struct
+		int slot = 0; // the N of register(bN)
+		std::vector<HlslField> fields;
+	};
+	std::vector<ConstantBuffer> m_constantBuffers;
+
+	// Layout metadata, the vertex outputs besides SV_POSITION are the varyings the pixel shader reads
+	std::vector<Element> m_vertexInputs;
+	std::vector<Element> m_vertexOutputs;
+	std::vector<Element> m_pixelInputs;
+	std::vector<Element> m_pixelOutputs;
+	int m_varyingCount = 0;
+
+	// State of the kernel being emitted
+	ShaderStage m_stage = ShaderStage::Vertex;
+	std::string m_file;
+	const HlslProgram* m_program = nullptr;
+	std::vector<std::string> m_variableNames;
+	std::vector<Value> m_variables;
+	Value m_returnTarget;
+	std::vector<std::string> m_lines;
+	int m_temporaryCount = 0;
+	std::string m_error;
+};
@@ -0,0 +1,697 @@
+#include "HlslParser.h"
+#include <cctype> // isalpha, isdigit
+#include <cstdlib> // strtof
+
+namespace
+{
+	std::string ToUpper(std::string text)
+	{
+		for (char& c : text)
+		{
+			c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+		}
+		return text;
+	}
+
+	std::unique_ptr<HlslExpression> CloneExpression(const HlslExpression& expression)
+	{
+		std::unique_ptr<HlslExpression> copy = std::make_unique<HlslExpression>();
+		copy->kind = expression.kind;
+		copy->text = expression.text;
+		copy->value = expression.value;
+		copy->line = expression.line;
+		for (const std::unique_ptr<HlslExpression>& argument : expression.arguments)
+		{
+			copy->arguments.push_back(CloneExpression(*argument));
+		}
+		return copy;
+	}
+}
+
+const HlslStruct* HlslProgram::FindStruct(const std::string& name) const
+{
+	for (const HlslStruct& structure : structs)
+	{
+		if (structure.name == name)
+		{
+			return &structure;
+		}
+	}
+	return nullptr;
+}
+
+const HlslFunction* HlslProgram::FindFunction(const std::string& name) const
+{
+	for (const HlslFunction& function : functions)
+	{
+		if (function.name == name)
+		{
+			return &function;
+		}
+	}
+	return nullptr;
+}
+
+bool HlslParser::Parse(const std::string& source, HlslProgram& program)
+{
+	m_error.clear();
+	m_position = 0;
+	if (!Tokenize(source))
+	{
+		return false;
+	}
+
+	while (Peek().kind != Token::Kind::End)
+	{
+		bool parsed = false;
+		if (Peek().text == "cbuffer")
+		{
+			parsed = ParseCBuffer(program);
+		}
+		else if (Peek().text == "struct")
+		{
+			parsed = ParseStruct(program);
+		}
+		else
+		{
+			parsed = ParseFunction(program);
+		}
+
+		if (!parsed)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool HlslParser::Tokenize(const std::string& source)
+{
+	m_tokens.clear();
+	int line = 1;
+	size_t i = 0;
+
+	while (i < source.size())
+	{
+		char c = source[i];
+
+		// Whitespace and comments
+		if (c == '\n')
+		{
+			line++;
+			i++;
+			continue;
+		}
+		if (std::isspace(static_cast<unsigned char>(c)))
+		{
+			i++;
+			continue;
+		}
+		if (source.compare(i, 2, "//") == 0)
+		{
+			while (i < source.size() && source[i] != '\n')
+			{
+				i++;
+			}
+			continue;
+		}
+		if (source.compare(i, 2, "/*") == 0)
+		{
+			size_t end = source.find("*/", i + 2);
+			if (end == std::string::npos)
+			{
+				m_error = "line " + std::to_string(line) + ": unterminated comment";
+				return false;
+			}
+			for (size_t j = i; j < end; j++)
+			{
+				line += source[j] == '\n' ? 1 : 0;
+			}
+			i = end + 2;
+			continue;
+		}
+		// The preprocessor is not part of the subset
+		if (c == '#')
+		{
+			m_error = "line " + std::to_string(line) + ": preprocessor directives are not supported";
+			return false;
+		}
+
+		Token token;
+		token.line = line;
+		size_t start = i;
+
+		if (std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+		{
+			while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_'))
+			{
+				i++;
+			}
+			token.kind = Token::Kind::Identifier;
+		}
+		else if (std::isdigit(static_cast<unsigned char>(c)) || (c == '.' && i + 1 < source.size() && std::isdigit(static_cast<unsigned char>(source[i + 1]))))
+		{
+			// 1, 1.0, .5, 1e-3, with an optional f/h suffix
+			while (i < source.size() && (std::isdigit(static_cast<unsigned char>(source[i])) || source[i] == '.'))
+			{
+				i++;
+			}
+			if (i < source.size() && (source[i] == 'e' || source[i] == 'E'))
+			{
+				i++;
+				if (i < source.size() && (source[i] == '+' || source[i] == '-'))
+				{
+					i++;
+				}
+				while (i < source.size() && std::isdigit(static_cast<unsigned char>(source[i])))
+				{
+					i++;
+				}
+			}
+			if (i < source.size() && (source[i] == 'f' || source[i] == 'F' || source[i] == 'h' || source[i] == 'H'))
+			{
+				i++;
+			}
+			token.kind = Token::Kind::Number;
+		}
+		else
+		{
+			// Two character operators first
+			static const char* const kDoubleSymbols[] = { "+=", "-=", "*=", "/=" };
+			bool matched = false;
+			for (const char* symbol : kDoubleSymbols)
+			{
+				if (source.compare(i, 2, symbol) == 0)
+				{
+					i += 2;
+					matched = true;
+					break;
+				}
+			}
+			if (!matched)
+			{
+				if (std::string("{}()[];:,.=+-*/<>").find(c) == std::string::npos)
+				{
+					m_error = "line " + std::to_string(line) + ": unexpected character '" + std::string(1, c) + "'";
+					return false;
+				}
+				i++;
+			}
+			token.kind = Token::Kind::Symbol;
+		}
+
+		token.text = source.substr(start, i - start);
+		m_tokens.push_back(token);
+	}
+
+	Token end;
+	end.kind = Token::Kind::End;
+	end.line = line;
+	m_tokens.push_back(end);
+	return true;
+}
+
+const HlslParser::Token& HlslParser::Peek(int offset) const
+{
+	size_t index = m_position + offset;
+	return index < m_tokens.size() ? m_tokens[index] : m_tokens.back();
+}
+
+const HlslParser::Token& HlslParser::Next()
+{
+	const Token& token = Peek();
+	if (m_position < m_tokens.size() - 1)
+	{
+		m_position++;
+	}
+	return token;
+}
+
+bool HlslParser::Accept(const char* symbol)
+{
+	if (Peek().kind != Token::Kind::End && Peek().text == symbol)
+	{
+		Next();
+		return true;
+	}
+	return false;
+}
+
+bool HlslParser::Expect(const char* symbol)
+{
+	if (Accept(symbol))
+	{
+		return true;
+	}
+	return Fail(std::string("expected '") + symbol + "' but found '" + Peek().text + "'");
+}
+
+bool HlslParser::Fail(const std::string& message)
+{
+	// Keep the first error, it is the one that makes sense
+	if (m_error.empty())
+	{
+		m_error = "line " + std::to_string(Peek().line) + ": " + message;
+	}
+	return false;
+}
+
+bool HlslParser::IsTypeName(const std::string& name, const HlslProgram& program) const
+{
+	return name == "void" || name == "float" || name == "float2" || name == "float3" || name == "float4"
+		|| name == "matrix" || name == "float4x4" || program.FindStruct(name) != nullptr;
+}
+
+bool HlslParser::ParseType(const HlslProgram& program, HlslType& type)
+{
+	const Token& token = Next();
+	const std::string& name = token.text;
+
+	if (name == "void")
+	{
+		type.base = HlslBaseType::Void;
+		type.components = 0;
+	}
+	else if (name == "float")
+	{
+		type.base = HlslBaseType::Float;
+		type.components = 1;
+	}
+	else if (name == "float2" || name == "float3" || name == "float4")
+	{
+		type.base = HlslBaseType::Float;
+		type.components = name[5] - '0';
+	}
+	else if (name == "matrix" || name == "float4x4")
+	{
+		type.base = HlslBaseType::Matrix;
+		type.components = 16;
+	}
+	else if (program.FindStruct(name))
+	{
+		type.base = HlslBaseType::Struct;
+		type.components = 0;
+		type.structName = name;
+	}
+	else
+	{
+		m_position--;
+		return Fail("unknown type '" + name + "'");
+	}
+	return true;
+}
+
+bool HlslParser::ParseSemantic(std::string& semantic)
+{
+	semantic.clear();
+	if (!Accept(":"))
+	{
+		return true;
+	}
+	if (Peek().kind != Token::Kind::Identifier)
+	{
+		return Fail("expected a semantic");
+	}
+	semantic = ToUpper(Next().text);
+	return true;
+}
+
+bool HlslParser::ParseCBuffer(HlslProgram& program)
+{
+	Next(); // cbuffer
+	HlslCBuffer cbuffer;
+	if (Peek().kind != Token::Kind::Identifier)
+	{
+		return Fail("expected a cbuffer name");
+	}
+	cbuffer.name = Next().text;
+
+	// Optional : register(bN)
+	if (Accept(":"))
+	{
+		if (!Accept("register") || !Expect("("))
+		{
+			return Fail("expected register(bN)");
+		}
+		const std::string& slot = Next().text;
+		if (slot.size() < 2 || (slot[0] != 'b' && slot[0] != 'B'))
+		{
+			return Fail("cbuffers have to use a b register");
+		}
+		cbuffer.registerIndex = std::atoi(slot.c_str() + 1);
+		if (!Expect(")"))
+		{
+			return false;
+		}
+	}
+
+	if (!Expect("{"))
+	{
+		return false;
+	}
+	while (!Accept("}"))
+	{
+		HlslField field;
+		field.line = Peek().line;
+		if (!ParseType(program, field.type))
+		{
+			return false;
+		}
+		if (field.type.base != HlslBaseType::Float && field.type.base != HlslBaseType::Matrix)
+		{
+			return Fail("cbuffer members have to be float, floatN or matrix");
+		}
+		if (Peek().kind != Token::Kind::Identifier)
+		{
+			return Fail("expected a member name");
+		}
+		field.name = Next().text;
+		if (!Expect(";"))
+		{
+			return false;
+		}
+		cbuffer.fields.push_back(field);
+	}
+	Accept(";");
+
+	program.cbuffers.push_back(cbuffer);
+	return true;
+}
+
+bool HlslParser::ParseStruct(HlslProgram& program)
+{
+	Next(); // struct
+	HlslStruct structure;
+	if (Peek().kind != Token::Kind::Identifier)
+	{
+		return Fail("expected a struct name");
+	}
+	structure.name = Next().text;
+
+	if (!Expect("{"))
+	{
+		return false;
+	}
+	while (!Accept("}"))
+	{
+		HlslField field;
+		field.line = Peek().line;
+		if (!ParseType(program, field.type))
+		{
+			return false;
+		}
+		if (field.type.base != HlslBaseType::Float)
+		{
+			return Fail("struct members have to be float or floatN");
+		}
+		if (Peek().kind != Token::Kind::Identifier)
+		{
+			return Fail("expected a member name");
+		}
+		field.name = Next().text;
+		if (!ParseSemantic(field.semantic) || !Expect(";"))
+		{
+			return false;
+		}
+		structure.fields.push_back(field);
+	}
+	if (!Expect(";"))
+	{
+		return false;
+	}
+
+	program.structs.push_back(structure);
+	return true;
+}
+
+bool HlslParser::ParseFunction(HlslProgram& program)
+{
+	HlslFunction function;
+	if (!ParseType(program, function.returnType))
+	{
+		return false;
+	}
+	if (Peek().kind != Token::Kind::Identifier)
+	{
+		return Fail("expected a function name");
+	}
+	function.name = Next().text;
+
+	if (!Expect("("))
+	{
+		return false;
+	}
+	while (!Accept(")"))
+	{
+		if (!function.parameters.empty() && !Expect(","))
+		{
+			return false;
+		}
+		Accept("in");
+
+		HlslField parameter;
+		parameter.line = Peek().line;
+		if (!ParseType(program, parameter.type))
+		{
+			return false;
+		}
+		if (Peek().kind != Token::Kind::Identifier)
+		{
+			return Fail("expected a parameter name");
+		}
+		parameter.name = Next().text;
+		if (!ParseSemantic(parameter.semantic))
+		{
+			return false;
+		}
+		function.parameters.push_back(parameter);
+	}
+
+	if (!ParseSemantic(function.returnSemantic) || !Expect("{"))
+	{
+		return false;
+	}
+	while (!Accept("}"))
+	{
+		if (Peek().kind == Token::Kind::End)
+		{
+			return Fail("missing '}' at the end of " + function.name);
+		}
+		HlslStatement statement;
+		if (!ParseStatement(program, statement))
+		{
+			return false;
+		}
+		function.body.push_back(std::move(statement));
+	}
+
+	program.functions.push_back(std::move(function));
+	return true;
+}
+
+bool HlslParser::ParseStatement(const HlslProgram& program, HlslStatement& statement)
+{
+	statement.line = Peek().line;
+
+	if (Accept("return"))
+	{
+		statement.kind = HlslStatement::Kind::Return;
+		statement.value = ParseExpression();
+		return statement.value && Expect(";");
+	}
+
+	// type name [= value];
+	if (Peek().kind == Token::Kind::Identifier && IsTypeName(Peek().text, program) && Peek(1).kind == Token::Kind::Identifier)
+	{
+		statement.kind = HlslStatement::Kind::Declare;
+		if (!ParseType(program, statement.type))
+		{
+			return false;
+		}
+		statement.name = Next().text;
+		if (Accept("="))
+		{
+			statement.value = ParseExpression();
+			if (!statement.value)
+			{
+				return false;
+			}
+		}
+		return Expect(";");
+	}
+
+	// target = value; (and the compound versions)
+	statement.kind = HlslStatement::Kind::Assign;
+	statement.target = ParsePostfix();
+	if (!statement.target)
+	{
+		return false;
+	}
+
+	std::string op = Next().text;
+	if (op != "=" && op != "+=" && op != "-=" && op != "*=" && op != "/=")
+	{
+		m_position--;
+		return Fail("expected an assignment");
+	}
+	statement.value = ParseExpression();
+	if (!statement.value)
+	{
+		return false;
+	}
+
+	// a += b is a = a + b
+	if (op != "=")
+	{
+		std::unique_ptr<HlslExpression> binary = std::make_unique<HlslExpression>();
+		binary->kind = HlslExpression::Kind::Binary;
+		binary->text = op.substr(0, 1);
+		binary->line = statement.line;
+		binary->arguments.push_back(CloneExpression(*statement.target));
+		binary->arguments.push_back(std::move(statement.value));
+		statement.value = std::move(binary);
+	}
+	return Expect(";");
+}
+
+std::unique_ptr<HlslExpression> HlslParser::ParseExpression()
+{
+	std::unique_ptr<HlslExpression> left = ParseTerm();
+	while (left && (Peek().text == "+" || Peek().text == "-") && Peek().kind == Token::Kind::Symbol)
+	{
+		std::unique_ptr<HlslExpression> binary = std::make_unique<HlslExpression>();
+		binary->kind = HlslExpression::Kind::Binary;
+		binary->line = Peek().line;
+		binary->text = Next().text;
+		binary->arguments.push_back(std::move(left));
+		std::unique_ptr<HlslExpression> right = ParseTerm();
+		if (!right)
+		{
+			return nullptr;
+		}
+		binary->arguments.push_back(std::move(right));
+		left = std::move(binary);
+	}
+	return left;
+}
+
+std::unique_ptr<HlslExpression> HlslParser::ParseTerm()
+{
+	std::unique_ptr<HlslExpression> left = ParseUnary();
+	while (left && (Peek().text == "*" || Peek().text == "/") && Peek().kind == Token::Kind::Symbol)
+	{
+		std::unique_ptr<HlslExpression> binary = std::make_unique<HlslExpression>();
+		binary->kind = HlslExpression::Kind::Binary;
+		binary->line = Peek().line;
+		binary->text = Next().text;
+		binary->arguments.push_back(std::move(left));
+		std::unique_ptr<HlslExpression> right = ParseUnary();
+		if (!right)
+		{
+			return nullptr;
+		}
+		binary->arguments.push_back(std::move(right));
+		left = std::move(binary);
+	}
+	return left;
+}
+
+std::unique_ptr<HlslExpression> HlslParser::ParseUnary()
+{
+	if (Peek().kind == Token::Kind::Symbol && Peek().text == "-")
+	{
+		std::unique_ptr<HlslExpression> negate = std::make_unique<HlslExpression>();
+		negate->kind = HlslExpression::Kind::Negate;
+		negate->line = Next().line;
+		std::unique_ptr<HlslExpression> operand = ParseUnary();
+		if (!operand)
+		{
+			return nullptr;
+		}
+		negate->arguments.push_back(std::move(operand));
+		return negate;
+	}
+	if (Peek().kind == Token::Kind::Symbol && Peek().text == "+")
+	{
+		Next();
+		return ParseUnary();
+	}
+	return ParsePostfix();
+}
+
+std::unique_ptr<HlslExpression> HlslParser::ParsePostfix()
+{
+	std::unique_ptr<HlslExpression> expression = ParsePrimary();
+	while (expression && Peek().kind == Token::Kind::Symbol && Peek().text == ".")
+	{
+		Next();
+		if (Peek().kind != Token::Kind::Identifier)
+		{
+			Fail("expected a member name after '.'");
+			return nullptr;
+		}
+		std::unique_ptr<HlslExpression> member = std::make_unique<HlslExpression>();
+		member->kind = HlslExpression::Kind::Member;
+		member->line = Peek().line;
+		member->text = Next().text;
+		member->arguments.push_back(std::move(expression));
+		expression = std::move(member);
+	}
+	return expression;
+}
+
+std::unique_ptr<HlslExpression> HlslParser::ParsePrimary()
+{
+	const Token& token = Peek();
+	std::unique_ptr<HlslExpression> expression = std::make_unique<HlslExpression>();
+	expression->line = token.line;
+
+	if (token.kind == Token::Kind::Number)
+	{
+		expression->kind = HlslExpression::Kind::Literal;
+		expression->value = std::strtof(Next().text.c_str(), nullptr);
+		return expression;
+	}
+
+	if (token.kind == Token::Kind::Symbol && token.text == "(")
+	{
+		Next();
+		expression = ParseExpression();
+		if (!expression || !Expect(")"))
+		{
+			return nullptr;
+		}
+		return expression;
+	}
+
+	if (token.kind == Token::Kind::Identifier)
+	{
+		expression->text = Next().text;
+
+		// Function call or constructor
+		if (Accept("("))
+		{
+			expression->kind = HlslExpression::Kind::Call;
+			while (!Accept(")"))
+			{
+				if (!expression->arguments.empty() && !Expect(","))
+				{
+					return nullptr;
+				}
+				std::unique_ptr<HlslExpression> argument = ParseExpression();
+				if (!argument)
+				{
+					return nullptr;
+				}
+				expression->arguments.push_back(std::move(argument));
+			}
+			return expression;
+		}
+
+		expression->kind = HlslExpression::Kind::Identifier;
+		return expression;
+	}
+
+	Fail("unexpected '" + token.text + "'");
+	return nullptr;
+}
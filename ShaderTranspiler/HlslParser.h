@@ -0,0 +1,146 @@
+#pragma once
+#include <memory> // unique_ptr
+#include <string>
+#include <vector>
+
+// Parser for the subset of HLSL our shaders use:
+// cbuffers, structs with semantics, one entry point made of declarations,
+// assignments and a return, with float/floatN/matrix math and a few intrinsics
+
+// Types the subset knows about
+enum class HlslBaseType
+{
+	Void,
+	Float, // float, float2, float3, float4 (components = 1..4)
+	Matrix, // matrix / float4x4 (components = 16)
+	Struct
+};
+
+struct HlslType
+{
+	HlslBaseType base = HlslBaseType::Void;
+	int components = 0;
+	std::string structName;
+};
+
+// A struct member, cbuffer member or function parameter
+struct HlslField
+{
+	HlslType type;
+	std::string name;
+	std::string semantic; // empty when there is none, upper case
+	int line = 0;
+};
+
+struct HlslStruct
+{
+	std::string name;
+	std::vector<HlslField> fields;
+};
+
+struct HlslCBuffer
+{
+	std::string name;
+	int registerIndex = -1; // the N of register(bN), -1 when not given
+	std::vector<HlslField> fields;
+};
+
+struct HlslExpression
+{
+	enum class Kind
+	{
+		Literal, // value
+		Identifier, // text = name
+		Member, // arguments[0].text, member or swizzle
+		Call, // text(arguments...), also constructors like float4(...)
+		Binary, // arguments[0] text arguments[1], text is + - * /
+		Negate // -arguments[0]
+	};
+
+	Kind kind = Kind::Literal;
+	std::string text;
+	float value = 0.0f;
+	std::vector<std::unique_ptr<HlslExpression>> arguments;
+	int line = 0;
+};
+
+struct HlslStatement
+{
+	enum class Kind
+	{
+		Declare, // type name [= value]
+		Assign, // target = value
+		Return // return value
+	};
+
+	Kind kind = Kind::Declare;
+	HlslType type; // Declare only
+	std::string name; // Declare only
+	std::unique_ptr<HlslExpression> target; // Assign only
+	std::unique_ptr<HlslExpression> value; // can be null for a Declare without initializer
+	int line = 0;
+};
+
+struct HlslFunction
+{
+	HlslType returnType;
+	std::string returnSemantic;
+	std::string name;
+	std::vector<HlslField> parameters;
+	std::vector<HlslStatement> body;
+};
+
+struct HlslProgram
+{
+	std::vector<HlslCBuffer> cbuffers;
+	std::vector<HlslStruct> structs;
+	std::vector<HlslFunction> functions;
+
+	const HlslStruct* FindStruct(const std::string& name) const;
+	const HlslFunction* FindFunction(const std::string& name) const;
+};
+
+class HlslParser
+{
+public:
+	// Parse a whole file, returns false and fills the error message on failure
+	bool Parse(const std::string& source, HlslProgram& program);
+	const std::string& GetError() const { return m_error; }
+
+private:
+	struct Token
+	{
+		enum class Kind { Identifier, Number, Symbol, End };
+		Kind kind = Kind::End;
+		std::string text;
+		int line = 0;
+	};
+
+	bool Tokenize(const std::string& source);
+
+	// Token helpers
+	const Token& Peek(int offset = 0) const;
+	const Token& Next();
+	bool Accept(const char* symbol);
+	bool Expect(const char* symbol);
+	bool Fail(const std::string& message);
+
+	bool IsTypeName(const std::string& name, const HlslProgram& program) const;
+	bool ParseType(const HlslProgram& program, HlslType& type);
+	bool ParseSemantic(std::string& semantic);
+	bool ParseCBuffer(HlslProgram& program);
+	bool ParseStruct(HlslProgram& program);
+	bool ParseFunction(HlslProgram& program);
+	bool ParseStatement(const HlslProgram& program, HlslStatement& statement);
+
+	// Expressions, lowest to highest precedence
+	std::unique_ptr<HlslExpression> ParseExpression();
+	std::unique_ptr<HlslExpression> ParseTerm();
+	std::unique_ptr<HlslExpression> ParseUnary();
+	std::unique_ptr<HlslExpression> ParsePostfix();
+	std::unique_ptr<HlslExpression> ParsePrimary();
+
+	std::vector<Token> m_tokens;
+	size_t m_position = 0;
+	std::string m_error;
+};
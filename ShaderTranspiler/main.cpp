@@ -0,0 +1,127 @@
+#include <cstdio> // fprintf
+#include <cstring> // strcmp
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "CppEmitter.h"
+#include "HlslParser.h"
+
+// ShaderTranspiler --vs VertexShader.hlsl --ps PixelShader.hlsl --out GeneratedShaders.h [--entry main] [--prefix Name]
+//
+// Offline tool that turns the HLSL shaders of DirectXLearning into the SoA C++ kernels
+// of the CPU renderer, run it again whenever a shader changes and commit the output
+
+namespace
+{
+	bool ReadFile(const std::string& path, std::string& contents)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		contents = stream.str();
+		return true;
+	}
+
+	// Path without the directories, for messages and comments
+	std::string GetFileName(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+
+	bool ParseFile(const std::string& path, HlslProgram& program)
+	{
+		std::string source;
+		if (!ReadFile(path, source))
+		{
+			std::fprintf(stderr, "%s: can't read the file\n", path.c_str());
+			return false;
+		}
+
+		HlslParser parser;
+		if (!parser.Parse(source, program))
+		{
+			std::fprintf(stderr, "%s: %s\n", path.c_str(), parser.GetError().c_str());
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string vertexPath;
+	std::string pixelPath;
+	std::string outputPath;
+	std::string entryPoint = "main";
+	std::string prefix; // for the generated names: <prefix>VertexShaderKernel, Generated<prefix><cbuffer>...
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--vs") == 0)
+		{
+			vertexPath = argv[i + 1];
+		}
+		else if (std::strcmp(argv[i], "--ps") == 0)
+		{
+			pixelPath = argv[i + 1];
+		}
+		else if (std::strcmp(argv[i], "--out") == 0)
+		{
+			outputPath = argv[i + 1];
+		}
+		else if (std::strcmp(argv[i], "--entry") == 0)
+		{
+			entryPoint = argv[i + 1];
+		}
+		else if (std::strcmp(argv[i], "--prefix") == 0)
+		{
+			prefix = argv[i + 1];
+		}
+	}
+	if (vertexPath.empty() || pixelPath.empty() || outputPath.empty() || argc % 2 == 0)
+	{
+		std::fprintf(stderr, "usage: ShaderTranspiler --vs VertexShader.hlsl --ps PixelShader.hlsl --out GeneratedShaders.h [--entry main] [--prefix Name]\n");
+		return 1;
+	}
+
+	HlslProgram vertexProgram;
+	HlslProgram pixelProgram;
+	if (!ParseFile(vertexPath, vertexProgram) || !ParseFile(pixelPath, pixelProgram))
+	{
+		return 1;
+	}
+
+	std::string vertexFile = GetFileName(vertexPath);
+	std::string pixelFile = GetFileName(pixelPath);
+	std::string output = "// Generated by ShaderTranspiler from " + vertexFile + " and " + pixelFile + ", don't edit\n"
+		+ "// ShaderTranspiler --vs " + vertexFile + " --ps " + pixelFile + " --out " + GetFileName(outputPath)
+		+ (entryPoint != "main" ? " --entry " + entryPoint : "")
+		+ (!prefix.empty() ? " --prefix " + prefix : "") + "\n";
+
+	CppEmitter emitter;
+	if (!emitter.Emit(vertexProgram, vertexFile, pixelProgram, pixelFile, entryPoint, prefix, output))
+	{
+		std::fprintf(stderr, "%s\n", emitter.GetError().c_str());
+		return 1;
+	}
+
+	// Leave the file alone when nothing changed, so it doesn't rebuild everything that includes it
+	std::string previous;
+	if (ReadFile(outputPath, previous) && previous == output)
+	{
+		return 0;
+	}
+	std::ofstream file(outputPath, std::ios::binary);
+	file << output;
+	if (!file)
+	{
+		std::fprintf(stderr, "%s: can't write the file\n", outputPath.c_str());
+		return 1;
+	}
+	return 0;
+}